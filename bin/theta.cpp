@@ -5,6 +5,7 @@
 #include "interface/variables.hpp"
 #include "interface/main.hpp"
 #include "interface/redirect_stdio.hpp"
+#include "interface/perf_profile.hpp"
 
 #include "libconfig/libconfig.h++"
 
@@ -187,6 +188,7 @@ int main(int argc, char** argv) {
     desc.add_options()("help,h", "show help message")
     ("quiet,q", "quiet mode (suppress progress message)")
     ("nowarn", "do not warn about unused configuration file statements")
+    ("profile", "count cycles, instructions, cache and branch misses of the likelihood, HistogramFunction and minimizer code and report them at exit")
     ("redirect-io", po::value<bool>(&redirect_io)->default_value(true), "redirect stio/stderr of libraries to /dev/null");
 
     po::options_description hidden("Hidden options");
@@ -225,6 +227,12 @@ int main(int argc, char** argv) {
     vector<string> cfg_filenames = cmdline_vars["cfg-file"].as<vector<string> >();
     bool quiet = cmdline_vars.count("quiet");
     bool nowarn = cmdline_vars.count("nowarn");
+    if(cmdline_vars.count("profile")){
+        string reason;
+        if(!enable_profiling(reason)){
+            theta::cout << "WARNING: profiling disabled, hardware performance counters not available (" << reason << ")" << endl;
+        }
+    }
     
     //determine theta_dir (for config file replacements with $THETA_DIR
     string theta_dir = get_theta_dir(argv);
@@ -263,6 +271,9 @@ int main(int argc, char** argv) {
         theta::cerr << "A fatal error ocurred in Run::run: " << ex.message << endl;
         return 1;
     }
+    if(profiling_enabled){
+        write_profile_report(theta::cout);
+    }
     if(theta::stop_execution){
         theta::cout << "(exiting on SIGINT)" << endl;
     }
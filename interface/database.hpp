@@ -3,8 +3,10 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 #include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
 #include "interface/decls.hpp"
@@ -308,6 +310,20 @@ private:
  * 
  * \c time is the number of seconds since the unix epoch (1970-01-01 UTC),
  *    with sub-second accuracy.
+ *
+ * The messages Run writes for every run and event ("run start", "run end", "start" and "end", all with severity info) are
+ * passed with one of the codes from LogTable::e_code instead of a string. In the default mode, they are written
+ * as rows with the corresponding message. In compact mode (see set_compact), all messages except errors are
+ * only counted, so the table contains only errors. Instead, one row is written per run to a summary table
+ * with the columns
+ * <ol>
+ * <li>runid (typeInt)</li>
+ * <li>n_events (typeInt): the number of events, i.e., of messages with code event_end</li>
+ * <li>n_errors, n_warnings, n_infos, n_debugs (typeInt): the number of messages per severity in the run, counted as for get_n_messages</li>
+ * <li>event_time_total, event_time_min, event_time_max (typeDouble): the sum, minimum and maximum of the event times passed to add_event_time
+ *    in the run, in nanoseconds</li>
+ * <li>event_times (typeHisto): the distribution of the event times, as histogram of log10 of the time in nanoseconds with 100 bins from 2 to 12</li>
+ * </ol>
  **/
 class LogTable: private boost::noncopyable {
 public:
@@ -326,6 +342,14 @@ public:
     enum e_severity {
         error = 0, warning, info, debug
     };
+
+    /** \brief Codes for the messages written by Run for each run and event
+     *
+     * In the default mode, these are written with the messages "run start", "run end", "start" and "end", respectively.
+     */
+    enum e_code {
+        run_start = 0, run_end, event_start, event_end
+    };
     
     /** \brief Construct a new logTable based on the given Table
      *
@@ -354,6 +378,8 @@ public:
      * \c s is the severity level of the log message
      *
      * \c message is the message, in human-readable english
+     *
+     * In compact mode, only errors are written to the table; messages with other severities are only counted for the summary.
      */
     void append(int runid, int eventid, e_severity s, const std::string & message){
         //define inline as hint to the compiler; keep this function as short as possible to
@@ -361,6 +387,29 @@ public:
         // case the user disables logging.
         if(s <= level) really_append(runid, eventid, s, message);
     }
+
+    /** \brief Append the message with code \c code to the log table, if severity is larger than currently configured level
+     *
+     * In compact mode, nothing is written to the table unless \c s is error; for \c code run_end, the summary row is written.
+     * The codes are used for the summary regardless of the configured level.
+     */
+    void append(int runid, int eventid, e_severity s, e_code code){
+        if(s <= level || summary_table.get()) really_append(runid, eventid, s, code);
+    }
+
+    /** \brief Switch to compact mode, writing the per-run summary to \c summary_table
+     *
+     * Ownership of summary_table will be transferred. Has to be called before the first message is appended.
+     */
+    void set_compact(std::auto_ptr<Table> & summary_table);
+
+    /** \brief Add the time \c ns in nanoseconds it took to process an event to the summary of the current run
+     *
+     * Only used in compact mode.
+     */
+    void add_event_time(boost::uint64_t ns){
+        if(summary_table.get()) really_add_event_time(ns);
+    }
     
     /** \brief Returns the number of messages
      *
@@ -373,10 +422,22 @@ private:
 
     /// really append the log message. Called from append() in case severity is large enough
     void really_append(int runid, int eventid, e_severity s, const std::string & message);
+    void really_append(int runid, int eventid, e_severity s, e_code code);
+    void really_add_event_time(boost::uint64_t ns);
+    // write the summary row for runid and reset the counters
+    void write_summary(int runid);
+
     e_severity level;
     int n_messages[4];
     std::auto_ptr<Column> c_runid, c_eventid, c_severity, c_message, c_time;
     std::auto_ptr<Table> table;
+
+    // compact mode: the summary table and the counters of the current run:
+    std::auto_ptr<Table> summary_table;
+    std::auto_ptr<Column> c_s_runid, c_n_events, c_n_messages[4], c_event_time_total, c_event_time_min, c_event_time_max, c_event_times;
+    int run_n_events, run_n_messages[4];
+    boost::uint64_t event_time_total, event_time_min, event_time_max;
+    std::vector<double> event_times;
 };
 
 
@@ -388,7 +449,9 @@ private:
  * The corresponding table has following columns:
  * <ol>
  * <li>runid (typeInt): the run id the entry refers to.</li>
+ * <li>name (typeString): the name of the module using the random number generator.</li>
  * <li>seed (typeInt): the seed of the random number generator used in the run.</li>
+ * <li>key (typeString): the key of a counter-based random number generator, empty otherwise.</li>
  * </ol>
  */
 class RndInfoTable: private boost::noncopyable {
@@ -403,11 +466,12 @@ public:
      *
      * \c runid is the current runid
      * \c name is the name of the module of the seed, according to \link theta::ProductsTableWriter ProductsTableWriter \endlink . <br />
-     * \c seed is the seed of the random number generator used for this module
+     * \c seed is the seed of the random number generator used for this module <br />
+     * \c key identifies the stream of a counter-based random number generator (see RandomConsumer); it is empty for other generators.
      */
-    void append(int runid, const std::string & name, int seed);
+    void append(int runid, const std::string & name, int seed, const std::string & key = "");
 private:
-    std::auto_ptr<Column> c_runid, c_name, c_seed;
+    std::auto_ptr<Column> c_runid, c_name, c_seed, c_key;
     std::auto_ptr<Table> table;
 };
 
@@ -28,6 +28,7 @@ namespace theta{
           class Configuration;
     }
     class Random;
+    class RandomStreams;
     class Run;
     
     //variables.hpp
@@ -80,6 +80,16 @@ namespace theta{
         */
         virtual double evalNL_withDerivatives(const ParValues & values, ParValues & derivatives) const = 0;
 
+        /** \brief Whether evalNL_withDerivatives is implemented
+         *
+         * Models use this to decide whether the likelihood function can provide analytical derivatives.
+         * The default implementation returns true; derived classes which cannot calculate the derivatives
+         * should re-implement it to return false.
+         */
+        virtual bool provides_derivatives() const{
+            return true;
+        }
+
         /** \brief Get the support of a parameter
          *
          * The support is the set of values on which the density is non-vanishing. If the support is not
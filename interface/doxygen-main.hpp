@@ -641,6 +641,12 @@
   * use this if you are sure that the warnings can be savely ignored (in case of a problem, <em>always</em>
   * reproduce it without using this option first).
   *
+  * The \c --profile option counts cycles, instructions, cache misses and branch misses with the hardware performance counters
+  * (via perf_event_open) separately for the likelihood evaluation, the evaluation of the HistogramFunction instances and the
+  * minimizers, and reports them at exit, including the instructions per cycle and the misses per 1000 instructions. This helps
+  * to tell whether these parts are compute-bound or memory-bound. If the counters are not available, e.g. in a virtual machine,
+  * a warning is printed and %theta runs without profiling.
+  *
   * If you send the \c SIGINT signal to %theta (e.g., by hitting ctrl+C on a terminal running %theta),
   * it will exit gracefully as soon as the current toy experiment is processed. This feature is useful for
   * interactive use if the whole run takes too long but you still want to be able to
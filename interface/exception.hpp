@@ -5,6 +5,8 @@
 #include <sstream>
 #include <typeinfo>
 
+#include <boost/exception_ptr.hpp>
+
 
 namespace theta {
 
@@ -118,6 +120,14 @@ public:
    ExitException(const std::string & message_): message(message_){}
 };
 
+/** \brief Capture the exception currently handled, keeping the type of the %theta exceptions
+ *
+ * To be called in a catch block, as boost::current_exception. The latter keeps the type only for exceptions thrown via
+ * boost::throw_exception; this function also keeps the type of all exceptions declared here. The result can be passed to
+ * another thread and thrown there with boost::rethrow_exception.
+ */
+boost::exception_ptr current_exception();
+
 }
 
 #endif
@@ -27,6 +27,15 @@ namespace theta {
          */
         virtual const Histogram & operator()(const ParValues & values) const = 0;
 
+        /** \brief Returns the Histogram, using an array of parameter values with precomputed indices
+         *
+         * Same as operator()(const ParValues&), but the parameter values are given as for Function::eval_dense:
+         * the value of the i-th parameter of getParameters() is \c x[offsets[i]].
+         *
+         * The default implementation copies the values into a ParValues instance and calls operator()(const ParValues&).
+         */
+        virtual const Histogram & eval_dense(const double * x, const size_t * offsets) const;
+
         /** \brief Returns the Histogram for the given parameter values, but randomly fluctuated around its parametrization uncertainty.
          *
          * If a derived class does not provide its own implementation of this method, the
@@ -72,12 +81,37 @@ namespace theta {
          */
         virtual Histogram get_histogram_dimensions() const = 0;
 
+        /** \brief Returns the partial derivative of the Histogram with respect to a parameter
+         *
+         * Bin i of the returned Histogram contains the derivative of bin i of operator()(values) with
+         * respect to \c pid. If the HistogramFunction does not depend on \c pid, a Histogram with
+         * all entries zero is returned.
+         *
+         * As for operator(), the returned reference is only guaranteed to be valid until the next call of
+         * a method of this HistogramFunction.
+         *
+         * Derived classes which implement this method should also re-implement provides_derivatives. The
+         * default implementation throws a FatalException.
+         */
+        virtual const Histogram & gradient(const ParValues & values, const ParId & pid) const;
+
+        /** \brief Returns whether gradient is implemented
+         *
+         * The default implementation returns false.
+         */
+        virtual bool provides_derivatives() const{
+            return false;
+        }
+
         /// Declare the destructor virtual as there will be polymorphic access to derived classes
         virtual ~HistogramFunction(){}
         
     protected:
         /// To be filled by derived classes:
         ParIds par_ids;
+
+    private:
+        mutable ParValues pv;
     };
     
 
@@ -102,6 +136,11 @@ namespace theta {
         virtual const Histogram & operator()(const ParValues & values) const{
             return h;
         }
+
+        /// Returns the Histogram \c h, as operator()
+        virtual const Histogram & eval_dense(const double * x, const size_t * offsets) const{
+            return h;
+        }
         
         /// Return a Histogram of the same dimenions as the one returned by operator()
         virtual Histogram get_histogram_dimensions() const{
@@ -159,6 +198,11 @@ namespace theta {
             return h;
         }
 
+        /// Returns the Histogram \c h, as operator()
+        virtual const Histogram & eval_dense(const double * x, const size_t * offsets) const{
+            return h;
+        }
+
         /** \brief Returns the bin-by-bin fluctuated Histogram.
          *
          * For evey bin j, a random number from a gaussian distribution around 1, truncated at 0, with
@@ -4,11 +4,74 @@
 #include "interface/decls.hpp"
 #include "interface/utils.hpp"
 #include <cstring>
+#include <algorithm>
+
+#include <boost/utility.hpp>
 
 void get_allocs_frees(int & n_alls, int & n_frs);
 
 namespace theta{
 
+/** \brief A non-owning view of histogram data
+ *
+ * Refers to an array of bin contents with the same layout as the one of Histogram, i.e., nbins+2 doubles
+ * including the underflow and overflow bin, together with the binning. It can be used to pass bin arrays
+ * owned by someone else to Histogram methods like Histogram::assign_with_coeff without copying them into a Histogram first.
+ *
+ * The referenced data must outlive the view. A Histogram converts implicitly to a view of its contents.
+ */
+class HistogramView{
+public:
+    /// Construct a view of \c nbins_+2 doubles at \c data_ with range (\c xmin_, \c xmax_)
+    HistogramView(const double * data_, size_t nbins_, double xmin_, double xmax_): data(data_), nbins(nbins_), xmin(xmin_), xmax(xmax_){}
+
+    /// Construct a view of the contents of \c h
+    HistogramView(const Histogram & h);
+
+    /// The bin content of bin \c i, using the same bin index convention as Histogram
+    double get(size_t i) const{
+        return data[i];
+    }
+
+    /// The raw data, including underflow and overflow bin
+    const double * getData() const{
+        return data;
+    }
+
+    //@{
+    /// The binning, as in Histogram
+    size_t get_nbins() const{
+        return nbins;
+    }
+    double get_xmin() const{
+        return xmin;
+    }
+    double get_xmax() const{
+        return xmax;
+    }
+    //@}
+
+private:
+    const double * data;
+    size_t nbins;
+    double xmin, xmax;
+};
+
+/** \brief Enables the per-thread cache for the bin contents of Histograms (and therefore Data) in the current thread
+ *
+ * While at least one instance exists in a thread, Histograms created and destroyed in this thread take their memory from
+ * and return it to the cache of this thread; otherwise, they allocate and free it directly. Run installs a guard
+ * in the threads running the event loop and the likelihood of the default model during its evaluation, so the temporaries
+ * of the producers do not allocate memory in the steady state. Instances can be nested.
+ *
+ * The cached memory is limited to 64MB per thread and freed at thread exit.
+ */
+class HistodataPoolGuard: private boost::noncopyable{
+public:
+    HistodataPoolGuard();
+    ~HistodataPoolGuard();
+};
+
 /** A Histogram class holding binned data.
  *
  * Only equally spaced binning is supported. Binning is therefore fully determined
@@ -18,6 +81,11 @@ namespace theta{
  * - bin 0 is the "underflow bin", it corresponds to the range (-infinity, xmin)
  * - bin \c i with \c i &gt;=1 and \c i &lt;= nbins holds weight for the range [xmin + (i-1)*binwidth, xmin + i*binwidth), where binwidth = (xmax-xmin)/nbins.
  * - bin nbins+1 is the "overflow bin", it corresponds to the range [xmax, infinity).
+ *
+ * While a HistodataPoolGuard exists in the current thread, the memory for the bin contents is taken from a per-thread cache
+ * with one free list per size class (powers of two), so that creating and destroying Histograms of the same sizes, e.g. temporaries
+ * in the evaluation of the likelihood, does not allocate memory in the steady state. The global counters returned by get_allocs_frees
+ * count the actual allocations and frees.
  */
 class Histogram {
 private:
@@ -42,6 +110,38 @@ public:
     /// Copy assignment. Copies the content of \c rhs into this.
     void operator=(const Histogram& rhs);
 
+#if __cplusplus >= 201103L
+    /** \brief Move constructor. Takes over the contents of \c rhs without copying.
+     *
+     * \c rhs is left without data and may only be destroyed or assigned to.
+     */
+    Histogram(Histogram && rhs) noexcept: histodata(rhs.histodata), nbins(rhs.nbins), xmin(rhs.xmin), xmax(rhs.xmax){
+        rhs.histodata = 0;
+        rhs.nbins = 0;
+        rhs.xmin = rhs.xmax = 0.0;
+    }
+
+    /// Move assignment. Exchanges the contents of this and \c rhs.
+    Histogram & operator=(Histogram && rhs) noexcept{
+        swap(rhs);
+        return *this;
+    }
+#endif
+
+    /// Create a Histogram with a copy of the contents of the view \c rhs
+    explicit Histogram(const HistogramView & rhs);
+
+    /** \brief Exchange the contents and binning of this and \c other
+     *
+     * This does not copy any bin contents and never allocates memory. Use it to "move" a Histogram, e.g., from a temporary.
+     */
+    void swap(Histogram & other){
+        std::swap(histodata, other.histodata);
+        std::swap(nbins, other.nbins);
+        std::swap(xmin, other.xmin);
+        std::swap(xmax, other.xmax);
+    }
+
     ///Destructor. De-allocates internal memory of the histogram data
     ~Histogram();
 
@@ -172,9 +272,25 @@ public:
     void add_with_coeff(double coeff, const Histogram & other){
        utils::add_fast_with_coeff(histodata, other.histodata, coeff, nbins+2);
     }
-    
+
+    /** \brief Calculate this = coeff * other.
+     *
+     * This is the same as assigning \c other and multiplying by \c coeff, but does only one pass over the
+     * data. If the binning of \c other differs from the one of this, this Histogram is re-binned first; otherwise, no memory is allocated.
+     */
+    void assign_with_coeff(double coeff, const HistogramView & other);
 };
 
+inline HistogramView::HistogramView(const Histogram & h): data(h.getData()), nbins(h.get_nbins()), xmin(h.get_xmin()), xmax(h.get_xmax()){}
+
+}
+
+namespace std{
+    /// Specialization of std::swap, for use in standard algorithms and containers
+    template<>
+    inline void swap(theta::Histogram & a, theta::Histogram & b){
+        a.swap(b);
+    }
 }
 
 #endif
@@ -7,20 +7,63 @@ extern "C"{
     /** \brief Calculate inner product of a vector with log of the vector
      *
      * result = sum_i=0^{n-1}  y[i] * log2(x[i])
+     *
+     * Uses the fastest implementation supported by the cpu, see log2_dot_simd_support().
      */
     double log2_dot(const double * x, const double * y, unsigned int n);
-    
+
     /** \brief calculate the negative-log-likelihood for the data and prediction
      *
      * calculates
      * sum_{i=0}^{n-1}  pred[i] - data[i] * log(pred[i])
      *
      * If, for some i, data[i] and pred[i] are both zero, this is i is skipped in
-     * the sum (i.e., summand is treated as 0).
+     * the sum (i.e., summand is treated as 0). Data which is not positive (including NAN) does not
+     * contribute to the log term.
      *
      * If, for some i, data[i] > 0.0 and pred[i] <= 0.0, +infinity is returned.
+     *
+     * Uses the fastest implementation supported by the cpu, see log2_dot_simd_support().
      */
     double template_nllikelihood(const double * data, const double * pred, unsigned int n);
+
+    /** \brief Instruction set levels for the implementations of log2_dot and template_nllikelihood
+     *
+     * The level is determined once from the cpu features, on the first call of one of the functions.
+     */
+    enum log2_dot_simd_level{
+        log2_dot_nosimd = 0, ///< the default implementation (log2_dot.s on x86_64, or the generic C++ version)
+        log2_dot_avx2 = 1,   ///< requires AVX2 and FMA
+        log2_dot_avx512 = 2  ///< requires AVX-512F
+    };
+
+    /** \brief Returns the highest log2_dot_simd_level supported by the cpu and this build
+     *
+     * This is the implementation used by log2_dot and template_nllikelihood. It is always log2_dot_nosimd
+     * on non-x86_64 platforms and if compiled with GENERIC_ARCH.
+     */
+    int log2_dot_simd_support();
+
+    //@{
+    /** \brief Call a particular implementation of log2_dot and template_nllikelihood
+     *
+     * \c level is a value from log2_dot_simd_level. If the requested level is not supported, the
+     * highest supported level below \c level is used.
+     *
+     * These functions are intended for testing and benchmarking only; use log2_dot and template_nllikelihood instead.
+     */
+    double log2_dot_simd(int level, const double * x, const double * y, unsigned int n);
+    double template_nllikelihood_simd(int level, const double * data, const double * pred, unsigned int n);
+    //@}
+
+    //@{
+    /** \brief The default, non-vectorized implementations
+     *
+     * Defined in log2_dot.s or log2_dot.cxx, depending on the architecture.
+     */
+    double log2_dot_default(const double * x, const double * y, unsigned int n);
+    double template_nllikelihood_default(const double * data, const double * pred, unsigned int n);
+    //@}
 }
 
 #endif
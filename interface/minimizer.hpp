@@ -94,6 +94,9 @@ namespace theta{
          * 
          * If either step is 0.0 or the range contains only one value, the parameter should be
          * considered as fixed.
+         *
+         * Implementations should create a theta::MinimizeCall at the beginning, which counts and times the call for the
+         * timing instrumentation of theta::Run.
          */
         virtual MinimizationResult minimize(const theta::Function & f, const theta::ParValues & start,
                 const theta::ParValues & step, const std::map<theta::ParId, std::pair<double, double> > & ranges) = 0;
@@ -14,6 +14,7 @@
 
 #include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/ptr_container/ptr_map.hpp>
+#include <boost/utility.hpp>
 
 namespace theta {
 
@@ -135,6 +136,7 @@ namespace theta {
     /** \brief The default model in theta
      */
     class default_model: public Model{
+    friend class default_model_nll;
     private:
         //The problem of std::map<ObsId, ptr_vector<Function> > is that
         // this requires ptr_vector to be copy-constructible which in turn
@@ -222,17 +224,57 @@ namespace theta {
          * 
          */
         virtual const Distribution & get_parameter_distribution()const = 0;
+
+        /** \brief Evaluate the negative log-likelihood at many parameter points
+         *
+         * \c x contains \c n parameter points, each as getnpar() consecutive doubles following the
+         * convention of Function::operator()(const double*). The \c n function values are written to \c result.
+         *
+         * Use this instead of calling operator() in a loop whenever many points are known in advance, e.g., in scans.
+         * The default implementation calls operator()(const double*) for each point; derived classes can
+         * override it to share work between the points.
+         */
+        virtual void eval_batch(const double * x, size_t n, double * result) const;
         
         ///Make destructor virtual as this is an abstract base class
         virtual ~NLLikelihood(){}
     };
     
     
-    class default_model_nll: public NLLikelihood{
+    /** \brief The NLLikelihood returned by default_model::getNLLikelihood
+     *
+     * The evaluation does not materialize the model prediction as Histogram. Instead, the bins are
+     * processed in blocks of \c tile_size entries: for each block, the coefficient-weighted sum of all
+     * component templates is built in a small buffer which stays in the L1 cache and the Poisson
+     * negative log-likelihood of this block is added immediately. The result is the same (up to rounding) as
+     * calling default_model::get_prediction and template_nllikelihood for each observable.
+     *
+     * The coefficient and the template of each component are cached. Between calls, only those
+     * are re-evaluated which depend on a parameter whose value changed since the previous call. They are
+     * evaluated via Function::eval_dense and HistogramFunction::eval_dense, with the parameter layouts
+     * computed at construction. This is
+     * useful for numerical derivatives and component-wise Markov chain updates, where only one or few
+     * parameters change from one call to the next.
+     *
+     * eval_batch evaluates the coefficients of all points first, stored per component as contiguous array over the points.
+     * For observables whose templates do not depend on a parameter which varies within the batch, the templates are
+     * evaluated only once and each block of template bins is used for all points while it is in the cache.
+     * The results are the same as those of operator().
+     *
+     * Analytical derivatives are provided if all coefficient Functions and all HistogramFunctions
+     * which depend on parameters (and the additional term, if set) provide derivatives. The parameter
+     * distribution must implement Distribution::evalNL_withDerivatives.
+     */
+    class default_model_nll: public NLLikelihood, private boost::noncopyable{
     friend class default_model;
     public:
         using Function::operator();
+        using Function::eval_withDerivatives;
         virtual double operator()(const ParValues & values) const;
+        virtual double eval_withDerivatives(const ParValues & values, ParValues & derivatives) const;
+        virtual bool provides_derivatives() const;
+        virtual void eval_batch(const double * x, size_t n, double * result) const;
+        virtual ~default_model_nll();
         
         virtual void set_additional_term(const boost::shared_ptr<Function> & term);
         virtual void set_override_distribution(const boost::shared_ptr<Distribution> & d);
@@ -252,8 +294,38 @@ namespace theta {
 
         std::map<ParId, std::pair<double, double> > ranges;
 
-        //cached predictions:
-        mutable Data predictions;
+        //number of bins per block in the fused prediction / likelihood evaluation. Has to be even.
+        static const size_t tile_size = 512;
+        //16-byte aligned buffer of tile_size doubles for the prediction of the current block, owned (hence noncopyable):
+        double * tile;
+        //cached coefficient and template of a model component, and the layout of the parameters
+        // of the coefficient function and the HistogramFunction in par_values:
+        struct component{
+            double coeff;
+            Histogram histo;
+            ParLayout coeff_pars, histo_pars;
+        };
+        mutable std::map<ObsId, std::vector<component> > components;
+        //the parameter values of the previous call as dense array in the order of par_ids, and for each parameter whether
+        // it changed since then. If components_valid is false, all components are re-evaluated in the next call:
+        mutable std::vector<double> par_values;
+        mutable std::vector<char> par_changed;
+        mutable bool components_valid;
+
+        //the prediction and derivative temporaries for eval_withDerivatives:
+        mutable Histogram pred;
+        mutable ParValues coeff_derivatives;
+
+        //temporaries for eval_batch: the parameter values of the current point, the coefficients of
+        // component i at point k in batch_coeffs[i * n + k] and the contribution of observable j at point k
+        // in batch_nll[j * n + k]:
+        mutable ParValues batch_values;
+        mutable std::vector<double> batch_coeffs, batch_nll, batch_prior, batch_additional;
+
+        void update_changed(const ParValues & values) const;
+        const std::vector<component> & update_components(const ObsId & obs_id) const;
+        double eval_observable(const ObsId & obs_id) const;
+        double eval_observable_withDerivatives(const ObsId & obs_id, const ParValues & values, ParValues & derivatives) const;
         
         default_model_nll(const default_model & m, const Data & data, const ObsIds & obs);
      };
@@ -0,0 +1,70 @@
+#ifndef PERF_PROFILE_HPP
+#define PERF_PROFILE_HPP
+
+#include <ostream>
+#include <string>
+
+namespace theta{
+
+/** \brief The sections of the code measured in profiling mode, see ProfileSection
+ *
+ * The sections are:
+ * - profile_nll: the evaluation of the negative log-likelihood of the default model, i.e., building the prediction from the
+ *   cached templates and template_nllikelihood
+ * - profile_histogram_function: the evaluation of the HistogramFunction instances and coefficients of the model,
+ *   in Model::get_prediction and for the likelihood
+ * - profile_minimize: Minimizer::minimize, see MinimizeCall
+ */
+enum e_profile_section { profile_nll = 0, profile_histogram_function, profile_minimize, n_profile_sections };
+
+/// Whether profiling is enabled; only changed by enable_profiling
+extern bool profiling_enabled;
+
+/** \brief Enable the profiling with hardware performance counters
+ *
+ * Opens the counters for cycles, instructions, cache misses and branch misses of the calling thread with perf_event_open;
+ * other threads open their counters when they enter their first ProfileSection. Only user space is counted.
+ *
+ * If the hardware counters are not available (e.g. in virtual machines without performance monitoring unit, or
+ * if forbidden by /proc/sys/kernel/perf_event_paranoid), profiling stays disabled and false is returned; \c reason
+ * is set to a description of the problem.
+ *
+ * Has to be called before other threads enter a ProfileSection.
+ */
+bool enable_profiling(std::string & reason);
+
+/** \brief Write the profile report to \c out
+ *
+ * For each section, the number of calls, cycles and instructions, the instructions per cycle and the cache and branch misses
+ * per 1000 instructions are reported, summed over all threads, including those which have exited already. The counts of a section do not
+ * include those of nested sections.
+ */
+void write_profile_report(std::ostream & out);
+
+/** \brief Scope guard which attributes the hardware events to a section of the code
+ *
+ * From construction to destruction, the events of the current thread are counted for \c section, except while
+ * another ProfileSection is active within it. If profiling is not enabled, this does nothing.
+ */
+class ProfileSection{
+public:
+    explicit ProfileSection(e_profile_section section): active(profiling_enabled), previous(-1){
+        if(active) previous = enter(section);
+    }
+
+    ~ProfileSection(){
+        if(active) leave(previous);
+    }
+
+private:
+    // return the previously active section, -1 for none
+    static int enter(e_profile_section section);
+    static void leave(int previous);
+
+    bool active;
+    int previous;
+};
+
+}
+
+#endif
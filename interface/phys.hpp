@@ -55,6 +55,64 @@ namespace theta {
             return operator()(pv);
         }
 
+        /** \brief Evaluate the function, using an array of values for more parameters with precomputed indices
+         *
+         * The value of the i-th parameter of getParameters() (in iteration order) is \c x[offsets[i]]. The
+         * offsets are typically taken from a ParLayout built once at setup time for the parameters of this Function.
+         * As opposed to operator()(const ParValues&), no checks for missing or NAN values are made.
+         *
+         * The default implementation copies the values into a ParValues instance and calls operator()(const ParValues&).
+         * Derived classes can re-implement it to use the values in \c x directly, which avoids the lookup of the
+         * parameters in ParValues.
+         */
+        virtual double eval_dense(const double * x, const size_t * offsets) const{
+            size_t i=0;
+            for(ParIds::const_iterator it=par_ids.begin(); it!=par_ids.end(); ++it, ++i){
+                assert(!std::isnan(x[offsets[i]]));
+                pv.set(*it, x[offsets[i]]);
+            }
+            return operator()(pv);
+        }
+
+        /** \brief Evaluate the function and its partial derivatives
+         *
+         * Returns the function value at \c v, just as operator()(const ParValues&). Additionally, the partial
+         * derivatives with respect to all parameters in getParameters() are set in \c derivatives.
+         *
+         * Derived classes which implement this method should also re-implement provides_derivatives. The
+         * default implementation throws a FatalException.
+         */
+        virtual double eval_withDerivatives(const ParValues & v, ParValues & derivatives) const;
+
+        /** \brief Evaluate the function and its derivatives, using arrays of doubles
+         *
+         * The same as eval_withDerivatives(const ParValues&, ParValues&), but using arrays of doubles
+         * for the parameter values and the derivatives, following the same convention as operator()(const double*).
+         * \c grad must have space for getnpar() doubles.
+         */
+        double eval_withDerivatives(const double * x, double * grad) const{
+            size_t i=0;
+            for(ParIds::const_iterator it=par_ids.begin(); it!=par_ids.end(); ++it, ++i){
+                assert(!std::isnan(x[i]));
+                pv.set(*it, x[i]);
+            }
+            double result = eval_withDerivatives(pv, pv_derivatives);
+            i = 0;
+            for(ParIds::const_iterator it=par_ids.begin(); it!=par_ids.end(); ++it, ++i){
+                grad[i] = pv_derivatives.get(*it);
+            }
+            return result;
+        }
+
+        /** \brief Returns whether analytical derivatives are available via eval_withDerivatives
+         *
+         * Minimizers can use this to decide whether to use the analytical derivatives or whether to
+         * calculate derivatives numerically. The default implementation returns false.
+         */
+        virtual bool provides_derivatives() const{
+            return false;
+        }
+
 
         /** \brief Returns the parameters this function depends on
          */
@@ -89,6 +147,7 @@ namespace theta {
         
     private:
         mutable ParValues pv; //saving this class-wide and not in operator()(const double*) saves quiet some time ...
+        mutable ParValues pv_derivatives;
     };
     
     
@@ -119,7 +178,7 @@ namespace theta {
          */
         //@{
         Histogram & operator[](const ObsId & id){
-            if(id.id >= data.size()) data.resize(id.id + 1);
+            if(id.id >= data.size()) grow(id.id + 1);
             return data[id.id];
         }
         const Histogram & operator[](const ObsId & id) const{
@@ -137,7 +196,15 @@ namespace theta {
             }
         }
 
+        /// \brief Exchange the contents of this and \c other without copying any Histogram
+        void swap(Data & other){
+            data.swap(other.data);
+        }
+
     private:
+        // resize data to n elements, swapping instead of copying the existing Histograms
+        void grow(size_t n);
+
         std::vector<Histogram> data;
     };
     
@@ -4,26 +4,90 @@
 #include "interface/plugin.hpp"
 #include "interface/random.hpp"
 #include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
 
 namespace theta{
 
+/** \brief The Random instances with a counter-based RandomSource within one Run (or one worker thread of a Run)
+ *
+ * The Run sets an instance of this class in the PropertyMap with name "default" and calls set_event at the start of
+ * each event, before the data source is asked for data. The RandomConsumer registers its Random instance here if it
+ * uses a counter-based RandomSource.
+ */
+class RandomStreams{
+public:
+    /// Register \c rnd. Ownership is not transferred.
+    void add(Random * rnd);
+
+    /// Remove \c rnd, previously registered with add
+    void remove(Random * rnd);
+
+    /// Call Random::set_stream for all registered Random instances
+    void set_event(int runid, int eventid);
+private:
+    std::vector<Random*> randoms;
+};
+
 /// \brief Base class for plugins using a random number generator.
 class RandomConsumer{
 protected:
    /** \brief Constructor to be used by derived classes
+    *
+    * The random number generator is configured with the optional setting group \c rnd_gen in cfg.setting, like
+    * \code
+    * rnd_gen = {
+    *   source_type = "mt"; // optional, default is "taus"
+    *   seed = 123; // optional, default is -1
+    *   poisson = "ptrs"; // optional, default is "root"
+    * };
+    * \endcode
+    * \c source_type selects the RandomSource, either "taus" for RandomSourceTaus, "mt" for RandomSourceMersenneTwister or
+    * "philox" for RandomSourcePhilox.
+    * A \c seed of -1 means to derive the seed from \c name and the time-based seed, which is the int "time_seed" in cfg.pm
+    * if set (a Run sets it once for all its plugins and worker threads) and the result of time_seed() otherwise.
+    * \c poisson selects the algorithm used by Random::poisson, either "root" or "ptrs" (see Random::set_poisson_algorithm).
     *
     * Will save the random seed in the RndInfoTable of the cfg.pm, if this is set.
+    *
+    * If the instance is constructed for a worker thread of a Run with n-threads &gt; 1 (i.e., if cfg.pm
+    * contains an int "threadid"), the seed of the worker with threadid \c i &gt; 0 is saved in the RndInfoTable with name
+    * <tt>name + "__thread" + i</tt>. For the sequential sources, this worker uses the seed <tt>seed * 33 + i</tt>
+    * instead of the configured (or time-based) seed.
+    *
+    * The counter-based "philox" source is keyed with the seed and a hash of \c name. It starts the stream of (runid, eventid)
+    * at the start of each event (see RandomStreams), so the random numbers of an event depend neither on the previous events
+    * nor on n-threads and any single event can be reproduced in isolation. In this case, all worker threads use the same seed. The key is saved in the 'key' column of the RndInfoTable as "philox:&lt;seed&gt;:&lt;name key&gt;".
     */
    RandomConsumer(const theta::plugin::Configuration & cfg, const std::string & name);
+
+   /// Removes the Random instance from the RandomStreams, if it was registered
+   ~RandomConsumer();
    
    /// random seed used
    int seed;
    
    /// random number generator instance to be used by derived classes
    std::auto_ptr<Random> rnd_gen;
+
+private:
+   boost::shared_ptr<RandomStreams> streams;
 };
 
 
+/** \brief Construct a RandomSource of type \c source_type, as configured by \c rnd_gen of a RandomConsumer
+ *
+ * \c source_type is "taus", "mt" or "philox" (see RandomConsumer); \c name determines the key of the counter-based source.
+ * Throws a ConfigurationException for an unknown \c source_type.
+ */
+std::auto_ptr<RandomSource> make_random_source(const std::string & source_type, const std::string & name);
+
+/** \brief Derive a seed from the current time and the hostname
+ *
+ * Used by RandomConsumer for a configured seed of -1.
+ */
+int time_seed();
+
 /** \brief Dice a poisson for each bin of a given Histogram
  *
  * Replaces the bin contents of the given Histogram \c h with a random variable drawn from a Poisson distribution.
@@ -4,6 +4,7 @@
 #include "interface/decls.hpp"
 
 #include <vector>
+#include <string>
 #include <memory>
 #include <limits>
 #include <boost/utility.hpp>
@@ -28,6 +29,15 @@ class RandomSource{
         /** \brief Set the seed of the generator.
          */
         virtual void set_seed(unsigned int seed) = 0;
+
+        /** \brief Position the generator at the start of the stream for the given event
+         *
+         * Only counter-based generators such as RandomSourcePhilox support this; they return true. The
+         * default implementation does nothing and returns false.
+         */
+        virtual bool set_stream(unsigned int runid, unsigned int eventid){
+            return false;
+        }
 };
 
 /** \brief Random number distribution generator
@@ -52,14 +62,28 @@ private:
     std::vector<unsigned int>::const_iterator current;
     std::vector<unsigned int>::const_iterator end;
 
+    int poisson_algo;
+
+    //the current stream, if the source is counter-based:
+    bool has_stream;
+    unsigned int stream_runid, stream_eventid;
+
     double gauss_zig(double);
     unsigned int poisson_root(double mean);
+    unsigned int poisson_ptrs(double mean);
+    unsigned int poisson_inversion(double mean);
     
     void fill(){
         rnd->fill(random_data);
         current = random_data.begin();
     }
 public:
+
+    /// The algorithms available for poisson(), see set_poisson_algorithm
+    enum e_poisson_algorithm{
+        poisson_algo_root = 0, ///< the GNU Scientific Library "root" method; this is the default
+        poisson_algo_ptrs = 1  ///< inversion for small means and Hoermann's PTRS transformed rejection for large means
+    };
     
     /** \brief Construct a generator with \c rnd_ as underlying source
      *
@@ -68,7 +92,8 @@ public:
     //While larger buffer sizes help very much for small buffers, tests have shown that
     // choosing a buffer sizes larger than around 100 does not increase performance significantly.
     Random(RandomSource * rnd_): rnd(rnd_), random_data(100),
-        current(random_data.end()), end(random_data.end()){
+        current(random_data.end()), end(random_data.end()), poisson_algo(poisson_algo_root),
+        has_stream(false), stream_runid(0), stream_eventid(0){
     }
     
     /** \brief get a random number distributed according to a normal distribution with the given standard deviation
@@ -81,11 +106,35 @@ public:
     
     /** \brief get a random number distributed according to a poisson distribution
      *
-     * Uses the GNU Scientific Library "root" method. For details and references, see there.
+     * Uses the algorithm selected with set_poisson_algorithm. By default, this is the GNU Scientific Library "root" method.
+     * For details and references, see there.
      */
     unsigned int poisson(double mean){
+        if(poisson_algo == poisson_algo_ptrs) return poisson_ptrs(mean);
         return poisson_root(mean);
     }
+
+    /** \brief Replace each element of an array by a poisson random number
+     *
+     * For each i in [0, n), x[i] is replaced by a random number drawn from a poisson distribution with mean x[i],
+     * if x[i] &gt; 0. Elements &lt;= 0 are not changed. The result is the same as calling poisson() for each element in turn,
+     * but avoids the per-element dispatch.
+     */
+    void poisson(double * x, size_t n);
+
+    /** \brief Select the algorithm used for poisson
+     *
+     * \c algo is a value from e_poisson_algorithm. The "root" method uses O(mean) uniform random numbers for mean &lt; 25 and
+     * a rejection method with two lngamma evaluations per trial for larger means. "ptrs" uses inversion by sequential search
+     * with one uniform random number for mean &lt; 10 and the transformed rejection method PTRS (W. Hoermann,
+     * "The transformed rejection method for generating Poisson random variables", Insurance: Mathematics and Economics 12, 1993)
+     * with an acceptance rate of around 90% for larger means, which is much faster for most means.
+     *
+     * Both are deterministic for a fixed seed, but produce different sequences.
+     */
+    void set_poisson_algorithm(int algo){
+        poisson_algo = algo;
+    }
     
     /** \brief get a 32 bit random number from the generator
      */
@@ -112,6 +161,43 @@ public:
         //invalidate the buffer:
         current = end;
     }
+
+    /** \brief Start the random stream of the given event
+     *
+     * This calls RandomSource::set_stream. If the RandomSource supports it, all subsequent random numbers
+     * depend only on the seed, the key of the source, \c runid and \c eventid. Otherwise, this has no effect.
+     */
+    void set_stream(unsigned int runid, unsigned int eventid){
+        if(rnd->set_stream(runid, eventid)){
+            current = end;
+            has_stream = true;
+            stream_runid = runid;
+            stream_eventid = eventid;
+        }
+    }
+
+    /** \brief Switch to and from the run-scoped stream
+     *
+     * For one-time initializations within an event loop which consume random numbers, such as
+     * tuning a proposal function at the first event: begin_run_stream switches to the stream of eventid 0 of the current run, end_run_stream
+     * restarts the stream of the current event. This makes the result of the initialization, and the random numbers
+     * of the event, independent of the event in which the initialization takes place.
+     *
+     * Both have no effect if set_stream has not been called with a counter-based RandomSource.
+     */
+    //@{
+    void begin_run_stream(){
+        if(has_stream){
+            unsigned int eventid = stream_eventid;
+            set_stream(stream_runid, 0);
+            stream_eventid = eventid;
+        }
+    }
+
+    void end_run_stream(){
+        if(has_stream) set_stream(stream_runid, stream_eventid);
+    }
+    //@}
 };
 
     /** \brief Tausworthe generator
@@ -164,6 +250,44 @@ public:
         RandomSourceMersenneTwister();
 
     };
+
+    /** \brief The counter-based Philox4x32-10 generator
+     *
+     * See J. K. Salmon, M. A. Moraes, R. O. Dror, D. E. Shaw: "Parallel random numbers: as easy as 1, 2, 3",
+     * Proceedings of the International Conference for High Performance Computing, Networking, Storage and Analysis (SC11), 2011.
+     *
+     * The output is a fixed function of a 64 bit key and a 128 bit counter: each block of four 32 bit random numbers is obtained
+     * by applying ten rounds of the Philox bijection to the counter (block number, 0, eventid, runid) with the key (seed, \c name_key).
+     * As there is no sequential state, the stream of any event can be generated in isolation via set_stream, independently of the
+     * events generated before and of the thread generating it.
+     *
+     * \c fill processes independent blocks, which allows the compiler to vectorize the loop.
+     */
+    class RandomSourcePhilox: public RandomSource{
+    private:
+        unsigned int key[2];
+        unsigned int counter[4];
+    protected:
+        //@{
+        /** \brief Implement the virtual methods from RandomSource
+         *
+         * set_seed sets the first key word and resets the counter to the start of the stream of runid = eventid = 0.
+         */
+        virtual void fill(std::vector<unsigned int> & buffer);
+        virtual void set_seed(unsigned int);
+        virtual bool set_stream(unsigned int runid, unsigned int eventid);
+        //@}
+    public:
+        /** \brief Construct with a given second key word
+         *
+         * \c name_key is used as the second key word. RandomConsumer derives it from the plugin name, so that
+         * different plugins use different streams even with the same seed.
+         */
+        explicit RandomSourcePhilox(unsigned int name_key = 0);
+
+        /// Returns the key word derived from \c name (32 bit FNV-1a hash), as used by RandomConsumer
+        static unsigned int name_key(const std::string & name);
+    };
 }
 
 
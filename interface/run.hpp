@@ -3,6 +3,7 @@
 
 #include "interface/database.hpp"
 #include "interface/main.hpp"
+#include "interface/timing.hpp"
 
 #include <string>
 #include <sstream>
@@ -10,6 +11,10 @@
 #include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/shared_ptr.hpp>
 
+namespace boost{
+    class thread_group;
+}
+
 namespace theta{
 
 
@@ -40,6 +45,9 @@ namespace theta{
  *   //optional:
  *   log-level = "error";  //default is "warning"
  *   log-report = false;  //default is true
+ *   log-compact = true; //default is false
+ *   timing = true; //default is false
+ *   n-threads = 4; //default is 1
  * };
  *
  * hypotest = {...}; //some producer definition
@@ -69,6 +77,33 @@ namespace theta{
  *       level. This allows for a quick check by the user whether everything went Ok or whether there
  *       have been obvious errors.
  *
+ * \c log-compact is a boolean which enables the compact mode of the log table: instead of writing the "start" and "end" rows for
+ *       every event (and all other messages except errors), these messages are only counted, and one row per run is written to a table
+ *       'log_summary' with the message counters and the distribution of the time per event, measured as the time to produce
+ *       the data and to run all producers on it. Errors are still written to the log table. See LogTable for details.
+ *
+ * \c timing is a boolean which enables the timing instrumentation: the number of calls and the wall and cpu time is recorded
+ *      for the data source (DataSource::fill), for each producer (Producer::produce) and for writing the results to the output database.
+ *      For the data source and the producers, also the number of likelihood evaluations and the number, wall and cpu time of the calls of
+ *      Minimizer::minimize made within them are recorded. The results are written to a table 'timing' with one row per component and run
+ *      and columns 'runid', 'name', 'calls', 'sampled', 'wall_time', 'cpu_time', 'nll_evals', 'minimize_calls', 'minimize_wall_time' and
+ *      'minimize_cpu_time' (times in seconds); they are also part of the log report. To keep the overhead small, the times
+ *      are only measured for a sample of the events (see TimingSampler) and extrapolated to all calls; the counts are exact.
+ *      For n-threads &gt; 1, the statistics of all worker threads are summed.
+ *
+ * \c n-threads is the number of worker threads to use for the pseudo experiments. The default of 1 runs all events
+ *      in the calling thread. For values larger than one, each worker thread uses its own instance of the model,
+ *      the data_source and the producers, built from the same configuration. The event ids are distributed
+ *      round-robin: worker \c i (counting from 0) processes the events with eventid-1 = i modulo n-threads. The per-event
+ *      results are written to the output database by the calling thread, strictly in eventid order.
+ *      Each worker constructs its own random number generators; seeds are derived by the RandomConsumer
+ *      from the worker index and saved in the 'rndinfo' table (see RandomConsumer for details); the time-based seed used
+ *      for plugins without a configured seed is determined once per Run. Therefore, a run with
+ *      n-threads &gt; 1 can be reproduced exactly using the same seeds and the same value for n-threads. With the counter-based
+ *      random source (<tt>source_type = "philox"</tt> in \c rnd_gen), the random numbers of each event depend only on the seed, the plugin name,
+ *      the runid and the eventid, so the result is also independent of n-threads.
+ *      Note that all plugins used in the worker threads must not use any global state without proper locking.
+ *
  *  Handling of result tables is done in the individual producers. Only run-wide tables
  *  are managed here, that is
  *  <ul>
@@ -96,7 +131,25 @@ public:
      */
     Run(const plugin::Configuration & cfg);
     
+    /// Declare destructor explicitly, as the worker type is incomplete here
+    virtual ~Run();
+    
 private:
+    class worker;
+    class products_columns;
+    class products_sink;
+    
+    //the event loop for n_threads > 1:
+    void run_parallel();
+    void stop_workers(boost::thread_group & threads);
+    //write the log report to theta::cout, if configured:
+    void report();
+    //write timing_stats to the timing table:
+    void write_timing();
+    //the stats of component i, or 0 if timing is disabled:
+    TimingStats * timing_stat(size_t i){
+        return timing ? &timing_stats[i] : 0;
+    }
 
     boost::shared_ptr<VarIdManager> vm;
     std::auto_ptr<Model> model;
@@ -106,7 +159,15 @@ private:
 
     std::auto_ptr<LogTable> logtable;
     bool log_report;
+
+    //the timing instrumentation. timing_stats contains the data source, the producers and the database, in this order. For n_threads > 1,
+    // it is only filled at the end of the run, from the statistics of the workers and of the writer:
+    bool timing;
+    std::vector<TimingStats> timing_stats;
+    std::auto_ptr<Table> timing_table;
     boost::shared_ptr<RndInfoTable> rndinfo_table;
+    //the Random instances with counter-based sources, for n_threads == 1:
+    boost::shared_ptr<RandomStreams> random_streams;
 
     //the producers to be run on the pseudo data:
     boost::ptr_vector<Producer> producers;
@@ -115,6 +176,12 @@ private:
     //the runid, and the total number of events to produce:
     int runid;
     int n_event;
+    
+    //number of worker threads. If n_threads > 1, model, data_source and producers above
+    // are not used; the workers hold their own instances instead:
+    int n_threads;
+    boost::shared_ptr<products_columns> columns;
+    boost::ptr_vector<worker> workers;
 };
 
 
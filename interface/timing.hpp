@@ -0,0 +1,202 @@
+#ifndef TIMING_HPP
+#define TIMING_HPP
+
+#include "interface/utils.hpp"
+#include "interface/perf_profile.hpp"
+
+#include <boost/cstdint.hpp>
+#include <string>
+
+namespace theta{
+
+/** \brief Per-thread counters for the instrumentation of a Run
+ *
+ * The counters are incremented by the instrumented code in the thread it runs in. Run reads them before and after
+ * calling a Producer to attribute the counts to that Producer, see TimedCall. Counting is always enabled,
+ * as it only costs an increment of a thread-local variable; only the time measurements are sampled.
+ */
+struct TimingCounters{
+    /// the number of likelihood evaluations, counting each point of NLLikelihood::eval_batch
+    boost::uint64_t nll_evals;
+    /// the number of calls of Minimizer::minimize
+    boost::uint64_t minimize_calls;
+    /// the number of calls of Minimizer::minimize while \c sampling_weight was not zero
+    boost::uint64_t minimize_sampled;
+    /// the wall and cpu time of these calls in nanoseconds, each multiplied by \c sampling_weight
+    boost::uint64_t minimize_wall_ns, minimize_cpu_ns;
+    /** \brief The weight of the current event if it is timed, 0 otherwise
+     *
+     * Set by Run to the value returned by TimingSampler::sample, i.e., the number of events the current event represents.
+     */
+    boost::uint64_t sampling_weight;
+};
+
+/// The TimingCounters of the current thread
+extern THETA_THREAD_LOCAL TimingCounters timing_counters;
+
+/// The cpu time used by the current thread so far, in nanoseconds
+boost::uint64_t thread_cpu_ns();
+
+/** \brief The time spent in the time measurements themselves, in nanoseconds
+ *
+ * Reading the thread cpu clock is a system call, which takes some hundred nanoseconds. The measured times
+ * of MinimizeCall and TimedCall are corrected for this, using the values determined by calibrate_timing.
+ */
+struct TimingOverhead{
+    /// the wall and cpu time measured for an empty call
+    boost::uint64_t wall_ns, cpu_ns;
+    /// the wall and cpu time a complete measurement adds to an enclosing measurement
+    boost::uint64_t nested_wall_ns, nested_cpu_ns;
+};
+
+/// The overhead of the time measurements, as determined by the last call of calibrate_timing; zero before
+extern TimingOverhead timing_overhead;
+
+/** \brief Measure the overhead of the time measurements and save it in timing_overhead
+ *
+ * Should be called once before the first measurement, while no other thread measures times.
+ */
+void calibrate_timing();
+
+/// Returns \c t minus the overhead \c overhead, but at least zero
+inline boost::uint64_t subtract_overhead(boost::uint64_t t, boost::uint64_t overhead){
+    return t > overhead ? t - overhead : 0;
+}
+
+/** \brief Counts a call of Minimizer::minimize in timing_counters and measures its time, if sampling
+ *
+ * Minimizer implementations create an instance at the beginning of their minimize method. In profiling mode,
+ * the call is also the ProfileSection profile_minimize.
+ */
+class MinimizeCall{
+public:
+    MinimizeCall(): weight(timing_counters.sampling_weight), profile(profile_minimize){
+        ++timing_counters.minimize_calls;
+        if(weight){
+            wall0 = utils::now_ns();
+            cpu0 = thread_cpu_ns();
+        }
+    }
+
+    ~MinimizeCall(){
+        if(weight){
+            timing_counters.minimize_cpu_ns += subtract_overhead(thread_cpu_ns() - cpu0, timing_overhead.cpu_ns) * weight;
+            timing_counters.minimize_wall_ns += subtract_overhead(utils::now_ns() - wall0, timing_overhead.wall_ns) * weight;
+            ++timing_counters.minimize_sampled;
+        }
+    }
+
+private:
+    boost::uint64_t weight;
+    boost::uint64_t wall0, cpu0;
+    ProfileSection profile;
+};
+
+/** \brief Timing statistics of one instrumented component of a Run, such as the DataSource or a Producer
+ *
+ * The number of calls and the counts taken from TimingCounters are exact. The times are only measured for the sampled calls;
+ * each measured time is multiplied by the number of calls the sampled call represents, so the sums are estimates of the total time of all calls.
+ */
+struct TimingStats{
+    std::string name;
+    /// the number of calls, the number of sampled calls and the estimated total wall and cpu time of all calls in nanoseconds
+    boost::uint64_t calls, sampled, wall_ns, cpu_ns;
+    boost::uint64_t nll_evals, minimize_calls, minimize_sampled, minimize_wall_ns, minimize_cpu_ns;
+
+    explicit TimingStats(const std::string & name_ = ""): name(name_), calls(0), sampled(0), wall_ns(0), cpu_ns(0), nll_evals(0), minimize_calls(0),
+        minimize_sampled(0), minimize_wall_ns(0), minimize_cpu_ns(0){}
+
+    /// Add the counts and times of \c other, e.g., of the same component in another thread
+    void add(const TimingStats & other);
+
+    //@{
+    /// The estimated total time of all calls, in seconds
+    double wall_time() const{
+        return 1e-9 * wall_ns;
+    }
+    double cpu_time() const{
+        return 1e-9 * cpu_ns;
+    }
+    double minimize_wall_time() const{
+        return 1e-9 * minimize_wall_ns;
+    }
+    double minimize_cpu_time() const{
+        return 1e-9 * minimize_cpu_ns;
+    }
+    //@}
+};
+
+/** \brief Scope guard which records one call of a component in a TimingStats instance
+ *
+ * The call count and the changes of timing_counters are always recorded; the wall and cpu time, multiplied by \c weight, only if \c weight
+ * is not zero. The overhead of the own measurement and of the MinimizeCall measurements during the call is subtracted from the times.
+ * If \c stats is 0, nothing is recorded.
+ */
+class TimedCall{
+public:
+    TimedCall(TimingStats * stats_, boost::uint64_t weight_): stats(stats_), weight(weight_){
+        if(stats == 0) return;
+        counters0 = timing_counters;
+        if(weight){
+            wall0 = utils::now_ns();
+            cpu0 = thread_cpu_ns();
+        }
+    }
+
+    ~TimedCall(){
+        if(stats == 0) return;
+        if(weight){
+            const boost::uint64_t nested = timing_counters.minimize_sampled - counters0.minimize_sampled;
+            stats->cpu_ns += subtract_overhead(thread_cpu_ns() - cpu0, timing_overhead.cpu_ns + nested * timing_overhead.nested_cpu_ns) * weight;
+            stats->wall_ns += subtract_overhead(utils::now_ns() - wall0, timing_overhead.wall_ns + nested * timing_overhead.nested_wall_ns) * weight;
+            ++stats->sampled;
+        }
+        ++stats->calls;
+        stats->nll_evals += timing_counters.nll_evals - counters0.nll_evals;
+        stats->minimize_calls += timing_counters.minimize_calls - counters0.minimize_calls;
+        stats->minimize_sampled += timing_counters.minimize_sampled - counters0.minimize_sampled;
+        stats->minimize_wall_ns += timing_counters.minimize_wall_ns - counters0.minimize_wall_ns;
+        stats->minimize_cpu_ns += timing_counters.minimize_cpu_ns - counters0.minimize_cpu_ns;
+    }
+
+private:
+    TimingStats * stats;
+    boost::uint64_t weight;
+    TimingCounters counters0;
+    boost::uint64_t wall0, cpu0;
+};
+
+/** \brief Decides which events to time, such that the overhead of the time measurements stays small
+ *
+ * Reading the wall and cpu clock takes some hundred nanoseconds, which is not negligible compared to fast Producers. So only every
+ * n-th event is timed, where n is adapted such that the estimated cost of the time measurements, according to timing_overhead,
+ * is less than 1% of the event time.
+ * The first events are always timed. Each timed event represents the events up to the next timed one; their number is
+ * the weight of the timed event.
+ */
+class TimingSampler{
+public:
+    TimingSampler();
+
+    /// The weight of the next event if it should be timed, 0 otherwise. Call once per event.
+    boost::uint64_t sample();
+
+    /** \brief Report the wall time \c wall_ns of a sampled event with \c n_timed time measurements
+     *
+     * Updates the sampling interval.
+     */
+    void add_sampled(boost::uint64_t wall_ns, size_t n_timed);
+
+    /// The current sampling interval, i.e., every interval-th event is timed
+    boost::uint64_t get_interval() const{
+        return interval;
+    }
+
+private:
+    double event_ns; // mean time of the sampled events
+    boost::uint64_t n_sampled, interval, countdown;
+};
+
+}
+
+#endif
@@ -2,11 +2,14 @@
 #define UTILS_HPP
 
 #include <sys/time.h>
+#include <time.h>
 #include <algorithm>
 #include <cmath>
 
 #include <iostream>
 
+#include <boost/cstdint.hpp>
+
 #ifdef USE_CRLIBM
 #include "crlibm/crlibm.h"
 #endif
@@ -15,6 +18,10 @@
 #include <emmintrin.h>
 #endif
 
+// storage class for thread-local variables with static storage duration, constant initialization and trivial destructor
+// (C++98 has no thread_local). Use boost::thread_specific_ptr for anything else.
+#define THETA_THREAD_LOCAL __thread
+
 namespace theta { namespace utils{
 
 double phi_inverse(double p);
@@ -128,6 +135,17 @@ inline bool close_to(double a, double b, double scale){
    return fabs(a-b) / scale < 10e-15;
 }
 
+/** \brief The time of a monotonic clock, in nanoseconds
+ *
+ * Only differences of the returned values are meaningful. Reading the clock takes only some tens
+ * of nanoseconds, so it can be used to time individual events.
+ */
+inline boost::uint64_t now_ns(){
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return static_cast<boost::uint64_t>(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+}
+
 
 }}
 
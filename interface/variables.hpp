@@ -192,6 +192,52 @@ namespace theta {
     /// \brief Template instantiation for a set of parameters
     typedef VarIds<ParId> ParIds;
 
+    /** \brief Positions of parameters in a dense array of parameter values
+     *
+     * An array of parameter values for the parameters \c all follows the usual convention of theta
+     * (see Function::operator()(const double*)): the value for the i-th parameter in the iteration order of \c all
+     * is at index i. A ParLayout holds, for each parameter of a subset \c sub of \c all, the index of this parameter in such an array.
+     *
+     * A ParLayout is meant to be built once at setup time, e.g., in the construction of a likelihood function,
+     * to make the evaluation of Functions via Function::eval_dense free of any lookup in ParIds or ParValues.
+     */
+    class ParLayout{
+    public:
+        /// Create an empty layout
+        ParLayout(){}
+
+        /** \brief Create the layout of \c sub in an array for \c all
+         *
+         * The indices are in the iteration order of \c sub. If \c sub contains a parameter not in \c all,
+         * an InvalidArgumentException is thrown.
+         */
+        ParLayout(const ParIds & all, const ParIds & sub);
+
+        /** \brief Create the layout of \c sub in an array for \c all
+         *
+         * Same as the constructor above, but the indices are in the order of \c sub, which may also contain a parameter more than once.
+         */
+        ParLayout(const ParIds & all, const std::vector<ParId> & sub);
+
+        /// The index of the i-th parameter of \c sub
+        size_t operator[](size_t i) const{
+            return offsets[i];
+        }
+
+        /// The number of parameters, i.e., the size of \c sub
+        size_t size() const{
+            return offsets.size();
+        }
+
+        /// The indices as array of size(), or 0 if the layout is empty
+        const size_t * get_offsets() const{
+            return offsets.empty() ? 0 : &offsets[0];
+        }
+
+    private:
+        std::vector<size_t> offsets;
+    };
+
     class ParValues;
     
     /** \brief Manager class for parameter and observable information
@@ -0,0 +1,283 @@
+#include "plugins/async_database.hpp"
+#include "interface/plugin.hpp"
+
+#include <iostream>
+#include <time.h>
+
+using namespace std;
+using namespace theta;
+
+namespace{
+    // the monotonic time in seconds:
+    double now(){
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + 1e-9 * ts.tv_nsec;
+    }
+}
+
+async_database::async_database(const plugin::Configuration & cfg): head(0), tail(0), producer_waiting(false), writer_waiting(false),
+    writer_stop(false), writer_failed(false), max_queued(0), n_blocked(0), blocked_time(0.0), n_rows(0), latency_sum(0.0), latency_max(0.0){
+    size_t queue_size = 1024;
+    if(cfg.setting.exists("queue_size")){
+        int qs = cfg.setting["queue_size"];
+        if(qs <= 0){
+            throw ConfigurationException("async_database: queue_size must be positive");
+        }
+        queue_size = qs;
+    }
+    if(cfg.setting.exists("statistics_table")){
+        statistics_table = static_cast<string>(cfg.setting["statistics_table"]);
+    }
+    size_t n = 1;
+    while(n < queue_size) n *= 2;
+    slots.resize(n);
+    mask = n - 1;
+    database = plugin::PluginManager<Database>::instance().build(plugin::Configuration(cfg, cfg.setting["database"]));
+    writer.reset(new boost::thread(writer_task(this)));
+}
+
+async_database::~async_database(){
+    writer_stop = true;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        cond.notify_all();
+    }
+    writer->join();
+    if(writer_failed){
+        cerr << "async_database: error while writing to the database: " << writer_error << endl;
+    }
+    else if(!statistics_table.empty()){
+        try{
+            write_statistics();
+        }
+        catch(Exception & ex){
+            cerr << "async_database: error while writing the statistics table: " << ex.message << endl;
+        }
+    }
+    //close the remaining tables of database before database itself:
+    tables.clear();
+    database.reset();
+}
+
+std::auto_ptr<Table> async_database::create_table(const string & table_name){
+    check_name(table_name);
+    tables.push_back(new table_state());
+    tables.back().name = table_name;
+    return std::auto_ptr<Table>(new async_table(tables.back(), boost::dynamic_pointer_cast<async_database>(shared_from_this())));
+}
+
+async_database::slot & async_database::acquire(){
+    if(writer_failed.load(boost::memory_order_acquire)){
+        boost::unique_lock<boost::mutex> lock(mutex);
+        throw DatabaseException("async_database writer thread: " + writer_error);
+    }
+    const size_t h = head.load(boost::memory_order_relaxed);
+    if(h - tail.load(boost::memory_order_acquire) > mask){
+        ++n_blocked;
+        const double t0 = now();
+        boost::unique_lock<boost::mutex> lock(mutex);
+        producer_waiting = true;
+        while(h - tail.load() > mask && !writer_failed){
+            cond.wait(lock);
+        }
+        producer_waiting = false;
+        blocked_time += now() - t0;
+        if(writer_failed){
+            throw DatabaseException("async_database writer thread: " + writer_error);
+        }
+    }
+    const size_t queued = h - tail.load(boost::memory_order_relaxed) + 1;
+    if(queued > max_queued) max_queued = queued;
+    return slots[h & mask];
+}
+
+void async_database::publish(){
+    const size_t h = head.load(boost::memory_order_relaxed) + 1;
+    head.store(h);
+    //wake up the writer thread if it sleeps on the empty ring buffer. As the store to head and the load of writer_waiting here and
+    // the corresponding operations in write_loop are sequentially consistent, either the writer thread sees the new head or
+    // this thread sees writer_waiting, so no wakeup is lost:
+    if(writer_waiting.load()){
+        boost::unique_lock<boost::mutex> lock(mutex);
+        cond.notify_all();
+    }
+}
+
+void async_database::write_loop(){
+    while(true){
+        const size_t t = tail.load(boost::memory_order_relaxed);
+        if(head.load() == t){
+            if(writer_stop.load()){
+                if(head.load() == t) return;
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            writer_waiting = true;
+            if(head.load() == t && !writer_stop.load()){
+                cond.wait(lock);
+            }
+            writer_waiting = false;
+            continue;
+        }
+        slot & s = slots[t & mask];
+        if(!writer_failed.load(boost::memory_order_relaxed)){
+            string error;
+            bool failed = true;
+            try{
+                write(s);
+                failed = false;
+            }
+            catch(Exception & ex){
+                error = ex.message;
+            }
+            catch(FatalException & ex){
+                error = ex.message;
+            }
+            catch(std::exception & ex){
+                error = ex.what();
+            }
+            catch(...){
+                error = "unknown exception";
+            }
+            if(failed){
+                if(error.empty()) error = "unknown error";
+                //keep on taking the rows out of the ring buffer, so the producer does not wait forever, but discard them:
+                boost::unique_lock<boost::mutex> lock(mutex);
+                writer_error = error;
+                writer_failed = true;
+            }
+        }
+        tail.store(t + 1);
+        if(producer_waiting.load()){
+            boost::unique_lock<boost::mutex> lock(mutex);
+            cond.notify_all();
+        }
+    }
+}
+
+void async_database::write(slot & s){
+    table_state & t = *s.table;
+    if(t.inner.get() == 0){
+        t.inner = database->create_table(t.name);
+        if(!t.autoinc_column.empty()) t.inner->set_autoinc_column(t.autoinc_column);
+        for(size_t i=0; i<t.columns.size(); ++i){
+            t.inner_columns.push_back(t.inner->add_column(t.columns[i].first, t.columns[i].second));
+        }
+    }
+    if(s.close){
+        t.inner.reset();
+        t.inner_columns.clear();
+        return;
+    }
+    Table & inner = *t.inner;
+    for(size_t i=0; i<s.cells.size(); ++i){
+        const cell & c = s.cells[i];
+        switch(c.type){
+            case typeDouble: inner.set_column(t.inner_columns[i], c.d); break;
+            case typeInt: inner.set_column(t.inner_columns[i], c.i); break;
+            case typeString: inner.set_column(t.inner_columns[i], c.s); break;
+            case typeHisto: inner.set_column(t.inner_columns[i], c.h); break;
+            default:; //NULL
+        }
+    }
+    inner.add_row();
+    ++n_rows;
+    const double latency = now() - s.time;
+    latency_sum += latency;
+    if(latency > latency_max) latency_max = latency;
+}
+
+void async_database::write_statistics(){
+    std::auto_ptr<Table> table = database->create_table(statistics_table);
+    std::auto_ptr<Column> c_rows = table->add_column("rows", typeInt);
+    std::auto_ptr<Column> c_max_queued = table->add_column("max_queued", typeInt);
+    std::auto_ptr<Column> c_n_blocked = table->add_column("n_blocked", typeInt);
+    std::auto_ptr<Column> c_blocked_time = table->add_column("blocked_time", typeDouble);
+    std::auto_ptr<Column> c_latency_mean = table->add_column("latency_mean", typeDouble);
+    std::auto_ptr<Column> c_latency_max = table->add_column("latency_max", typeDouble);
+    table->set_column(*c_rows, static_cast<int>(n_rows));
+    table->set_column(*c_max_queued, static_cast<int>(max_queued));
+    table->set_column(*c_n_blocked, static_cast<int>(n_blocked));
+    table->set_column(*c_blocked_time, blocked_time);
+    table->set_column(*c_latency_mean, n_rows > 0 ? latency_sum / n_rows : 0.0);
+    table->set_column(*c_latency_max, latency_max);
+    table->add_row();
+}
+
+async_database::async_table::async_table(table_state & state_, const boost::shared_ptr<async_database> & db_): Table(db_),
+    state(state_), db(db_), have_autoinc(false), have_rows(false), last_autoinc_id(0){
+}
+
+async_database::async_table::~async_table(){
+    try{
+        slot & s = db->acquire();
+        s.table = &state;
+        s.close = true;
+        s.time = now();
+        db->publish();
+    }
+    catch(Exception &){
+        //the error of the writer thread is reported by the async_database destructor
+    }
+}
+
+std::auto_ptr<Column> async_database::async_table::add_column(const std::string & name, const data_type & type){
+    if(have_rows) throw FatalException("async_table::add_column called after add_row");
+    if(type != typeDouble && type != typeInt && type != typeString && type != typeHisto){
+        throw InvalidArgumentException("Table::add_column: invalid type parameter given.");
+    }
+    state.columns.push_back(make_pair(name, type));
+    row.resize(state.columns.size());
+    return std::auto_ptr<Column>(new async_column(state.columns.size() - 1));
+}
+
+void async_database::async_table::set_autoinc_column(const std::string & name){
+    if(have_rows) throw FatalException("async_table::set_autoinc_column called after add_row");
+    if(have_autoinc) throw InvalidArgumentException("async_table::set_autoinc_column: already have an autoinc column");
+    have_autoinc = true;
+    state.autoinc_column = name;
+}
+
+void async_database::async_table::set_column(const Column & c, double d){
+    cell & value = row[static_cast<const async_column&>(c).index];
+    value.type = typeDouble;
+    value.d = d;
+}
+
+void async_database::async_table::set_column(const Column & c, int i){
+    cell & value = row[static_cast<const async_column&>(c).index];
+    value.type = typeInt;
+    value.i = i;
+}
+
+void async_database::async_table::set_column(const Column & c, const std::string & s){
+    cell & value = row[static_cast<const async_column&>(c).index];
+    value.type = typeString;
+    value.s = s;
+}
+
+void async_database::async_table::set_column(const Column & c, const Histogram & h){
+    cell & value = row[static_cast<const async_column&>(c).index];
+    value.type = typeHisto;
+    value.h = h;
+}
+
+int async_database::async_table::add_row(){
+    slot & s = db->acquire();
+    have_rows = true;
+    s.table = &state;
+    s.close = false;
+    s.cells.swap(row);
+    s.time = now();
+    db->publish();
+    //the cells swapped in from the slot are those of an earlier row, possibly of another table:
+    row.resize(state.columns.size());
+    for(size_t i=0; i<row.size(); ++i){
+        row[i].type = -1;
+    }
+    if(have_autoinc) return ++last_autoinc_id;
+    return 0;
+}
+
+REGISTER_PLUGIN(async_database)
@@ -0,0 +1,184 @@
+#ifndef PLUGIN_ASYNC_DATABASE_HPP
+#define PLUGIN_ASYNC_DATABASE_HPP
+
+#include "interface/decls.hpp"
+#include "interface/database.hpp"
+#include "interface/histogram.hpp"
+
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/** \brief Database which writes the rows of another Database in a separate thread
+ *
+ * Configured via a setting group like
+ * \code
+ * output_database = {
+ *   type = "async_database";
+ *   database = { type = "sqlite_database"; filename = "abc.db"; };
+ *   queue_size = 1024; // optional, default is 1024
+ *   statistics_table = "writer_statistics"; // optional, default is not to write statistics
+ * }
+ * \endcode
+ *
+ * \c type must always be "async_database" in order to select this plugin
+ *
+ * \c database is the definition of the Database the rows are actually written to. It can be any Database plugin.
+ *
+ * \c queue_size is the maximum number of rows (summed over all tables) which have been added but not yet written. It is rounded up to
+ *    the next power of two.
+ *
+ * \c statistics_table is the name of a table to create in \c database when closing, with one row containing the statistics of the writer
+ *    thread (see below).
+ *
+ * add_row does not call the Table of \c database but copies the values of the row into a slot of a fixed-size ring buffer and returns immediately.
+ * A writer thread takes the rows out of the ring buffer in the order they were added and writes them to \c database. So the event loop does not
+ * wait for the database backend, as long as the writer thread keeps up on average. Otherwise, add_row waits until
+ * the writer thread has written a row (backpressure), so that the memory use is bounded by \c queue_size rows.
+ *
+ * The ring buffer has a single producer and a single consumer and is lock-free, i.e., the producer and the writer thread only
+ * synchronize via two atomic indices as long as the ring buffer is neither full nor empty. The slots are re-used; values are
+ * swapped into the slots, so no memory is allocated in the steady state. As a consequence, all Tables of one async_database must be used from the same
+ * thread, which is the case for theta::Run.
+ *
+ * All calls to \c database and its Tables, including create_table and add_column, are made in the writer thread. Errors reported by
+ * \c database are thrown as DatabaseException by a later call to add_row, or written to standard error when closing. For a table with an autoinc column,
+ * add_row returns the ids 1, 2, 3, ...; this is also the numbering of all theta Database plugins.
+ *
+ * The statistics table has the integer columns 'rows', 'max_queued' (the maximum number of rows in the ring buffer) and 'n_blocked' (the number of add_row calls
+ * which had to wait for the writer thread) and the double columns 'blocked_time' (the total time add_row waited, in seconds),
+ * 'latency_mean' and 'latency_max' (the time between add_row and the completion of the add_row call of \c database, in seconds).
+ */
+class async_database: public theta::Database{
+public:
+
+    /** \brief Constructor for the plugin system
+     *
+     * See class documentation for a description of the Configuration settings.
+     */
+    async_database(const theta::plugin::Configuration & cfg);
+
+    /// Waits until all rows are written, stops the writer thread and closes \c database
+    virtual ~async_database();
+
+    /** \brief See documentation of Database::create_table
+     */
+    virtual std::auto_ptr<theta::Table> create_table(const std::string & table_name);
+
+private:
+    // a value of the row. type is a theta::data_type or -1 for NULL:
+    struct cell{
+        int type;
+        double d;
+        int i;
+        std::string s;
+        theta::Histogram h;
+        cell(): type(-1), d(0.0), i(0){}
+    };
+
+    // the definition of a table and its counterpart in database. The definition is written by the async_table
+    // before its first row is published; the inner table and columns are only used by the writer thread:
+    struct table_state{
+        std::string name;
+        std::vector<std::pair<std::string, theta::data_type> > columns;
+        std::string autoinc_column;
+        std::auto_ptr<theta::Table> inner;
+        boost::ptr_vector<theta::Column> inner_columns;
+    };
+
+    // a slot of the ring buffer: a row of table, or the request to close the table if close is true
+    struct slot{
+        table_state * table;
+        bool close;
+        std::vector<cell> cells;
+        double time;
+        slot(): table(0), close(false), time(0.0){}
+    };
+
+    // wait for a free slot. Throws a DatabaseException if the writer thread failed.
+    slot & acquire();
+    // pass the slot returned by acquire to the writer thread
+    void publish();
+
+    // the main loop of the writer thread
+    void write_loop();
+    // write the slot to database; called in the writer thread
+    void write(slot & s);
+    // write the statistics to the statistics table; called after the writer thread has finished
+    void write_statistics();
+
+    struct writer_task{
+        async_database * db;
+        explicit writer_task(async_database * db_): db(db_){}
+        void operator()(){
+            db->write_loop();
+        }
+    };
+
+    boost::shared_ptr<theta::Database> database;
+    std::string statistics_table;
+
+    // the ring buffer. Slot head & mask is written next by the producer, slot tail & mask is read next by the writer thread:
+    std::vector<slot> slots;
+    size_t mask;
+    boost::atomic<size_t> head, tail;
+
+    // for sleeping if the ring buffer is full (producer) or empty (writer thread). The sleeping thread sets its flag; the other thread
+    // notifies cond after changing head or tail if the flag is set:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    boost::atomic<bool> producer_waiting, writer_waiting, writer_stop, writer_failed;
+    std::string writer_error; // protected by mutex
+    boost::scoped_ptr<boost::thread> writer;
+
+    // all tables created so far; owned here, as the writer thread uses them after the async_table is destroyed:
+    boost::ptr_vector<table_state> tables;
+
+    // statistics; the first three are only used by the producer, the others by the writer thread:
+    size_t max_queued, n_blocked;
+    double blocked_time;
+    size_t n_rows;
+    double latency_sum, latency_max;
+
+    class async_table: public theta::Table {
+    friend class async_database;
+
+        // destructor; passes the request to close the table to the writer thread
+        virtual ~async_table();
+
+        virtual std::auto_ptr<theta::Column> add_column(const std::string & name, const theta::data_type & type);
+        virtual void set_autoinc_column(const std::string & name);
+
+        virtual void set_column(const theta::Column & c, double d);
+        virtual void set_column(const theta::Column & c, int i);
+        virtual void set_column(const theta::Column & c, const std::string & s);
+        virtual void set_column(const theta::Column & c, const theta::Histogram & h);
+        virtual int add_row();
+
+    private:
+        async_table(table_state & state_, const boost::shared_ptr<async_database> & db_);
+
+        table_state & state;
+        boost::shared_ptr<async_database> db;
+        // the values of the current row; swapped with the cells of the slot in add_row:
+        std::vector<cell> row;
+        bool have_autoinc, have_rows;
+        int last_autoinc_id;
+
+        class async_column: public theta::Column{
+        public:
+            size_t index;
+            async_column(size_t i): index(i){}
+            virtual ~async_column(){}
+        };
+    };
+};
+
+#endif
@@ -0,0 +1,512 @@
+#include "plugins/columnar_database.hpp"
+#include "interface/plugin.hpp"
+#include "interface/histogram.hpp"
+
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/filesystem.hpp>
+
+#include <sstream>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+using namespace theta;
+using boost::uint32_t;
+using boost::uint64_t;
+
+namespace{
+    const char magic[] = "THETACOL";
+    const size_t magic_size = 8;
+    const uint32_t format_version = 1;
+    const double nan_value = numeric_limits<double>::quiet_NaN();
+
+    template<typename T>
+    void put(string & out, const T & value){
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void put_string(string & out, const string & s){
+        put<uint32_t>(out, s.size());
+        out.append(s);
+    }
+
+    // reads the directory, checking that no data beyond end is accessed:
+    class reader{
+    public:
+        reader(const char * data_, const char * end_): data(data_), end(end_){}
+
+        template<typename T>
+        T get(){
+            check(sizeof(T));
+            T result;
+            memcpy(&result, data, sizeof(T));
+            data += sizeof(T);
+            return result;
+        }
+
+        string get_string(){
+            uint32_t size = get<uint32_t>();
+            check(size);
+            string result(data, size);
+            data += size;
+            return result;
+        }
+
+    private:
+        void check(size_t n){
+            if(static_cast<size_t>(end - data) < n) throw DatabaseException("columnar database: corrupt directory");
+        }
+        const char * data, * end;
+    };
+}
+
+namespace columnar{
+
+string encode(const string & raw, size_t data_begin, size_t element_size, bool compress){
+    string shuffled(raw);
+    if(element_size > 1){
+        const size_t n = (raw.size() - data_begin) / element_size;
+        const char * src = raw.data() + data_begin;
+        char * dest = &shuffled[data_begin];
+        for(size_t i=0; i<n; ++i){
+            for(size_t b=0; b<element_size; ++b){
+                dest[b * n + i] = src[i * element_size + b];
+            }
+        }
+    }
+    if(!compress) return shuffled;
+    string result;
+    {
+        boost::iostreams::filtering_ostream out;
+        out.push(boost::iostreams::zlib_compressor(boost::iostreams::zlib::best_speed));
+        out.push(boost::iostreams::back_inserter(result));
+        out.write(shuffled.data(), shuffled.size());
+    }
+    return result;
+}
+
+void decode(const char * data, size_t size, size_t raw_size, size_t data_begin, size_t element_size, bool compressed, string & raw){
+    string shuffled;
+    if(compressed){
+        shuffled.resize(raw_size);
+        try{
+            boost::iostreams::filtering_istream in;
+            in.push(boost::iostreams::zlib_decompressor());
+            in.push(boost::iostreams::array_source(data, size));
+            if(raw_size > 0) in.read(&shuffled[0], raw_size);
+            if(static_cast<size_t>(in.gcount()) != raw_size) throw DatabaseException("columnar database: corrupt column chunk");
+        }
+        catch(boost::iostreams::zlib_error & ex){
+            throw DatabaseException(string("columnar database: corrupt column chunk: ") + ex.what());
+        }
+    }
+    else{
+        if(size != raw_size) throw DatabaseException("columnar database: corrupt column chunk");
+        shuffled.assign(data, size);
+    }
+    raw = shuffled;
+    if(element_size > 1){
+        if(data_begin > raw_size) throw DatabaseException("columnar database: corrupt column chunk");
+        const size_t n = (raw_size - data_begin) / element_size;
+        const char * src = shuffled.data() + data_begin;
+        char * dest = &raw[data_begin];
+        for(size_t i=0; i<n; ++i){
+            for(size_t b=0; b<element_size; ++b){
+                dest[i * element_size + b] = src[b * n + i];
+            }
+        }
+    }
+}
+
+size_t element_size(int type){
+    switch(type){
+        case typeDouble: return sizeof(double);
+        case typeInt: return sizeof(int);
+        case typeHisto: return sizeof(double);
+        default: return 1;
+    }
+}
+
+// The directory consists of the format version, the compression flag (1 for zlib, 0 for none) and the number
+// of tables (as 4 byte integers), followed by for each table:
+//  - the table name (4 byte length + characters)
+//  - the number of chunks and the number of rows of each chunk (4 byte integers)
+//  - the number of columns, and for each column: the name, the type and width (4 byte integers), and for each chunk:
+//    the offset, size and raw_size (8 byte integers), has_nulls (4 byte integer), min and max (doubles)
+string write_directory(const vector<table_info> & tables, bool compressed){
+    string result;
+    put<uint32_t>(result, format_version);
+    put<uint32_t>(result, compressed ? 1 : 0);
+    put<uint32_t>(result, tables.size());
+    for(size_t i=0; i<tables.size(); ++i){
+        const table_info & t = tables[i];
+        put_string(result, t.name);
+        put<uint32_t>(result, t.chunk_rows.size());
+        for(size_t k=0; k<t.chunk_rows.size(); ++k){
+            put<uint32_t>(result, t.chunk_rows[k]);
+        }
+        put<uint32_t>(result, t.columns.size());
+        for(size_t j=0; j<t.columns.size(); ++j){
+            const column_info & c = t.columns[j];
+            put_string(result, c.name);
+            put<uint32_t>(result, c.type);
+            put<uint32_t>(result, c.width);
+            for(size_t k=0; k<c.chunks.size(); ++k){
+                put<uint64_t>(result, c.chunks[k].offset);
+                put<uint64_t>(result, c.chunks[k].size);
+                put<uint64_t>(result, c.chunks[k].raw_size);
+                put<uint32_t>(result, c.chunks[k].has_nulls);
+                put<double>(result, c.chunks[k].min);
+                put<double>(result, c.chunks[k].max);
+            }
+        }
+    }
+    return result;
+}
+
+void read_directory(const char * data, size_t size, vector<table_info> & tables, bool & compressed){
+    const size_t trailer_size = sizeof(uint64_t) + magic_size;
+    if(size < magic_size + trailer_size || memcmp(data, magic, magic_size) != 0 || memcmp(data + size - magic_size, magic, magic_size) != 0){
+        throw DatabaseException("columnar database: not a columnar database file or file incomplete");
+    }
+    uint64_t directory_offset;
+    memcpy(&directory_offset, data + size - trailer_size, sizeof(uint64_t));
+    if(directory_offset < magic_size || directory_offset > size - trailer_size){
+        throw DatabaseException("columnar database: corrupt directory offset");
+    }
+    reader r(data + directory_offset, data + size - trailer_size);
+    uint32_t version = r.get<uint32_t>();
+    if(version != format_version){
+        stringstream ss;
+        ss << "columnar database: unsupported format version " << version;
+        throw DatabaseException(ss.str());
+    }
+    compressed = r.get<uint32_t>() != 0;
+    tables.resize(r.get<uint32_t>());
+    for(size_t i=0; i<tables.size(); ++i){
+        table_info & t = tables[i];
+        t.name = r.get_string();
+        t.chunk_rows.resize(r.get<uint32_t>());
+        for(size_t k=0; k<t.chunk_rows.size(); ++k){
+            t.chunk_rows[k] = r.get<uint32_t>();
+        }
+        t.columns.resize(r.get<uint32_t>());
+        for(size_t j=0; j<t.columns.size(); ++j){
+            column_info & c = t.columns[j];
+            c.name = r.get_string();
+            c.type = r.get<uint32_t>();
+            c.width = r.get<uint32_t>();
+            c.chunks.resize(t.chunk_rows.size());
+            for(size_t k=0; k<c.chunks.size(); ++k){
+                c.chunks[k].offset = r.get<uint64_t>();
+                c.chunks[k].size = r.get<uint64_t>();
+                c.chunks[k].raw_size = r.get<uint64_t>();
+                c.chunks[k].has_nulls = r.get<uint32_t>();
+                c.chunks[k].min = r.get<double>();
+                c.chunks[k].max = r.get<double>();
+                if(c.chunks[k].offset < magic_size || c.chunks[k].offset + c.chunks[k].size > directory_offset){
+                    throw DatabaseException("columnar database: corrupt chunk offset in directory");
+                }
+            }
+        }
+    }
+}
+
+}
+
+
+columnar_database::columnar_database(const plugin::Configuration & cfg): file_offset(0), chunk_size(4096), compress(true), save_all_products(true){
+    filename = static_cast<string>(cfg.setting["filename"]);
+    if(cfg.setting.exists("products_data")){
+      try{
+         string s = cfg.setting["products_data"];
+         if(s=="*")save_all_products = true;
+         else throw ConfigurationException("products_data setting is a string but not '*'");
+      }
+      catch(libconfig::SettingTypeException & e){
+          save_all_products = false;
+          size_t n = cfg.setting["products_data"].size();
+          for(size_t i=0; i<n; ++i){
+              string column_name = cfg.setting["products_data"][i];
+              products_data.insert(column_name);
+              if(column_name=="*"){
+                 save_all_products = true;
+                 products_data.clear();
+                 break;
+              }
+          }
+          //if anything is written at all, also write runid and eventid:
+          if(products_data.size()){
+             products_data.insert("runid");
+             products_data.insert("eventid");
+          }
+      }
+    }
+    if(cfg.setting.exists("chunk_size")){
+        int cs = cfg.setting["chunk_size"];
+        if(cs <= 0){
+            throw ConfigurationException("columnar_database: chunk_size must be positive");
+        }
+        chunk_size = cs;
+    }
+    if(cfg.setting.exists("compression")){
+        string c = cfg.setting["compression"];
+        if(c == "none") compress = false;
+        else if(c != "zlib"){
+            throw ConfigurationException("columnar_database: invalid compression '" + c + "' (valid values are 'zlib' and 'none')");
+        }
+    }
+    if (boost::filesystem::exists(filename)) {
+        boost::filesystem::remove(filename);
+    }
+    file.open(filename.c_str(), ios::binary | ios::out | ios::trunc);
+    if(!file){
+        throw DatabaseException("columnar_database: could not open file '" + filename + "' for writing");
+    }
+    append(string(magic, magic_size));
+}
+
+columnar_database::~columnar_database(){
+    //write the directory, but do not throw on failure, just print it:
+    try{
+        uint64_t directory_offset = append(columnar::write_directory(tables, compress));
+        string trailer;
+        put<uint64_t>(trailer, directory_offset);
+        trailer.append(magic, magic_size);
+        append(trailer);
+        file.close();
+        if(!file){
+            throw DatabaseException("columnar_database: error closing file '" + filename + "'");
+        }
+    }
+    catch(Exception & e){
+        cerr << "Exception while closing database in destructor: " << e.message << endl << "Ingoring." << endl;
+    }
+}
+
+uint64_t columnar_database::append(const string & data){
+    uint64_t result = file_offset;
+    file.write(data.data(), data.size());
+    if(!file){
+        throw DatabaseException("columnar_database: error writing to file '" + filename + "'");
+    }
+    file_offset += data.size();
+    return result;
+}
+
+std::auto_ptr<Table> columnar_database::create_table(const string & table_name){
+    check_name(table_name);
+    columnar_table * result = new columnar_table(table_name, boost::dynamic_pointer_cast<columnar_database>(shared_from_this()));
+    if(table_name == "products"){
+        result->save_all_columns = save_all_products;
+        result->save_columns = products_data;
+    }
+    return std::auto_ptr<Table>(result);
+}
+
+
+columnar_database::columnar_table::column_buffer::column_buffer(data_type t): type(t), width(0), has_nulls(false), is_set(false){}
+
+columnar_database::columnar_table::columnar_table(const string & name_, const boost::shared_ptr<columnar_database> & db_): Table(db_),
+    name(name_), autoinc_index(-1), last_autoinc_id(0), nrows(0), table_index(0), table_created(false), db(db_), save_all_columns(true){
+}
+
+std::auto_ptr<Column> columnar_database::columnar_table::add_column(const std::string & name, const data_type & type){
+    if(table_created) throw FatalException("columnar_table::add_column called after table already created (via call to set_column / add_row).");
+    if(!save_all_columns && save_columns.find(name) == save_columns.end()) return std::auto_ptr<Column>(new columnar_column(-1));
+    if(type != typeDouble && type != typeInt && type != typeString && type != typeHisto){
+        throw InvalidArgumentException("Table::add_column: invalid type parameter given.");
+    }
+    buffers.push_back(column_buffer(type));
+    column_names.push_back(name);
+    return std::auto_ptr<Column>(new columnar_column(buffers.size() - 1));
+}
+
+void columnar_database::columnar_table::set_autoinc_column(const std::string & name){
+    if(table_created) throw FatalException("columnar_table::add_column called after table already created (via call to set_column / add_row).");
+    if(autoinc_index >= 0)
+         throw InvalidArgumentException("columnar_database::add_column: tried to add more than one Column of type typeAutoIncrement");
+    buffers.push_back(column_buffer(typeInt));
+    column_names.push_back(name);
+    autoinc_index = buffers.size() - 1;
+}
+
+void columnar_database::columnar_table::create_table(){
+    table_index = db->tables.size();
+    db->tables.push_back(columnar::table_info());
+    columnar::table_info & t = db->tables.back();
+    t.name = name;
+    t.columns.resize(buffers.size());
+    for(size_t i=0; i<buffers.size(); ++i){
+        t.columns[i].name = column_names[i];
+        t.columns[i].type = buffers[i].type;
+        t.columns[i].width = buffers[i].width;
+    }
+    table_created = true;
+}
+
+columnar_database::columnar_table::~columnar_table(){
+    try{
+        if(not table_created) create_table();
+        if(nrows > 0) write_chunk();
+    }
+    catch(Exception & e){
+        cerr << "Exception while writing table '" << name << "' in destructor: " << e.message << endl;
+    }
+}
+
+void columnar_database::columnar_table::set_column(const Column & c, double d){
+    if(not table_created) create_table();
+    int index = static_cast<const columnar_column&>(c).index;
+    if(index < 0) return;
+    column_buffer & b = buffers[index];
+    if(b.is_set) memcpy(&b.values[nrows * sizeof(double)], &d, sizeof(double));
+    else put<double>(b.values, d);
+    b.is_set = true;
+}
+
+void columnar_database::columnar_table::set_column(const Column & c, int i){
+    if(not table_created) create_table();
+    int index = static_cast<const columnar_column&>(c).index;
+    if(index < 0) return;
+    column_buffer & b = buffers[index];
+    if(b.is_set) memcpy(&b.values[nrows * sizeof(int)], &i, sizeof(int));
+    else put<int>(b.values, i);
+    b.is_set = true;
+}
+
+void columnar_database::columnar_table::set_column(const Column & c, const std::string & s){
+    if(not table_created) create_table();
+    int index = static_cast<const columnar_column&>(c).index;
+    if(index < 0) return;
+    column_buffer & b = buffers[index];
+    if(!b.is_set) b.strings.push_back(string());
+    b.strings.back() = s;
+    b.is_set = true;
+}
+
+void columnar_database::columnar_table::set_column(const Column & c, const theta::Histogram & h){
+    if(not table_created) create_table();
+    int index = static_cast<const columnar_column&>(c).index;
+    if(index < 0) return;
+    column_buffer & b = buffers[index];
+    const uint32_t width = h.get_nbins() + 4;
+    if(b.width == 0){
+        //the first histogram in this column; fill the NULL rows of this chunk so far with NAN:
+        b.width = width;
+        db->tables[table_index].columns[index].width = width;
+        b.values.clear();
+        for(size_t i=0; i < nrows * width; ++i){
+            put<double>(b.values, nan_value);
+        }
+    }
+    else if(width != b.width){
+        stringstream ss;
+        ss << "columnar_database: Histograms of column '" << column_names[index] << "' must have the same number of bins, but got "
+           << h.get_nbins() << " instead of " << (b.width - 4);
+        throw DatabaseException(ss.str());
+    }
+    if(!b.is_set) b.values.resize(b.values.size() + width * sizeof(double));
+    double * dest = reinterpret_cast<double*>(&b.values[nrows * width * sizeof(double)]);
+    dest[0] = h.get_xmin();
+    dest[1] = h.get_xmax();
+    std::copy(h.getData(), h.getData() + h.get_nbins() + 2, dest + 2);
+    b.is_set = true;
+}
+
+void columnar_database::columnar_table::append_null(column_buffer & b){
+    b.has_nulls = true;
+    switch(b.type){
+        case typeDouble: put<double>(b.values, nan_value); break;
+        case typeInt: put<int>(b.values, 0); break;
+        case typeString: b.strings.push_back(string()); break;
+        case typeHisto:
+            for(size_t i=0; i<b.width; ++i){
+                put<double>(b.values, nan_value);
+            }
+            break;
+    }
+}
+
+int columnar_database::columnar_table::add_row(){
+    if(not table_created) create_table();
+    if(autoinc_index >= 0){
+        column_buffer & b = buffers[autoinc_index];
+        put<int>(b.values, ++last_autoinc_id);
+        b.is_set = true;
+    }
+    for(size_t i=0; i<buffers.size(); ++i){
+        column_buffer & b = buffers[i];
+        if(!b.is_set) append_null(b);
+        b.valid.push_back(b.is_set ? 1 : 0);
+        b.is_set = false;
+    }
+    ++nrows;
+    if(nrows >= db->chunk_size){
+        write_chunk();
+    }
+    return autoinc_index >= 0 ? last_autoinc_id : 0;
+}
+
+void columnar_database::columnar_table::write_chunk(){
+    string raw;
+    vector<columnar::chunk_info> infos(buffers.size());
+    for(size_t i=0; i<buffers.size(); ++i){
+        column_buffer & b = buffers[i];
+        columnar::chunk_info & info = infos[i];
+        info.has_nulls = b.has_nulls ? 1 : 0;
+        info.min = info.max = nan_value;
+        //statistics for the non-NULL values:
+        if(b.type == typeDouble || b.type == typeInt){
+            for(size_t k=0; k<nrows; ++k){
+                if(!b.valid[k]) continue;
+                double value;
+                if(b.type == typeDouble) memcpy(&value, &b.values[k * sizeof(double)], sizeof(double));
+                else{
+                    int ivalue;
+                    memcpy(&ivalue, &b.values[k * sizeof(int)], sizeof(int));
+                    value = ivalue;
+                }
+                if(std::isnan(value)) continue;
+                if(!(value >= info.min)) info.min = value;
+                if(!(value <= info.max)) info.max = value;
+            }
+        }
+        raw.clear();
+        if(b.has_nulls) raw.append(b.valid.begin(), b.valid.end());
+        if(b.type == typeString){
+            for(size_t k=0; k<nrows; ++k){
+                put<uint32_t>(raw, b.strings[k].size());
+            }
+            for(size_t k=0; k<nrows; ++k){
+                raw.append(b.strings[k]);
+            }
+        }
+        else{
+            raw.append(b.values);
+        }
+        const size_t data_begin = b.has_nulls ? nrows : 0;
+        string data = columnar::encode(raw, data_begin, columnar::element_size(b.type), db->compress);
+        info.offset = db->append(data);
+        info.size = data.size();
+        info.raw_size = raw.size();
+    }
+    //the directory is only changed after all columns have been written:
+    columnar::table_info & t = db->tables[table_index];
+    for(size_t i=0; i<buffers.size(); ++i){
+        t.columns[i].chunks.push_back(infos[i]);
+        column_buffer & b = buffers[i];
+        b.values.clear();
+        b.strings.clear();
+        b.valid.clear();
+        b.has_nulls = false;
+    }
+    t.chunk_rows.push_back(nrows);
+    nrows = 0;
+}
+
+REGISTER_PLUGIN(columnar_database)
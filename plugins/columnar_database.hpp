@@ -0,0 +1,221 @@
+#ifndef PLUGIN_COLUMNAR_DATABASE_HPP
+#define PLUGIN_COLUMNAR_DATABASE_HPP
+
+#include "interface/decls.hpp"
+#include "interface/database.hpp"
+
+#include <boost/cstdint.hpp>
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <set>
+
+namespace columnar{
+
+/** \brief Directory entry of one column chunk in a columnar database file
+ *
+ * See columnar_database for a description of the file format.
+ */
+struct chunk_info{
+    /// the position of the (compressed) data in the file and its size
+    boost::uint64_t offset, size;
+    /// the size of the data after decompression
+    boost::uint64_t raw_size;
+    /// whether the chunk contains NULL values, i.e., starts with the validity bytes
+    boost::uint32_t has_nulls;
+    /// minimum and maximum of the non-NULL values for typeDouble and typeInt columns; NAN otherwise
+    double min, max;
+};
+
+/// Directory entry of a column in a columnar database file
+struct column_info{
+    std::string name;
+    /// the theta::data_type
+    boost::uint32_t type;
+    /// number of doubles per value for typeHisto columns (nbins + 4); 0 if not known yet, i.e., if all values are NULL
+    boost::uint32_t width;
+    /// one entry per chunk of the table
+    std::vector<chunk_info> chunks;
+};
+
+/// Directory entry of a table in a columnar database file
+struct table_info{
+    std::string name;
+    /// the number of rows in each chunk
+    std::vector<boost::uint32_t> chunk_rows;
+    std::vector<column_info> columns;
+};
+
+/** \brief Encode the raw data of a column chunk
+ *
+ * Shuffles the bytes of values with \c element_size bytes, i.e., writes the first bytes of all values, then the second bytes, etc., starting
+ * at \c data_begin. This makes the data much better compressible, as the exponent and high mantissa bytes of similar values are
+ * mostly equal. If \c compress is true, the result is compressed with zlib.
+ */
+std::string encode(const std::string & raw, size_t data_begin, size_t element_size, bool compress);
+
+/** \brief Decode a column chunk written by encode
+ *
+ * \c raw_size is the size of the raw data, as given to encode. Throws a DatabaseException in case of corrupt data.
+ */
+void decode(const char * data, size_t size, size_t raw_size, size_t data_begin, size_t element_size, bool compressed, std::string & raw);
+
+/// The element size used to shuffle the values of a column of theta::data_type \c type
+size_t element_size(int type);
+
+/// Write the directory in the format documented in columnar_database
+std::string write_directory(const std::vector<table_info> & tables, bool compressed);
+
+/** \brief Read the directory from the file contents \c data of size \c size
+ *
+ * Throws a DatabaseException if the file is not a columnar database file or it is corrupt.
+ */
+void read_directory(const char * data, size_t size, std::vector<table_info> & tables, bool & compressed);
+
+}
+
+/** \brief Database which stores tables column by column in a single binary file
+ *
+ * Configured via a setting group like
+ * \code
+ * output_database = {
+ *   type = "columnar_database";
+ *   filename = "abc.thc";
+ *   products_data = ("deltanll__nll_sb"); // optional, default is '*'
+ *   chunk_size = 4096; // optional, default is 4096
+ *   compression = "zlib"; // optional, default is "zlib"
+ * }
+ * \endcode
+ *
+ * \c type must always be "columnar_database" in order to select this plugin
+ *
+ * \c filename is the filename of the output file. It is a path relative to the path where theta is invoked. If the file
+ *    already exists, it is overwritten silently.
+ *
+ * \c products_data is a list of column names to save, as for \link sqlite_database sqlite_database \endlink.
+ *
+ * \c chunk_size is the number of rows per chunk, see below.
+ *
+ * \c compression is either "zlib" or "none".
+ *
+ * As opposed to sqlite_database, which stores the tables row by row, the rows of a table are split into chunks of \c chunk_size rows
+ * and, within a chunk, the values of each column are stored contiguously and compressed independently of the other columns. So reading a
+ * few columns of a table with many columns only reads a small fraction of the file. Use \link columnar_database_in columnar_database_in \endlink
+ * to read the file.
+ *
+ * The values of a column chunk are written as follows, in native byte order (i.e., little-endian on all supported platforms):
+ * <ul>
+ *   <li>typeDouble: 8 bytes per value</li>
+ *   <li>typeInt: 4 bytes per value</li>
+ *   <li>typeHisto: nbins + 4 doubles per value: the lower and upper border and the raw histogram data, including underflow and overflow bin,
+ *       as in the BLOB of sqlite_database. All histograms of a column must have the same number of bins, so the values are a
+ *       contiguous array with fixed width.</li>
+ *   <li>typeString: the lengths of all strings as 4 byte integers, followed by the concatenated strings</li>
+ * </ul>
+ * If a column chunk has NULL values, i.e., rows for which set_column has not been called for this column, the values are preceded by one byte per
+ * row which is 1 for rows with a value and 0 for NULL. The values of NULL rows are NAN for typeDouble and typeHisto, 0 for typeInt and
+ * the empty string for typeString.
+ * Then, the bytes of the values are shuffled (see columnar::encode) and the result is compressed with zlib, using the fastest compression level.
+ *
+ * The file starts with the 8 bytes "THETACOL" and ends with the directory, followed by the file offset of the directory
+ * as 8 byte integer and "THETACOL". The directory contains for each table its name, the number of rows per chunk and for each column
+ * the name, type, width and for each chunk the file offset, the compressed and uncompressed size and the minimum and maximum value
+ * (for typeDouble and typeInt only; NAN otherwise). See columnar::write_directory for details.
+ *
+ * The file is only complete after the database has been closed at the end of the run.
+ */
+class columnar_database: public theta::Database{
+public:
+
+    /** \brief Constructor for the plugin system
+     *
+     * See class documentation for a description of the Configuration settings.
+     */
+    columnar_database(const theta::plugin::Configuration & cfg);
+
+    /// Writes the directory and closes the file
+    virtual ~columnar_database();
+
+    /** \brief See documentation of Database::create_table
+     */
+    virtual std::auto_ptr<theta::Table> create_table(const std::string & table_name);
+
+private:
+    // append data to the file, returning the file offset
+    boost::uint64_t append(const std::string & data);
+
+    std::string filename;
+    std::ofstream file;
+    boost::uint64_t file_offset;
+    size_t chunk_size;
+    bool compress;
+    bool save_all_products;
+    std::set<std::string> products_data;
+
+    // the directory; tables add their entry at creation and update it whenever they write a chunk:
+    std::vector<columnar::table_info> tables;
+
+    class columnar_table: public theta::Table {
+    friend class columnar_database;
+
+        // destructor; writes the remaining rows
+        virtual ~columnar_table();
+
+        virtual std::auto_ptr<theta::Column> add_column(const std::string & name, const theta::data_type & type);
+        virtual void set_autoinc_column(const std::string & name);
+
+        virtual void set_column(const theta::Column & c, double d);
+        virtual void set_column(const theta::Column & c, int i);
+        virtual void set_column(const theta::Column & c, const std::string & s);
+        virtual void set_column(const theta::Column & c, const theta::Histogram & h);
+        virtual int add_row();
+
+    private:
+        columnar_table(const std::string & name_, const boost::shared_ptr<columnar_database> & db_);
+
+        // add the table to the directory of db
+        void create_table();
+
+        // encode and write the buffered rows as one chunk
+        void write_chunk();
+
+        // the values of the current chunk of one column, see class documentation for the layout of values:
+        struct column_buffer{
+            theta::data_type type;
+            boost::uint32_t width;
+            std::string values; // the raw values for all types except typeString
+            std::vector<std::string> strings; // the values for typeString
+            std::vector<char> valid;
+            bool has_nulls;
+            // whether the value of the current row has been set:
+            bool is_set;
+            column_buffer(theta::data_type t);
+        };
+
+        // append a NULL value for the current row
+        void append_null(column_buffer & b);
+
+        std::string name;
+        std::vector<column_buffer> buffers;
+        std::vector<std::string> column_names;
+        int autoinc_index, last_autoinc_id;
+        size_t nrows; // number of rows in the buffers
+        size_t table_index; // index in db->tables
+        bool table_created;
+        boost::shared_ptr<columnar_database> db;
+
+        bool save_all_columns;
+        std::set<std::string> save_columns;
+
+        class columnar_column: public theta::Column{
+        public:
+            int index;
+            columnar_column(int i): index(i){}
+            virtual ~columnar_column(){}
+        };
+    };
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include "plugins/columnar_database_in.hpp"
+#include "interface/plugin.hpp"
+#include "interface/histogram.hpp"
+
+#include <boost/filesystem.hpp>
+
+#include <sstream>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+using namespace theta;
+using namespace std;
+
+columnar_database_in::columnar_database_in(const theta::plugin::Configuration & cfg){
+    if(cfg.setting.exists("filename") && cfg.setting.exists("filenames")) throw ConfigurationException("both 'filename' and 'filenames' given");
+    vector<string> filenames;
+    if(cfg.setting.exists("filename")){
+        filenames.push_back(cfg.replace_theta_dir(cfg.setting["filename"]));
+    }
+    else{
+        size_t n_files = cfg.setting["filenames"].size();
+        if(n_files == 0) throw ConfigurationException("'filenames' is empty");
+        for(size_t i=0; i<n_files; ++i){
+            filenames.push_back(cfg.replace_theta_dir(cfg.setting["filenames"][i]));
+        }
+    }
+    files.resize(filenames.size());
+    for(size_t i=0; i<filenames.size(); ++i){
+        if(!boost::filesystem::exists(filenames[i])){
+            throw ConfigurationException("file '" + filenames[i] + "' does not exist");
+        }
+        try{
+            files[i].data.reset(new boost::iostreams::mapped_file_source(filenames[i]));
+        }
+        catch(std::exception & ex){
+            throw DatabaseException("could not open file " + filenames[i] + ": " + ex.what());
+        }
+        try{
+            columnar::read_directory(files[i].data->data(), files[i].data->size(), files[i].tables, files[i].compressed);
+        }
+        catch(Exception & ex){
+            ex.message = "file " + filenames[i] + ": " + ex.message;
+            throw;
+        }
+    }
+}
+
+const columnar::table_info & columnar_database_in::get_table(size_t i, const string & table_name) const{
+    for(size_t j=0; j<files[i].tables.size(); ++j){
+        if(files[i].tables[j].name == table_name) return files[i].tables[j];
+    }
+    throw DatabaseException("columnar_database_in: table '" + table_name + "' does not exist");
+}
+
+std::auto_ptr<DatabaseInput::ResultIterator> columnar_database_in::query(const std::string & table_name, const std::vector<std::string> & column_names){
+    return std::auto_ptr<ResultIterator>(new ColumnarResultIterator(*this, table_name, column_names));
+}
+
+void columnar_database_in::get_range(const string & table_name, const string & column_name, double & min, double & max) const{
+    min = max = numeric_limits<double>::quiet_NaN();
+    for(size_t i=0; i<files.size(); ++i){
+        const columnar::table_info & t = get_table(i, table_name);
+        bool found = false;
+        for(size_t j=0; j<t.columns.size(); ++j){
+            if(t.columns[j].name != column_name) continue;
+            found = true;
+            for(size_t k=0; k<t.columns[j].chunks.size(); ++k){
+                const columnar::chunk_info & c = t.columns[j].chunks[k];
+                if(!(c.min >= min)) min = c.min;
+                if(!(c.max <= max)) max = c.max;
+            }
+        }
+        if(!found) throw DatabaseException("columnar_database_in: column '" + column_name + "' does not exist in table '" + table_name + "'");
+    }
+}
+
+
+columnar_database_in::ColumnarResultIterator::ColumnarResultIterator(const columnar_database_in & db_, const string & table_name_,
+        const vector<string> & column_names_): db(db_), table_name(table_name_), column_names(column_names_), has_data_(true),
+        ifile(0), ichunk(0), irow(0), nrows(0), table(0), columns(column_names_.size()), raw(column_names_.size()),
+        data_begin(column_names_.size()), width(column_names_.size()), string_begin(column_names_.size()){
+    for(size_t i=0; i<column_names.size(); ++i){
+        if(column_names[i]==""){
+            throw DatabaseException("columnar_database_in::query: got empty column name. This is not allowed.");
+        }
+    }
+    seek();
+}
+
+void columnar_database_in::ColumnarResultIterator::start_file(){
+    table = &db.get_table(ifile, table_name);
+    for(size_t i=0; i<column_names.size(); ++i){
+        columns[i] = 0;
+        for(size_t j=0; j<table->columns.size(); ++j){
+            if(table->columns[j].name == column_names[i]){
+                columns[i] = &table->columns[j];
+                break;
+            }
+        }
+        if(columns[i] == 0){
+            throw DatabaseException("columnar_database_in: column '" + column_names[i] + "' does not exist in table '" + table_name + "'");
+        }
+    }
+}
+
+void columnar_database_in::ColumnarResultIterator::seek(){
+    while(ifile < db.files.size()){
+        if(table == 0) start_file();
+        if(ichunk < table->chunk_rows.size()){
+            if(table->chunk_rows[ichunk] > 0){
+                load_chunk();
+                irow = 0;
+                return;
+            }
+            ++ichunk;
+            continue;
+        }
+        ++ifile;
+        ichunk = 0;
+        table = 0;
+    }
+    has_data_ = false;
+}
+
+void columnar_database_in::ColumnarResultIterator::load_chunk(){
+    nrows = table->chunk_rows[ichunk];
+    const file & f = db.files[ifile];
+    for(size_t i=0; i<columns.size(); ++i){
+        const columnar::column_info & col = *columns[i];
+        const columnar::chunk_info & c = col.chunks[ichunk];
+        data_begin[i] = c.has_nulls ? nrows : 0;
+        columnar::decode(f.data->data() + c.offset, c.size, c.raw_size, data_begin[i], columnar::element_size(col.type), f.compressed, raw[i]);
+        const size_t n_values = raw[i].size() - std::min(raw[i].size(), data_begin[i]);
+        bool ok = raw[i].size() >= data_begin[i];
+        switch(col.type){
+            case typeDouble: ok = ok && n_values == nrows * sizeof(double); break;
+            case typeInt: ok = ok && n_values == nrows * sizeof(int); break;
+            case typeHisto:
+                //the width is zero for chunks before the first non-NULL histogram:
+                width[i] = n_values / (nrows * sizeof(double));
+                ok = ok && n_values == width[i] * nrows * sizeof(double);
+                break;
+            case typeString:{
+                ok = ok && n_values >= nrows * sizeof(boost::uint32_t);
+                if(!ok) break;
+                vector<size_t> & begin = string_begin[i];
+                begin.resize(nrows + 1);
+                begin[0] = data_begin[i] + nrows * sizeof(boost::uint32_t);
+                for(size_t k=0; k<nrows; ++k){
+                    boost::uint32_t length;
+                    memcpy(&length, &raw[i][data_begin[i] + k * sizeof(boost::uint32_t)], sizeof(boost::uint32_t));
+                    begin[k+1] = begin[k] + length;
+                }
+                ok = begin[nrows] == raw[i].size();
+                break;
+            }
+            default: ok = false;
+        }
+        if(!ok){
+            throw DatabaseException("columnar_database_in: corrupt chunk of column '" + col.name + "' in table '" + table_name + "'");
+        }
+    }
+}
+
+void columnar_database_in::ColumnarResultIterator::operator++(){
+    if(!has_data_) return;
+    ++irow;
+    if(irow < nrows) return;
+    ++ichunk;
+    seek();
+}
+
+void columnar_database_in::ColumnarResultIterator::check(size_t icol, data_type type, const char * type_name){
+    if(columns[icol]->type != static_cast<boost::uint32_t>(type)){
+        throw DatabaseException(string("column type mismatch: asked for ") + type_name + " but column '" + column_names[icol] + "' has another type");
+    }
+    if(data_begin[icol] > 0 && raw[icol][irow] == 0){
+        throw DatabaseException("column '" + column_names[icol] + "' is NULL");
+    }
+}
+
+double columnar_database_in::ColumnarResultIterator::get_double(size_t icol){
+    check(icol, typeDouble, "double");
+    double result;
+    memcpy(&result, &raw[icol][data_begin[icol] + irow * sizeof(double)], sizeof(double));
+    return result;
+}
+
+int columnar_database_in::ColumnarResultIterator::get_int(size_t icol){
+    check(icol, typeInt, "int");
+    int result;
+    memcpy(&result, &raw[icol][data_begin[icol] + irow * sizeof(int)], sizeof(int));
+    return result;
+}
+
+std::string columnar_database_in::ColumnarResultIterator::get_string(size_t icol){
+    check(icol, typeString, "string");
+    const vector<size_t> & begin = string_begin[icol];
+    return raw[icol].substr(begin[irow], begin[irow+1] - begin[irow]);
+}
+
+theta::Histogram columnar_database_in::ColumnarResultIterator::get_histogram(size_t icol){
+    check(icol, typeHisto, "Histogram");
+    if(width[icol] < 5) throw DatabaseException("illegal Histogram value: nbins <= 0");
+    const size_t nbins = width[icol] - 4;
+    const char * data = &raw[icol][data_begin[icol] + irow * width[icol] * sizeof(double)];
+    double range[2];
+    memcpy(range, data, sizeof(range));
+    if(range[0] >= range[1]) throw DatabaseException("illegal Histogram value: xmin >= xmax");
+    Histogram result(nbins, range[0], range[1]);
+    memcpy(result.getData(), data + sizeof(range), (nbins + 2) * sizeof(double));
+    return result;
+}
+
+REGISTER_PLUGIN(columnar_database_in)
@@ -0,0 +1,96 @@
+#ifndef PLUGINS_COLUMNAR_DATABASE_IN_HPP
+#define PLUGINS_COLUMNAR_DATABASE_IN_HPP
+
+#include "interface/decls.hpp"
+#include "interface/database.hpp"
+#include "plugins/columnar_database.hpp"
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+#include <string>
+
+/** \brief Database class to read data from a file written by columnar_database
+ *
+ * Configured via a setting like
+ * \code
+ *  input_database = {
+ *     type = "columnar_database_in";
+ *     filename = "in.thc";
+ *     //alternatively: filenames = ("in1.thc", "in2.thc", "in3.thc");
+ *  };
+ * \endcode
+ *
+ * Exactly one of the settings \c filename and \c filenames must be given. If more than one file is given, the query result
+ * contains the rows of the table in all files, in the order of the files.
+ *
+ * The files are memory-mapped and a query only decompresses the chunks of the requested columns, one chunk at a time, so
+ * the time and memory to read a few columns do not depend on the number of other columns in the table.
+ *
+ * Calling a get_* method of the ResultIterator for a column with another type or for a NULL value throws a DatabaseException.
+ */
+class columnar_database_in: public theta::DatabaseInput{
+public:
+    /// Constructor used by the plugin system to build an instance given the configuration
+    columnar_database_in(const theta::plugin::Configuration & cfg);
+
+    virtual std::auto_ptr<ResultIterator> query(const std::string & table_name, const std::vector<std::string> & column_names);
+
+    /** \brief The range of values of a column from the chunk statistics
+     *
+     * Sets \c min and \c max to the minimum and maximum of the non-NULL values in the column \c column_name of table \c table_name
+     * in all files. This only reads the directory, not the data. The values are NAN if the column type is neither typeDouble nor typeInt
+     * or if the column has no non-NULL values.
+     */
+    void get_range(const std::string & table_name, const std::string & column_name, double & min, double & max) const;
+
+private:
+    struct file{
+        boost::shared_ptr<boost::iostreams::mapped_file_source> data;
+        std::vector<columnar::table_info> tables;
+        bool compressed;
+    };
+    std::vector<file> files;
+
+    // the table table_name in files[i]; throws a DatabaseException if it does not exist
+    const columnar::table_info & get_table(size_t i, const std::string & table_name) const;
+
+    class ColumnarResultIterator: public DatabaseInput::ResultIterator{
+    public:
+        ColumnarResultIterator(const columnar_database_in & db_, const std::string & table_name_, const std::vector<std::string> & column_names_);
+        bool has_data(){
+            return has_data_;
+        }
+        virtual void operator++();
+        double get_double(size_t icol);
+        int get_int(size_t icol);
+        std::string get_string(size_t icol);
+        theta::Histogram get_histogram(size_t icol);
+
+    private:
+        // set up the columns of the table in the current file
+        void start_file();
+        // go to the first row of chunk ichunk in file ifile or, if it is empty, the next non-empty chunk
+        void seek();
+        // decode the current chunk of all requested columns
+        void load_chunk();
+        // check the type of column icol and that the current row is not NULL
+        void check(size_t icol, theta::data_type type, const char * type_name);
+
+        const columnar_database_in & db;
+        std::string table_name;
+        std::vector<std::string> column_names;
+        bool has_data_;
+        size_t ifile, ichunk, irow, nrows;
+        const columnar::table_info * table;
+        // per requested column: the column in table, the decoded chunk, the begin of the values in the chunk,
+        // the width of histograms in the chunk and the begin of the strings:
+        std::vector<const columnar::column_info *> columns;
+        std::vector<std::string> raw;
+        std::vector<size_t> data_begin, width;
+        std::vector<std::vector<size_t> > string_begin;
+    };
+};
+
+#endif
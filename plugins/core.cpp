@@ -438,6 +438,7 @@ mult::mult(const Configuration & cfg){
         par_ids.insert(pid);
         v_pids.push_back(pid);
     }
+    v_layout = ParLayout(par_ids, v_pids);
 }
 
 double mult::operator()(const ParValues & v) const{
@@ -448,6 +449,32 @@ double mult::operator()(const ParValues & v) const{
     return result;
 }
 
+double mult::eval_dense(const double * x, const size_t * offsets) const{
+    double result = 1.0;
+    const size_t n = v_layout.size();
+    for(size_t i=0; i<n; ++i){
+        result *= x[offsets[v_layout[i]]];
+    }
+    return result;
+}
+
+double mult::eval_withDerivatives(const ParValues & v, ParValues & derivatives) const{
+    const size_t n = v_pids.size();
+    for(size_t i=0; i<n; ++i){
+        derivatives.set(v_pids[i], 0.0);
+    }
+    //the derivative w.r.t. factor i is the product of all other factors. Do not divide
+    // the total product by the factor i, as it might be zero:
+    for(size_t i=0; i<n; ++i){
+        double d = 1.0;
+        for(size_t j=0; j<n; ++j){
+            if(j!=i) d *= v.get(v_pids[j]);
+        }
+        derivatives.addTo(v_pids[i], d);
+    }
+    return operator()(v);
+}
+
 //product_distribution
 
 void product_distribution::add_distributions(const Configuration & cfg, const theta::SettingWrapper & s, int depth){
@@ -505,6 +532,13 @@ double product_distribution::evalNL_withDerivatives(const ParValues & values, Pa
     return result;
 }
 
+bool product_distribution::provides_derivatives() const{
+    const boost::ptr_vector<Distribution>::const_iterator end = distributions.end();
+    for (boost::ptr_vector<Distribution>::const_iterator it = distributions.begin(); it != end; ++it) {
+        if(!it->provides_derivatives()) return false;
+    }
+    return true;
+}
 
 const std::pair<double, double> & product_distribution::support(const ParId & p) const{
     map<ParId, size_t>::const_iterator it = parid_to_index.find(p);
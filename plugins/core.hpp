@@ -339,9 +339,16 @@ public:
      * See documentation of Function for their meaning.
      */
     virtual double operator()(const theta::ParValues & v) const;
+    virtual double eval_dense(const double * x, const size_t * offsets) const;
+    virtual double eval_withDerivatives(const theta::ParValues & v, theta::ParValues & derivatives) const;
+    virtual bool provides_derivatives() const{
+        return true;
+    }
     
 private:
     std::vector<theta::ParId> v_pids;
+    //the index of v_pids[i] in par_ids:
+    theta::ParLayout v_layout;
 };
 
 /** \brief A Distribution product of other distributions
@@ -377,6 +384,9 @@ public:
     virtual const std::pair<double, double> & support(const theta::ParId & p) const;
     //@}
 
+    /// Returns true only if all component distributions provide derivatives
+    virtual bool provides_derivatives() const;
+
 private:
     void add_distributions(const theta::plugin::Configuration & cfg, const theta::SettingWrapper & s, int depth);
     
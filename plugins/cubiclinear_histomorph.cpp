@@ -4,31 +4,72 @@ using namespace std;
 using namespace theta;
 using namespace theta::plugin;
 
+void cubiclinear_histomorph::add_morph(size_t isys, double delta) const{
+    if(delta==0.0) return;
+    //linear extrpolation beyond 1 sigma:
+    if(fabs(delta) > 1){
+        const Histogram & t_sys = delta > 0 ? hplus_diff[isys] : hminus_diff[isys];
+        h.add_with_coeff(fabs(delta), t_sys);
+    }
+    else{
+        //cubic interpolation:
+        diff_total = diff[isys];
+        diff_total *= 0.5 * delta;
+        diff_total.add_with_coeff(delta * delta - 0.5 * pow(fabs(delta), 3), sum[isys]);
+        h += diff_total;
+    }
+}
+
+void cubiclinear_histomorph::truncate() const{
+    for(size_t i=1; i<=h.get_nbins(); ++i){
+       h.set(i, max(h.get(i), 0.0));
+    }
+    h.set(0,0);
+    h.set(h.get_nbins() + 1,0);
+}
+
 const Histogram & cubiclinear_histomorph::operator()(const ParValues & values) const {
     h = h0;
     const size_t n_sys = hplus_diff.size();
     for (size_t isys = 0; isys < n_sys; isys++) {
+        add_morph(isys, values.get(vid[isys]));
+    }
+    truncate();
+    return h;
+}
+
+const Histogram & cubiclinear_histomorph::eval_dense(const double * x, const size_t * offsets) const {
+    h = h0;
+    const size_t n_sys = hplus_diff.size();
+    for (size_t isys = 0; isys < n_sys; isys++) {
+        add_morph(isys, x[offsets[vid_layout[isys]]]);
+    }
+    truncate();
+    return h;
+}
+
+const Histogram & cubiclinear_histomorph::gradient(const ParValues & values, const ParId & pid) const {
+    h_gradient.reset();
+    const size_t n_sys = hplus_diff.size();
+    for (size_t isys = 0; isys < n_sys; isys++) {
+        if(vid[isys]!=pid) continue;
         const double delta = values.get(vid[isys]);
-        if(delta==0.0) continue;
-        //linear extrpolation beyond 1 sigma:
         if(fabs(delta) > 1){
-            const Histogram & t_sys = delta > 0 ? hplus_diff[isys] : hminus_diff[isys];
-            h.add_with_coeff(fabs(delta), t_sys);
+            h_gradient.add_with_coeff(delta > 0 ? 1.0 : -1.0, delta > 0 ? hplus_diff[isys] : hminus_diff[isys]);
         }
         else{
-            //cubic interpolation:
-            diff_total = diff[isys];
-            diff_total *= 0.5 * delta;
-            diff_total.add_with_coeff(delta * delta - 0.5 * pow(fabs(delta), 3), sum[isys]);
-            h += diff_total;
+            h_gradient.add_with_coeff(0.5, diff[isys]);
+            h_gradient.add_with_coeff(2 * delta - 1.5 * delta * fabs(delta), sum[isys]);
         }
     }
-    for(size_t i=1; i<=h.get_nbins(); ++i){
-       h.set(i, max(h.get(i), 0.0));
+    //bins cut off at zero do not depend on delta:
+    const Histogram & h_value = operator()(values);
+    for(size_t i=1; i<=h_gradient.get_nbins(); ++i){
+        if(h_value.get(i) <= 0.0) h_gradient.set(i, 0.0);
     }
-    h.set(0,0);
-    h.set(h.get_nbins() + 1,0);
-    return h;
+    h_gradient.set(0,0);
+    h_gradient.set(h_gradient.get_nbins() + 1,0);
+    return h_gradient;
 }
 
 cubiclinear_histomorph::cubiclinear_histomorph(const Configuration & ctx){
@@ -61,7 +102,9 @@ cubiclinear_histomorph::cubiclinear_histomorph(const Configuration & ctx){
     assert(hplus_diff.size()==hminus_diff.size());
     assert(vid.size()==hminus_diff.size());
     assert(vid.size()==n);
+    vid_layout = ParLayout(par_ids, vid);
     h = h0;
+    h_gradient = h0;
 }
 
 Histogram cubiclinear_histomorph::getConstantHistogram(const Configuration & cfg, SettingWrapper s){
@@ -44,12 +44,27 @@ public:
      * throws a NotFoundException if a parameter is missing.
      */
     virtual const theta::Histogram & operator()(const theta::ParValues & values) const;
+
+    /// Same as operator(), with parameter values given as for theta::Function::eval_dense
+    virtual const theta::Histogram & eval_dense(const double * x, const size_t * offsets) const;
     
     /// Return a Histogram of the same dimenions as the one returned by operator()
     virtual theta::Histogram get_histogram_dimensions() const{
        return h0;
     }
 
+    /** \brief The derivative of the interpolated Histogram w.r.t. the parameter \c pid
+     *
+     * Bins which are cut off at zero have derivative zero. For the linear extrapolation at exactly
+     * +-1 sigma, the derivative of the cubic interpolation is returned (the two are the same if the
+     * interpolation is smooth).
+     */
+    virtual const theta::Histogram & gradient(const theta::ParValues & values, const theta::ParId & pid) const;
+
+    virtual bool provides_derivatives() const{
+        return true;
+    }
+
 
 private:
     /** \brief Build a (constant) Histogram from a Setting block.
@@ -57,6 +72,11 @@ private:
     * Will throw an InvalidArgumentException if the Histogram is not constant.
     */
     static theta::Histogram getConstantHistogram(const theta::plugin::Configuration & ctx, theta::SettingWrapper s);
+
+    //add the interpolation for parameter vid[isys] at value delta to h:
+    void add_morph(size_t isys, double delta) const;
+    //set negative bins and underflow / overflow of h to zero:
+    void truncate() const;
     
     theta::Histogram h0;
     std::vector<theta::Histogram> hplus_diff; // hplus_diff[i] + h0 yields hplus
@@ -67,10 +87,14 @@ private:
     std::vector<theta::Histogram> sum;
     //the interpolation parameters used to interpolate between hplus and hminus.
     std::vector<theta::ParId> vid;
+    //the index of vid[i] in par_ids:
+    theta::ParLayout vid_layout;
     //the Histogram returned by operator(). Defined as mutable to allow operator() to be const.
     mutable theta::Histogram h;
     //intermediate histogram for operator()
     mutable theta::Histogram diff_total;
+    //the Histogram returned by gradient
+    mutable theta::Histogram h_gradient;
 };
 
 #endif
@@ -2,6 +2,7 @@
 #include "plugins/reduced_nll.hpp"
 #include "plugins/secant.hpp"
 #include "plugins/asimov_likelihood_widths.hpp"
+#include "plugins/warm_start.hpp"
 #include "interface/plugin.hpp"
 #include "interface/minimizer.hpp"
 #include "interface/histogram.hpp"
@@ -22,10 +23,14 @@ void deltanll_intervals::produce(const theta::Data & data, const theta::Model &
         step.set(asimov_likelihood_widths(model, override_parameter_distribution));
         start_step_ranges_init = true;
     }
-    MinimizationResult minres = minimizer->minimize(*nll, start, step, ranges);
+    MinimizationResult minres = warm_start.minimize(*minimizer, *nll, start, step, ranges);
+    if(warm_start.enabled()){
+        products_sink->set_product(*c_start, warm_start.get_used_start());
+    }
     const double value_at_minimum = minres.values.get(pid);
     products_sink->set_product(*c_maxl, value_at_minimum);
-    ReducedNLL nll_r(*nll, pid, minres.values, re_minimize ? minimizer.get() : 0, start, step, ranges);
+    //with warm start, also start the re-minimization from the global minimum:
+    ReducedNLL nll_r(*nll, pid, minres.values, re_minimize ? minimizer.get() : 0, warm_start.enabled() ? minres.values : start, step, ranges);
     const pair<double, double> & range = ranges[pid];
     for(size_t i=0; i < deltanll_levels.size(); ++i){
         nll_r.set_offset_nll(minres.fval + deltanll_levels[i]);
@@ -96,7 +101,7 @@ void deltanll_intervals::produce(const theta::Data & data, const theta::Model &
 }
 
 deltanll_intervals::deltanll_intervals(const theta::plugin::Configuration & cfg): Producer(cfg),
-   pid(cfg.vm->getParId(cfg.setting["parameter"])), re_minimize(true), start_step_ranges_init(false){
+   pid(cfg.vm->getParId(cfg.setting["parameter"])), re_minimize(true), start_step_ranges_init(false), warm_start(cfg.setting){
     SettingWrapper s = cfg.setting;
     minimizer = theta::plugin::PluginManager<Minimizer>::instance().build(theta::plugin::Configuration(cfg, s["minimizer"]));
     string par_name = s["parameter"];
@@ -118,6 +123,9 @@ deltanll_intervals::deltanll_intervals(const theta::plugin::Configuration & cfg)
         deltanll_levels[i] *= deltanll_levels[i]*0.5;
     }
     c_maxl = products_sink->declare_product(*this, "maxl", theta::typeDouble);
+    if(warm_start.enabled()){
+        c_start = products_sink->declare_product(*this, "start", theta::typeInt);
+    }
     for(size_t i=0; i<clevels.size(); ++i){
         stringstream ss;
         ss << "lower" << setw(5) << setfill('0') << static_cast<int>(clevels[i] * 10000 + 0.5);
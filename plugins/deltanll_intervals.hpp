@@ -6,6 +6,7 @@
 #include "interface/variables.hpp"
 #include "interface/database.hpp"
 #include "interface/producer.hpp"
+#include "plugins/warm_start.hpp"
 
 #include <string>
 
@@ -23,6 +24,7 @@
  *  minimizer = "@myminuit";
  *  clevels = [0.68, 0.95];
  *  re-minimize = false; //Optional. Default is true
+ *  warm-start = "last"; //Optional. Default is "none"
  * }
  *
  * myminuit = {...} //see the minimizer documentation.
@@ -40,6 +42,10 @@
  * \c re-minimize specifies whether or not to search for a minimum of the negative log-likelihood when scanning
  *    through the parameter of interest or to use the parameter values found at the global minimum. See below for details.
  *
+ * \c warm-start configures where to start the minimization at the global minimum, see \ref WarmStart for the allowed values.
+ *   If it is not "none", the minimizations done for \c re-minimize start at the parameter values at the global minimum, and the
+ *   products table contains a column 'start' of type typeInt with the start used for the global minimization (see WarmStart::e_start).
+ *
  * \c clevels is an array (or list) of doubles of confidence levels for which the intervals
  *   shall be calculated. Note that an interval for the "0" confidence level (i.e., the
  *   interval containing the minimum) is always determined.
@@ -90,11 +96,13 @@ private:
     bool start_step_ranges_init;
     theta::ParValues start, step;
     std::map<theta::ParId, std::pair<double, double> > ranges;
+    WarmStart warm_start;
 
     //table columns:
     boost::ptr_vector<theta::Column> lower_columns;
     boost::ptr_vector<theta::Column> upper_columns;
     std::auto_ptr<theta::Column> c_maxl;
+    std::auto_ptr<theta::Column> c_start;
 };
 
 #endif
@@ -20,5 +20,11 @@ double exp_function::operator()(const theta::ParValues & values) const{
     return exp(lambda * val);
 }
 
+double exp_function::eval_dense(const double * x, const size_t * offsets) const{
+    double val = x[offsets[0]];
+    double lambda = val < 0 ? lambda_minus: lambda_plus;
+    return exp(lambda * val);
+}
+
 REGISTER_PLUGIN(exp_function)
 
@@ -31,6 +31,8 @@ public:
     exp_function(const theta::plugin::Configuration & cfg);
     /// overloaded evaluation operator of theta::Function
     virtual double operator()(const theta::ParValues & v) const;
+    /// same as operator(), with the parameter value given as for theta::Function::eval_dense
+    virtual double eval_dense(const double * x, const size_t * offsets) const;
 };
 
 
@@ -0,0 +1,281 @@
+#include "plugins/hmc.hpp"
+#include "interface/model.hpp"
+#include "interface/random.hpp"
+#include "interface/plugin.hpp"
+#include "interface/exception.hpp"
+
+#include <cmath>
+#include <limits>
+
+using namespace theta;
+using namespace std;
+
+namespace{
+    const double inf = numeric_limits<double>::infinity();
+    // the step in y coordinates for the finite-difference gradient:
+    const double h_gradient = 1e-4;
+    // trajectories are stopped if the energy error exceeds this value:
+    const double delta_max = 1000.0;
+    // dual averaging constants as recommended by Hoffman and Gelman:
+    const double da_gamma = 0.05;
+    const double da_t0 = 10.0;
+    const double da_kappa = 0.75;
+}
+
+HMCOptions::HMCOptions(): max_tree_depth(10), target_acceptance(0.8), step_size(0.0){}
+
+HMCOptions::HMCOptions(const plugin::Configuration & cfg): max_tree_depth(10), target_acceptance(0.8), step_size(0.0){
+    SettingWrapper s = cfg.setting;
+    if(s.exists("max-tree-depth")){
+        max_tree_depth = static_cast<unsigned int>(s["max-tree-depth"]);
+        if(max_tree_depth == 0){
+            throw ConfigurationException("HMCOptions: 'max-tree-depth' must be at least 1");
+        }
+    }
+    if(s.exists("target-acceptance")){
+        target_acceptance = s["target-acceptance"];
+        if(!(target_acceptance > 0.0 && target_acceptance < 1.0)){
+            throw ConfigurationException("HMCOptions: 'target-acceptance' must be in the interval (0, 1)");
+        }
+    }
+    if(s.exists("step-size")){
+        step_size = s["step-size"];
+        if(!(step_size > 0.0)){
+            throw ConfigurationException("HMCOptions: 'step-size' must be positive");
+        }
+    }
+}
+
+NUTSSampler::NUTSSampler(const NLLikelihood & nll_, Random & rnd_, const vector<double> & startvalues, const Matrix & sqrt_cov_,
+                         const HMCOptions & options_): nll(nll_), rnd(rnd_), options(options_), npar(startvalues.size()),
+                         analytic_gradient(nll_.provides_derivatives()), x0(startvalues), sqrt_cov(sqrt_cov_), y(npar), g(npar), x(npar),
+                         grad_x(npar), nll_value(inf), eps(options_.step_size), log_eps_bar(0.0), h_bar(0.0), mu(0.0), m(0){
+    if(npar != nll.getnpar() || sqrt_cov.getRows() != npar || sqrt_cov.getCols() != npar)
+        throw InvalidArgumentException("NUTSSampler: dimension/size of arguments mismatch");
+    for(size_t i=0; i<npar; ++i){
+        if(sqrt_cov(i,i) > 0.0) free_index.push_back(i);
+    }
+    nll_value = eval(y, g);
+    if(!std::isfinite(nll_value)){
+        throw Exception("NUTSSampler: negative log-likelihood is not finite at the start values");
+    }
+    if(eps == 0.0){
+        find_initial_step_size();
+    }
+    log_eps_bar = log(eps);
+    mu = log(10 * eps);
+}
+
+void NUTSSampler::set_x(const vector<double> & y_){
+    for(size_t i=0; i<npar; ++i){
+        double xi = x0[i];
+        for(size_t j=0; j<=i; ++j){
+            xi += sqrt_cov(i,j) * y_[j];
+        }
+        x[i] = xi;
+    }
+}
+
+double NUTSSampler::eval(const vector<double> & y_, vector<double> & g_y){
+    set_x(y_);
+    std::fill(g_y.begin(), g_y.end(), 0.0);
+    if(analytic_gradient){
+        //one evaluation for value and gradient:
+        const double result = nll.eval_withDerivatives(&x[0], &grad_x[0]);
+        if(!std::isfinite(result)) return inf;
+        for(size_t k=0; k<free_index.size(); ++k){
+            const size_t j = free_index[k];
+            double gj = 0.0;
+            for(size_t i=j; i<npar; ++i){
+                gj += sqrt_cov(i,j) * grad_x[i];
+            }
+            g_y[j] = gj;
+        }
+        return result;
+    }
+    const double result = nll(&x[0]);
+    if(!std::isfinite(result)) return inf;
+    //central differences along the columns of sqrt_cov; one-sided where one of the points is outside the support:
+    for(size_t k=0; k<free_index.size(); ++k){
+        const size_t j = free_index[k];
+        for(size_t i=j; i<npar; ++i) x[i] += h_gradient * sqrt_cov(i,j);
+        const double f_plus = nll(&x[0]);
+        for(size_t i=j; i<npar; ++i) x[i] -= 2 * h_gradient * sqrt_cov(i,j);
+        const double f_minus = nll(&x[0]);
+        for(size_t i=j; i<npar; ++i) x[i] += h_gradient * sqrt_cov(i,j);
+        const bool plus_ok = std::isfinite(f_plus), minus_ok = std::isfinite(f_minus);
+        if(plus_ok && minus_ok) g_y[j] = (f_plus - f_minus) / (2 * h_gradient);
+        else if(plus_ok) g_y[j] = (f_plus - result) / h_gradient;
+        else if(minus_ok) g_y[j] = (result - f_minus) / h_gradient;
+    }
+    return result;
+}
+
+double NUTSSampler::kinetic(const vector<double> & r) const{
+    double result = 0.0;
+    for(size_t k=0; k<free_index.size(); ++k){
+        result += r[free_index[k]] * r[free_index[k]];
+    }
+    return 0.5 * result;
+}
+
+double NUTSSampler::leapfrog(vector<double> & y_, vector<double> & r, vector<double> & g_, double step){
+    for(size_t k=0; k<free_index.size(); ++k){
+        const size_t j = free_index[k];
+        r[j] -= 0.5 * step * g_[j];
+        y_[j] += step * r[j];
+    }
+    const double result = eval(y_, g_);
+    if(!std::isfinite(result)) return inf;
+    for(size_t k=0; k<free_index.size(); ++k){
+        const size_t j = free_index[k];
+        r[j] -= 0.5 * step * g_[j];
+    }
+    return result;
+}
+
+bool NUTSSampler::no_uturn(const vector<double> & y_minus, const vector<double> & y_plus, const vector<double> & r_minus,
+                           const vector<double> & r_plus) const{
+    double dot_minus = 0.0, dot_plus = 0.0;
+    for(size_t k=0; k<free_index.size(); ++k){
+        const size_t j = free_index[k];
+        const double dy = y_plus[j] - y_minus[j];
+        dot_minus += dy * r_minus[j];
+        dot_plus += dy * r_plus[j];
+    }
+    return dot_minus >= 0.0 && dot_plus >= 0.0;
+}
+
+void NUTSSampler::build_tree(const vector<double> & y_, const vector<double> & r, const vector<double> & g_, double log_u, int v,
+                             size_t j, double joint0, tree & t){
+    if(j==0){
+        t.y_prop = y_;
+        t.g_prop = g_;
+        t.r_minus = r;
+        const double u = leapfrog(t.y_prop, t.r_minus, t.g_prop, v * eps);
+        double joint = -u - kinetic(t.r_minus);
+        if(std::isnan(joint)) joint = -inf;
+        t.nll_prop = u;
+        t.n = log_u <= joint ? 1 : 0;
+        t.s = log_u < joint + delta_max;
+        t.alpha = joint > joint0 ? 1.0 : exp(joint - joint0);
+        t.n_alpha = 1;
+        t.y_minus = t.y_plus = t.y_prop;
+        t.r_plus = t.r_minus;
+        t.g_minus = t.g_plus = t.g_prop;
+        return;
+    }
+    build_tree(y_, r, g_, log_u, v, j - 1, joint0, t);
+    if(!t.s) return;
+    tree t2;
+    if(v == -1){
+        build_tree(t.y_minus, t.r_minus, t.g_minus, log_u, v, j - 1, joint0, t2);
+        t.y_minus.swap(t2.y_minus);
+        t.r_minus.swap(t2.r_minus);
+        t.g_minus.swap(t2.g_minus);
+    }
+    else{
+        build_tree(t.y_plus, t.r_plus, t.g_plus, log_u, v, j - 1, joint0, t2);
+        t.y_plus.swap(t2.y_plus);
+        t.r_plus.swap(t2.r_plus);
+        t.g_plus.swap(t2.g_plus);
+    }
+    if(t2.n > 0 && rnd.uniform() * (t.n + t2.n) < t2.n){
+        t.y_prop.swap(t2.y_prop);
+        t.g_prop.swap(t2.g_prop);
+        t.nll_prop = t2.nll_prop;
+    }
+    t.alpha += t2.alpha;
+    t.n_alpha += t2.n_alpha;
+    t.s = t2.s && no_uturn(t.y_minus, t.y_plus, t.r_minus, t.r_plus);
+    t.n += t2.n;
+}
+
+void NUTSSampler::find_initial_step_size(){
+    eps = 1.0;
+    vector<double> r(npar), y1(npar), r1(npar), g1(npar);
+    for(size_t k=0; k<free_index.size(); ++k){
+        r[free_index[k]] = rnd.gauss();
+    }
+    const double joint0 = -nll_value - kinetic(r);
+    y1 = y;
+    r1 = r;
+    g1 = g;
+    double log_ratio = -leapfrog(y1, r1, g1, eps) - kinetic(r1) - joint0;
+    if(std::isnan(log_ratio)) log_ratio = -inf;
+    //double the step size while the acceptance probability is larger than 1/2, or halve it while it is smaller:
+    const double a = log_ratio > -log(2.0) ? 1.0 : -1.0;
+    for(int i=0; i<100 && a * log_ratio > -a * log(2.0); ++i){
+        eps *= a > 0 ? 2.0 : 0.5;
+        y1 = y;
+        r1 = r;
+        g1 = g;
+        const double u = leapfrog(y1, r1, g1, eps);
+        log_ratio = -u - kinetic(r1) - joint0;
+        if(std::isnan(log_ratio)) log_ratio = -inf;
+    }
+    set_x(y);
+}
+
+bool NUTSSampler::next(bool adapt){
+    vector<double> r(npar);
+    for(size_t k=0; k<free_index.size(); ++k){
+        r[free_index[k]] = rnd.gauss();
+    }
+    const double joint0 = -nll_value - kinetic(r);
+    //the slice variable; 1 - uniform() is in (0, 1]:
+    const double log_u = joint0 + log(1.0 - rnd.uniform());
+    tree t;
+    t.y_minus = t.y_plus = y;
+    t.r_minus = t.r_plus = r;
+    t.g_minus = t.g_plus = g;
+    t.alpha = t.n_alpha = 0;
+    double n = 1;
+    bool s = true, moved = false;
+    double alpha = 0.0, n_alpha = 0.0;
+    for(size_t j=0; s && j < options.max_tree_depth; ++j){
+        const int v = rnd.uniform() < 0.5 ? -1 : 1;
+        tree t2;
+        if(v == -1){
+            build_tree(t.y_minus, t.r_minus, t.g_minus, log_u, v, j, joint0, t2);
+            t.y_minus.swap(t2.y_minus);
+            t.r_minus.swap(t2.r_minus);
+            t.g_minus.swap(t2.g_minus);
+        }
+        else{
+            build_tree(t.y_plus, t.r_plus, t.g_plus, log_u, v, j, joint0, t2);
+            t.y_plus.swap(t2.y_plus);
+            t.r_plus.swap(t2.r_plus);
+            t.g_plus.swap(t2.g_plus);
+        }
+        alpha += t2.alpha;
+        n_alpha += t2.n_alpha;
+        if(!t2.s) break;
+        if(t2.n > 0 && rnd.uniform() * n < t2.n){
+            y.swap(t2.y_prop);
+            g.swap(t2.g_prop);
+            nll_value = t2.nll_prop;
+            moved = true;
+        }
+        n += t2.n;
+        s = no_uturn(t.y_minus, t.y_plus, t.r_minus, t.r_plus);
+    }
+    //x has been overwritten by the evaluations along the trajectory:
+    set_x(y);
+    if(adapt){
+        ++m;
+        const double w = 1.0 / (m + da_t0);
+        h_bar = (1 - w) * h_bar + w * (options.target_acceptance - (n_alpha > 0 ? alpha / n_alpha : 0.0));
+        const double log_eps = mu - sqrt(static_cast<double>(m)) / da_gamma * h_bar;
+        const double mk = pow(static_cast<double>(m), -da_kappa);
+        log_eps_bar = mk * log_eps + (1 - mk) * log_eps_bar;
+        eps = exp(log_eps);
+    }
+    return moved;
+}
+
+void NUTSSampler::end_adaptation(){
+    if(m > 0){
+        eps = exp(log_eps_bar);
+    }
+}
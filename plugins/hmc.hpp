@@ -0,0 +1,159 @@
+#ifndef PLUGINS_HMC_HPP
+#define PLUGINS_HMC_HPP
+
+#include "interface/decls.hpp"
+#include "interface/matrix.hpp"
+
+#include <vector>
+
+namespace theta {
+
+/** \brief Settings of the No-U-Turn sampler hamiltonianMC
+ *
+ * Read from the setting group of the producer; all settings are optional:
+ * \code
+ * max-tree-depth = 10;        // default is 10
+ * target-acceptance = 0.8;    // default is 0.8
+ * step-size = 0.1;            // default is to adapt the step size during burn-in
+ * \endcode
+ *
+ * \c max-tree-depth limits the length of a trajectory to 2^max-tree-depth leapfrog steps.
+ *
+ * \c target-acceptance is the average acceptance probability the step size is adapted to during burn-in.
+ *
+ * \c step-size is a fixed leapfrog step size in units of the proposal matrix. If given, no adaptation takes place.
+ */
+struct HMCOptions{
+    /// The maximum depth of the trajectory tree
+    size_t max_tree_depth;
+
+    /// The target acceptance probability of the step size adaptation
+    double target_acceptance;
+
+    /// The fixed step size; zero to adapt the step size during burn-in
+    double step_size;
+
+    /// Default settings
+    HMCOptions();
+
+    /// Read the settings from the setting group in \c cfg
+    explicit HMCOptions(const plugin::Configuration & cfg);
+};
+
+/** \brief One Markov chain of the No-U-Turn sampler
+ *
+ * Implements the No-U-Turn sampler with slice sampling and dual averaging adaptation of the step size, algorithm 6 in
+ * M. D. Hoffman and A. Gelman, "The No-U-Turn Sampler", JMLR 15 (2014).
+ *
+ * The sampler works in the coordinates y with x = x0 + L y, where x0 are the startvalues and L is the \c sqrt_cov
+ * matrix, so it is most efficient if L is the Cholesky decomposition of the posterior covariance. Parameters with
+ * zero diagonal in \c sqrt_cov are fixed.
+ *
+ * The gradient is calculated with NLLikelihood::eval_withDerivatives if the likelihood provides derivatives and with central
+ * finite differences otherwise. Points with infinite negative log-likelihood, e.g., outside of the support of the parameter
+ * distribution, are never accepted.
+ */
+class NUTSSampler{
+public:
+    /// Start a chain at \c startvalues
+    NUTSSampler(const NLLikelihood & nll, Random & rnd, const std::vector<double> & startvalues, const Matrix & sqrt_cov,
+                const HMCOptions & options);
+
+    /** \brief Make one iteration of the chain
+     *
+     * If \c adapt is true, the step size is adapted. Returns whether the point has changed.
+     */
+    bool next(bool adapt);
+
+    /// Fix the step size to the adapted value. Call this at the end of burn-in
+    void end_adaptation();
+
+    /// The parameter values of the current point
+    const double * get_x() const{
+        return &x[0];
+    }
+
+    /// The negative log-likelihood of the current point
+    double get_nll() const{
+        return nll_value;
+    }
+
+    /// The current step size
+    double get_step_size() const{
+        return eps;
+    }
+
+private:
+    // the end points and proposal of a trajectory tree
+    struct tree{
+        std::vector<double> y_minus, r_minus, g_minus, y_plus, r_plus, g_plus, y_prop, g_prop;
+        double nll_prop;
+        double n;
+        bool s;
+        double alpha, n_alpha;
+    };
+
+    void set_x(const std::vector<double> & y);
+    double eval(const std::vector<double> & y, std::vector<double> & g_y);
+    double leapfrog(std::vector<double> & y, std::vector<double> & r, std::vector<double> & g, double step);
+    bool no_uturn(const std::vector<double> & y_minus, const std::vector<double> & y_plus,
+                  const std::vector<double> & r_minus, const std::vector<double> & r_plus) const;
+    void build_tree(const std::vector<double> & y, const std::vector<double> & r, const std::vector<double> & g,
+                    double log_u, int v, size_t j, double joint0, tree & t);
+    double kinetic(const std::vector<double> & r) const;
+    void find_initial_step_size();
+
+    const NLLikelihood & nll;
+    Random & rnd;
+    HMCOptions options;
+    size_t npar;
+    bool analytic_gradient;
+    std::vector<size_t> free_index;
+    std::vector<double> x0;
+    Matrix sqrt_cov;
+    // the current point in y coordinates, its gradient in y and the values in x:
+    std::vector<double> y, g;
+    std::vector<double> x;
+    std::vector<double> grad_x;
+    double nll_value;
+    // step size and dual averaging state:
+    double eps, log_eps_bar, h_bar, mu;
+    size_t m;
+};
+
+/** \brief Run the No-U-Turn sampler
+ *
+ * The parameters have the same meaning as for metropolisHastings, with \c sqrt_cov defining the coordinates of the sampler,
+ * see NUTSSampler. The step size is adapted during the \c burn_in iterations, unless fixed in \c options.
+ */
+template<class resulttype>
+void hamiltonianMC(const NLLikelihood & nll, resulttype &res, Random & rand, const std::vector<double> & startvalues,
+                   const Matrix & sqrt_cov, size_t iterations, size_t burn_in, const HMCOptions & options){
+    const size_t npar = startvalues.size();
+    if(npar != res.getnpar())
+        throw InvalidArgumentException("hamiltonianMC: dimension/size of arguments mismatch");
+    NUTSSampler sampler(nll, rand, startvalues, sqrt_cov, options);
+    for(size_t it=0; it<burn_in; ++it){
+        sampler.next(options.step_size == 0.0);
+    }
+    sampler.end_adaptation();
+    std::vector<double> x_rec(sampler.get_x(), sampler.get_x() + npar);
+    double nll_rec = sampler.get_nll();
+    size_t weight = 1;
+    for(size_t it=1; it<iterations; ++it){
+        if(sampler.next(false)){
+            res.fill(&x_rec[0], nll_rec, weight);
+            weight = 1;
+            std::copy(sampler.get_x(), sampler.get_x() + npar, x_rec.begin());
+            nll_rec = sampler.get_nll();
+        }
+        else{
+            ++weight;
+        }
+    }
+    res.fill(&x_rec[0], nll_rec, weight);
+}
+
+}
+
+#endif
@@ -21,28 +21,31 @@ const Histogram & interpolating_histo::operator()(const ParValues & values) cons
 
 const Histogram & interpolating_histo::gradient(const ParValues & values, const ParId & pid) const{
     const size_t n_sys = hplus.size();
-    bool found = false;
-    for (size_t isys = 0; isys < n_sys; isys++) {
-        if(vid[isys]!=pid)continue;
-        found = true;
-        const double delta = values.get(vid[isys]);
-        const Histogram & t_sys = delta > 0 ? hplus[isys] : hminus[isys];
-        if (t_sys.get_nbins() == 0)continue;
-        h.multiply_with_ratio_exponented(t_sys, h0, fabs(delta));
-        const size_t nbins = t_sys.get_nbins();
-        for(size_t i=1; i<=nbins; ++i){
-            if(h0.get(i)>0.0)
-                h.set(i, h.get(i) * theta::utils::log(t_sys.get(i) / h0.get(i)));
-        }
-        break;
+    size_t isys = 0;
+    for (; isys < n_sys; isys++) {
+        if(vid[isys]==pid) break;
     }
-    if(not found){
-        h.reset();
+    if(isys==n_sys){
+        h_gradient.reset();
+        return h_gradient;
     }
-    else{
-        h *= h0;
+    const double delta = values.get(vid[isys]);
+    const Histogram & t_sys = delta > 0 ? hplus[isys] : hminus[isys];
+    if (t_sys.get_nbins() == 0){
+        h_gradient.reset();
+        return h_gradient;
     }
-    return h;
+    //d/d delta (t/h0)^|delta| = (t/h0)^|delta| * log(t/h0) * sgn(delta):
+    h_gradient = operator()(values);
+    const double sign = delta > 0 ? 1.0 : -1.0;
+    const size_t nbins = t_sys.get_nbins();
+    for(size_t i=1; i<=nbins; ++i){
+        if(h0.get(i) > 0.0 && t_sys.get(i) > 0.0)
+            h_gradient.set(i, sign * h_gradient.get(i) * theta::utils::log(t_sys.get(i) / h0.get(i)));
+        else
+            h_gradient.set(i, 0.0);
+    }
+    return h_gradient;
 }
 
 interpolating_histo::interpolating_histo(const Configuration & ctx){
@@ -71,6 +74,7 @@ interpolating_histo::interpolating_histo(const Configuration & ctx){
     assert(vid.size()==hminus.size());
     assert(vid.size()==n);
     h = h0;
+    h_gradient = h0;
     
     const size_t nsys = hplus.size();
     std::set<ParId> pid_set;
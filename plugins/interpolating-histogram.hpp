@@ -44,7 +44,16 @@ public:
     }
 
 
+    /** \brief The derivative of the interpolated Histogram w.r.t. the parameter \c pid
+     *
+     * For parameter p_i, this is the interpolated Histogram multiplied binwise with +-log(hplus[i][k]/h0[k]) or
+     * +-log(hminus[i][k]/h0[k]) with the sign of p_i. At p_i = 0, the derivative for p_i &lt; 0 is returned.
+     */
     virtual const theta::Histogram & gradient(const theta::ParValues & values, const theta::ParId & pid) const;
+
+    virtual bool provides_derivatives() const{
+        return true;
+    }
 private:
     /** \brief Build a (constant) Histogram from a Setting block.
     *
@@ -59,6 +68,8 @@ private:
     std::vector<theta::ParId> vid;
     //the Histogram returned by operator(). Defined as mutable to allow operator() to be const.
     mutable theta::Histogram h;
+    //the Histogram returned by gradient.
+    mutable theta::Histogram h_gradient;
 };
 
 #endif
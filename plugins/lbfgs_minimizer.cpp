@@ -0,0 +1,351 @@
+#include "plugins/lbfgs_minimizer.hpp"
+#include "interface/matrix.hpp"
+#include "interface/timing.hpp"
+#include "liblbfgs/lbfgs.h"
+
+#include <boost/exception_ptr.hpp>
+
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+using namespace theta;
+using namespace theta::plugin;
+using namespace std;
+
+namespace{
+
+// The function to minimize in terms of the internal, unconstrained parameters. Holds the
+// parameter transformations and calculates the gradient, either analytically or numerically.
+class lbfgs_problem{
+public:
+    enum bound_type{ unbounded, lower, upper, both };
+
+    lbfgs_problem(const Function & f_, bool use_gradient_): f(f_), use_gradient(use_gradient_), n(f.getnpar()),
+      x(n), g_x(n), g_internal(n), has_error(false), fatal(false){
+    }
+
+    // add a parameter, in the order of f.getParameters()
+    void add_parameter(double value, double step, double a, double b){
+        const size_t i = is_free.size();
+        x[i] = value;
+        h.push_back(1e-4 * step);
+        lo.push_back(a);
+        hi.push_back(b);
+        if(step == 0.0 || a == b){
+            is_free.push_back(false);
+            types.push_back(unbounded);
+            return;
+        }
+        is_free.push_back(true);
+        free_index.push_back(i);
+        bound_type t = unbounded;
+        if(!std::isinf(a)) t = std::isinf(b) ? lower : both;
+        else if(!std::isinf(b)) t = upper;
+        types.push_back(t);
+        //move start values away from the boundaries:
+        if(t==lower || t==both){
+            if(x[i] - a < 1e-3 * step) x[i] = a + (t == both ? min(0.1 * step, 0.5 * (b - a)) : 0.1 * step);
+        }
+        if(t==upper || t==both){
+            if(b - x[i] < 1e-3 * step) x[i] = b - (t == both ? min(0.1 * step, 0.5 * (b - a)) : 0.1 * step);
+        }
+    }
+
+    size_t n_free() const{
+        return free_index.size();
+    }
+
+    double to_external(size_t i, double y) const{
+        switch(types[i]){
+            case lower: return lo[i] - 1 + sqrt(y * y + 1);
+            case upper: return hi[i] + 1 - sqrt(y * y + 1);
+            case both: return lo[i] + (hi[i] - lo[i]) * 0.5 * (sin(y) + 1);
+            default: return y;
+        }
+    }
+
+    double to_internal(size_t i, double xi) const{
+        switch(types[i]){
+            case lower: { double d = xi - lo[i] + 1; return sqrt(max(d * d - 1, 0.0)); }
+            case upper: { double d = hi[i] - xi + 1; return sqrt(max(d * d - 1, 0.0)); }
+            case both: return asin(max(-1.0, min(1.0, 2 * (xi - lo[i]) / (hi[i] - lo[i]) - 1)));
+            default: return xi;
+        }
+    }
+
+    // dx / dy
+    double derivative(size_t i, double y) const{
+        switch(types[i]){
+            case lower: return y / sqrt(y * y + 1);
+            case upper: return -y / sqrt(y * y + 1);
+            case both: return (hi[i] - lo[i]) * 0.5 * cos(y);
+            default: return 1.0;
+        }
+    }
+
+    // the internal start values
+    void get_internal(double * y) const{
+        for(size_t k=0; k<free_index.size(); ++k){
+            size_t i = free_index[k];
+            y[k] = to_internal(i, x[i]);
+        }
+    }
+
+    // set the external parameter values from the internal ones
+    void set_internal(const double * y){
+        for(size_t k=0; k<free_index.size(); ++k){
+            size_t i = free_index[k];
+            x[i] = to_external(i, y[k]);
+        }
+    }
+
+    // function value and gradient w.r.t. the external parameters at the current x
+    double eval_external(double * grad){
+        if(use_gradient){
+            return f.eval_withDerivatives(&x[0], grad);
+        }
+        const double f0 = f(&x[0]);
+        if(std::isinf(f0)) return f0;
+        for(size_t k=0; k<free_index.size(); ++k){
+            const size_t i = free_index[k];
+            const double x0 = x[i];
+            //use central differences, but do not cross the boundaries:
+            double h_plus = h[i], h_minus = h[i];
+            if(x0 + h_plus > hi[i]) h_plus = 0.0;
+            if(x0 - h_minus < lo[i]) h_minus = 0.0;
+            x[i] = x0 + h_plus;
+            double f_plus = h_plus > 0.0 ? f(&x[0]) : f0;
+            x[i] = x0 - h_minus;
+            double f_minus = h_minus > 0.0 ? f(&x[0]) : f0;
+            x[i] = x0;
+            grad[i] = (f_plus - f_minus) / (h_plus + h_minus);
+        }
+        return f0;
+    }
+
+    // as eval_external, but exceptions are saved (to be thrown by rethrow) and infinity is returned instead.
+    double eval_saved(double * grad){
+        try{
+            return eval_external(grad);
+        }
+        catch(Exception & ex){
+            error = ex.message;
+            has_error = true;
+        }
+        catch(FatalException & ex){
+            error = ex.message;
+            has_error = fatal = true;
+        }
+        catch(...){
+            //any other exception, such as std::bad_alloc, is rethrown as it is:
+            pending = boost::current_exception();
+            has_error = true;
+        }
+        return numeric_limits<double>::infinity();
+    }
+
+    // function value and gradient w.r.t. the internal parameters y. Exceptions must not propagate
+    // through liblbfgs, so they are saved and the optimization is cancelled via the progress callback.
+    double eval(const double * y, double * g){
+        set_internal(y);
+        const double result = eval_saved(&g_x[0]);
+        if(has_error) return result;
+        for(size_t k=0; k<free_index.size(); ++k){
+            const size_t i = free_index[k];
+            g[k] = g_x[i] * derivative(i, y[k]);
+        }
+        return result;
+    }
+
+    bool failed() const{
+        return has_error;
+    }
+
+    void rethrow(){
+        if(pending) boost::rethrow_exception(pending);
+        if(fatal) throw FatalException("lbfgs_minimizer: " + error);
+        throw MinimizationException("lbfgs_minimizer: function evaluation failed: " + error);
+    }
+
+    // Hessian w.r.t. the free external parameters at the current x, from differences of the gradient.
+    // If an evaluation fails, the result is incomplete and failed() returns true.
+    Matrix hessian(){
+        const size_t nf = free_index.size();
+        Matrix result(nf, nf);
+        vector<double> g_plus(n), g_minus(n);
+        for(size_t k=0; k<nf; ++k){
+            const size_t i = free_index[k];
+            const double x0 = x[i];
+            double h_plus = 10 * h[i], h_minus = 10 * h[i];
+            if(x0 + h_plus > hi[i]) h_plus = 0.0;
+            if(x0 - h_minus < lo[i]) h_minus = 0.0;
+            x[i] = x0 + h_plus;
+            eval_saved(&g_plus[0]);
+            x[i] = x0 - h_minus;
+            eval_saved(&g_minus[0]);
+            x[i] = x0;
+            if(has_error) return result;
+            for(size_t l=0; l<nf; ++l){
+                result(l, k) = (g_plus[free_index[l]] - g_minus[free_index[l]]) / (h_plus + h_minus);
+            }
+        }
+        for(size_t k=0; k<nf; ++k){
+            for(size_t l=0; l<k; ++l){
+                result(k, l) = result(l, k) = 0.5 * (result(k, l) + result(l, k));
+            }
+        }
+        return result;
+    }
+
+    const Function & f;
+    const bool use_gradient;
+    const size_t n;
+    // external parameter values and gradient:
+    vector<double> x, g_x;
+    vector<double> g_internal;
+    // numerical derivative steps and ranges, for all parameters:
+    vector<double> h, lo, hi;
+    vector<bound_type> types;
+    vector<bool> is_free;
+    // indices of the free parameters:
+    vector<size_t> free_index;
+    string error;
+    bool has_error, fatal;
+    boost::exception_ptr pending;
+};
+
+lbfgsfloatval_t evaluate(void * instance, const lbfgsfloatval_t * y, lbfgsfloatval_t * g, const int n, const lbfgsfloatval_t step){
+    return static_cast<lbfgs_problem*>(instance)->eval(y, g);
+}
+
+int progress(void * instance, const lbfgsfloatval_t * x, const lbfgsfloatval_t * g, const lbfgsfloatval_t fx,
+        const lbfgsfloatval_t xnorm, const lbfgsfloatval_t gnorm, const lbfgsfloatval_t step, int n, int k, int ls){
+    return static_cast<lbfgs_problem*>(instance)->failed() ? 1 : 0;
+}
+
+double norm(const double * x, size_t n){
+    double result = 0.0;
+    for(size_t i=0; i<n; ++i){
+        result += x[i] * x[i];
+    }
+    return sqrt(result);
+}
+
+}
+
+MinimizationResult lbfgs_minimizer::minimize(const theta::Function & f, const theta::ParValues & start,
+        const theta::ParValues & steps, const std::map<theta::ParId, std::pair<double, double> > & ranges){
+    MinimizeCall call;
+    lbfgs_problem problem(f, analytic_gradient && f.provides_derivatives());
+    const ParIds & parameters = f.getParameters();
+    for(ParIds::const_iterator it=parameters.begin(); it!=parameters.end(); ++it){
+        std::map<theta::ParId, std::pair<double, double> >::const_iterator r_it = ranges.find(*it);
+        if(r_it==ranges.end()) throw InvalidArgumentException("lbfgs_minimizer::minimize: range not set for a parameter");
+        const pair<double, double> & range = r_it->second;
+        double value = start.get(*it);
+        if(range.first == range.second) value = range.first;
+        problem.add_parameter(value, steps.get(*it), range.first, range.second);
+    }
+    const size_t nf = problem.n_free();
+    MinimizationResult result;
+    if(nf > 0){
+        lbfgs_parameter_t param;
+        lbfgs_parameter_init(&param);
+        param.epsilon = tolerance;
+        param.max_iterations = max_iterations;
+        //backtracking handles infinite function values by reducing the step size:
+        param.linesearch = LBFGS_LINESEARCH_BACKTRACKING;
+        lbfgsfloatval_t * y = lbfgs_malloc(nf);
+        if(y==0) throw std::bad_alloc();
+        problem.get_internal(y);
+        lbfgsfloatval_t fx = problem.eval(y, &problem.g_internal[0]);
+        if(problem.failed()){
+            lbfgs_free(y);
+            problem.rethrow();
+        }
+        if(std::isinf(fx)){
+            lbfgs_free(y);
+            throw MinimizationException("lbfgs_minimizer: function to minimize is infinite at the start values");
+        }
+        int status = lbfgs(nf, y, &fx, evaluate, progress, &problem, &param);
+        if(problem.failed()){
+            lbfgs_free(y);
+            problem.rethrow();
+        }
+        //some errors are reported if the line search cannot improve further, typically
+        // close to the minimum. Accept the result in this case if the gradient is small:
+        if(status < 0){
+            double fy = problem.eval(y, &problem.g_internal[0]);
+            bool accept = (status == LBFGSERR_ROUNDING_ERROR || status == LBFGSERR_MINIMUMSTEP || status == LBFGSERR_MAXIMUMLINESEARCH)
+                && !std::isinf(fy) && norm(&problem.g_internal[0], nf) < 100 * tolerance * max(1.0, norm(y, nf));
+            if(!accept){
+                lbfgs_free(y);
+                stringstream s;
+                s << "lbfgs_minimizer: liblbfgs returned status " << status;
+                throw MinimizationException(s.str());
+            }
+            fx = fy;
+        }
+        problem.set_internal(y);
+        lbfgs_free(y);
+        result.fval = fx;
+    }
+    else{
+        result.fval = f(&problem.x[0]);
+    }
+    size_t i = 0;
+    for(ParIds::const_iterator it=parameters.begin(); it!=parameters.end(); ++it, ++i){
+        result.values.set(*it, problem.x[i]);
+    }
+    const size_t npar = parameters.size();
+    result.covariance.reset(npar, npar);
+    if(covariance){
+        Matrix cov = problem.hessian();
+        if(problem.failed()) problem.rethrow();
+        try{
+            if(nf > 0) cov.invert_cholesky();
+        }
+        catch(MathException & ex){
+            throw MinimizationException("lbfgs_minimizer: Hessian at the minimum is not positive definite (" + ex.message + ")");
+        }
+        for(size_t k=0; k<nf; ++k){
+            for(size_t l=0; l<nf; ++l){
+                result.covariance(problem.free_index[k], problem.free_index[l]) = cov(k, l);
+            }
+        }
+        i = 0;
+        for(ParIds::const_iterator it=parameters.begin(); it!=parameters.end(); ++it, ++i){
+            double error = sqrt(result.covariance(i, i));
+            result.errors_plus.set(*it, error);
+            result.errors_minus.set(*it, error);
+        }
+    }
+    else{
+        i = 0;
+        for(ParIds::const_iterator it=parameters.begin(); it!=parameters.end(); ++it, ++i){
+            result.errors_plus.set(*it, -1);
+            result.errors_minus.set(*it, -1);
+            result.covariance(i, i) = -1;
+        }
+    }
+    return result;
+}
+
+lbfgs_minimizer::lbfgs_minimizer(const Configuration & cfg): Minimizer(cfg), max_iterations(0), analytic_gradient(true), covariance(false){
+    tolerance = 1e-5;
+    if(cfg.setting.exists("tolerance")){
+        tolerance = cfg.setting["tolerance"];
+    }
+    if(cfg.setting.exists("max-iterations")){
+        max_iterations = cfg.setting["max-iterations"];
+    }
+    if(cfg.setting.exists("analytic-gradient")){
+        analytic_gradient = cfg.setting["analytic-gradient"];
+    }
+    if(cfg.setting.exists("covariance")){
+        covariance = cfg.setting["covariance"];
+    }
+}
+
+REGISTER_PLUGIN(lbfgs_minimizer)
@@ -0,0 +1,68 @@
+#ifndef PLUGIN_LBFGS_MINIMIZER_HPP
+#define PLUGIN_LBFGS_MINIMIZER_HPP
+
+#include "interface/plugin.hpp"
+#include "interface/phys.hpp"
+#include "interface/minimizer.hpp"
+
+/** \brief Minimizer using the limited-memory BFGS algorithm of liblbfgs
+ *
+ * Configuration with a setting like:
+ * \code
+ * {
+ *  type = "lbfgs_minimizer";
+ *
+ *  tolerance = 1e-6; // optional. Default is 1e-5
+ *  max-iterations = 1000; // optional. Default is 0
+ *  analytic-gradient = false; // optional. Default is true
+ *  covariance = true; // optional. Default is false
+ * }
+ * \endcode
+ *
+ * \c tolerance is the convergence criterion: the minimization stops if the norm of the gradient is
+ *   smaller than \c tolerance * max(1, norm of the parameter vector). Both norms are calculated in the internal parameters (see below).
+ *
+ * \c max-iterations is the maximum number of iterations. The default of 0 means to iterate until convergence.
+ *
+ * \c analytic-gradient controls whether to use analytical derivatives of the function to minimize if
+ *   they are available (see theta::Function::provides_derivatives). Otherwise, the gradient is calculated
+ *   numerically using central differences with a step size of 1e-4 times the step size passed to minimize().
+ *
+ * \c covariance controls whether the covariance matrix and the parameter errors are calculated. If true, the Hessian at the minimum
+ *   is calculated by numerical differentiation of the gradient and the covariance matrix is its inverse; the errors are the square roots of the
+ *   diagonal elements. This assumes that the function to minimize is a negative log-likelihood (and not twice the
+ *   negative log-likelihood). If false, the errors are set to -1 and the covariance matrix is the negative unity matrix.
+ *
+ * Parameter ranges are implemented via the same transformations MINUIT uses: the minimization is done in internal,
+ * unconstrained parameters y which are mapped to the external parameter x with
+ *  - x = a - 1 + sqrt(y^2 + 1) if only a lower bound a is given,
+ *  - x = b + 1 - sqrt(y^2 + 1) if only an upper bound b is given,
+ *  - x = a + (b - a) / 2 * (sin(y) + 1) if both bounds are given.
+ *
+ * As these transformations have a vanishing derivative at the boundaries, start values at a boundary are moved
+ * inside the allowed range by 0.1 times the step size. Parameters with step size 0.0 or with a range containing only one value
+ * are fixed.
+ *
+ * A theta::MinimizationException is thrown if the function is infinite at the start values, if evaluating the function
+ * fails with a theta::Exception, if liblbfgs reports an error and the gradient is not small, or if the requested covariance matrix
+ * is not positive definite.
+ */
+class lbfgs_minimizer: public theta::Minimizer{
+public:
+    /** \brief Constructor used by the plugin system to build an instance from a configuration file.
+     */
+    lbfgs_minimizer(const theta::plugin::Configuration & cfg);
+
+    /** \brief Implement the Minimizer::minimize routine.
+     *
+     * See documentation of Minimizer::minimize and the class documentation.
+     */
+    virtual theta::MinimizationResult minimize(const theta::Function & f, const theta::ParValues & start,
+            const theta::ParValues & step, const std::map<theta::ParId, std::pair<double, double> > & ranges);
+private:
+    int max_iterations;
+    bool analytic_gradient;
+    bool covariance;
+};
+
+#endif
@@ -6,7 +6,7 @@ using namespace theta;
 using namespace theta::plugin;
 using namespace libconfig;
 
-const Histogram & linear_histo_morph::operator()(const ParValues & values) const {
+double linear_histo_morph::interpolate(const ParValues & values) const {
     h.reset_to_1();
     const size_t n_sys = kappa_plus.size();
     //1. interpolate linearly in each bin; also calculate normalization
@@ -29,6 +29,11 @@ const Histogram & linear_histo_morph::operator()(const ParValues & values) const
          //throw UnphysicalPredictionException();
        }
     }
+    return scale_unc;
+}
+
+const Histogram & linear_histo_morph::operator()(const ParValues & values) const {
+    double scale_unc = interpolate(values);
     //3.a. rescale to nominal:
     h *= h0exp / h.get_sum_of_bincontents();
     //3.b. apply scale uncertainty
@@ -36,6 +41,39 @@ const Histogram & linear_histo_morph::operator()(const ParValues & values) const
     return h;
 }
 
+const Histogram & linear_histo_morph::gradient(const ParValues & values, const ParId & pid) const {
+    h_gradient.reset();
+    const size_t n_sys = kappa_plus.size();
+    size_t isys = 0;
+    for (; isys < n_sys; isys++) {
+        if(parameters[isys]==pid) break;
+    }
+    if(isys==n_sys) return h_gradient;
+    //h is the interpolated, not yet normalized, histogram h_raw with sum S. The result is
+    // h_raw * h0exp / S * scale_unc, so its derivative is
+    //  (h_raw' - h_raw * S' / S) * h0exp / S * scale_unc + result * scale_unc' / scale_unc
+    const double scale_unc = interpolate(values);
+    const double sum = h.get_sum_of_bincontents();
+    const double delta = values.get(pid);
+    const double sign = delta > 0 ? 1.0 : -1.0;
+    const Histogram & kappa_sys = delta > 0 ? kappa_plus[isys] : kappa_minus[isys];
+    if(kappa_sys.get_nbins() > 0){
+        h_gradient.add_with_coeff(sign, kappa_sys);
+        h_gradient *= h0;
+        for(size_t i=1; i <= h.get_nbins(); ++i){
+            if(h.get(i) <= 0.0) h_gradient.set(i, 0.0);
+        }
+        h_gradient.add_with_coeff(-h_gradient.get_sum_of_bincontents() / sum, h);
+    }
+    const double relexp = delta > 0 ? plus_relexp[isys] : minus_relexp[isys];
+    const double factor = 1.0 + fabs(delta) * relexp;
+    if(factor > 0.0){
+        h_gradient.add_with_coeff(sign * relexp / factor, h);
+    }
+    h_gradient *= h0exp / sum * scale_unc;
+    return h_gradient;
+}
+
 linear_histo_morph::linear_histo_morph(const Configuration & ctx){
     SettingWrapper psetting = ctx.setting["parameters"];
     size_t n = psetting.size();
@@ -71,6 +109,7 @@ linear_histo_morph::linear_histo_morph(const Configuration & ctx){
     std::set<ParId> pid_set;
     h0 = getConstantHistogram(ctx, ctx.setting["nominal-histogram"]);
     h = h0;
+    h_gradient = h0;
     for(size_t i=0; i < nsys; i++){
         pid_set.insert(parameters[i]);
         if(kappa_plus[i].get_nbins() > 0)
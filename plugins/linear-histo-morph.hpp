@@ -56,7 +56,25 @@ public:
         return h;
     }
 
+    /** \brief The derivative of the interpolated Histogram w.r.t. the parameter \c pid
+     *
+     * This includes the derivative of the normalization. Bins which are cut off at zero have derivative zero.
+     * At delta[i] = 0, the derivative for negative delta[i] is returned.
+     */
+    virtual const theta::Histogram & gradient(const theta::ParValues & values, const theta::ParId & pid) const;
+
+    virtual bool provides_derivatives() const{
+        return true;
+    }
+
 private:
+    /** \brief Fill h with the binwise interpolation, before normalization
+     *
+     * This is the histogram of step 1 and 2 in the class documentation, i.e. after the lower bin cutoff
+     * and before rescaling. Returns the normalization factor from the rate uncertainties.
+     */
+    double interpolate(const theta::ParValues & values) const;
+
     /** \brief Build a (constant) Histogram from a Setting block.
     *
     * Will throw an InvalidArgumentException if the Histogram is not constant.
@@ -76,6 +94,8 @@ private:
     
     //the Histogram returned by operator(). Defined as mutable to allow operator() to be const.
     mutable theta::Histogram h;
+    //the Histogram returned by gradient
+    mutable theta::Histogram h_gradient;
 };
 
 #endif
@@ -5,6 +5,17 @@
 #include "interface/distribution.hpp"
 #include "interface/model.hpp"
 #include "interface/redirect_stdio.hpp"
+#include "interface/plugin.hpp"
+#include "interface/phys.hpp"
+#include "interface/random-utils.hpp"
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/cstdint.hpp>
+
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <cassert>
@@ -15,6 +26,9 @@
 #include <iomanip>
 #include <cstdio>
 #include <sstream>
+#include <fstream>
+#include <map>
+#include <set>
 
 using namespace std;
 
@@ -68,6 +82,363 @@ void get_cholesky(const Matrix & cov, Matrix & result, int expect_reduced){
     }
 }
 
+MCMCOptions::MCMCOptions(): adaptive(true), n_temperatures(1), max_temperature(10.0), target_ess(0.0), check_interval(1000), n_chains(1){}
+
+MCMCOptions::MCMCOptions(const plugin::Configuration & cfg): adaptive(true), n_temperatures(1), max_temperature(10.0),
+        target_ess(0.0), check_interval(1000), n_chains(1){
+    SettingWrapper s = cfg.setting;
+    if(s.exists("adaptive")){
+        adaptive = s["adaptive"];
+    }
+    if(s.exists("temperatures")){
+        n_temperatures = static_cast<unsigned int>(s["temperatures"]);
+        if(n_temperatures == 0){
+            throw ConfigurationException("MCMCOptions: 'temperatures' must be at least 1");
+        }
+    }
+    if(s.exists("max-temperature")){
+        max_temperature = s["max-temperature"];
+        if(!(max_temperature > 1.0)){
+            throw ConfigurationException("MCMCOptions: 'max-temperature' must be larger than 1");
+        }
+    }
+    if(s.exists("target-ess")){
+        target_ess = s["target-ess"];
+        if(target_ess < 0.0){
+            throw ConfigurationException("MCMCOptions: 'target-ess' must not be negative");
+        }
+    }
+    if(s.exists("check-interval")){
+        check_interval = static_cast<unsigned int>(s["check-interval"]);
+        if(check_interval == 0){
+            throw ConfigurationException("MCMCOptions: 'check-interval' must be at least 1");
+        }
+    }
+    if(s.exists("proposal-cache")){
+        proposal_cache = static_cast<string>(s["proposal-cache"]);
+    }
+    if(s.exists("chains")){
+        n_chains = static_cast<unsigned int>(s["chains"]);
+        if(n_chains == 0){
+            throw ConfigurationException("MCMCOptions: 'chains' must be at least 1");
+        }
+    }
+}
+
+
+MCMCProposal::MCMCProposal(const Matrix & sqrt_cov): npar(sqrt_cov.getRows()), npar_reduced(npar), fixed(npar), lm(npar * (npar + 1) / 2),
+        dx(npar), initial_var(npar), n_points(0), mean(npar), count_covariance(npar, npar){
+    for(size_t i=0; i<npar; i++){
+        if(sqrt_cov(i,i)==0){
+            fixed[i] = true;
+            --npar_reduced;
+        }
+    }
+    if(npar_reduced==0){
+        throw InvalidArgumentException("MCMCProposal: all parameters are fixed");
+    }
+    factor = 2.38 / sqrt(npar_reduced);
+    size_t z = 0;
+    for (size_t i = 0; i < npar; i++) {
+        for (size_t j = 0; j <= i; j++) {
+            lm[z] = sqrt_cov(i,j) * factor;
+            initial_var[i] += sqrt_cov(i,j) * sqrt_cov(i,j);
+            z++;
+        }
+    }
+}
+
+void MCMCProposal::add_point(const double * x){
+    ++n_points;
+    //as in Result::fill: update the mean first, then use the differences to the old and new mean:
+    for(size_t i=0; i<npar; ++i){
+        dx[i] = x[i] - mean[i];
+        mean[i] += dx[i] / n_points;
+    }
+    for(size_t i=0; i<npar; ++i){
+        for(size_t j=0; j<=i; ++j){
+            count_covariance(i,j) += dx[i] * (x[j] - mean[j]);
+        }
+    }
+}
+
+void MCMCProposal::adapt(){
+    if(n_points < max<size_t>(100, 2 * npar_reduced)) return;
+    Matrix cov(npar, npar), sqrt_cov;
+    for(size_t i=0; i<npar; ++i){
+        if(fixed[i]) continue;
+        for(size_t j=0; j<i; ++j){
+            if(fixed[j]) continue;
+            cov(i,j) = cov(j,i) = count_covariance(i,j) / (n_points - 1);
+        }
+        cov(i,i) = count_covariance(i,i) / (n_points - 1) + 1e-6 * initial_var[i];
+    }
+    try{
+        get_cholesky(cov, sqrt_cov, npar_reduced);
+    }
+    catch(Exception &){
+        //keep the current proposal:
+        return;
+    }
+    size_t z = 0;
+    for (size_t i = 0; i < npar; i++) {
+        for (size_t j = 0; j <= i; j++) {
+            lm[z] = sqrt_cov(i,j) * factor;
+            z++;
+        }
+    }
+}
+
+
+MCMCBatchMeans::MCMCBatchMeans(size_t npar_, size_t batch_size_): npar(npar_), batch_size(batch_size_), n(0), mean(npar), m2(npar),
+        n_batch(0), batch_sum(npar){
+}
+
+void MCMCBatchMeans::add(const double * x, size_t weight){
+    for(size_t i=0; i<npar; ++i){
+        const double delta = x[i] - mean[i];
+        mean[i] += delta * weight / (n + weight);
+        m2[i] += weight * delta * (x[i] - mean[i]);
+    }
+    n += weight;
+    //fill the batches; a weighted point can complete several batches:
+    while(weight > 0){
+        size_t w = min(weight, batch_size - n_batch);
+        for(size_t i=0; i<npar; ++i){
+            batch_sum[i] += w * x[i];
+        }
+        n_batch += w;
+        weight -= w;
+        if(n_batch == batch_size){
+            for(size_t i=0; i<npar; ++i){
+                batch_means.push_back(batch_sum[i] / batch_size);
+                batch_sum[i] = 0.0;
+            }
+            n_batch = 0;
+        }
+    }
+}
+
+double MCMCBatchMeans::ess(const MCMCProposal & proposal) const{
+    const size_t nb = batch_means.size() / npar;
+    if(nb < 4) return 0.0;
+    //combine m consecutive batches to a = nb / m batches:
+    const size_t m = static_cast<size_t>(sqrt(static_cast<double>(nb)));
+    const size_t a = nb / m;
+    double result = numeric_limits<double>::infinity();
+    for(size_t i=0; i<npar; ++i){
+        if(proposal.is_fixed(i) || m2[i] <= 0.0) continue;
+        const double var = m2[i] / (n - 1);
+        double sum = 0.0, sum2 = 0.0;
+        for(size_t k=0; k<a; ++k){
+            double bmean = 0.0;
+            for(size_t l=0; l<m; ++l){
+                bmean += batch_means[(k * m + l) * npar + i];
+            }
+            bmean /= m;
+            sum += bmean;
+            sum2 += bmean * bmean;
+        }
+        const double var_b = (sum2 - sum * sum / a) / (a - 1);
+        if(var_b <= 0.0) continue;
+        result = min(result, a * var / var_b);
+    }
+    if(std::isinf(result)) return n;
+    return result;
+}
+
+MCMCChainRecord::MCMCChainRecord(size_t npar_, bool store_points_): npar(npar_), store_points(store_points_), count(0), mean(npar), m2(npar){
+}
+
+void MCMCChainRecord::fill(const double * x, double nll, size_t weight){
+    for(size_t i=0; i<npar; ++i){
+        const double delta = x[i] - mean[i];
+        mean[i] += delta * weight / (count + weight);
+        m2[i] += weight * delta * (x[i] - mean[i]);
+    }
+    count += weight;
+    if(store_points){
+        points.insert(points.end(), x, x + npar);
+        nll_values.push_back(nll);
+        weights.push_back(weight);
+    }
+}
+
+
+namespace{
+
+// runs one chain of MCMCChains::run_chains in its own thread
+class chain_task{
+public:
+    chain_task(const NLLikelihood & nll_, Random & rnd_, const std::vector<double> & startvalues_, const Matrix & sqrt_cov_,
+               size_t iterations_, size_t burn_in_, const MCMCOptions & options_, MCMCChainRecord & record_, MCMCChainInfo & info_):
+               nll(nll_), rnd(rnd_), startvalues(startvalues_), sqrt_cov(sqrt_cov_), iterations(iterations_), burn_in(burn_in_),
+               options(options_), record(record_), info(info_){}
+
+    void operator()(){
+        HistodataPoolGuard pool_guard;
+        try{
+            info = adaptiveMetropolis(nll, record, rnd, startvalues, sqrt_cov, iterations, burn_in, options);
+        }
+        catch(...){
+            error = theta::current_exception();
+        }
+    }
+
+    // the exception thrown by the chain, if any:
+    const boost::exception_ptr & get_error() const{
+        return error;
+    }
+
+private:
+    const NLLikelihood & nll;
+    Random & rnd;
+    const std::vector<double> & startvalues;
+    const Matrix & sqrt_cov;
+    size_t iterations, burn_in;
+    const MCMCOptions & options;
+    MCMCChainRecord & record;
+    MCMCChainInfo & info;
+    boost::exception_ptr error;
+};
+
+// overdispersed start for a chain of MCMCChains: a point drawn around startvalues from a gaussian with twice the width
+// of the proposal sqrt_cov. Points where the likelihood is not finite (e.g. outside the parameter ranges) are rejected; if
+// no valid point is found, x is startvalues.
+void jitter_start(const NLLikelihood & nll, Random & rnd, const std::vector<double> & startvalues, const Matrix & sqrt_cov, std::vector<double> & x){
+    const size_t npar = startvalues.size();
+    std::vector<double> z(npar);
+    for(int attempt=0; attempt<10; ++attempt){
+        for(size_t i=0; i<npar; ++i){
+            z[i] = rnd.gauss();
+        }
+        for(size_t i=0; i<npar; ++i){
+            x[i] = startvalues[i];
+            for(size_t j=0; j<=i; ++j){
+                x[i] += 2.0 * sqrt_cov(i,j) * z[j];
+            }
+        }
+        if(std::isfinite(nll(&x[0]))) return;
+    }
+    x = startvalues;
+}
+
+}
+
+MCMCChains::MCMCChains(const plugin::Configuration & cfg, const MCMCOptions & options_): options(options_){
+    if(options.n_chains == 1) return;
+    if(!cfg.pm->exists<SettingWrapper>("model")){
+        throw ConfigurationException("MCMCChains: chains > 1 is only possible within a run which defines a model");
+    }
+    plugin::Configuration model_cfg(cfg, *cfg.pm->get<SettingWrapper>("model"));
+    //the random number generators of the chains use the source type configured for the producer:
+    std::string source_type = "taus";
+    if(cfg.setting.exists("rnd_gen") && cfg.setting["rnd_gen"].exists("source_type")){
+        source_type = static_cast<std::string>(cfg.setting["rnd_gen"]["source_type"]);
+    }
+    std::string name = cfg.setting.exists("name") ? static_cast<std::string>(cfg.setting["name"]) : "mcmc";
+    for(size_t k=1; k<options.n_chains; ++k){
+        models.push_back(plugin::PluginManager<Model>::instance().build(model_cfg));
+        boost::shared_ptr<Distribution> dist;
+        if(cfg.setting.exists("override-parameter-distribution")){
+            dist = plugin::PluginManager<Distribution>::instance().build(plugin::Configuration(cfg, cfg.setting["override-parameter-distribution"]));
+        }
+        override_distributions.push_back(dist);
+        boost::shared_ptr<Function> term;
+        if(cfg.setting.exists("additional-nll-term")){
+            term = plugin::PluginManager<Function>::instance().build(plugin::Configuration(cfg, cfg.setting["additional-nll-term"]));
+        }
+        additional_terms.push_back(term);
+        std::stringstream chain_name;
+        chain_name << name << "__chain" << k;
+        rnds.push_back(new Random(make_random_source(source_type, chain_name.str()).release()));
+    }
+}
+
+MCMCChains::~MCMCChains(){}
+
+void MCMCChains::run_chains(const NLLikelihood & nll, const Data & data, Random & rnd, const std::vector<double> & startvalues, const Matrix & sqrt_cov,
+                    size_t iterations, size_t burn_in, boost::ptr_vector<MCMCChainRecord> & records, std::vector<MCMCChainInfo> & infos){
+    const size_t n = options.n_chains;
+    MCMCOptions chain_options(options);
+    chain_options.target_ess = options.target_ess / n;
+    boost::ptr_vector<NLLikelihood> nlls;
+    for(size_t k=1; k<n; ++k){
+        std::auto_ptr<NLLikelihood> chain_nll = models[k-1].getNLLikelihood(data);
+        if(override_distributions[k-1]){
+            chain_nll->set_override_distribution(override_distributions[k-1]);
+        }
+        chain_nll->set_additional_term(additional_terms[k-1]);
+        nlls.push_back(chain_nll);
+        rnds[k-1].set_seed(rnd.get());
+    }
+    //each chain starts at its own overdispersed point, so that R-hat can detect chains which did not forget their start:
+    std::vector<std::vector<double> > chain_startvalues(n, startvalues);
+    for(size_t k=0; k<n; ++k){
+        jitter_start(k==0 ? nll : nlls[k-1], k==0 ? rnd : rnds[k-1], startvalues, sqrt_cov, chain_startvalues[k]);
+    }
+    records.clear();
+    infos.resize(n);
+    boost::ptr_vector<chain_task> tasks;
+    for(size_t k=0; k<n; ++k){
+        records.push_back(new MCMCChainRecord(nll.getnpar(), true));
+        //the first chain takes the remaining iterations:
+        size_t chain_iterations = iterations / n + (k==0 ? iterations % n : 0);
+        tasks.push_back(new chain_task(k==0 ? nll : nlls[k-1], k==0 ? rnd : rnds[k-1], chain_startvalues[k], sqrt_cov, chain_iterations, burn_in,
+                                       chain_options, records[k], infos[k]));
+    }
+    //the threads are started for each call; this costs some ten microseconds per chain which is small compared to
+    // the likelihood evaluations of a chain:
+    boost::thread_group threads;
+    for(size_t k=0; k<n; ++k){
+        threads.create_thread(boost::ref(tasks[k]));
+    }
+    threads.join_all();
+    //pass on the exception of the first failed chain with its original type:
+    for(size_t k=0; k<n; ++k){
+        if(tasks[k].get_error()) boost::rethrow_exception(tasks[k].get_error());
+    }
+}
+
+MCMCDiagnostics MCMCChains::get_diagnostics(const boost::ptr_vector<MCMCChainRecord> & records, const std::vector<MCMCChainInfo> & infos,
+                    const Matrix & sqrt_cov) const{
+    MCMCDiagnostics result;
+    result.ess = 0.0;
+    for(size_t k=0; k<infos.size(); ++k){
+        result.ess += infos[k].ess;
+    }
+    // Gelman-Rubin: compare the within-chain variance W to the variance of the chain means B / n:
+    const size_t m = records.size();
+    double n = 0.0;
+    for(size_t k=0; k<m; ++k){
+        n += records[k].get_count();
+    }
+    n /= m;
+    result.rhat = 1.0;
+    for(size_t i=0; i<sqrt_cov.getRows(); ++i){
+        if(sqrt_cov(i,i)==0.0) continue;
+        double w = 0.0, mean = 0.0;
+        for(size_t k=0; k<m; ++k){
+            w += records[k].get_variance(i);
+            mean += records[k].get_mean(i);
+        }
+        w /= m;
+        mean /= m;
+        double b_over_n = 0.0;
+        for(size_t k=0; k<m; ++k){
+            const double d = records[k].get_mean(i) - mean;
+            b_over_n += d * d;
+        }
+        b_over_n /= m - 1;
+        if(w == 0.0){
+            if(b_over_n > 0.0) result.rhat = numeric_limits<double>::infinity();
+            continue;
+        }
+        result.rhat = max(result.rhat, sqrt(((n - 1) / n * w + b_over_n) / w));
+    }
+    return result;
+}
+
 bool jump_rates_converged(const vector<double> & jump_rates){
     if(jump_rates.size() < 2) return false;
     const size_t n = jump_rates.size();
@@ -83,6 +454,242 @@ bool jump_rates_converged(const vector<double> & jump_rates){
 }
 
 
+Matrix get_sqrt_cov_diagonal(const Model & model, std::vector<double> & startvalues,
+                    const boost::shared_ptr<theta::Distribution> & override_parameter_distribution){
+    const size_t n = model.getParameters().size();
+    Matrix sqrt_cov(n, n);
+    startvalues.resize(n);
+    ParValues widths = asimov_likelihood_widths(model, override_parameter_distribution);
+    const Distribution & dist = override_parameter_distribution.get()? *override_parameter_distribution : model.get_parameter_distribution();
+    ParValues pv_start;
+    dist.mode(pv_start);
+    ParIds par_ids = model.getParameters();
+    size_t k=0;
+    for(ParIds::const_iterator it=par_ids.begin(); it!=par_ids.end(); ++it, ++k){
+        startvalues[k] = pv_start.get(*it);
+        sqrt_cov(k, k) = widths.get(*it);
+    }
+    return sqrt_cov;
+}
+
+namespace{
+
+// 64 bit FNV-1a hash of the parameters, parameter distribution and model predictions; see get_sqrt_cov_start
+class fingerprint{
+public:
+    fingerprint(): h(14695981039346656037ULL){}
+
+    void add(const void * data, size_t n){
+        const unsigned char * p = static_cast<const unsigned char*>(data);
+        for(size_t i=0; i<n; ++i){
+            h ^= p[i];
+            h *= 1099511628211ULL;
+        }
+    }
+
+    void add(double d){
+        add(&d, sizeof(double));
+    }
+
+    void add(const string & s){
+        add(s.data(), s.size());
+        add(static_cast<double>(s.size()));
+    }
+
+    void add(const Histogram & h){
+        add(static_cast<double>(h.get_nbins()));
+        add(h.get_xmin());
+        add(h.get_xmax());
+        add(h.getData(), sizeof(double) * (h.get_nbins() + 2));
+    }
+
+    string str() const{
+        stringstream ss;
+        ss << hex << setw(16) << setfill('0') << h;
+        return ss.str();
+    }
+
+    boost::uint64_t value() const{
+        return h;
+    }
+
+private:
+    boost::uint64_t h;
+};
+
+string proposal_key(const string & kind, const Model & model, const boost::shared_ptr<Distribution> & override_parameter_distribution,
+                    const VarIdManager & vm){
+    const Distribution & dist = override_parameter_distribution.get()? *override_parameter_distribution : model.get_parameter_distribution();
+    ParIds par_ids = model.getParameters();
+    ObsIds obs_ids = model.getObservables();
+    ParValues mode;
+    dist.mode(mode);
+    fingerprint fp;
+    fp.add(kind);
+    for(ParIds::const_iterator it=par_ids.begin(); it!=par_ids.end(); ++it){
+        fp.add(vm.getName(*it));
+        fp.add(mode.get(*it));
+        fp.add(dist.support(*it).first);
+        fp.add(dist.support(*it).second);
+    }
+    for(ObsIds::const_iterator it=obs_ids.begin(); it!=obs_ids.end(); ++it){
+        fp.add(vm.getName(*it));
+    }
+    //probe the distribution and model at the mode and one shifted point per parameter:
+    ParIds::const_iterator shifted = par_ids.end();
+    do{
+        ParValues values(mode);
+        if(shifted != par_ids.end()){
+            double v = mode.get(*shifted);
+            const pair<double, double> & support = dist.support(*shifted);
+            v += 0.1 * max(fabs(v), 1.0);
+            if(v > support.second) v = mode.get(*shifted) - 0.1 * max(fabs(mode.get(*shifted)), 1.0);
+            if(v < support.first) v = mode.get(*shifted);
+            values.set(*shifted, v);
+        }
+        fp.add(dist.evalNL(values));
+        Data prediction;
+        model.get_prediction(prediction, values);
+        for(ObsIds::const_iterator it=obs_ids.begin(); it!=obs_ids.end(); ++it){
+            fp.add(prediction[*it]);
+        }
+        shifted = shifted == par_ids.end() ? par_ids.begin() : ++shifted;
+    } while(shifted != par_ids.end());
+    return kind + ":" + fp.str();
+}
+
+// the process-wide cache of starting values and proposal matrices, see get_sqrt_cov_start.
+// Each line of a cache file is one entry: the key, the number of parameters n, the n starting values and
+// the n(n+1)/2 elements of the lower triangle of the proposal matrix.
+class ProposalCache{
+public:
+    static ProposalCache & instance(){
+        static ProposalCache cache;
+        return cache;
+    }
+
+    // get the entry for key, calculating it if it is neither in memory nor in filename. The mutex of the entry is held during
+    // the calculation, so each entry is calculated only once per process; the global mutex only protects the map.
+    Matrix get(const string & key, const string & filename, bool diagonal, const Model & model, vector<double> & startvalues,
+               const boost::shared_ptr<Distribution> & override_parameter_distribution, const boost::shared_ptr<VarIdManager> & vm){
+        boost::shared_ptr<entry> e;
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if(loaded_files.count(filename) == 0){
+                load(filename);
+                loaded_files.insert(filename);
+            }
+            boost::shared_ptr<entry> & slot = entries[make_pair(filename, key)];
+            if(!slot) slot.reset(new entry());
+            e = slot;
+        }
+        boost::mutex::scoped_lock entry_lock(e->mutex);
+        if(!e->ready){
+            if(diagonal){
+                e->sqrt_cov = get_sqrt_cov_diagonal(model, e->startvalues, override_parameter_distribution);
+            }
+            else{
+                //use a random number generator seeded from the key, so that the entry does not depend on which
+                // thread or producer calculates it first:
+                fingerprint fp;
+                fp.add(key);
+                Random rnd(new RandomSourceTaus());
+                rnd.set_seed(static_cast<unsigned int>(fp.value() ^ (fp.value() >> 32)));
+                e->sqrt_cov = get_sqrt_cov2(rnd, model, e->startvalues, override_parameter_distribution, vm);
+            }
+            append(filename, key, *e);
+            e->ready = true;
+        }
+        startvalues = e->startvalues;
+        return e->sqrt_cov;
+    }
+
+private:
+    struct entry: private boost::noncopyable{
+        boost::mutex mutex;
+        // whether startvalues and sqrt_cov are set:
+        bool ready;
+        vector<double> startvalues;
+        Matrix sqrt_cov;
+
+        entry(): ready(false){}
+    };
+
+    // appends the entry as one line to filename. Other processes might use the same file, so the line is written
+    // with a single write call while holding an exclusive lock of the file.
+    void append(const string & filename, const string & key, const entry & e){
+        const size_t n = e.startvalues.size();
+        stringstream line;
+        line << setprecision(17) << key << " " << n;
+        for(size_t i=0; i<n; ++i){
+            line << " " << e.startvalues[i];
+        }
+        for(size_t i=0; i<n; ++i){
+            for(size_t j=0; j<=i; ++j){
+                line << " " << e.sqrt_cov(i,j);
+            }
+        }
+        line << "\n";
+        const string & data = line.str();
+        int fd = open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+        bool success = fd >= 0 && flock(fd, LOCK_EX) == 0 && write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+        if(fd >= 0) close(fd);
+        if(!success){
+            throw Exception("could not write proposal cache file '" + filename + "'");
+        }
+    }
+
+    // reads the entries from filename, holding a shared lock of the file; incomplete lines (e.g. from an interrupted write) are ignored.
+    void load(const string & filename){
+        int fd = open(filename.c_str(), O_RDONLY);
+        if(fd < 0) return;
+        flock(fd, LOCK_SH);
+        ifstream in(filename.c_str());
+        string line;
+        while(getline(in, line)){
+            istringstream ss(line);
+            string key;
+            size_t n = 0;
+            if(!(ss >> key >> n) || n==0) continue;
+            boost::shared_ptr<entry> e(new entry());
+            e->startvalues.resize(n);
+            e->sqrt_cov.reset(n, n);
+            for(size_t i=0; i<n; ++i){
+                ss >> e->startvalues[i];
+            }
+            for(size_t i=0; i<n; ++i){
+                for(size_t j=0; j<=i; ++j){
+                    ss >> e->sqrt_cov(i,j);
+                }
+            }
+            if(!ss) continue;
+            e->ready = true;
+            entries[make_pair(filename, key)] = e;
+        }
+        close(fd);
+    }
+
+    // protects entries and loaded_files:
+    boost::mutex mutex;
+    // the entries by filename and key:
+    map<pair<string, string>, boost::shared_ptr<entry> > entries;
+    set<string> loaded_files;
+};
+
+}
+
+Matrix get_sqrt_cov_start(const MCMCOptions * options, Random & rnd, const Model & model, std::vector<double> & startvalues,
+                    const boost::shared_ptr<theta::Distribution> & override_parameter_distribution,
+                    const boost::shared_ptr<VarIdManager> & vm){
+    const bool diagonal = options && options->adaptive;
+    if(options==0 || options->proposal_cache.empty()){
+        if(diagonal) return get_sqrt_cov_diagonal(model, startvalues, override_parameter_distribution);
+        else return get_sqrt_cov2(rnd, model, startvalues, override_parameter_distribution, vm);
+    }
+    const string key = proposal_key(diagonal ? "diagonal" : "cov2", model, override_parameter_distribution, *vm);
+    return ProposalCache::instance().get(key, options->proposal_cache, diagonal, model, startvalues, override_parameter_distribution, vm);
+}
+
 Matrix get_sqrt_cov2(Random & rnd, const Model & model, std::vector<double> & startvalues,
                     const boost::shared_ptr<theta::Distribution> & override_parameter_distribution,
                     const boost::shared_ptr<VarIdManager> & vm){
@@ -123,15 +730,24 @@ Matrix get_sqrt_cov2(Random & rnd, const Model & model, std::vector<double> & st
     vector<double> jump_rates;
     jump_rates.reserve(max_passes);
     Result res(n);
-    for (size_t i = 0; i < max_passes; i++) {
-        res.reset();
-        metropolisHastings(nll, res, rnd, startvalues, sqrt_cov, iterations, iterations/10);
-        startvalues = res.getMeans();
-        cov = res.getCov();
-        get_cholesky(cov, sqrt_cov, static_cast<int>(n) - n_fixed_parameters);
-        jump_rates.push_back(static_cast<double>(res.getCountDifferent()) / res.getCount());
-        if(jump_rates_converged(jump_rates)) break;
+    //for counter-based random sources, make the result independent of the event for which this is called:
+    rnd.begin_run_stream();
+    try{
+        for (size_t i = 0; i < max_passes; i++) {
+            res.reset();
+            metropolisHastings(nll, res, rnd, startvalues, sqrt_cov, iterations, iterations/10);
+            startvalues = res.getMeans();
+            cov = res.getCov();
+            get_cholesky(cov, sqrt_cov, static_cast<int>(n) - n_fixed_parameters);
+            jump_rates.push_back(static_cast<double>(res.getCountDifferent()) / res.getCount());
+            if(jump_rates_converged(jump_rates)) break;
+        }
+    }
+    catch(...){
+        rnd.end_run_stream();
+        throw;
     }
+    rnd.end_run_stream();
     if(jump_rates.size()==max_passes){
         theta::cout << "WARNING in get_sqrt_cov: covariance estimate did not really converge; jump rates were: ";
         for(size_t i=0; i<max_passes; ++i){
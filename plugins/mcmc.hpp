@@ -7,9 +7,13 @@
 #include "interface/phys.hpp"
 
 #include <vector>
+#include <string>
 #include <cmath>
+#include <algorithm>
 
 #include <boost/scoped_array.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/utility.hpp>
 
 namespace theta {
 /** Run the metropolis-Hastings Markov-Chain Monte-Carlo algorithm.
@@ -102,6 +106,432 @@ void metropolisHastings(const nlltype & nllikelihood, resulttype &res, Random &
     res.fill(x.get(), nll, weight);
 }
 
+/** \brief Settings of the adaptive MCMC engine adaptiveMetropolis
+ *
+ * The MCMC producers (\link mcmc_quantiles mcmc_quantiles\endlink, \link mcmc_posterior_histo mcmc_posterior_histo\endlink,
+ * \link mcmc_posterior_ratio mcmc_posterior_ratio\endlink and \link mcmc_mean_prediction mcmc_mean_prediction\endlink) use
+ * this engine instead of metropolisHastings if their optional setting \c mcmc is given. It refers to a setting group
+ * which can be shared by all producers, like
+ * \code
+ * mcmc-engine = {
+ *   adaptive = true;        // optional; default is true
+ *   temperatures = 4;       // optional; default is 1 (no parallel tempering)
+ *   max-temperature = 20.0; // optional; default is 10.0
+ *   target-ess = 2000.0;    // optional; default is 0.0 (always run all iterations)
+ *   check-interval = 1000;  // optional; default is 1000
+ *   chains = 4;             // optional; default is 1
+ *   proposal-cache = "proposals.txt"; // optional; default is no file
+ * };
+ *
+ * hypotest = {
+ *   type = "mcmc_posterior_ratio";
+ *   // ...
+ *   iterations = 100000;
+ *   mcmc = "@mcmc-engine";
+ * };
+ * \endcode
+ *
+ * \c adaptive enables the online adaptation of the proposal covariance during burn-in (Haario et al.,
+ * "An adaptive Metropolis algorithm", Bernoulli 7, 2001). The chain starts with a diagonal covariance from the asimov likelihood
+ * widths, so the expensive preparation of get_sqrt_cov2 is not needed. If \c adaptive is false, the covariance is estimated
+ * once with get_sqrt_cov2 as for metropolisHastings.
+ *
+ * \c temperatures is the number of chains for parallel tempering. The chains sample the posterior raised to the power
+ * 1/T with temperatures T forming a geometric ladder from 1 to \c max-temperature; after each iteration, an exchange
+ * of the states of a random pair of neighboring chains is proposed. Only the chain with T=1 is reported. This helps
+ * for multimodal posteriors, but the run time is proportional to the number of temperatures.
+ *
+ * \c target-ess is the effective sample size (ESS) at which to stop the chain. If positive, the ESS is estimated every
+ * \c check-interval iterations after burn-in using batch means, and the chain stops once the ESS of all non-fixed parameters exceeds
+ * \c target-ess. In this case, the \c iterations setting of the producer is the maximum number of iterations. The cost of
+ * an ESS estimate is proportional to the number of points so far, so \c check-interval should not be much smaller than
+ * the default.
+ *
+ * \c chains is the number of independent chains to run for each call of the producer, each in its own thread, see MCMCChains.
+ * The \c iterations and \c target-ess are split evenly among the chains; each chain has its own burn-in. The producers
+ * write the combined ESS to a column "ess" and, for more than one chain, the Gelman-Rubin R-hat to a column "rhat".
+ *
+ * \c proposal-cache is the name of a file used to keep the starting values and proposal matrices between processes, see get_sqrt_cov_start.
+ * Without this setting, they are calculated anew by each producer.
+ */
+struct MCMCOptions{
+    /// Whether to adapt the proposal covariance during burn-in
+    bool adaptive;
+
+    /// The number of parallel tempering chains; 1 disables parallel tempering
+    size_t n_temperatures;
+
+    /// The temperature of the hottest chain; only used if n_temperatures &gt; 1
+    double max_temperature;
+
+    /// The effective sample size at which to stop; zero to always run all iterations
+    double target_ess;
+
+    /// The number of iterations between two evaluations of the stopping criterion
+    size_t check_interval;
+
+    /// The number of independent chains, see MCMCChains
+    size_t n_chains;
+
+    /// The file to persist the proposal cache to, see get_sqrt_cov_start; empty for no file
+    std::string proposal_cache;
+
+    /// Default settings: adaptive, one chain without parallel tempering, no ESS-based stopping
+    MCMCOptions();
+
+    /// Read the settings from the setting group in \c cfg
+    explicit MCMCOptions(const plugin::Configuration & cfg);
+};
+
+/// \brief Information about a Markov chain run with adaptiveMetropolis
+struct MCMCChainInfo{
+    /// The number of iterations reported, excluding burn-in
+    size_t iterations;
+
+    /// The fraction of accepted proposals of the T=1 chain after burn-in
+    double acceptance_rate;
+
+    /// The fraction of accepted exchanges between neighboring chains of the temperature ladder; zero without tempering
+    double swap_rate;
+
+    /// The estimated effective sample size of the reported chain, minimum over all non-fixed parameters
+    double ess;
+};
+
+/** \brief Gaussian proposal for adaptiveMetropolis with an adaptable covariance
+ *
+ * The proposal is x_new = x + scale * factor * L * z, where z is a vector of independent standard normal random numbers,
+ * L the lower triangular Cholesky factor of the current covariance estimate and factor = 2.38 / sqrt(n) for n non-fixed
+ * parameters, as in metropolisHastings. Parameters with zero initial width are fixed and never change.
+ */
+class MCMCProposal{
+public:
+    /// Start with the Cholesky factor \c sqrt_cov
+    explicit MCMCProposal(const Matrix & sqrt_cov);
+
+    /// The number of parameters
+    size_t getnpar() const{
+        return npar;
+    }
+
+    /// The number of non-fixed parameters
+    size_t get_npar_reduced() const{
+        return npar_reduced;
+    }
+
+    /// Whether parameter \c i is fixed
+    bool is_fixed(size_t i) const{
+        return fixed[i];
+    }
+
+    /// Write a proposal point for current point \c x to \c x_new; \c scale multiplies the step size
+    void propose(Random & rand, const double * x, double * x_new, double scale) const{
+        for (size_t i = 0; i < npar; i++) {
+            dx[i] = rand.gauss();
+        }
+        size_t z = 0;
+        for (size_t i = 0; i < npar; ++i) {
+            double d = 0.0;
+            for (size_t j = 0; j <= i; ++j) {
+                d += lm[z] * dx[j];
+                z++;
+            }
+            x_new[i] = x[i] + scale * d;
+        }
+    }
+
+    /// Add a point of the chain to the running covariance estimate
+    void add_point(const double * x);
+
+    /** \brief Use the running covariance estimate for the proposal
+     *
+     * A small multiple of the initial covariance is added to the estimate to keep it regular. The proposal
+     * is not changed if there are not enough points yet or if the estimate is not positive definite.
+     */
+    void adapt();
+
+private:
+    size_t npar, npar_reduced;
+    double factor;
+    std::vector<char> fixed;
+    // lower triangle of the current Cholesky factor, times factor:
+    std::vector<double> lm;
+    mutable std::vector<double> dx;
+    // diagonal of the initial covariance:
+    std::vector<double> initial_var;
+    // running mean and covariance times n_points of the added points:
+    size_t n_points;
+    std::vector<double> mean;
+    Matrix count_covariance;
+};
+
+/** \brief Online estimate of the effective sample size of a Markov chain
+ *
+ * Uses batch means: the chain is split into consecutive batches of \c batch_size points whose means are stored.
+ * For the ESS estimate, these are combined into about sqrt(n / batch_size) batches of equal size b and the ESS is
+ * n * var / (b * var_b), where var is the variance of the chain and var_b the variance of the batch means.
+ */
+class MCMCBatchMeans{
+public:
+    /// Construct for chains with \c npar parameters
+    MCMCBatchMeans(size_t npar, size_t batch_size = 50);
+
+    /// Add \c weight points at \c x
+    void add(const double * x, size_t weight);
+
+    /// The number of points added
+    size_t get_count() const{
+        return n;
+    }
+
+    /** \brief The estimated effective sample size
+     *
+     * Returns the minimum over the parameters for which \c proposal.is_fixed is false and for which the chain
+     * has non-zero variance. Returns 0 if there are less than four complete batches.
+     */
+    double ess(const MCMCProposal & proposal) const;
+
+private:
+    size_t npar, batch_size;
+    size_t n;
+    std::vector<double> mean, m2;
+    // sum of the current batch:
+    size_t n_batch;
+    std::vector<double> batch_sum;
+    // means of the completed batches, npar values per batch:
+    std::vector<double> batch_means;
+};
+
+/** \brief Run an adaptive Metropolis Markov chain, optionally with parallel tempering and ESS-based stopping
+ *
+ * The parameters \c nllikelihood, \c res, \c rand and \c startvalues have the same meaning as for metropolisHastings; \c sqrt_cov
+ * is the initial Cholesky factor of the proposal covariance. \c iterations is the (maximum) number of iterations reported to \c res.
+ * The algorithm is controlled by \c options, see MCMCOptions.
+ *
+ * The proposal covariance is adapted only during the \c burn_in iterations, so the reported chain is a Metropolis-Hastings chain
+ * with fixed proposal. With parallel tempering, all chains start at \c startvalues and use the proposal of the T=1 chain scaled by
+ * sqrt(T).
+ */
+template<class nlltype, class resulttype>
+MCMCChainInfo adaptiveMetropolis(const nlltype & nllikelihood, resulttype &res, Random & rand,
+        const std::vector<double> & startvalues, const Matrix & sqrt_cov, size_t iterations, size_t burn_in,
+        const MCMCOptions & options) {
+    const size_t npar = startvalues.size();
+    if(npar != sqrt_cov.getRows() || npar!=sqrt_cov.getCols() || npar!=nllikelihood.getnpar() || npar!=res.getnpar())
+        throw InvalidArgumentException("adaptiveMetropolis: dimension/size of arguments mismatch");
+    const size_t n_t = options.n_temperatures;
+    MCMCProposal proposal(sqrt_cov);
+    MCMCBatchMeans batch_means(npar);
+    //inverse temperatures, index 0 is the T=1 chain:
+    std::vector<double> beta(n_t, 1.0);
+    std::vector<double> scale(n_t, 1.0);
+    for(size_t k=1; k<n_t; ++k){
+        beta[k] = pow(options.max_temperature, -static_cast<double>(k) / (n_t - 1));
+        scale[k] = 1.0 / sqrt(beta[k]);
+    }
+    std::vector<std::vector<double> > x(n_t, startvalues);
+    std::vector<double> nll(n_t, nllikelihood(&startvalues[0]));
+    std::vector<double> x_new(npar);
+    //the last point reported (or to be reported) for the T=1 chain:
+    std::vector<double> x_rec(startvalues);
+    double nll_rec = nll[0];
+    
+    const size_t adapt_interval = 100;
+    const size_t iter = burn_in + iterations;
+    size_t weight = 1, n_accepted = 0, n_swaps = 0, n_swaps_accepted = 0;
+    size_t it;
+    for(it = 1; it < iter; ++it){
+        bool changed = false;
+        for(size_t k=0; k<n_t; ++k){
+            proposal.propose(rand, &x[k][0], &x_new[0], scale[k]);
+            double nll_new = nllikelihood(&x_new[0]);
+            if((nll_new <= nll[k]) || (rand.uniform() < exp(beta[k] * (nll[k] - nll_new)))){
+                x[k].swap(x_new);
+                nll[k] = nll_new;
+                if(k==0){
+                    changed = true;
+                    if(it > burn_in) ++n_accepted;
+                }
+            }
+        }
+        if(n_t > 1){
+            size_t k = std::min(static_cast<size_t>(rand.uniform() * (n_t - 1)), n_t - 2);
+            ++n_swaps;
+            if(rand.uniform() < exp((beta[k] - beta[k+1]) * (nll[k] - nll[k+1]))){
+                x[k].swap(x[k+1]);
+                std::swap(nll[k], nll[k+1]);
+                ++n_swaps_accepted;
+                if(k==0) changed = true;
+            }
+        }
+        if(it <= burn_in){
+            if(options.adaptive){
+                proposal.add_point(&x[0][0]);
+                if(it % adapt_interval == 0) proposal.adapt();
+            }
+            if(changed){
+                x_rec = x[0];
+                nll_rec = nll[0];
+            }
+            continue;
+        }
+        if(changed){
+            res.fill(&x_rec[0], nll_rec, weight);
+            batch_means.add(&x_rec[0], weight);
+            weight = 1;
+            x_rec = x[0];
+            nll_rec = nll[0];
+        }
+        else{
+            ++weight;
+        }
+        if(options.target_ess > 0 && (it - burn_in + 1) % options.check_interval == 0 && batch_means.ess(proposal) >= options.target_ess){
+            ++it;
+            break;
+        }
+    }
+    res.fill(&x_rec[0], nll_rec, weight);
+    batch_means.add(&x_rec[0], weight);
+    MCMCChainInfo result;
+    result.iterations = batch_means.get_count();
+    result.acceptance_rate = result.iterations > 1 ? static_cast<double>(n_accepted) / (result.iterations - 1) : 0.0;
+    result.swap_rate = n_swaps > 0 ? static_cast<double>(n_swaps_accepted) / n_swaps : 0.0;
+    result.ess = batch_means.ess(proposal);
+    return result;
+}
+
+/// \brief Convergence diagnostics of a set of chains run by MCMCChains
+struct MCMCDiagnostics{
+    /// The sum of the effective sample sizes of the chains, see MCMCChainInfo::ess
+    double ess;
+
+    /** \brief The Gelman-Rubin potential scale reduction factor R-hat
+     *
+     * This is the maximum over the non-fixed parameters; values close to 1 indicate that the chains sample the same distribution.
+     * It is NAN for a single chain.
+     */
+    double rhat;
+};
+
+/** \brief Result class for the Markov chain engines recording the chain
+ *
+ * Keeps the weighted mean and variance of all parameters and, if \c store_points is true, all points of the
+ * chain to replay them to another result object later.
+ */
+class MCMCChainRecord{
+public:
+    /// Construct a record for a chain with \c npar parameters
+    MCMCChainRecord(size_t npar, bool store_points);
+
+    /// The number of parameters
+    size_t getnpar() const{
+        return npar;
+    }
+
+    /// Add \c weight points with parameter values \c x and negative log-likelihood \c nll
+    void fill(const double * x, double nll, size_t weight);
+
+    /// Call res.fill for all stored points in the order they were filled
+    template<class resulttype>
+    void replay(resulttype & res) const{
+        for(size_t i=0; i<weights.size(); ++i){
+            res.fill(&points[i * npar], nll_values[i], weights[i]);
+        }
+    }
+
+    /// The total weight filled
+    size_t get_count() const{
+        return count;
+    }
+
+    /// The weighted mean of parameter \c i
+    double get_mean(size_t i) const{
+        return mean[i];
+    }
+
+    /// The weighted sample variance of parameter \c i
+    double get_variance(size_t i) const{
+        return count > 1 ? m2[i] / (count - 1) : 0.0;
+    }
+
+private:
+    size_t npar;
+    bool store_points;
+    size_t count;
+    std::vector<double> mean, m2;
+    std::vector<double> points, nll_values;
+    std::vector<size_t> weights;
+};
+
+/** \brief Several independent adaptive Markov chains, run in parallel threads
+ *
+ * Runs MCMCOptions::n_chains chains with adaptiveMetropolis. The first chain uses the likelihood and random number generator
+ * passed to run. Each other chain evaluates its own likelihood function built from its own instance of the model, override distribution
+ * and additional likelihood term (as the model and function classes are not thread-safe), and has its own random number generator
+ * which is seeded from the random number generator passed to run and uses the source type configured in the \c rnd_gen setting of
+ * the producer (see RandomConsumer). So the result of run is fully determined by its arguments. If a chain throws an exception,
+ * run throws it with its original type after all chains have finished.
+ *
+ * The chains start at overdispersed points: the start of each chain is drawn from a gaussian around the start values with twice
+ * the width of the proposal \c sqrt_cov, so that the R-hat diagnostic is sensitive to chains which did not converge within
+ * the burn-in. The threads are started for each call of run, which adds some ten microseconds per chain.
+ *
+ * The additional model instances are built in the constructor from the "model" setting which the Run places in the
+ * PropertyMap of the configuration.
+ */
+class MCMCChains: private boost::noncopyable{
+public:
+    /** \brief Prepare the chains for the producer configured in \c cfg
+     *
+     * \c cfg.setting is the setting group of the producer. Its settings "override-parameter-distribution" and "additional-nll-term"
+     * are built again for each additional chain.
+     */
+    MCMCChains(const plugin::Configuration & cfg, const MCMCOptions & options);
+
+    ~MCMCChains();
+
+    /// The options
+    const MCMCOptions & get_options() const{
+        return options;
+    }
+
+    /** \brief Run all chains and fill their points into \c res
+     *
+     * The parameters have the same meaning as for adaptiveMetropolis; \c data is used to build the likelihood functions of the
+     * additional chains. The chains are filled into \c res one after the other.
+     */
+    template<class nlltype, class resulttype>
+    MCMCDiagnostics run(const nlltype & nll, const Data & data, resulttype & res, Random & rnd,
+            const std::vector<double> & startvalues, const Matrix & sqrt_cov, size_t iterations, size_t burn_in){
+        if(options.n_chains == 1){
+            MCMCDiagnostics result;
+            result.ess = adaptiveMetropolis(nll, res, rnd, startvalues, sqrt_cov, iterations, burn_in, options).ess;
+            result.rhat = NAN;
+            return result;
+        }
+        boost::ptr_vector<MCMCChainRecord> records;
+        std::vector<MCMCChainInfo> infos;
+        run_chains(nll, data, rnd, startvalues, sqrt_cov, iterations, burn_in, records, infos);
+        for(size_t k=0; k<records.size(); ++k){
+            records[k].replay(res);
+        }
+        return get_diagnostics(records, infos, sqrt_cov);
+    }
+
+private:
+    void run_chains(const NLLikelihood & nll, const Data & data, Random & rnd, const std::vector<double> & startvalues, const Matrix & sqrt_cov,
+                    size_t iterations, size_t burn_in, boost::ptr_vector<MCMCChainRecord> & records, std::vector<MCMCChainInfo> & infos);
+    MCMCDiagnostics get_diagnostics(const boost::ptr_vector<MCMCChainRecord> & records, const std::vector<MCMCChainInfo> & infos,
+                    const Matrix & sqrt_cov) const;
+
+    MCMCOptions options;
+    // for the chains 1 to n_chains - 1:
+    boost::ptr_vector<Model> models;
+    std::vector<boost::shared_ptr<Distribution> > override_distributions;
+    std::vector<boost::shared_ptr<Function> > additional_terms;
+    boost::ptr_vector<Random> rnds;
+};
+
 /** \brief estimate the square root (cholesky decomposition) of the covariance matrix of the likelihood function
  *
  * The method will start a Markov chain at the given startvalues with the \c iterations iterations.
@@ -117,6 +547,33 @@ Matrix get_sqrt_cov2(Random & rnd, const Model & model, std::vector<double> & st
                     const boost::shared_ptr<theta::Distribution> & override_parameter_distribution,
                     const boost::shared_ptr<VarIdManager> & vm);
 
+/** \brief Diagonal starting covariance for adaptiveMetropolis
+ *
+ * Returns the diagonal matrix of the asimov likelihood widths (see asimov_likelihood_widths) and
+ * sets \c startvalues to the mode of the parameter distribution.
+ */
+Matrix get_sqrt_cov_diagonal(const Model & model, std::vector<double> & startvalues,
+                    const boost::shared_ptr<theta::Distribution> & override_parameter_distribution);
+
+/** \brief The starting values and proposal for the engine selected by \c options
+ *
+ * Calls get_sqrt_cov_diagonal if \c options is not null and requests adaptation and get_sqrt_cov2 otherwise.
+ *
+ * Only if \c options->proposal_cache is set, the results are cached: in memory, so producers and worker threads using the same model
+ * and parameter distribution share one calculation (threads requesting different entries calculate them in parallel), and in the file \c options->proposal_cache, so that later processes with the same
+ * model can skip the calculation. Newly calculated entries are appended to the file while holding a lock of the file, so several
+ * processes can use the same file. In this case, get_sqrt_cov2 uses its own random number generator seeded from the cache key instead of \c rnd, so
+ * the result does not depend on which thread calculates it first.
+ *
+ * The cache key is a hash of the parameter names, the mode and support of the parameter distribution
+ * (i.e., \c override_parameter_distribution or the one of the model) and of the distribution value and model prediction at the mode
+ * and at one shifted point per parameter. This identifies the model well in practice, but is no proof that two models are
+ * the same; the file should therefore only be shared between runs of the same configuration.
+ */
+Matrix get_sqrt_cov_start(const MCMCOptions * options, Random & rnd, const Model & model, std::vector<double> & startvalues,
+                    const boost::shared_ptr<theta::Distribution> & override_parameter_distribution,
+                    const boost::shared_ptr<VarIdManager> & vm);
+
 /** \brief Calculate the cholesky decomposition, but allow zero eigenvalues.
  *
  *
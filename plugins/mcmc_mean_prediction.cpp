@@ -94,7 +94,7 @@ void mcmc_mean_prediction::produce(const Data & data, const Model & model) {
     if(!init){
         try{
             //get the covariance for average data:
-            sqrt_cov = get_sqrt_cov2(*rnd_gen, model, startvalues, override_parameter_distribution, vm);
+            sqrt_cov = get_sqrt_cov_start(mcmc_options.get(), *rnd_gen, model, startvalues, override_parameter_distribution, vm);
             init = true;
         }
         catch(Exception & ex){
@@ -105,7 +105,14 @@ void mcmc_mean_prediction::produce(const Data & data, const Model & model) {
     
     std::auto_ptr<NLLikelihood> nll = get_nllikelihood(data, model);
     MCMCMeanPredictionResult result(model, observables, nll->getnpar());
-    metropolisHastings(*nll, result, *rnd_gen, startvalues, sqrt_cov, iterations, burn_in);
+    if(chains.get()){
+        MCMCDiagnostics diag = chains->run(*nll, data, result, *rnd_gen, startvalues, sqrt_cov, iterations, burn_in);
+        products_sink->set_product(*c_ess, diag.ess);
+        if(c_rhat.get()) products_sink->set_product(*c_rhat, diag.rhat);
+    }
+    else{
+        metropolisHastings(*nll, result, *rnd_gen, startvalues, sqrt_cov, iterations, burn_in);
+    }
     
     size_t i=0;
     for(ObsIds::const_iterator it=observables.begin(); it!=observables.end(); ++it, ++i){
@@ -136,6 +143,14 @@ mcmc_mean_prediction::mcmc_mean_prediction(const theta::plugin::Configuration &
     else{
         burn_in = iterations / 10;
     }
+    if(s.exists("mcmc")){
+        mcmc_options.reset(new MCMCOptions(theta::plugin::Configuration(cfg, s["mcmc"])));
+        chains.reset(new MCMCChains(cfg, *mcmc_options));
+        c_ess = products_sink->declare_product(*this, "ess", theta::typeDouble);
+        if(mcmc_options->n_chains > 1){
+            c_rhat = products_sink->declare_product(*this, "rhat", theta::typeDouble);
+        }
+    }
     
     for(ObsIds::const_iterator it=observables.begin(); it!=observables.end(); ++it){
         c_mean.push_back(products_sink->declare_product(*this, vm->getName(*it) + "_mean", theta::typeHisto));
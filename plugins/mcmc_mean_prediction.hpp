@@ -7,6 +7,7 @@
 #include "interface/producer.hpp"
 #include "interface/random-utils.hpp"
 #include "interface/matrix.hpp"
+#include "plugins/mcmc.hpp"
 
 #include <string>
 
@@ -24,6 +25,7 @@
  *   observables = ("o1", "o2", "o3");
  *   iterations = 10000;
  *   burn-in = 100; //optional. default is iterations / 10
+ *   mcmc = "@mcmc-engine"; //optional
  * };
  * \endcode
  *
@@ -40,6 +42,9 @@
  * \c burn_in is the number of MCMC iterations to do at the beginning and throw away. See additional comments in the
  *     documentation of \link mcmc_posterior_ratio mcmc_posterior_ratio \endlink
  *
+ * \c mcmc is optional and selects the adaptive MCMC engine; see the documentation of \link mcmc_posterior_ratio mcmc_posterior_ratio \endlink
+ *     and theta::MCMCOptions.
+ *
  * For given data, one Markov Chain is constructed. For each point in the Markov Chain,
  * the prediction of the Poisson mean in each bin of each observable is calculated. This mean
  * enters the calculation of the mean and width of the prediction. In addition, the prediction at the highest
@@ -69,6 +74,9 @@ private:
     //MCMC parameters:
     unsigned int iterations;
     unsigned int burn_in;
+    std::auto_ptr<theta::MCMCOptions> mcmc_options;
+    std::auto_ptr<theta::MCMCChains> chains;
+    std::auto_ptr<theta::Column> c_ess, c_rhat;
     theta::Matrix sqrt_cov;
     std::vector<double> startvalues;
     //whether sqrt_cov* and startvalues* have been initialized:
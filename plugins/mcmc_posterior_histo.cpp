@@ -1,5 +1,6 @@
 #include "plugins/mcmc_posterior_histo.hpp"
 #include "plugins/mcmc.hpp"
+#include "plugins/hmc.hpp"
 #include "interface/plugin.hpp"
 #include "interface/model.hpp"
 #include "interface/histogram.hpp"
@@ -59,18 +60,24 @@ public:
             }
     }
     
+    // evaluates the nll at all bin centers of a histogram at once, using NLLikelihood::eval_batch
     void fill(const double * x, double nll0, size_t n){
-        vector<double> myvalues(npar);
         if(isnan(nll0) || (isinf(nll0) && nll0 < 0)){
             throw FatalException("nll0 is nan/-inf in mcmc_posterior_histo");
         }
         for(size_t ih=0; ih<histos.size(); ++ih){
-            copy(x, x + npar, myvalues.begin());
+            const size_t nbins = histos[ih].get_nbins();
+            points.resize(nbins * npar);
+            nll_values.resize(nbins);
             const double xmin = histos[ih].get_xmin();
-            const double x_binwidth = (histos[ih].get_xmax() - histos[ih].get_xmin()) / histos[ih].get_nbins();
-            for(size_t i=1; i<=histos[ih].get_nbins(); ++i){
-                myvalues[ipars[ih]] = xmin + (i - 0.5) * x_binwidth;
-                double nll_value = nll(&myvalues[0]);
+            const double x_binwidth = (histos[ih].get_xmax() - histos[ih].get_xmin()) / nbins;
+            for(size_t i=0; i<nbins; ++i){
+                copy(x, x + npar, points.begin() + i * npar);
+                points[i * npar + ipars[ih]] = xmin + (i + 0.5) * x_binwidth;
+            }
+            nll.eval_batch(&points[0], nbins, &nll_values[0]);
+            for(size_t i=1; i<=nbins; ++i){
+                double nll_value = nll_values[i-1];
                 if(isnan(nll_value) || (isinf(nll_value) && nll_value < 0)){
                     throw FatalException("nll value is nan/-inf in mcmc_posterior_histo");
                 }
@@ -92,6 +99,7 @@ private:
     size_t npar;
     vector<size_t> ipars;
     vector<theta::Histogram> histos, histos_tmp;
+    vector<double> points, nll_values;
 };
 
 
@@ -99,11 +107,26 @@ private:
 
 
 
+template<class resulttype>
+void mcmc_posterior_histo::run_chain(const Data & data, const NLLikelihood & nll, resulttype & result){
+    if(hmc_options.get()){
+        hamiltonianMC(nll, result, *rnd_gen, startvalues, sqrt_cov, iterations, burn_in, *hmc_options);
+    }
+    else if(chains.get()){
+        MCMCDiagnostics diag = chains->run(nll, data, result, *rnd_gen, startvalues, sqrt_cov, iterations, burn_in);
+        products_sink->set_product(*c_ess, diag.ess);
+        if(c_rhat.get()) products_sink->set_product(*c_rhat, diag.rhat);
+    }
+    else{
+        metropolisHastings(nll, result, *rnd_gen, startvalues, sqrt_cov, iterations, burn_in);
+    }
+}
+
 void mcmc_posterior_histo::produce(const Data & data, const Model & model) {
     if(!init){
         try{
             //get the covariance for average data:
-            sqrt_cov = get_sqrt_cov2(*rnd_gen, model, startvalues, override_parameter_distribution, vm);
+            sqrt_cov = get_sqrt_cov_start(mcmc_options.get(), *rnd_gen, model, startvalues, override_parameter_distribution, vm);
             //find ipars:
             ParIds nll_pars = model.getParameters();
             ipars.resize(parameters.size());
@@ -123,14 +146,14 @@ void mcmc_posterior_histo::produce(const Data & data, const Model & model) {
     std::auto_ptr<NLLikelihood> nll = get_nllikelihood(data, model);
     if(!smooth){
         MCMCPosteriorHistoResult result(ipars, nll->getnpar(), nbins, lower, upper);
-        metropolisHastings(*nll, result, *rnd_gen, startvalues, sqrt_cov, iterations, burn_in);
+        run_chain(data, *nll, result);
         for(size_t i=0; i<parameters.size(); ++i){
             products_sink->set_product(columns[i], result.get_histo(i));
         }
     }
     else{
         MCMCPosteriorHistoResultSmoothed result(ipars, nbins, lower, upper, *nll);
-        metropolisHastings(*nll, result, *rnd_gen, startvalues, sqrt_cov, iterations, burn_in);
+        run_chain(data, *nll, result);
         for(size_t i=0; i<parameters.size(); ++i){
             products_sink->set_product(columns[i], result.get_histo(i));
         }
@@ -157,6 +180,24 @@ mcmc_posterior_histo::mcmc_posterior_histo(const theta::plugin::Configuration &
     else{
         burn_in = iterations / 10;
     }
+    if(static_cast<string>(s["type"]) == "hmc_posterior_histo"){
+        hmc_options.reset(new HMCOptions(cfg));
+    }
+    if(s.exists("mcmc")){
+        mcmc_options.reset(new MCMCOptions(theta::plugin::Configuration(cfg, s["mcmc"])));
+        if(hmc_options.get()){
+            if(mcmc_options->n_chains > 1 || mcmc_options->n_temperatures > 1 || mcmc_options->target_ess > 0.0){
+                throw ConfigurationException("hmc_posterior_histo: only the settings 'adaptive' and 'proposal-cache' of 'mcmc' are supported");
+            }
+        }
+        else{
+            chains.reset(new MCMCChains(cfg, *mcmc_options));
+            c_ess = products_sink->declare_product(*this, "ess", theta::typeDouble);
+            if(mcmc_options->n_chains > 1){
+                c_rhat = products_sink->declare_product(*this, "rhat", theta::typeDouble);
+            }
+        }
+    }
     if(s.exists("smooth")){
         smooth = s["smooth"];
     }
@@ -166,3 +207,4 @@ mcmc_posterior_histo::mcmc_posterior_histo(const theta::plugin::Configuration &
 }
 
 REGISTER_PLUGIN(mcmc_posterior_histo)
+REGISTER_PLUGIN_NAME(mcmc_posterior_histo, hmc_posterior_histo)
@@ -6,6 +6,8 @@
 #include "interface/producer.hpp"
 #include "interface/random-utils.hpp"
 #include "interface/matrix.hpp"
+#include "plugins/mcmc.hpp"
+#include "plugins/hmc.hpp"
 
 #include <string>
 
@@ -22,6 +24,7 @@
  *   parameters = ("s");  //assuming "s" was defined as parameter earlier
  *   iterations = 100000;
  *   burn-in = 100; //optional. default is iterations / 10 
+ *   mcmc = "@mcmc-engine"; //optional
  *   smooth = true; //optional, default is false
  *
  *   histo_s = {
@@ -32,7 +35,7 @@
  *
  * \endcode
  *
- * \c type is always "mcmc_posterior_histo" to select this producer.
+ * \c type is "mcmc_posterior_histo" or "hmc_posterior_histo" to select this producer, see below for the latter.
  *
  * \c name is a unique producer name of your choice; it is used to construct column names in the output database. It may only contain alphanumeric
  *    characters (no spaces, special characters, etc.).
@@ -45,6 +48,9 @@
  * \c burn_in is the number of MCMC iterations to do at the beginning and throw away. See additional comments in the
  *     documentation of \link mcmc_posterior_ratio mcmc_posterior_ratio \endlink
  *
+ * \c mcmc is optional and selects the adaptive MCMC engine; see the documentation of \link mcmc_posterior_ratio mcmc_posterior_ratio \endlink
+ *     and theta::MCMCOptions.
+ *
  * \c smooth controls whether to make a smooth posterior histogram. In this case, each point in the chain constributes
  *    with a whole histogram in the respective parameter instead of with a single point. This has important consequences
  *    on the runtime, see comment below.
@@ -70,6 +76,10 @@
  * With smoothing, the number of likelihood evaluations increases with respect to the non-smooth version
  * by \c iterations * \c n_nbins * acceptance rate, where "acceptance rate" is the probability of a proposal point to be
  * accepted and is typically between 0.2 and 0.4; \c n_bins is the total number of bins of all histograms requested.
+ *
+ * With \c type = "hmc_posterior_histo", the chain is constructed with Hamiltonian Monte-Carlo instead of Metropolis-Hastings. All other
+ * settings and the result columns are the same; the additional settings and the runtime are documented
+ * in \link mcmc_quantiles mcmc_quantiles \endlink.
  */
 class mcmc_posterior_histo: public theta::Producer, public theta::RandomConsumer{
 public:
@@ -78,6 +88,10 @@ public:
     virtual void produce(const theta::Data & data, const theta::Model & model);
     
 private:
+    //run the chain with the sampler selected in the configuration, filling result:
+    template<class resulttype>
+    void run_chain(const theta::Data & data, const theta::NLLikelihood & nll, resulttype & result);
+
     //whether sqrt_cov* and startvalues* have been initialized:
     bool init;
     
@@ -93,6 +107,11 @@ private:
     //MCMC parameters:
     unsigned int iterations;
     unsigned int burn_in;
+    std::auto_ptr<theta::MCMCOptions> mcmc_options;
+    std::auto_ptr<theta::MCMCChains> chains;
+    std::auto_ptr<theta::Column> c_ess, c_rhat;
+    //set for type "hmc_posterior_histo":
+    std::auto_ptr<theta::HMCOptions> hmc_options;
     theta::Matrix sqrt_cov;
     std::vector<double> startvalues;
     
@@ -53,8 +53,8 @@ class MCMCPosteriorRatioResult{
 void mcmc_posterior_ratio::produce(const theta::Data & data, const theta::Model & model) {
     if(!init){
         try{
-            sqrt_cov_sb = get_sqrt_cov2(*rnd_gen, model, startvalues_sb, s_plus_b, vm);
-            sqrt_cov_b = get_sqrt_cov2(*rnd_gen, model, startvalues_b, b_only, vm);
+            sqrt_cov_sb = get_sqrt_cov_start(mcmc_options.get(), *rnd_gen, model, startvalues_sb, s_plus_b, vm);
+            sqrt_cov_b = get_sqrt_cov_start(mcmc_options.get(), *rnd_gen, model, startvalues_b, b_only, vm);
             init = true;
         }catch(Exception & ex){
             ex.message = "initialization failed: " + ex.message;
@@ -66,12 +66,26 @@ void mcmc_posterior_ratio::produce(const theta::Data & data, const theta::Model
     
     //a. calculate s plus b:
     MCMCPosteriorRatioResult res_sb(nll->getnpar());
-    metropolisHastings(*nll, res_sb, *rnd_gen, startvalues_sb, sqrt_cov_sb, iterations, burn_in);
+    if(mcmc_options.get()){
+        MCMCDiagnostics diag = chains->run(*nll, data, res_sb, *rnd_gen, startvalues_sb, sqrt_cov_sb, iterations, burn_in);
+        products_sink->set_product(*c_ess_sb, diag.ess);
+        if(c_rhat_sb.get()) products_sink->set_product(*c_rhat_sb, diag.rhat);
+    }
+    else{
+        metropolisHastings(*nll, res_sb, *rnd_gen, startvalues_sb, sqrt_cov_sb, iterations, burn_in);
+    }
     double nl_posterior_sb = res_sb.get_nl_average_posterior();
 
     //b. calculate b only:
     MCMCPosteriorRatioResult res_b(nll->getnpar());
-    metropolisHastings(*nll, res_b, *rnd_gen, startvalues_b, sqrt_cov_b, iterations, burn_in);
+    if(mcmc_options.get()){
+        MCMCDiagnostics diag = chains->run(*nll, data, res_b, *rnd_gen, startvalues_b, sqrt_cov_b, iterations, burn_in);
+        products_sink->set_product(*c_ess_b, diag.ess);
+        if(c_rhat_b.get()) products_sink->set_product(*c_rhat_b, diag.rhat);
+    }
+    else{
+        metropolisHastings(*nll, res_b, *rnd_gen, startvalues_b, sqrt_cov_b, iterations, burn_in);
+    }
     double nl_posterior_b = res_b.get_nl_average_posterior();
 
     if(std::isnan(nl_posterior_sb) || std::isnan(nl_posterior_b)){
@@ -95,8 +109,20 @@ mcmc_posterior_ratio::mcmc_posterior_ratio(const theta::plugin::Configuration &
     else{
         burn_in = iterations / 10;
     }
+    if(s.exists("mcmc")){
+        mcmc_options.reset(new MCMCOptions(theta::plugin::Configuration(cfg, s["mcmc"])));
+        chains.reset(new MCMCChains(cfg, *mcmc_options));
+    }
     c_nl_posterior_sb = products_sink->declare_product(*this, "nl_posterior_sb", theta::typeDouble);
     c_nl_posterior_b =  products_sink->declare_product(*this, "nl_posterior_b",  theta::typeDouble);
+    if(mcmc_options.get()){
+        c_ess_sb = products_sink->declare_product(*this, "ess_sb", theta::typeDouble);
+        c_ess_b = products_sink->declare_product(*this, "ess_b", theta::typeDouble);
+        if(mcmc_options->n_chains > 1){
+            c_rhat_sb = products_sink->declare_product(*this, "rhat_sb", theta::typeDouble);
+            c_rhat_b = products_sink->declare_product(*this, "rhat_b", theta::typeDouble);
+        }
+    }
 }
 
 REGISTER_PLUGIN(mcmc_posterior_ratio)
@@ -6,6 +6,7 @@
 #include "interface/producer.hpp"
 #include "interface/random-utils.hpp"
 #include "interface/matrix.hpp"
+#include "plugins/mcmc.hpp"
 
 #include <string>
 
@@ -26,6 +27,7 @@
  *   signal-plus-background-distribution = "@default-dist";
  *   iterations = 10000;
  *   burn-in = 100; //optional. default is iterations / 10
+ *   mcmc = "@mcmc-engine"; //optional
  * };
  * \endcode
  *
@@ -46,6 +48,12 @@
  * \c burn_in is the number of MCMC iterations to do at the beginning and throw away. There is some controversy about whether it is needed at all
  *     and how large it should be. If unsure, just take the default value of iteratios / 10 and if someone asks why, vary it a bit (say, between iterations/100 and iterations)
  *     and show that the result does not depend on it anyway ...
+ *
+ * \c mcmc is optional and refers to a setting group configuring the adaptive MCMC engine, see theta::MCMCOptions. It can
+ *     be shared by several producers. If given, the chain adapts its proposal covariance during burn-in, can use parallel tempering
+ *     and can stop before \c iterations once a target effective sample size is reached. If omitted, the plain Metropolis-Hastings
+ *     algorithm with a covariance estimated once at the first call is used. The convergence diagnostics of the engine are
+ *     written to the columns \c ess_sb, \c ess_b and, for more than one chain, \c rhat_sb and \c rhat_b.
  *     
  * Note that the setting "override-parameter-distribution" is not allowed for this producer.
  *
@@ -70,6 +78,9 @@ private:
     
     unsigned int iterations;
     unsigned int burn_in;
+    std::auto_ptr<theta::MCMCOptions> mcmc_options;
+    std::auto_ptr<theta::MCMCChains> chains;
+    std::auto_ptr<theta::Column> c_ess_sb, c_rhat_sb, c_ess_b, c_rhat_b;
     
     //the matrices and startvalues to use for the Markov chains in the two cases:
     theta::Matrix sqrt_cov_sb;
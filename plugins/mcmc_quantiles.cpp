@@ -1,5 +1,7 @@
 #include "plugins/mcmc_quantiles.hpp"
 #include "plugins/mcmc.hpp"
+#include "plugins/hmc.hpp"
+#include "plugins/tdigest.hpp"
 #include "interface/plugin.hpp"
 #include "interface/model.hpp"
 #include "interface/histogram.hpp"
@@ -15,9 +17,15 @@ using namespace libconfig;
 //the result class for the metropolisHastings routine.
 class MCMCPosteriorQuantilesResult{
     public:
-        //ipar_ is the parameter of interest
-        MCMCPosteriorQuantilesResult(size_t npar_, size_t ipar_, size_t n_iterations_): npar(npar_), ipar(ipar_), n_iterations(n_iterations_){
-            par_values.reserve(n_iterations);
+        //ipar_ is the parameter of interest. n_iterations_ is the (maximum) chain length. If digest_ is not null,
+        // the values are added to it instead of being saved.
+        MCMCPosteriorQuantilesResult(size_t npar_, size_t ipar_, size_t n_iterations_, TDigest * digest_): npar(npar_), ipar(ipar_), digest(digest_){
+            if(digest){
+                digest->reset();
+            }
+            else{
+                par_values.reserve(n_iterations_);
+            }
         }
         
         size_t getnpar() const{
@@ -26,14 +34,23 @@ class MCMCPosteriorQuantilesResult{
         
         //just save the parameter value we are interested in
         void fill(const double * x, double, size_t n_){
+            if(digest){
+                digest->add(x[ipar], n_);
+                return;
+            }
             for(size_t i=0; i<n_; ++i){
                par_values.push_back(x[ipar]);
             }
         }
         
-        //return the quantile q
+        //return the quantile q. The chain length is the number of values filled, which can be less than n_iterations_
+        // if the chain stopped early.
         double get_quantile(double q){
-            if(par_values.size()!=n_iterations){
+            if(digest){
+                return digest->quantile(q);
+            }
+            const size_t n_iterations = par_values.size();
+            if(n_iterations == 0){
                 throw InvalidArgumentException("MCMCPosteriorQuantilesResult: called get_quantile before chain has finished!");
             }
             int index = static_cast<int>(q * n_iterations);
@@ -45,14 +62,14 @@ class MCMCPosteriorQuantilesResult{
     private:
         size_t npar;
         size_t ipar;
-        size_t n_iterations;
         vector<double> par_values;
+        TDigest * digest;
 };
 
 void mcmc_quantiles::produce(const Data & data, const Model & model) {
     if(!init){
         try{
-            sqrt_cov = get_sqrt_cov2(*rnd_gen, model, startvalues, override_parameter_distribution, vm);
+            sqrt_cov = get_sqrt_cov_start(mcmc_options.get(), *rnd_gen, model, startvalues, override_parameter_distribution, vm);
             //find the number of the parameter of interest:
             ParIds model_pars = model.getParameters();
             ipar=0;
@@ -69,12 +86,23 @@ void mcmc_quantiles::produce(const Data & data, const Model & model) {
     }
     
     std::auto_ptr<NLLikelihood> nll = get_nllikelihood(data, model);
-    MCMCPosteriorQuantilesResult result(nll->getnpar(), ipar, iterations);
-    metropolisHastings(*nll, result, *rnd_gen, startvalues, sqrt_cov, iterations, burn_in);
+    MCMCPosteriorQuantilesResult result(nll->getnpar(), ipar, iterations, digest.get());
+    if(hmc_options.get()){
+        hamiltonianMC(*nll, result, *rnd_gen, startvalues, sqrt_cov, iterations, burn_in, *hmc_options);
+    }
+    else if(chains.get()){
+        MCMCDiagnostics diag = chains->run(*nll, data, result, *rnd_gen, startvalues, sqrt_cov, iterations, burn_in);
+        products_sink->set_product(*c_ess, diag.ess);
+        if(c_rhat.get()) products_sink->set_product(*c_rhat, diag.rhat);
+    }
+    else{
+        metropolisHastings(*nll, result, *rnd_gen, startvalues, sqrt_cov, iterations, burn_in);
+    }
     
     for(size_t i=0; i<quantiles.size(); ++i){
         products_sink->set_product(columns[i], result.get_quantile(quantiles[i]));
     }
+    products_sink->set_product(*c_method, method);
 }
 
 mcmc_quantiles::mcmc_quantiles(const theta::plugin::Configuration & cfg): Producer(cfg), RandomConsumer(cfg, getName()),
@@ -100,6 +128,45 @@ mcmc_quantiles::mcmc_quantiles(const theta::plugin::Configuration & cfg): Produc
     else{
         burn_in = iterations / 10;
     }
+    if(static_cast<string>(s["type"]) == "hmc_quantiles"){
+        hmc_options.reset(new HMCOptions(cfg));
+    }
+    if(s.exists("mcmc")){
+        mcmc_options.reset(new MCMCOptions(theta::plugin::Configuration(cfg, s["mcmc"])));
+        if(hmc_options.get()){
+            if(mcmc_options->n_chains > 1 || mcmc_options->n_temperatures > 1 || mcmc_options->target_ess > 0.0){
+                throw ConfigurationException("hmc_quantiles: only the settings 'adaptive' and 'proposal-cache' of 'mcmc' are supported");
+            }
+        }
+        else{
+            chains.reset(new MCMCChains(cfg, *mcmc_options));
+            c_ess = products_sink->declare_product(*this, "ess", theta::typeDouble);
+            if(mcmc_options->n_chains > 1){
+                c_rhat = products_sink->declare_product(*this, "rhat", theta::typeDouble);
+            }
+        }
+    }
+    method = "exact";
+    if(s.exists("method")){
+        method = static_cast<string>(s["method"]);
+    }
+    if(method == "tdigest"){
+        double compression = 100.0;
+        if(s.exists("compression")){
+            compression = s["compression"];
+            if(!(compression > 0.0)){
+                throw ConfigurationException("mcmc_quantiles: compression must be positive");
+            }
+        }
+        digest.reset(new TDigest(compression));
+        stringstream ss;
+        ss << "tdigest:" << compression;
+        method = ss.str();
+    }
+    else if(method != "exact"){
+        throw ConfigurationException("mcmc_quantiles: unknown method '" + method + "' (valid values are 'exact' and 'tdigest')");
+    }
+    c_method = products_sink->declare_product(*this, "method", theta::typeString);
     for(size_t i=0; i<quantiles.size(); ++i){
         stringstream ss;
         ss << "quant" << setw(5) << setfill('0') << static_cast<int>(quantiles[i] * 10000 + 0.5);
@@ -108,4 +175,5 @@ mcmc_quantiles::mcmc_quantiles(const theta::plugin::Configuration & cfg): Produc
 }
 
 REGISTER_PLUGIN(mcmc_quantiles)
+REGISTER_PLUGIN_NAME(mcmc_quantiles, hmc_quantiles)
 
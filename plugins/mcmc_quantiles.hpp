@@ -7,6 +7,9 @@
 #include "interface/producer.hpp"
 #include "interface/random-utils.hpp"
 #include "interface/matrix.hpp"
+#include "plugins/mcmc.hpp"
+#include "plugins/hmc.hpp"
+#include "plugins/tdigest.hpp"
 
 #include <string>
 
@@ -23,11 +26,14 @@
  *   quantiles = [0.025, 0.16, 0.5, 0.84, 0.975];
  *   iterations = 10000;
  *   burn-in = 100; //optional. default is iterations / 10
+ *   mcmc = "@mcmc-engine"; //optional
+ *   method = "tdigest"; //optional. default is "exact"
+ *   compression = 200.0; //optional. default is 100.0
  * };
  *
  * \endcode
  *
- * \c type is always "mcmc_posterior_ratio" to select this producer.
+ * \c type is "mcmc_quantiles" or "hmc_quantiles" to select this producer, see below for the latter.
  *
  * \c name is a unique producer name of your choice; it is used to construct column names in the output database. It may only contain alphanumeric
  *    characters (no spaces, special characters, etc.).
@@ -44,6 +50,15 @@
  * \c burn_in is the number of MCMC iterations to do at the beginning and throw away. See additional comments in the
  *     documentation of \link mcmc_posterior_ratio mcmc_posterior_ratio \endlink
  *
+ * \c mcmc is optional and selects the adaptive MCMC engine; see the documentation of \link mcmc_posterior_ratio mcmc_posterior_ratio \endlink
+ *     and theta::MCMCOptions.
+ *
+ * \c method selects how the quantiles are calculated from the chain. "exact" saves all values of the parameter in the chain, which
+ *     requires memory proportional to \c iterations. "tdigest" uses a streaming quantile estimate with memory proportional to \c compression
+ *     and independent of \c iterations, see theta::TDigest. Larger values of \c compression give more accurate quantiles;
+ *     the default of 100 gives an error of the quantile level below 0.01 around the median and much smaller errors in the tails,
+ *     which is well below the statistical error of typical chains.
+ *
  * For each data given, one chain will be used to derive all requested quantiles given in the \c quantiles list, so their error
  * from limited chain length is correlated by construction. If you do not want that, use two independent producers of type
  * mcmc_quantiles.
@@ -51,6 +66,16 @@
  * The result table contains as many columns as \c quantiles given in the configuration file. The column name
  * will be "quant" + 10000 * quantile, written with leading zeros. For example, if the quantile is 0.5,
  * the column name will be "quant05000", if the 99.9% quantile is requested (i.e., 0.999), the name will be "quant09990".
+ * The column "method" records the method used: either "exact" or "tdigest:" followed by the compression.
+ *
+ * With \c type = "hmc_quantiles", the chain is constructed with the No-U-Turn variant of Hamiltonian Monte-Carlo
+ * instead of Metropolis-Hastings, see theta::hamiltonianMC. All other settings and the result columns are the same, so a configuration can
+ * switch the sampler by changing the type only. The step size is adapted during \c burn-in, which should therefore
+ * be at least a few hundred iterations. The settings \c max-tree-depth, \c target-acceptance and \c step-size are optional and
+ * documented in theta::HMCOptions. Each iteration requires up to 2^max-tree-depth evaluations of the likelihood gradient,
+ * so HMC needs much fewer iterations than Metropolis-Hastings for the same precision, especially for many nuisance parameters.
+ * The gradient is analytical if the likelihood provides derivatives; otherwise, it is calculated with finite differences which costs 2 * n
+ * likelihood evaluations for n non-fixed parameters. Of the \c mcmc setting, only \c adaptive and \c proposal-cache are supported.
  */
 class mcmc_quantiles: public theta::Producer, public theta::RandomConsumer{
 public:
@@ -71,10 +96,20 @@ private:
     
     //result columns: one per requested quantile:
     boost::ptr_vector<theta::Column> columns;
+    std::auto_ptr<theta::Column> c_method;
+    
+    //the quantile method as written to c_method, and the digest for method "tdigest":
+    std::string method;
+    std::auto_ptr<theta::TDigest> digest;
     
     //MCMC parameters:
     unsigned int iterations;
     unsigned int burn_in;
+    std::auto_ptr<theta::MCMCOptions> mcmc_options;
+    std::auto_ptr<theta::MCMCChains> chains;
+    std::auto_ptr<theta::Column> c_ess, c_rhat;
+    //set for type "hmc_quantiles":
+    std::auto_ptr<theta::HMCOptions> hmc_options;
     theta::Matrix sqrt_cov;
     std::vector<double> startvalues;
 };
@@ -1,5 +1,6 @@
 #include "plugins/mle.hpp"
 #include "plugins/asimov_likelihood_widths.hpp"
+#include "plugins/warm_start.hpp"
 #include "interface/plugin.hpp"
 #include "interface/minimizer.hpp"
 #include "interface/histogram.hpp"
@@ -32,7 +33,10 @@ void mle::produce(const theta::Data & data, const theta::Model & model) {
         step.set(asimov_likelihood_widths(model, override_parameter_distribution));
         start_step_ranges_init = true;
     }
-    MinimizationResult minres = minimizer->minimize(*nll, start, step, ranges);
+    MinimizationResult minres = warm_start.minimize(*minimizer, *nll, start, step, ranges);
+    if(warm_start.enabled()){
+        products_sink->set_product(*c_start, warm_start.get_used_start());
+    }
     products_sink->set_product(*c_nll, minres.fval);
     for(size_t i=0; i<save_ids.size(); ++i){
         products_sink->set_product(parameter_columns[i], minres.values.get(save_ids[i]));
@@ -88,7 +92,7 @@ void mle::produce(const theta::Data & data, const theta::Model & model) {
     }
 }
 
-mle::mle(const theta::plugin::Configuration & cfg): Producer(cfg), start_step_ranges_init(false), write_covariance(false), write_ks_ts(false), write_bh_ts(false){
+mle::mle(const theta::plugin::Configuration & cfg): Producer(cfg), start_step_ranges_init(false), warm_start(cfg.setting), write_covariance(false), write_ks_ts(false), write_bh_ts(false){
     SettingWrapper s = cfg.setting;
     minimizer = PluginManager<Minimizer>::instance().build(Configuration(cfg, s["minimizer"]));
     size_t n_parameters = s["parameters"].size();
@@ -112,6 +116,9 @@ mle::mle(const theta::plugin::Configuration & cfg): Producer(cfg), start_step_ra
         parameter_columns.push_back(products_sink->declare_product(*this, parameter_names[i], theta::typeDouble));
         error_columns.push_back(products_sink->declare_product(*this, parameter_names[i] + "_error", theta::typeDouble));
     }
+    if(warm_start.enabled()){
+       c_start = products_sink->declare_product(*this, "start", theta::typeInt);
+    }
     if(write_covariance){
        c_covariance = products_sink->declare_product(*this, "covariance", theta::typeHisto);
     }
@@ -4,6 +4,7 @@
 #include "interface/variables.hpp"
 #include "interface/database.hpp"
 #include "interface/producer.hpp"
+#include "plugins/warm_start.hpp"
 
 #include <string>
 
@@ -17,6 +18,7 @@
  *   minimizer = "@myminuit";
  *   write_covariance = true; //optional, default is false
  *   write_ks_ts = true; //optional, default is false
+ *   warm-start = "last"; //optional, default is "none"
  * }
  * myminuit = {...}; // minimizer definition
  * \endcode
@@ -40,6 +42,9 @@
  *   compared directly, no normalization is applied. If there is more than one observable, the KS test statistic is calculated for
  *   each observable and the maximum value is written to the products table.
  *
+ * \c warm-start configures where to start the minimization, see \ref WarmStart for the allowed values. By default,
+ *   the minimization always starts at the mode of the parameter distribution.
+ *
  * This producer uses the given minimizer to find the maximum likelihood estimates for the
  * configured parameters by minimizing the negative log-likelihood of the model, given data.
  *
@@ -47,7 +52,8 @@
  * one with the parameter's name which contains the maximum likelihood estimate. The other
  * column with name '&lt;parameter name&gt;_error' contains the error estimate rom the minimizer
  * for that parameter. Additionally, one column is 'nll' is created which contains the value of the
- * negative log-likelihood at the minimum.
+ * negative log-likelihood at the minimum. If \c warm-start is not "none", a column 'start' of type typeInt contains the start used
+ * for the minimization, as value of WarmStart::e_start.
  */
 class mle: public theta::Producer{
 public:
@@ -64,6 +70,7 @@ private:
     bool start_step_ranges_init;
     theta::ParValues start, step;
     std::map<theta::ParId, std::pair<double, double> > ranges;
+    WarmStart warm_start;
     
     bool write_covariance;
     bool write_ks_ts;
@@ -75,6 +82,7 @@ private:
     boost::ptr_vector<theta::Column> parameter_columns;
     boost::ptr_vector<theta::Column> error_columns;
     std::auto_ptr<theta::Column> c_nll;
+    std::auto_ptr<theta::Column> c_start;
     std::auto_ptr<theta::Column> c_covariance;
     std::auto_ptr<theta::Column> c_ks_ts;
     std::auto_ptr<theta::Column> c_bh_ts;
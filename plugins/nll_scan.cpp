@@ -6,6 +6,7 @@
 #include "interface/distribution.hpp"
 
 #include <sstream>
+#include <vector>
 
 using namespace theta;
 using namespace std;
@@ -21,13 +22,35 @@ void nll_scan::produce(const Data & data, const Model & model) {
     }
     MinimizationResult minres = minimizer->minimize(*nll, m_start, m_step, m_ranges);
     products_sink->set_product(*c_maxl, minres.values.get(pid));
-    ReducedNLL nll_r(*nll, pid, minres.values, re_minimize ? minimizer.get() : 0, m_start, m_step, m_ranges);
-    nll_r.set_offset_nll(minres.fval);
     
     theta::Histogram result(n_steps, start, start + n_steps * step);
-    for(unsigned int i=0; i<n_steps; ++i){
-        double x = start + i * step;
-        result.set(i, nll_r(x));
+    if(re_minimize){
+        ReducedNLL nll_r(*nll, pid, minres.values, minimizer.get(), m_start, m_step, m_ranges);
+        nll_r.set_offset_nll(minres.fval);
+        for(unsigned int i=0; i<n_steps; ++i){
+            double x = start + i * step;
+            result.set(i, nll_r(x));
+        }
+    }
+    else{
+        //all parameter values are known in advance, so evaluate the likelihood for all of them at once:
+        const ParIds & pids = nll->getParameters();
+        const size_t npar = pids.size();
+        vector<double> points(n_steps * npar), nll_values(n_steps);
+        size_t ipid = 0, ip = 0;
+        for(ParIds::const_iterator it=pids.begin(); it!=pids.end(); ++it, ++ip){
+            if(*it == pid) ipid = ip;
+            for(unsigned int i=0; i<n_steps; ++i){
+                points[i * npar + ip] = minres.values.get(*it);
+            }
+        }
+        for(unsigned int i=0; i<n_steps; ++i){
+            points[i * npar + ipid] = start + i * step;
+        }
+        nll->eval_batch(&points[0], n_steps, &nll_values[0]);
+        for(unsigned int i=0; i<n_steps; ++i){
+            result.set(i, nll_values[i] - minres.fval);
+        }
     }
     products_sink->set_product(*c_nll, result);
 }
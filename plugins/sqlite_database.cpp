@@ -3,16 +3,56 @@
 #include "interface/histogram.hpp"
 
 #include <sstream>
+#include <algorithm>
 
 #include <boost/filesystem.hpp>
-#include <boost/scoped_array.hpp>
 
 using namespace std;
 using namespace theta;
 
+namespace{
+    // the maximum number of jobs queued for the writer thread before submit waits:
+    const size_t max_queued_jobs = 4;
+}
+
 sqlite_database::sqlite_database(const plugin::Configuration & cfg) :
-    db(0), transaction_active(false), save_all_products(true){
+    db(0), transaction_active(false), save_all_products(true), batch_size(256), commit_interval(10.0), writer_busy(false),
+    writer_stop(false), last_commit(time(0)){
     std::string filename = cfg.setting["filename"];
+    string journal_mode, synchronous;
+    int page_size = 0;
+    if(cfg.setting.exists("journal_mode")){
+        journal_mode = static_cast<string>(cfg.setting["journal_mode"]);
+        if(journal_mode != "delete" && journal_mode != "truncate" && journal_mode != "persist" && journal_mode != "memory"
+           && journal_mode != "wal" && journal_mode != "off"){
+            throw ConfigurationException("sqlite_database: invalid journal_mode '" + journal_mode + "'");
+        }
+    }
+    if(cfg.setting.exists("synchronous")){
+        synchronous = static_cast<string>(cfg.setting["synchronous"]);
+        if(synchronous != "off" && synchronous != "normal" && synchronous != "full" && synchronous != "extra"){
+            throw ConfigurationException("sqlite_database: invalid synchronous '" + synchronous + "'");
+        }
+    }
+    if(cfg.setting.exists("page_size")){
+        page_size = cfg.setting["page_size"];
+        if(page_size < 512 || page_size > 65536 || (page_size & (page_size - 1)) != 0){
+            throw ConfigurationException("sqlite_database: page_size must be a power of two between 512 and 65536");
+        }
+    }
+    if(cfg.setting.exists("batch_size")){
+        int bs = cfg.setting["batch_size"];
+        if(bs <= 0){
+            throw ConfigurationException("sqlite_database: batch_size must be positive");
+        }
+        batch_size = bs;
+    }
+    if(cfg.setting.exists("commit_interval")){
+        commit_interval = cfg.setting["commit_interval"];
+        if(commit_interval < 0.0){
+            throw ConfigurationException("sqlite_database: commit_interval must not be negative");
+        }
+    }
     if(cfg.setting.exists("products_data")){
       try{
          string s = cfg.setting["products_data"];
@@ -47,12 +87,185 @@ sqlite_database::sqlite_database(const plugin::Configuration & cfg) :
         ss << "sqlite_database constructor failed (filename=\"" << filename << "\") with SQLITE code " << res;
         error(ss.str());//throws.
     }
+    //page_size has to be set before anything is written and journal_mode outside of a transaction:
+    if(page_size > 0){
+        stringstream ss;
+        ss << "PRAGMA page_size = " << page_size << ";";
+        exec(ss.str());
+    }
+    if(!journal_mode.empty()){
+        exec("PRAGMA journal_mode = " + journal_mode + ";");
+    }
+    if(!synchronous.empty()){
+        exec("PRAGMA synchronous = " + synchronous + ";");
+    }
     beginTransaction();
+    writer.reset(new boost::thread(writer_task(this)));
+}
+
+void sqlite_database::check_writer_error(){
+    if(!writer_error.empty()){
+        throw DatabaseException("sqlite_database writer thread: " + writer_error);
+    }
+}
+
+void sqlite_database::submit(job & j){
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while(jobs.size() >= max_queued_jobs && writer_error.empty()){
+        cond.wait(lock);
+    }
+    check_writer_error();
+    jobs.push_back(job());
+    job & queued = jobs.back();
+    queued.table = j.table;
+    queued.sql.swap(j.sql);
+    queued.cells.swap(j.cells);
+    queued.nrows = j.nrows;
+    j.nrows = 0;
+    cond.notify_all();
+}
+
+void sqlite_database::flush(){
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while((!jobs.empty() || writer_busy) && writer_error.empty()){
+        cond.wait(lock);
+    }
+    check_writer_error();
+}
+
+void sqlite_database::write_loop(){
+    job j;
+    while(true){
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            writer_busy = false;
+            cond.notify_all();
+            while(jobs.empty() && !writer_stop){
+                cond.wait(lock);
+            }
+            if(jobs.empty()) return;
+            writer_busy = true;
+            j.table = jobs.front().table;
+            j.sql.swap(jobs.front().sql);
+            j.cells.swap(jobs.front().cells);
+            j.nrows = jobs.front().nrows;
+            jobs.pop_front();
+            //wake up a submit waiting for space in the queue:
+            cond.notify_all();
+        }
+        try{
+            if(j.table) insert_rows(j);
+            else exec(j.sql);
+            if(commit_interval > 0.0 && difftime(time(0), last_commit) >= commit_interval){
+                endTransaction();
+                beginTransaction();
+                last_commit = time(0);
+            }
+        }
+        //the error is reported to the main thread by the next call of submit or flush:
+        catch(Exception & ex){
+            writer_failed(ex.message);
+            return;
+        }
+        catch(FatalException & ex){
+            writer_failed(ex.message);
+            return;
+        }
+        catch(std::exception & ex){
+            writer_failed(ex.what());
+            return;
+        }
+        catch(...){
+            writer_failed("unknown exception");
+            return;
+        }
+        j.sql.clear();
+        j.cells.clear();
+    }
+}
+
+void sqlite_database::writer_failed(const std::string & message){
+    boost::unique_lock<boost::mutex> lock(mutex);
+    //an empty writer_error means no error:
+    writer_error = message.empty() ? "unknown error" : message;
+    jobs.clear();
+    writer_busy = false;
+    cond.notify_all();
+}
+
+void sqlite_database::insert_rows(job & j){
+    sqlite_table & t = *j.table;
+    const size_t ncols = t.row.size();
+    if(t.insert_statement == 0){
+        //use as many rows per statement as the limit of the number of variables allows:
+        size_t max_variables = sqlite3_limit(db, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+        t.rows_per_statement = std::max<size_t>(1, std::min(batch_size, max_variables / std::max<size_t>(ncols, 1)));
+    }
+    size_t row = 0;
+    while(row < j.nrows){
+        const size_t n = std::min(t.rows_per_statement, j.nrows - row);
+        sqlite3_stmt *& statement = n == t.rows_per_statement ? t.insert_statement : t.partial_statement;
+        if(n != t.rows_per_statement && t.partial_rows != n && statement != 0){
+            sqlite3_finalize(statement);
+            statement = 0;
+        }
+        if(statement == 0){
+            stringstream ss;
+            ss << t.insert_head;
+            for(size_t r=0; r<n; ++r){
+                ss << (r==0 ? "(" : ", (");
+                for(size_t c=0; c<ncols; ++c){
+                    ss << (c==0 ? "?" : ", ?");
+                }
+                ss << ")";
+            }
+            ss << ";";
+            statement = prepare(ss.str());
+            if(n != t.rows_per_statement) t.partial_rows = n;
+        }
+        const cell * cells = &j.cells[row * ncols];
+        for(size_t k=0; k < n * ncols; ++k){
+            const int index = k + 1;
+            switch(cells[k].type){
+                case typeDouble: sqlite3_bind_double(statement, index, cells[k].d); break;
+                case typeInt: sqlite3_bind_int(statement, index, cells[k].i); break;
+                case typeString: sqlite3_bind_text(statement, index, cells[k].s.data(), cells[k].s.size(), SQLITE_STATIC); break;
+                case typeHisto: sqlite3_bind_blob(statement, index, cells[k].s.data(), cells[k].s.size(), SQLITE_STATIC); break;
+                default: sqlite3_bind_null(statement, index);
+            }
+        }
+        int res = sqlite3_step(statement);
+        sqlite3_reset(statement);
+        if(res != SQLITE_DONE){
+            error(__FUNCTION__);
+        }
+        row += n;
+    }
 }
 
 void sqlite_database::close() {
     if (!db)
         return;
+    if(writer){
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            writer_stop = true;
+            cond.notify_all();
+        }
+        writer->join();
+        writer.reset();
+    }
+    if(!writer_error.empty()){
+        //close the database anyway, but report the error:
+        transaction_active = false;
+        sqlite3_stmt *pStmt;
+        while ((pStmt = sqlite3_next_stmt(db, 0)) != 0) {
+            sqlite3_finalize(pStmt);
+        }
+        sqlite3_close(db);
+        db = 0;
+        check_writer_error();
+    }
     endTransaction();
     //finalize all statements associated with the connection:
     sqlite3_stmt *pStmt;
@@ -142,8 +355,8 @@ std::auto_ptr<Table> sqlite_database::create_table(const string & table_name){
 
 
 sqlite_database::sqlite_table::sqlite_table(const string & name_, const boost::shared_ptr<sqlite_database> & db_) : Table(db_),
-    name(name_), have_autoinc(false), table_created(false), next_insert_index(1), insert_statement(0), db(db_),
-    save_all_columns(true) {
+    name(name_), have_autoinc(false), autoinc_index(-1), last_autoinc_id(0), table_created(false), next_insert_index(1), nrows(0),
+    last_submit(time(0)), insert_statement(0), rows_per_statement(0), partial_statement(0), partial_rows(0), db(db_), save_all_columns(true) {
 }
 
 std::auto_ptr<Column> sqlite_database::sqlite_table::add_column(const std::string & name, const data_type & type){
@@ -178,6 +391,11 @@ void sqlite_database::sqlite_table::set_autoinc_column(const std::string & name)
     column_definitions << "'" << name << "' ";
     have_autoinc = true;
     column_definitions << "INTEGER PRIMARY KEY AUTOINCREMENT";
+    //the ids are assigned in add_row and inserted explicitly:
+    if(ss_insert_statement.str().size() > 0)
+        ss_insert_statement << ", ";
+    ss_insert_statement << "'" << name << "'";
+    autoinc_index = next_insert_index++;
 }
 
 
@@ -185,44 +403,68 @@ void sqlite_database::sqlite_table::create_table(){
     stringstream ss;
     string col_def = column_definitions.str();
     ss << "CREATE TABLE '" << name << "' (" << col_def << ");";
-    db->exec(ss.str());
+    job j;
+    j.sql = ss.str();
+    db->submit(j);
     
     ss.str("");
-    ss << "INSERT INTO '" << name << "'(" << ss_insert_statement.str() << ") VALUES (";
-    for(int i=1; i < next_insert_index; ++i){
-        if(i==1)ss << "?";
-        else ss << ", ?";
-    }
-    ss << ");";
-    insert_statement = db->prepare(ss.str());
+    ss << "INSERT INTO '" << name << "'(" << ss_insert_statement.str() << ") VALUES ";
+    insert_head = ss.str();
+    row.resize(next_insert_index - 1);
+    rows.reserve(row.size() * db->batch_size);
     table_created = true;
 }
 
+void sqlite_database::sqlite_table::submit_rows(){
+    job j;
+    j.table = this;
+    j.cells.swap(rows);
+    j.nrows = nrows;
+    db->submit(j);
+    nrows = 0;
+    rows.reserve(row.size() * db->batch_size);
+    last_submit = time(0);
+}
+
 //create the table if it is empty to ensure that all tables have been created
-// even if there are no entries
+// even if there are no entries. Write the buffered rows and wait for the writer thread, as
+// it uses this table.
 sqlite_database::sqlite_table::~sqlite_table(){
-    if(not table_created) create_table();
+    try{
+        if(not table_created) create_table();
+        if(nrows > 0) submit_rows();
+        db->flush();
+    }
+    catch(Exception & e){
+        cerr << "Exception while writing table '" << name << "' in destructor: " << e.message << endl;
+    }
 }
 
 void sqlite_database::sqlite_table::set_column(const Column & c, double d){
     if(not table_created) create_table();
     int index = static_cast<const sqlite_column&>(c).insert_index;
-    if(index >= 0)
-        sqlite3_bind_double(insert_statement, index, d);
+    if(index >= 0){
+        row[index - 1].type = typeDouble;
+        row[index - 1].d = d;
+    }
 }
 
 void sqlite_database::sqlite_table::set_column(const Column & c, int i){
     if(not table_created) create_table();
     int index = static_cast<const sqlite_column&>(c).insert_index;
-    if(index >= 0)
-        sqlite3_bind_int(insert_statement, index, i);
+    if(index >= 0){
+        row[index - 1].type = typeInt;
+        row[index - 1].i = i;
+    }
 }
 
 void sqlite_database::sqlite_table::set_column(const Column & c, const std::string & s){
     if(not table_created) create_table();
     int index = static_cast<const sqlite_column&>(c).insert_index;
-    if(index >= 0)
-        sqlite3_bind_text(insert_statement, index, s.c_str(), s.size(), SQLITE_TRANSIENT);
+    if(index >= 0){
+        row[index - 1].type = typeString;
+        row[index - 1].s = s;
+    }
 }
 
 void sqlite_database::sqlite_table::set_column(const Column & c, const theta::Histogram & h){
@@ -231,33 +473,37 @@ void sqlite_database::sqlite_table::set_column(const Column & c, const theta::Hi
     if(index < 0) return;
     //including overflow and underflow, we have nbins+2 bins. Encoding the range with the first
     // two, we have nbins+4 double to save.
-    boost::scoped_array<double> blob_data(new double[h.get_nbins()+4]);
-    blob_data[0] = h.get_xmin();
-    blob_data[1] = h.get_xmax();
-    std::copy(h.getData(), h.getData() + h.get_nbins()+2, &blob_data[2]);
-    size_t nbytes = sizeof(double) * (h.get_nbins() + 4);
-    sqlite3_bind_blob(insert_statement, index, &blob_data[0], nbytes, SQLITE_TRANSIENT);
+    const double range[2] = {h.get_xmin(), h.get_xmax()};
+    std::string & blob = row[index - 1].s;
+    blob.resize(sizeof(double) * (h.get_nbins() + 4));
+    std::copy(reinterpret_cast<const char*>(range), reinterpret_cast<const char*>(range + 2), blob.begin());
+    std::copy(reinterpret_cast<const char*>(h.getData()), reinterpret_cast<const char*>(h.getData() + h.get_nbins() + 2),
+              blob.begin() + sizeof(range));
+    row[index - 1].type = typeHisto;
 }
 
-//NOTE: If coding for multiple threads accessing a single sqlite database,
-// we would have to do explicit locking between the insert statement execution
-// and this function call to ensure that we get the correct id here.
-
 int sqlite_database::sqlite_table::add_row(){
     if(not table_created) create_table();
-    int res = sqlite3_step(insert_statement);
-    sqlite3_reset(insert_statement);
-    //reset all to NULL
-    sqlite3_clear_bindings(insert_statement);
-    if (res != 101) {
-        db->error(__FUNCTION__);
-    }
     if(have_autoinc){
-        return sqlite3_last_insert_rowid(db->db);
+        row[autoinc_index - 1].type = typeInt;
+        row[autoinc_index - 1].i = ++last_autoinc_id;
+    }
+    //move the current row to the buffer and reset it to NULL:
+    const size_t ncols = row.size();
+    rows.resize(rows.size() + ncols);
+    for(size_t i=0; i<ncols; ++i){
+        cell & dest = rows[nrows * ncols + i];
+        dest.type = row[i].type;
+        dest.d = row[i].d;
+        dest.i = row[i].i;
+        dest.s.swap(row[i].s);
+        row[i].type = -1;
     }
-    else{
-        return 0;
+    ++nrows;
+    if(nrows >= db->batch_size || (db->commit_interval > 0.0 && difftime(time(0), last_submit) >= db->commit_interval)){
+        submit_rows();
     }
+    return have_autoinc ? last_autoinc_id : 0;
 }
 
 
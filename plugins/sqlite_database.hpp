@@ -4,11 +4,18 @@
 #include "interface/decls.hpp"
 #include "interface/database.hpp"
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <sqlite3.h>
 #include <memory>
 #include <string>
 #include <set>
+#include <deque>
+#include <vector>
+#include <ctime>
 
 
 /** \brief Database which stores all information in a single sqlite3 database file
@@ -19,6 +26,11 @@
  *   type = "sqlite_database";
  *   filename = "abc.db";
  *   products_data = ("deltanll__nll_sb"); // optional, default is '*'
+ *   journal_mode = "wal"; // optional, default is the sqlite default "delete"
+ *   synchronous = "normal"; // optional, default is the sqlite default "full"
+ *   page_size = 8192; // optional, default is the sqlite default
+ *   batch_size = 256; // optional, default is 256
+ *   commit_interval = 10.0; // optional, default is 10.0
  * }
  * \endcode
  *
@@ -29,8 +41,24 @@
  * \c products_data is a list of column names to save. The default is to save all columns which can
  *    be configured by setting it to "*". Note that the 'runid' and 'eventid' columns will always be saved.
  *
+ * \c journal_mode, \c synchronous and \c page_size set the sqlite PRAGMAs of the same name for the output file, see the
+ *    sqlite documentation. Valid values for \c journal_mode are "delete", "truncate", "persist", "memory", "wal" and "off"; for \c synchronous,
+ *    "off", "normal", "full" and "extra". \c page_size must be a power of two between 512 and 65536.
+ *
+ * \c batch_size is the number of rows per table which are buffered in memory before they are handed to the writer thread, see below.
+ *
+ * \c commit_interval is the time in seconds after which the rows written so far are committed to the file; a crash only
+ *    loses the rows of the current interval. A value of 0.0 commits only when closing the database.
+ *
  * If the file already exists, it is overwritten silently.
  *
+ * Rows are not written to the file in add_row. Instead, each table buffers \c batch_size rows (or the rows of \c commit_interval seconds, if
+ * that is shorter) and passes them to a writer thread, which inserts them
+ * with multi-row INSERT statements. So the sqlite overhead is taken out of the event loop. At most a few batches are queued; if the writer thread
+ * falls behind, add_row waits. Errors in the writer thread are reported as DatabaseException by the next call which
+ * passes a batch to the writer thread, or when closing the database. For a table with an autoinc column,
+ * the ids are assigned in add_row as 1, 2, 3, ... and written explicitly.
+ *
  * The types theta::typeDouble, theta::typeInt and theta::typeString are translated directly
  * to their SQL counterparts \c DOUBLE, \c INT(4) and \c TEXT, respectively. For theta::typeHisto,
  * an SQL BLOB is saved which contains the lower and upper border of the histogram and the raw histogram data,
@@ -80,11 +108,68 @@ private:
     void error(const std::string & functionName);
     
     void close();
+
+    class sqlite_table;
+
+    // a buffered value. type is a theta::data_type or -1 for NULL. Strings and histogram blobs are saved in s:
+    struct cell{
+        int type;
+        double d;
+        int i;
+        std::string s;
+        cell(): type(-1), d(0.0), i(0){}
+    };
+
+    // work for the writer thread: either execute sql or insert nrows rows with the values in cells into table:
+    struct job{
+        sqlite_table * table;
+        std::string sql;
+        std::vector<cell> cells;
+        size_t nrows;
+        job(): table(0), nrows(0){}
+    };
+
+    // passes the job to the writer thread, swapping out its contents. Waits if too many jobs are queued.
+    void submit(job & j);
+
+    // waits until the writer thread has processed all jobs
+    void flush();
+
+    // throws a DatabaseException if the writer thread failed. Has to be called with the mutex locked.
+    void check_writer_error();
+    // called by the writer thread for any exception: save the message for check_writer_error and wake up the main thread
+    void writer_failed(const std::string & message);
+
+    // the main loop of the writer thread
+    void write_loop();
+
+    // insert the rows of j; called in the writer thread
+    void insert_rows(job & j);
+
+    struct writer_task{
+        sqlite_database * db;
+        explicit writer_task(sqlite_database * db_): db(db_){}
+        void operator()(){
+            db->write_loop();
+        }
+    };
     
     sqlite3* db;
     bool transaction_active;
     bool save_all_products;
     std::set<std::string> products_data;
+
+    size_t batch_size;
+    double commit_interval;
+
+    // the writer thread state, protected by mutex:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<job> jobs;
+    bool writer_busy, writer_stop;
+    std::string writer_error;
+    time_t last_commit;
+    boost::scoped_ptr<boost::thread> writer;
     
     //declare privately(!) the sqlite_table class:
     class sqlite_table: public theta::Table {
@@ -106,15 +191,31 @@ private:
         
         sqlite_table(const std::string & name_, const boost::shared_ptr<sqlite_database> & db_);
         
+        // append the buffered rows to a job for the writer thread
+        void submit_rows();
+
         std::string name;
         bool have_autoinc;
+        int autoinc_index, last_autoinc_id;
         std::stringstream column_definitions; // use by the add_column method
         std::stringstream ss_insert_statement;
         bool table_created;
         
         int next_insert_index; // next free insert_index to use by add_column to construct an sqlite_column, starting at 1.
         
-        sqlite3_stmt * insert_statement; // this ressource is owned by sqlite_database.
+        // the current row, one cell per insert index, and the complete rows not yet passed to the writer thread:
+        std::vector<cell> row;
+        std::vector<cell> rows;
+        size_t nrows;
+        time_t last_submit;
+
+        // the part of the INSERT statement before the VALUES, and the statement inserting rows_per_statement rows
+        // and the one for the remaining rows of the last job. Only used by the writer thread; the statements are owned by sqlite_database.
+        std::string insert_head;
+        sqlite3_stmt * insert_statement;
+        size_t rows_per_statement;
+        sqlite3_stmt * partial_statement;
+        size_t partial_rows;
         boost::shared_ptr<sqlite_database> db;
 
         bool save_all_columns;
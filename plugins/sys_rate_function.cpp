@@ -19,6 +19,8 @@ sys_rate_function::sys_rate_function(const theta::plugin::Configuration & cfg){
        r_minus.push_back(cfg.setting["sys_rates"][i][1]);
        r_plus.push_back(cfg.setting["sys_rates"][i][2]);
     }
+    f_layout = theta::ParLayout(par_ids, f_pids);
+    s_layout = theta::ParLayout(par_ids, s_pids);
 }
 
 double sys_rate_function::operator()(const theta::ParValues & values) const{
@@ -35,4 +37,40 @@ double sys_rate_function::operator()(const theta::ParValues & values) const{
     return result;
 }
 
+double sys_rate_function::eval_dense(const double * x, const size_t * offsets) const{
+    double result = 1.0;
+    for(size_t i=0; i<s_layout.size(); ++i){
+       double s = x[offsets[s_layout[i]]];
+       result *= (1 + fabs(s) * (s > 0.0?r_plus[i]:r_minus[i]));
+       if(result <= 0.0) return 0.0;
+    }
+    for(size_t i=0; i<f_layout.size(); ++i){
+       result *= x[offsets[f_layout[i]]];
+       if(result <= 0.0) return 0.0;
+    }
+    return result;
+}
+
+double sys_rate_function::eval_withDerivatives(const theta::ParValues & values, theta::ParValues & derivatives) const{
+    for(size_t i=0; i<s_pids.size(); ++i){
+        derivatives.set(s_pids[i], 0.0);
+    }
+    for(size_t i=0; i<f_pids.size(); ++i){
+        derivatives.set(f_pids[i], 0.0);
+    }
+    const double result = operator()(values);
+    if(result == 0.0) return result;
+    //all factors are positive if the result is not cut off, so the derivative w.r.t. a parameter is
+    // the result, divided by the factor for that parameter, multiplied by the factor's derivative:
+    for(size_t i=0; i<s_pids.size(); ++i){
+       double s = values.get(s_pids[i]);
+       double r = s > 0.0 ? r_plus[i] : r_minus[i];
+       derivatives.addTo(s_pids[i], result / (1 + fabs(s) * r) * (s > 0.0 ? r : -r));
+    }
+    for(size_t i=0; i<f_pids.size(); ++i){
+       derivatives.addTo(f_pids[i], result / values.get(f_pids[i]));
+    }
+    return result;
+}
+
 REGISTER_PLUGIN(sys_rate_function)
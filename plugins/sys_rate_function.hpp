@@ -34,12 +34,24 @@ private:
     std::vector<theta::ParId> s_pids;
     std::vector<double> r_plus;
     std::vector<double> r_minus;
+    //the indices of f_pids and s_pids in par_ids:
+    theta::ParLayout f_layout, s_layout;
 
 public:
     /// constructor used by the plugin system
     sys_rate_function(const theta::plugin::Configuration & cfg);
     /// overloaded evaluation operator from theta::Function
     virtual double operator()(const theta::ParValues & v) const;
+    /// same as operator(), with parameter values given as for theta::Function::eval_dense
+    virtual double eval_dense(const double * x, const size_t * offsets) const;
+    /** \brief Function value and derivatives
+     *
+     * At s_i = 0, the derivative for negative s_i is used. If the function value is cut off at zero, all derivatives are zero.
+     */
+    virtual double eval_withDerivatives(const theta::ParValues & v, theta::ParValues & derivatives) const;
+    virtual bool provides_derivatives() const{
+        return true;
+    }
 };
 
 
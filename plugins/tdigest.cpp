@@ -0,0 +1,88 @@
+#include "plugins/tdigest.hpp"
+#include "interface/exception.hpp"
+
+#include <algorithm>
+#include <limits>
+
+using namespace theta;
+using namespace std;
+
+TDigest::TDigest(double compression_): compression(compression_), weight(0.0), x_min(numeric_limits<double>::infinity()),
+        x_max(-numeric_limits<double>::infinity()){
+    if(!(compression > 0.0)){
+        throw InvalidArgumentException("TDigest: compression must be positive");
+    }
+    buffer_size = static_cast<size_t>(5 * compression) + 10;
+    buffer.reserve(buffer_size);
+}
+
+void TDigest::reset(){
+    centroids.clear();
+    buffer.clear();
+    weight = 0.0;
+    x_min = numeric_limits<double>::infinity();
+    x_max = -numeric_limits<double>::infinity();
+}
+
+double TDigest::get_weight() const{
+    double result = weight;
+    for(size_t i=0; i<buffer.size(); ++i){
+        result += buffer[i].weight;
+    }
+    return result;
+}
+
+void TDigest::merge(){
+    if(buffer.empty()) return;
+    for(size_t i=0; i<buffer.size(); ++i){
+        weight += buffer[i].weight;
+        x_min = std::min(x_min, buffer[i].mean);
+        x_max = std::max(x_max, buffer[i].mean);
+    }
+    buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+    sort(buffer.begin(), buffer.end());
+    merged.clear();
+    centroid current = buffer[0];
+    //the total weight of the centroids before current:
+    double w_before = 0.0;
+    for(size_t i=1; i<buffer.size(); ++i){
+        const double w = current.weight + buffer[i].weight;
+        const double q = (w_before + 0.5 * w) / weight;
+        if(w <= 4 * weight * q * (1 - q) / compression){
+            current.mean += (buffer[i].mean - current.mean) * buffer[i].weight / w;
+            current.weight = w;
+        }
+        else{
+            merged.push_back(current);
+            w_before += current.weight;
+            current = buffer[i];
+        }
+    }
+    merged.push_back(current);
+    centroids.swap(merged);
+    buffer.clear();
+}
+
+double TDigest::quantile(double q){
+    merge();
+    if(centroids.empty()){
+        throw InvalidArgumentException("TDigest::quantile: no values added");
+    }
+    const double target = q * weight;
+    //each centroid is at the center of its weight:
+    double pos = 0.5 * centroids[0].weight;
+    if(target <= pos){
+        if(centroids[0].weight <= 1.0) return centroids[0].mean;
+        return x_min + (centroids[0].mean - x_min) * target / pos;
+    }
+    for(size_t i=1; i<centroids.size(); ++i){
+        const double next_pos = pos + 0.5 * (centroids[i-1].weight + centroids[i].weight);
+        if(target <= next_pos){
+            return centroids[i-1].mean + (centroids[i].mean - centroids[i-1].mean) * (target - pos) / (next_pos - pos);
+        }
+        pos = next_pos;
+    }
+    const centroid & last = centroids.back();
+    if(last.weight <= 1.0) return last.mean;
+    return last.mean + (x_max - last.mean) * (target - pos) / (weight - pos);
+}
@@ -0,0 +1,63 @@
+#ifndef PLUGINS_TDIGEST_HPP
+#define PLUGINS_TDIGEST_HPP
+
+#include <vector>
+#include <cstddef>
+
+namespace theta {
+
+/** \brief Streaming quantile estimate with bounded memory (merging t-digest)
+ *
+ * Summarizes a stream of weighted values by a sorted list of centroids (mean and weight), following T. Dunning and O. Ertl,
+ * "Computing extremely accurate quantiles using t-digests". New values are collected in a buffer which is merged into the centroids
+ * whenever it is full. A centroid at quantile q may hold a total weight of at most 4 N q (1-q) / \c compression for a total weight N, so
+ * the centroids are small in the tails and the relative accuracy of extreme quantiles is better than the one of the median.
+ *
+ * The memory is proportional to \c compression and independent of the number of values added. Larger values of \c compression
+ * give more accurate quantiles; the absolute error of the quantile level is below 1 / \c compression around the median.
+ */
+class TDigest{
+public:
+    /// Construct an empty digest with the given compression, which must be positive
+    explicit TDigest(double compression = 100.0);
+
+    /// Add the value \c x with weight \c w &gt; 0
+    void add(double x, double w = 1.0){
+        buffer.push_back(centroid(x, w));
+        if(buffer.size() >= buffer_size) merge();
+    }
+
+    /** \brief The estimated quantile \c q
+     *
+     * \c q must be in [0, 1]. Between the centroids, the quantile is interpolated linearly; the minimum and maximum value added
+     * are used as the 0 and 1 quantile. Throws an InvalidArgumentException if no values were added.
+     */
+    double quantile(double q);
+
+    /// The total weight of the values added
+    double get_weight() const;
+
+    /// Remove all values
+    void reset();
+
+private:
+    struct centroid{
+        double mean, weight;
+        centroid(double m, double w): mean(m), weight(w){}
+        bool operator<(const centroid & rhs) const{
+            return mean < rhs.mean;
+        }
+    };
+
+    // merge the buffer into the centroids
+    void merge();
+
+    double compression;
+    size_t buffer_size;
+    std::vector<centroid> centroids, buffer, merged;
+    double weight, x_min, x_max;
+};
+
+}
+
+#endif
@@ -56,6 +56,9 @@ public:
     virtual double evalNL_withDerivatives(const theta::ParValues & values, theta::ParValues & derivatives) const{
        throw theta::FatalException("vary_one::evalNL_withDerivatives is not implemented");
     }
+    virtual bool provides_derivatives() const{
+        return false;
+    }
     virtual const std::pair<double, double> & support(const theta::ParId & p) const{
        throw theta::FatalException("vary_one::support is not implemented");
     }
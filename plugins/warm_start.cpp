@@ -0,0 +1,67 @@
+#include "plugins/warm_start.hpp"
+#include "interface/cfg-utils.hpp"
+#include "interface/phys.hpp"
+
+#include <cmath>
+
+using namespace theta;
+using namespace std;
+
+WarmStart::WarmStart(const SettingWrapper & s): policy(cold), used_start(cold), n_minima(0){
+    if(s.exists("warm-start")){
+        string p = s["warm-start"];
+        if(p=="none") policy = cold;
+        else if(p=="mean") policy = mean;
+        else if(p=="last") policy = last;
+        else if(p=="covariance-step") policy = covariance_step;
+        else throw ConfigurationException("invalid warm-start '" + p + "' (allowed are 'none', 'mean', 'last' and 'covariance-step')");
+    }
+}
+
+void WarmStart::update(const ParIds & pars, const MinimizationResult & res){
+    ++n_minima;
+    size_t i=0;
+    for(ParIds::const_iterator it=pars.begin(); it!=pars.end(); ++it, ++i){
+        const double value = res.values.get(*it);
+        if(sum_values.contains(*it)) sum_values.addTo(*it, value);
+        else sum_values.set(*it, value);
+        last_values.set(*it, value);
+        const double var = res.covariance.getRows() > i ? res.covariance(i, i) : -1.0;
+        last_errors.set(*it, var > 0.0 ? sqrt(var) : 0.0);
+    }
+}
+
+MinimizationResult WarmStart::minimize(Minimizer & minimizer, const Function & f, const ParValues & start,
+        const ParValues & step, const std::map<ParId, std::pair<double, double> > & ranges){
+    const ParIds & pars = f.getParameters();
+    used_start = cold;
+    if(policy != cold && n_minima > 0){
+        ParValues warm_start, warm_step;
+        warm_start.set(start);
+        warm_step.set(step);
+        for(ParIds::const_iterator it=pars.begin(); it!=pars.end(); ++it){
+            std::map<ParId, std::pair<double, double> >::const_iterator r_it = ranges.find(*it);
+            if(r_it==ranges.end() || !last_values.contains(*it)) continue;
+            const pair<double, double> & range = r_it->second;
+            if(step.get(*it) == 0.0 || range.first == range.second) continue;
+            double value = policy == mean ? sum_values.get(*it) / n_minima : last_values.get(*it);
+            value = max(range.first, min(range.second, value));
+            warm_start.set(*it, value);
+            if(policy == covariance_step && last_errors.get(*it) > 0.0){
+                warm_step.set(*it, last_errors.get(*it));
+            }
+        }
+        try{
+            MinimizationResult res = minimizer.minimize(f, warm_start, warm_step, ranges);
+            used_start = policy;
+            update(pars, res);
+            return res;
+        }
+        catch(MinimizationException &){
+            used_start = -policy;
+        }
+    }
+    MinimizationResult res = minimizer.minimize(f, start, step, ranges);
+    update(pars, res);
+    return res;
+}
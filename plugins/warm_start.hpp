@@ -0,0 +1,69 @@
+#ifndef PLUGINS_WARM_START_HPP
+#define PLUGINS_WARM_START_HPP
+
+#include "interface/decls.hpp"
+#include "interface/variables.hpp"
+#include "interface/minimizer.hpp"
+
+#include <map>
+
+/** \brief Start values for a minimization derived from the minima of previous calls
+ *
+ * This class is used by producers which minimize the negative log-likelihood once per event, such as
+ * \ref mle and \ref deltanll_intervals. As consecutive pseudo experiments are statistically similar, starting
+ * the minimization close to the previous minima can save much of the time spent on convergence.
+ *
+ * The policy is configured via the optional "warm-start" setting of the producer which can be
+ * <ul>
+ *  <li>"none": always use the cold start, i.e., the start values and step sizes passed to minimize. This is the default.</li>
+ *  <li>"mean": start at the mean of all previous minima.</li>
+ *  <li>"last": start at the previous minimum.</li>
+ *  <li>"covariance-step": start at the previous minimum, using the parameter errors from the covariance matrix of the previous
+ *      minimization as step sizes (where available).</li>
+ * </ul>
+ *
+ * Warm start values are moved inside the parameter ranges; fixed parameters always use the cold start values. If the minimization
+ * from the warm start fails with a theta::MinimizationException, it is repeated from the cold start.
+ */
+class WarmStart{
+public:
+    /// The start values used in the last call of minimize; the values are written to the products table
+    enum e_start{
+        cold = 0, ///< cold start, as no warm-start policy is configured or no previous minimum is available
+        mean = 1, ///< warm start with policy "mean"
+        last = 2, ///< warm start with policy "last"
+        covariance_step = 3 ///< warm start with policy "covariance-step"
+        // the negative values -1, -2, -3 indicate a cold start after a failed minimization with the respective policy
+    };
+
+    /// Construct from the producer setting, reading the optional "warm-start" setting.
+    explicit WarmStart(const theta::SettingWrapper & s);
+
+    /// Whether a warm-start policy other than "none" is configured
+    bool enabled() const{
+        return policy != cold;
+    }
+
+    /** \brief Minimize f, using a warm start if available
+     *
+     * \c start, \c step and \c ranges are the cold start values, as passed to theta::Minimizer::minimize.
+     */
+    theta::MinimizationResult minimize(theta::Minimizer & minimizer, const theta::Function & f, const theta::ParValues & start,
+            const theta::ParValues & step, const std::map<theta::ParId, std::pair<double, double> > & ranges);
+
+    /// The start used in the last call of minimize, as value of e_start
+    int get_used_start() const{
+        return used_start;
+    }
+
+private:
+    void update(const theta::ParIds & pars, const theta::MinimizationResult & res);
+
+    e_start policy;
+    int used_start;
+
+    size_t n_minima;
+    theta::ParValues sum_values, last_values, last_errors;
+};
+
+#endif
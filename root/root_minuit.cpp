@@ -1,5 +1,8 @@
 #include "root/root_minuit.hpp"
 #include "interface/redirect_stdio.hpp"
+#include "interface/timing.hpp"
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 using namespace theta;
 using namespace theta::plugin;
@@ -44,76 +47,206 @@ private:
     const size_t ndim;
 };
 
+// function adapter which also provides the analytical gradient of the theta::Function
+class RootMinuitGradientAdapter: public ROOT::Math::IMultiGradFunction{
+public:
 
+    virtual ROOT::Math::IMultiGradFunction* Clone() const{
+        throw Exception("RootMinuitGradientAdapter::Clone not implemented");
+    }
 
-MinimizationResult root_minuit::minimize(const theta::Function & f, const theta::ParValues & start,
-        const theta::ParValues & steps, const std::map<theta::ParId, std::pair<double, double> > & ranges){
-    //I would like to re-use min. However, it horribly fails after very few uses with
+    virtual unsigned int NDim() const{
+        return ndim;
+    }
+
+    RootMinuitGradientAdapter(const Function & f_): f(f_), ndim(f.getnpar()), grad(ndim){
+    }
+
+    virtual double DoEval(const double * x) const{
+        return eval(x, &grad[0]);
+    }
+
+    virtual void Gradient(const double * x, double * g) const{
+        eval(x, g);
+    }
+
+    virtual void FdF(const double * x, double & value, double * g) const{
+        value = eval(x, g);
+    }
+
+    virtual double DoDerivative(const double * x, unsigned int icoord) const{
+        eval(x, &grad[0]);
+        return grad[icoord];
+    }
+
+private:
+    double eval(const double * x, double * g) const{
+        for(size_t i=0; i<ndim; ++i){
+            if(isnan(x[i])){
+               throw MinimizationException("minuit called likelihood function with NAN argument!");
+            }
+        }
+        double result = f.eval_withDerivatives(x, g);
+        if(isinf(result)){
+           theta::cerr << "Error in function to minimize: result is infinity. Parameter values: " << endl;
+           for(size_t i=0; i<ndim; ++i){
+               theta::cerr << x[i] << " ";
+           }
+           theta::cerr << endl;
+           throw MinimizationException("function to minimize was infinity during minimization");
+        }
+        return result;
+    }
+
+    const theta::Function & f;
+    const size_t ndim;
+    mutable std::vector<double> grad;
+};
+
+
+
+namespace{
+
+double seconds_since(const boost::posix_time::ptime & t0){
+    return (boost::posix_time::microsec_clock::universal_time() - t0).total_microseconds() / 1e6;
+}
+
+}
+
+bool root_minuit::variable_layout::operator==(const variable_layout & rhs) const{
+    if(name != rhs.name || kind != rhs.kind) return false;
+    switch(kind){
+        case fixed: return true;
+        case unlimited: return step == rhs.step;
+        case upper_limited: return step == rhs.step && upper == rhs.upper;
+        case lower_limited: return step == rhs.step && lower == rhs.lower;
+        default: return step == rhs.step && lower == rhs.lower && upper == rhs.upper;
+    }
+}
+
+void root_minuit::setup_minimizer(const std::vector<double> & values){
+    //Re-using min after registering variables anew horribly fails after very few uses with
     // unsigned int ROOT::Minuit2::MnUserTransformation::IntOfExt(unsigned int) const: Assertion `!fParameters[ext].IsFixed()' failed.
-    // when calling SetFixedVariable(...).
-    //Using a "new" one every time seems very wastefull, but it seems to work ...
+    // when calling SetFixedVariable(...). Therefore, a new one is created every time the variables have to be set up.
     min.reset(new ROOT::Minuit2::Minuit2Minimizer(type));
+    ++n_setup;
     min->SetPrintLevel(printlevel);
+    //use not the ranges directly, but a somewhat more narrow range (one permille of the respective border)
+    // in order to avoid that the numerical evaluation of the numerical derivative at the boundaries pass these
+    // boundaries ...
+    for(size_t ivar=0; ivar<layout.size(); ++ivar){
+        const variable_layout & v = layout[ivar];
+        switch(v.kind){
+            case variable_layout::fixed: min->SetFixedVariable(ivar, v.name, values[ivar]); break;
+            case variable_layout::unlimited: min->SetVariable(ivar, v.name, values[ivar], v.step); break;
+            case variable_layout::upper_limited:
+                min->SetUpperLimitedVariable(ivar, v.name, values[ivar], v.step, v.upper - fabs(v.upper) * 0.001);
+                break;
+            case variable_layout::lower_limited:
+                min->SetLowerLimitedVariable(ivar, v.name, values[ivar], v.step, v.lower + fabs(v.lower) * 0.001);
+                break;
+            case variable_layout::limited:
+                min->SetLimitedVariable(ivar, v.name, values[ivar], v.step, v.lower + fabs(v.lower) * 0.001, v.upper - fabs(v.upper) * 0.001);
+        }
+    }
+    if(!isnan(tolerance))  min->SetTolerance(tolerance);
+    //error definition. Unfortunately, SetErrorDef in ROOT is not documented, so I had to guess.
+    // 0.5 seems to work somehow.
+    min->SetErrorDef(0.5);
+}
+
+MinimizationResult root_minuit::minimize(const theta::Function & f, const theta::ParValues & start,
+        const theta::ParValues & steps, const std::map<theta::ParId, std::pair<double, double> > & ranges){
+    MinimizeCall call;
+    using boost::posix_time::ptime;
+    using boost::posix_time::microsec_clock;
+    ptime t0 = microsec_clock::universal_time();
+    ++n_calls;
     MinimizationResult result;
 
-    //1. setup parameters, limits and initial step sizes
-    ParIds parameters = f.getParameters();
+    //1. determine the variable layout and start values
+    const ParIds & parameters = f.getParameters();
+    std::vector<variable_layout> new_layout(parameters.size());
+    std::vector<double> values(parameters.size());
     int ivar=0;
     for(ParIds::const_iterator it=parameters.begin(); it!=parameters.end(); ++it, ++ivar){
         std::map<theta::ParId, std::pair<double, double> >::const_iterator r_it = ranges.find(*it);
         if(r_it==ranges.end()) throw InvalidArgumentException("root_minuit::minimize: range not set for a parameter");
-        pair<double, double> range = r_it->second;
-        double def = start.get(*it);
-        double step = steps.get(*it);
-        string name = vm->getName(*it);
-        //use not the ranges directly, but a somewhat more narrow range (one permille of the respective border)
-        // in order to avoid that the numerical evaluation of the numerical derivative at the boundaries pass these
-        // boundaries ...
-        if(step == 0.0){
-            min->SetFixedVariable(ivar, name, def);
-        }
+        const pair<double, double> & range = r_it->second;
+        variable_layout & v = new_layout[ivar];
+        v.name = vm->getName(*it);
+        v.step = steps.get(*it);
+        v.lower = range.first;
+        v.upper = range.second;
+        values[ivar] = start.get(*it);
+        if(v.step == 0.0) v.kind = variable_layout::fixed;
         else if(isinf(range.first)){
-            if(isinf(range.second)){
-                min->SetVariable(ivar, name, def, step);
-            }
-            else{
-                min->SetUpperLimitedVariable(ivar, name, def, step, range.second - fabs(range.second) * 0.001);
-            }
+            v.kind = isinf(range.second) ? variable_layout::unlimited : variable_layout::upper_limited;
         }
-        else{
-            if(isinf(range.second)){
-                min->SetLowerLimitedVariable(ivar, name, def, step, range.first + fabs(range.first) * 0.001);
-            }
-            else{ // both ends are finite
-                if(range.first==range.second){
-                    min->SetFixedVariable(ivar, name, range.first);
-                }
-                else{
-                    min->SetLimitedVariable(ivar, name, def, step, range.first + fabs(range.first) * 0.001, range.second - fabs(range.second) * 0.001);
-                }
-            }
+        else if(isinf(range.second)) v.kind = variable_layout::lower_limited;
+        else if(range.first == range.second){
+            v.kind = variable_layout::fixed;
+            values[ivar] = range.first;
         }
+        else v.kind = variable_layout::limited;
     }
 
-    //2. setup the function
+    //2. setup the minimizer: re-use the previous one if the layout is unchanged and only set the start values
+    // and step sizes (MINUIT would otherwise start with the errors of the previous minimization), otherwise create a new one.
+    bool reused = reuse && min.get() && new_layout == layout;
+    if(reused){
+        for(size_t i=0; i<values.size(); ++i){
+            min->SetVariableValue(i, values[i]);
+            if(layout[i].kind != variable_layout::fixed) min->SetVariableStepSize(i, layout[i].step);
+        }
+    }
+    else{
+        layout.swap(new_layout);
+        setup_minimizer(values);
+    }
+
+    //3. setup the function
     RootMinuitFunctionAdapter minuit_f(f);
-    min->SetFunction(minuit_f);
+    RootMinuitGradientAdapter minuit_gradf(f);
+    const bool use_gradient = analytic_gradient && f.provides_derivatives();
+    if(use_gradient){
+        min->SetFunction(minuit_gradf);
+    }
+    else{
+        min->SetFunction(minuit_f);
+    }
+    t_setup += seconds_since(t0);
 
-    //3. setup tolerance
-    if(!isnan(tolerance))  min->SetTolerance(tolerance);
-    //3.a. error definition. Unfortunately, SetErrorDef in ROOT is not documented, so I had to guess.
-    // 0.5 seems to work somehow.
-    min->SetErrorDef(0.5);
-    
-    //4. minimize. In case of failure, try harder
+    //4. minimize. In case of failure, try harder. If the minimizer was re-used, start with a new one to
+    // exclude that the failure is due to the state left over from the previous minimization
+    t0 = microsec_clock::universal_time();
     bool success;
-    for(int i=1; i<=3; i++){
-        success = min->Minimize();
-        if(success) break;
+    try{
+        for(int i=1; i<=3; i++){
+            success = min->Minimize();
+            if(success) break;
+            if(reused){
+                ptime t1 = microsec_clock::universal_time();
+                setup_minimizer(values);
+                if(use_gradient) min->SetFunction(minuit_gradf);
+                else min->SetFunction(minuit_f);
+                reused = false;
+                t_setup += seconds_since(t1);
+                t0 += microsec_clock::universal_time() - t1;
+            }
+        }
     }
+    catch(...){
+        //the state of min is unknown, so do not re-use it:
+        layout.clear();
+        t_minimize += seconds_since(t0);
+        throw;
+    }
+    t_minimize += seconds_since(t0);
 
     //5. do error handling
     if(not success){
+        layout.clear();
         int status = min->Status();
         int status_1 = status % 10;
         //int status_2 = status / 10;
@@ -167,10 +300,20 @@ MinimizationResult root_minuit::minimize(const theta::Function & f, const theta:
     return result;
 }
 
-root_minuit::root_minuit(const Configuration & cfg): Minimizer(cfg), tolerance(NAN), printlevel(0){
+root_minuit::root_minuit(const Configuration & cfg): Minimizer(cfg), tolerance(NAN), printlevel(0), analytic_gradient(false),
+  reuse(false), print_timing(false), n_calls(0), n_setup(0), t_setup(0.0), t_minimize(0.0){
+       if(cfg.setting.exists("reuse")){
+           reuse = cfg.setting["reuse"];
+       }
+       if(cfg.setting.exists("print-timing")){
+           print_timing = cfg.setting["print-timing"];
+       }
        if(cfg.setting.exists("printlevel")){
            printlevel = cfg.setting["printlevel"];
        }
+       if(cfg.setting.exists("analytic-gradient")){
+           analytic_gradient = cfg.setting["analytic-gradient"];
+       }
        string method = "migrad";
        if(cfg.setting.exists("method")){
            method = (string)cfg.setting["method"];
@@ -191,5 +334,12 @@ root_minuit::root_minuit(const Configuration & cfg): Minimizer(cfg), tolerance(N
        }
    }
 
+root_minuit::~root_minuit(){
+    if(print_timing){
+        theta::cout << "root_minuit: " << n_calls << " minimizations, " << n_setup << " minimizer setups; time for setup: "
+                    << t_setup << " s, time for minimization: " << t_minimize << " s" << endl;
+    }
+}
+
 REGISTER_PLUGIN(root_minuit)
 
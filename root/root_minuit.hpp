@@ -9,6 +9,9 @@
 #include "interface/phys.hpp"
 #include "interface/minimizer.hpp"
 
+#include <vector>
+#include <string>
+
 /** \brief Minimizer using the MINUIT minimizer from root
  *
  * Configuration with a setting like:
@@ -19,6 +22,9 @@
  *  printlevel = 1; // optional. Default is 0
  *  method = "simplex"; //optional. Default is "migrad"
  *  tolerance = 0.001; //optional. Default as in ROOT::Minuit2
+ *  analytic-gradient = true; //optional. Default is false
+ *  reuse = true; //optional. Default is false
+ *  print-timing = true; //optional. Default is false
  * }
  * \endcode
  *
@@ -31,6 +37,19 @@
  * \c tolerance is the Tolerance as should be documented in ROOT::Minuit2::Minuit2Minimizer::SetTolerance.
  *  Default is the one used by ROOT::Minuit2::Minuit2Minimizer.
  *
+ * If \c analytic-gradient is true and the function to minimize provides derivatives (see theta::Function::provides_derivatives),
+ *  MINUIT is given the analytical gradient instead of calculating it numerically. Otherwise, this setting has no effect.
+ *
+ * If \c reuse is true, the ROOT::Minuit2::Minuit2Minimizer instance is kept between calls of minimize as long as the
+ *  variable layout does not change, i.e., as long as the function has the same parameters with the same step sizes, ranges
+ *  and fixed flags. Only the start values are set in this case, which avoids allocating a new minimizer and registering all
+ *  variables for each minimization. The step sizes are reset to the configured ones, so the result does not depend on the previous minimization.
+ *  If the minimization with a re-used minimizer fails, it is repeated with a newly allocated one. The default is to allocate a new
+ *  minimizer for every call.
+ *
+ * If \c print-timing is true, the number of minimizations and minimizer setups as well as the total time spent
+ *  in setup (allocation, variable registration) and in the minimization itself are printed when the plugin is destroyed.
+ *
  * Please note that this plugin relies on the Minuit2 implementation of ROOT which is poorly documented. Minuit2
  * is a C++ proxy to the fortran MINUIT for which you can find more documentation.
  */
@@ -46,18 +65,42 @@ public:
      *
      * The minimizer forwards the task to a ROOT::Minuit2::Minuit2Minimizer using its
      * functions also for setting limits on the parameters. If minimization fails, it
-     * is attempted up to three times through repeating calls of ROOT::Minuit2::Minuit2Minimizer::Minimize.
+     * is attempted up to three times through repeating calls of ROOT::Minuit2::Minuit2Minimizer::Minimize (using a newly
+     * allocated minimizer after the first failure, if it was re-used).
      * If still an error is reported, a \ref theta::MinimizationException is thrown which contains the status
      * code returned by ROOT::Minuit2::Minuit2Minimizer::Status().
      */
     virtual theta::MinimizationResult minimize(const theta::Function & f, const theta::ParValues & start,
             const theta::ParValues & step, const std::map<theta::ParId, std::pair<double, double> > & ranges);
+
+    /// Prints the timing summary if \c print-timing is true
+    virtual ~root_minuit();
 private:
-    
+    // the way a variable was registered at the minimizer; used to decide whether min can be re-used
+    struct variable_layout{
+        enum e_kind{ fixed, unlimited, upper_limited, lower_limited, limited };
+        std::string name;
+        e_kind kind;
+        double lower, upper, step;
+        bool operator==(const variable_layout & rhs) const;
+    };
+
+    // allocate a new min and register the variables according to layout
+    void setup_minimizer(const std::vector<double> & values);
+
     ROOT::Minuit2::EMinimizerType type;
     std::auto_ptr<ROOT::Minuit2::Minuit2Minimizer> min;
     double tolerance;
     int printlevel;
+    bool analytic_gradient;
+    bool reuse;
+    bool print_timing;
+
+    std::vector<variable_layout> layout;
+
+    // statistics for print-timing:
+    int n_calls, n_setup;
+    double t_setup, t_minimize;
 };
 
 #endif
@@ -1,5 +1,7 @@
 #include <string>
 #include <sstream>
+#include <limits>
+#include <cmath>
 
 #include <boost/date_time/local_time/local_time.hpp>
 
@@ -58,9 +60,22 @@ void ProductsTable::add_row(int runid, int eventid){
 }
 
 /* LogTable */
-LogTable::LogTable(std::auto_ptr<Table> & table_): level(info), table(table_){
+namespace{
+    const char * code_messages[] = {"run start", "run end", "start", "end"};
+
+    // binning of the event_times histogram of the summary table, in log10(ns):
+    const size_t event_times_nbins = 100;
+    const double event_times_min = 2.0, event_times_max = 12.0;
+
+    // the value of event_time_min before the first event time of a run is added:
+    const boost::uint64_t no_event_time = std::numeric_limits<boost::uint64_t>::max();
+}
+
+LogTable::LogTable(std::auto_ptr<Table> & table_): level(info), table(table_), run_n_events(0), event_time_total(0),
+  event_time_min(no_event_time), event_time_max(0){
    for(int i=0; i<4; ++i){
        n_messages[i]=0;
+       run_n_messages[i]=0;
    }
    c_runid = table->add_column("runid", typeInt);
    c_eventid = table->add_column("eventid", typeInt);
@@ -84,6 +99,9 @@ LogTable::e_severity LogTable::get_loglevel() const{
 
 void LogTable::really_append(int runid, int eventid, e_severity s, const string & message) {
     n_messages[s]++;
+    run_n_messages[s]++;
+    //in compact mode, only the errors are written per event; all other messages are only counted for the summary:
+    if(summary_table.get() && s != error) return;
     table->set_column(*c_runid, runid);
     table->set_column(*c_eventid, eventid);
     table->set_column(*c_severity, s);
@@ -97,17 +115,81 @@ void LogTable::really_append(int runid, int eventid, e_severity s, const string
     table->add_row();
 }
 
+void LogTable::set_compact(std::auto_ptr<Table> & summary_table_){
+    summary_table = summary_table_;
+    c_s_runid = summary_table->add_column("runid", typeInt);
+    c_n_events = summary_table->add_column("n_events", typeInt);
+    c_n_messages[error] = summary_table->add_column("n_errors", typeInt);
+    c_n_messages[warning] = summary_table->add_column("n_warnings", typeInt);
+    c_n_messages[info] = summary_table->add_column("n_infos", typeInt);
+    c_n_messages[debug] = summary_table->add_column("n_debugs", typeInt);
+    c_event_time_total = summary_table->add_column("event_time_total", typeDouble);
+    c_event_time_min = summary_table->add_column("event_time_min", typeDouble);
+    c_event_time_max = summary_table->add_column("event_time_max", typeDouble);
+    c_event_times = summary_table->add_column("event_times", typeHisto);
+    event_times.resize(event_times_nbins + 2);
+}
+
+void LogTable::really_append(int runid, int eventid, e_severity s, e_code code){
+    if(s <= level){
+        really_append(runid, eventid, s, code_messages[code]);
+    }
+    if(summary_table.get()){
+        if(code == event_end) ++run_n_events;
+        else if(code == run_end) write_summary(runid);
+    }
+}
+
+void LogTable::really_add_event_time(boost::uint64_t ns){
+    if(ns < event_time_min) event_time_min = ns;
+    if(ns > event_time_max) event_time_max = ns;
+    event_time_total += ns;
+    //the underflow bin also holds the times of 0ns:
+    size_t bin = 0;
+    if(ns > 0){
+        double x = (log10(static_cast<double>(ns)) - event_times_min) / (event_times_max - event_times_min) * event_times_nbins;
+        if(x >= 0) bin = std::min<size_t>(static_cast<size_t>(x) + 1, event_times_nbins + 1);
+    }
+    event_times[bin] += 1.0;
+}
+
+void LogTable::write_summary(int runid){
+    summary_table->set_column(*c_s_runid, runid);
+    summary_table->set_column(*c_n_events, run_n_events);
+    for(int i=0; i<4; ++i){
+        summary_table->set_column(*c_n_messages[i], run_n_messages[i]);
+    }
+    summary_table->set_column(*c_event_time_total, static_cast<double>(event_time_total));
+    summary_table->set_column(*c_event_time_min, event_time_min == no_event_time ? 0.0 : static_cast<double>(event_time_min));
+    summary_table->set_column(*c_event_time_max, static_cast<double>(event_time_max));
+    Histogram h(event_times_nbins, event_times_min, event_times_max);
+    for(size_t i=0; i<event_times.size(); ++i){
+        h.set(i, event_times[i]);
+    }
+    summary_table->set_column(*c_event_times, h);
+    summary_table->add_row();
+    run_n_events = 0;
+    for(int i=0; i<4; ++i){
+        run_n_messages[i] = 0;
+    }
+    event_time_total = event_time_max = 0;
+    event_time_min = no_event_time;
+    std::fill(event_times.begin(), event_times.end(), 0.0);
+}
+
 //RndInfoTable
 RndInfoTable::RndInfoTable(std::auto_ptr<Table> & table_): table(table_){
     c_runid = table->add_column("runid", typeInt);
     c_name = table->add_column("name", typeString);
     c_seed = table->add_column("seed", typeInt);
+    c_key = table->add_column("key", typeString);
 }
 
-void RndInfoTable::append(int runid, const string & name, int seed){
+void RndInfoTable::append(int runid, const string & name, int seed, const string & key){
     table->set_column(*c_runid, runid);
     table->set_column(*c_name, name);
     table->set_column(*c_seed, seed);
+    table->set_column(*c_key, key);
     table->add_row();
 }
 
@@ -14,3 +14,40 @@ FatalException::FatalException(const Exception & ex){
 
 FatalException::FatalException(const std::string & message_): message(message_){
 }
+
+boost::exception_ptr theta::current_exception(){
+    //the most derived types have to come first:
+    try{
+        throw;
+    }
+    catch(ConfigurationException & ex){
+        return boost::copy_exception(ex);
+    }
+    catch(NotFoundException & ex){
+        return boost::copy_exception(ex);
+    }
+    catch(MathException & ex){
+        return boost::copy_exception(ex);
+    }
+    catch(DatabaseException & ex){
+        return boost::copy_exception(ex);
+    }
+    catch(MinimizationException & ex){
+        return boost::copy_exception(ex);
+    }
+    catch(Exception & ex){
+        return boost::copy_exception(ex);
+    }
+    catch(InvalidArgumentException & ex){
+        return boost::copy_exception(ex);
+    }
+    catch(FatalException & ex){
+        return boost::copy_exception(ex);
+    }
+    catch(ExitException & ex){
+        return boost::copy_exception(ex);
+    }
+    catch(...){
+        return boost::current_exception();
+    }
+}
@@ -6,6 +6,18 @@ REGISTER_PLUGIN_BASETYPE(theta::HistogramFunction);
 
 using namespace theta;
 
+const Histogram & HistogramFunction::gradient(const ParValues & values, const ParId & pid) const{
+    throw FatalException("HistogramFunction::gradient: derivatives not implemented for this HistogramFunction");
+}
+
+const Histogram & HistogramFunction::eval_dense(const double * x, const size_t * offsets) const{
+    size_t i=0;
+    for(ParIds::const_iterator it=par_ids.begin(); it!=par_ids.end(); ++it, ++i){
+        pv.set(*it, x[offsets[i]]);
+    }
+    return operator()(pv);
+}
+
 const Histogram &  ConstantHistogramFunctionError::getRandomFluctuation(Random & rnd, const ParValues & values) const{
     const size_t nbins = h.get_nbins();
     for(size_t i=1; i<=nbins; ++i){
@@ -7,40 +7,129 @@
 #include <sstream>
 #include <limits>
 #include <new>
+#include <vector>
+
+#include <boost/thread/tss.hpp>
+#include <boost/atomic.hpp>
 
 using namespace theta;
 
 namespace{
-   int n_allocs = 0;
-   int n_frees = 0;
+   // histograms are created and destroyed concurrently in the worker threads:
+   boost::atomic<int> n_allocs(0);
+   boost::atomic<int> n_frees(0);
+
+   // Per-thread cache of histodata blocks with one free list per size class; size class c holds blocks of
+   // 2^c doubles. Blocks are allocated with posix_memalign and can be returned to the cache of any thread.
+   class HistodataPool{
+   public:
+      static const int n_classes = 21;
+      static const size_t max_cached_bytes = 64 << 20;
+
+      HistodataPool(): cached_bytes(0){}
+
+      ~HistodataPool(){
+         for(int c=0; c<n_classes; ++c){
+            for(size_t i=0; i<free_lists[c].size(); ++i){
+               free(free_lists[c][i]);
+            }
+         }
+      }
+
+      double * get(int c){
+         if(free_lists[c].empty()) return 0;
+         double * result = free_lists[c].back();
+         free_lists[c].pop_back();
+         cached_bytes -= sizeof(double) << c;
+         return result;
+      }
+
+      bool put(double * p, int c){
+         const size_t size = sizeof(double) << c;
+         if(cached_bytes + size > max_cached_bytes) return false;
+         free_lists[c].push_back(p);
+         cached_bytes += size;
+         return true;
+      }
+
+   private:
+      std::vector<double*> free_lists[n_classes];
+      size_t cached_bytes;
+   };
+
+   THETA_THREAD_LOCAL HistodataPool * thread_pool = 0;
+   // the number of HistodataPoolGuard instances in the current thread:
+   THETA_THREAD_LOCAL int pool_guards = 0;
+
+   HistodataPool & get_pool(){
+      if(thread_pool == 0){
+         //the thread_specific_ptr deletes the pool at thread exit. It is never destroyed itself to allow
+         // Histograms with static storage duration.
+         static boost::thread_specific_ptr<HistodataPool> * pools = new boost::thread_specific_ptr<HistodataPool>();
+         thread_pool = new HistodataPool();
+         pools->reset(thread_pool);
+      }
+      return *thread_pool;
+   }
+
+   // the size class for nbins, or -1 if too large for the pool
+   int size_class(size_t nbins){
+      const size_t n = nbins + 2 + nbins % 2;
+      int c = 2;
+      while((static_cast<size_t>(1) << c) < n){
+         ++c;
+         if(c >= HistodataPool::n_classes) return -1;
+      }
+      return c;
+   }
 
    double * allocate_histodata(size_t nbins){
-      ++n_allocs;
       double * result = 0;
       const size_t nbins_orig = nbins;
       //always allocate an even number of bins:
       if(nbins_orig % 2) ++nbins;
-      //for the add_fast routine, which might use SSE optimizations, we need this alignment. And
-      // while we at it, we should make sure double is as expected:
-      BOOST_STATIC_ASSERT(sizeof(double)==8);
-      int err = posix_memalign(reinterpret_cast<void**>(&result), 16, sizeof(double) * (nbins + 2));
-      if(err!=0){
-        throw std::bad_alloc();
+      //blocks of a size class are always allocated with the full size, so they can be cached later:
+      const int c = size_class(nbins_orig);
+      if(c >= 0 && pool_guards > 0){
+         result = get_pool().get(c);
+      }
+      if(result==0){
+         n_allocs.fetch_add(1, boost::memory_order_relaxed);
+         //for the add_fast routine, which might use SSE optimizations, we need this alignment. And
+         // while we at it, we should make sure double is as expected:
+         BOOST_STATIC_ASSERT(sizeof(double)==8);
+         size_t n = c >= 0 ? (static_cast<size_t>(1) << c) : nbins + 2;
+         int err = posix_memalign(reinterpret_cast<void**>(&result), 16, sizeof(double) * n);
+         if(err!=0){
+           throw std::bad_alloc();
+         }
       }
       //set the extra allocated double to zero to make sure no time-consuming garbage is there ...
       if(nbins_orig % 2) result[nbins + 1] = 0.0;
       return result;
    }
    
-   void free_histodata(double * histodata){
-      ++n_frees;
+   void free_histodata(double * histodata, size_t nbins){
+      //moved-from Histograms have no data:
+      if(histodata==0) return;
+      const int c = size_class(nbins);
+      if(c >= 0 && pool_guards > 0 && get_pool().put(histodata, c)) return;
+      n_frees.fetch_add(1, boost::memory_order_relaxed);
       free(histodata);
    }
 }
 
+HistodataPoolGuard::HistodataPoolGuard(){
+    ++pool_guards;
+}
+
+HistodataPoolGuard::~HistodataPoolGuard(){
+    --pool_guards;
+}
+
 void get_allocs_frees(int & n_alls, int & n_frs){
-    n_alls = n_allocs;
-    n_frs = n_frees;
+    n_alls = n_allocs.load(boost::memory_order_relaxed);
+    n_frs = n_frees.load(boost::memory_order_relaxed);
 }
 
 
@@ -54,10 +143,26 @@ Histogram::Histogram(const Histogram& rhs) {
     initFromHisto(rhs);
 }
 
+Histogram::Histogram(const HistogramView & rhs): nbins(rhs.get_nbins()), xmin(rhs.get_xmin()), xmax(rhs.get_xmax()) {
+    histodata = allocate_histodata(nbins);
+    memcpy(histodata, rhs.getData(), sizeof (double) *(nbins + 2));
+}
+
+void Histogram::assign_with_coeff(double coeff, const HistogramView & other) {
+    if (nbins != other.get_nbins() || xmin != other.get_xmin() || xmax != other.get_xmax()) {
+        reset(other.get_nbins(), other.get_xmin(), other.get_xmax());
+    }
+    const double * src = other.getData();
+    const size_t n = nbins + 2;
+    for(size_t i=0; i<n; ++i){
+        histodata[i] = coeff * src[i];
+    }
+}
+
 void Histogram::operator=(const Histogram & rhs) {
     if (&rhs == this) return;
     if (nbins != rhs.nbins || xmin != rhs.xmin || xmax != rhs.xmax) {
-        free_histodata(histodata);
+        free_histodata(histodata, nbins);
         initFromHisto(rhs);
     } else {
         memcpy(histodata, rhs.histodata, sizeof (double) *(nbins + 2));
@@ -65,18 +170,20 @@ void Histogram::operator=(const Histogram & rhs) {
 }
 
 Histogram::~Histogram() {
-    free_histodata(histodata);
+    free_histodata(histodata, nbins);
 }
 
 void Histogram::reset(size_t b, double x_min, double x_max) {
     //only re-allocate if there where changes.
     if (b > 0 && (b != nbins || x_min != xmin || x_max != xmax)) {
+        if(x_min >= x_max) throw InvalidArgumentException("Histogram: xmin >= xmax not allowed");
+        if(b != nbins){
+            free_histodata(histodata, nbins);
+            histodata = allocate_histodata(b);
+        }
         nbins = b;
         xmin = x_min;
         xmax = x_max;
-        if(xmin >= xmax) throw InvalidArgumentException("Histogram: xmin >= xmax not allowed");
-        free_histodata(histodata);
-        histodata = allocate_histodata(nbins);
     }
     memset(histodata, 0, sizeof (double) *(nbins + 2));
 }
@@ -0,0 +1,323 @@
+// runtime-dispatched AVX2 and AVX-512 implementations of log2_dot and template_nllikelihood.
+//
+// The baseline implementations (log2_dot_default, template_nllikelihood_default) are in log2_dot.s (x86_64)
+// or log2_dot.cxx (generic architectures).
+//
+// The vectorized log uses the algorithm of fdlibm's __ieee754_log: reduce x = 2^k * (1+f) with
+// sqrt(2)/2 < 1+f < sqrt(2) and use a polynomial approximation in s = f / (2 + f), with an error
+// below 1 ulp. Therefore, the results agree with the crlibm log (used for the default implementation) up to
+// rounding errors, but not necessarily bit-by-bit; also the summation order is different.
+
+#include "interface/log2_dot.hpp"
+
+#include <limits>
+#include <algorithm>
+
+#if defined(__x86_64__) && !defined(GENERIC_ARCH) && defined(__GNUC__)
+#define THETA_HAVE_SIMD_KERNELS
+#include <immintrin.h>
+#endif
+
+#ifdef THETA_HAVE_SIMD_KERNELS
+
+namespace{
+
+// constants from fdlibm e_log.c:
+const double ln2_hi = 6.93147180369123816490e-01;
+const double ln2_lo = 1.90821492927058770002e-10;
+const double Lg1 = 6.666666666666735130e-01;
+const double Lg2 = 3.999999999940941908e-01;
+const double Lg3 = 2.857142874366239149e-01;
+const double Lg4 = 2.222219843214978396e-01;
+const double Lg5 = 1.818357216161805012e-01;
+const double Lg6 = 1.531383769920937332e-01;
+const double Lg7 = 1.479819860511658591e-01;
+const double sqrt2 = 1.41421356237309504880;
+const double one_over_ln2 = 1.44269504088896340736;
+
+/* AVX2 */
+
+// log(x) for x > 0 finite (including subnormals). For other x, the result is unspecified.
+__attribute__((target("avx2,fma")))
+inline __m256d log_avx2(__m256d x){
+    const __m256d one = _mm256_set1_pd(1.0);
+    //scale subnormals to the normal range:
+    const __m256d is_subnormal = _mm256_cmp_pd(x, _mm256_set1_pd(std::numeric_limits<double>::min()), _CMP_LT_OQ);
+    x = _mm256_blendv_pd(x, _mm256_mul_pd(x, _mm256_set1_pd(18014398509481984.0)), is_subnormal); // 2^54
+    __m256d k_offset = _mm256_blendv_pd(_mm256_set1_pd(1023.0), _mm256_set1_pd(1023.0 + 54.0), is_subnormal);
+    //split x into exponent k and mantissa m in [1, 2):
+    const __m256i bits = _mm256_castpd_si256(x);
+    // exponent to double via the 2^52 trick:
+    const __m256i two52_bits = _mm256_set1_epi64x(0x4330000000000000LL);
+    __m256d k = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), two52_bits)),
+                              _mm256_set1_pd(4503599627370496.0)); // 2^52
+    k = _mm256_sub_pd(k, k_offset);
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000fffffffffffffLL)),
+                                                    _mm256_castpd_si256(one)));
+    //move m to [sqrt(2)/2, sqrt(2)):
+    const __m256d m_large = _mm256_cmp_pd(m, _mm256_set1_pd(sqrt2), _CMP_GE_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), m_large);
+    k = _mm256_add_pd(k, _mm256_and_pd(m_large, one));
+    const __m256d f = _mm256_sub_pd(m, one);
+    const __m256d s = _mm256_div_pd(f, _mm256_add_pd(f, _mm256_set1_pd(2.0)));
+    const __m256d z = _mm256_mul_pd(s, s);
+    __m256d R = _mm256_fmadd_pd(z, _mm256_set1_pd(Lg7), _mm256_set1_pd(Lg6));
+    R = _mm256_fmadd_pd(z, R, _mm256_set1_pd(Lg5));
+    R = _mm256_fmadd_pd(z, R, _mm256_set1_pd(Lg4));
+    R = _mm256_fmadd_pd(z, R, _mm256_set1_pd(Lg3));
+    R = _mm256_fmadd_pd(z, R, _mm256_set1_pd(Lg2));
+    R = _mm256_fmadd_pd(z, R, _mm256_set1_pd(Lg1));
+    R = _mm256_mul_pd(z, R);
+    const __m256d hfsq = _mm256_mul_pd(_mm256_set1_pd(0.5), _mm256_mul_pd(f, f));
+    // log(x) = k*ln2_hi - ((hfsq - (s*(hfsq+R) + k*ln2_lo)) - f)
+    __m256d t = _mm256_fmadd_pd(s, _mm256_add_pd(hfsq, R), _mm256_mul_pd(k, _mm256_set1_pd(ln2_lo)));
+    t = _mm256_sub_pd(_mm256_sub_pd(hfsq, t), f);
+    return _mm256_fmsub_pd(k, _mm256_set1_pd(ln2_hi), t);
+}
+
+// log(x) including the special cases log(0) = -inf, log(inf) = inf and log(x) = NAN for x < 0 or x = NAN.
+__attribute__((target("avx2,fma")))
+inline __m256d log_avx2_full(__m256d x){
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d inf = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+    const __m256d regular = _mm256_and_pd(_mm256_cmp_pd(x, zero, _CMP_GT_OQ), _mm256_cmp_pd(x, inf, _CMP_LT_OQ));
+    __m256d result = log_avx2(_mm256_blendv_pd(_mm256_set1_pd(1.0), x, regular));
+    result = _mm256_blendv_pd(result, inf, _mm256_cmp_pd(x, inf, _CMP_EQ_OQ));
+    result = _mm256_blendv_pd(result, _mm256_sub_pd(zero, inf), _mm256_cmp_pd(x, zero, _CMP_EQ_OQ));
+    result = _mm256_blendv_pd(result, _mm256_set1_pd(std::numeric_limits<double>::quiet_NaN()), _mm256_cmp_pd(x, zero, _CMP_NGE_UQ));
+    return result;
+}
+
+__attribute__((target("avx2,fma")))
+inline double hsum_avx2(__m256d v){
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+// the mask for a maskload of the last n < 4 elements:
+__attribute__((target("avx2,fma")))
+inline __m256i tail_mask_avx2(unsigned int n){
+    return _mm256_cmpgt_epi64(_mm256_set1_epi64x(n), _mm256_set_epi64x(3, 2, 1, 0));
+}
+
+// process 4 bins of template_nllikelihood: update the sums and the mask of bins with
+// pred <= 0 and data > 0. As in template_nllikelihood_default, bins with data <= 0 or NAN do not contribute to the log term.
+__attribute__((target("avx2,fma")))
+inline void tnll_step_avx2(__m256d d, __m256d p, __m256d & sum_pred, __m256d & sum_dlog, __m256d & bad){
+    const __m256d zero = _mm256_setzero_pd();
+    sum_pred = _mm256_add_pd(sum_pred, p);
+    const __m256d data_pos = _mm256_cmp_pd(d, zero, _CMP_GT_OQ);
+    d = _mm256_and_pd(d, data_pos);
+    // pred <= 0 or NAN:
+    const __m256d pred_nonpos = _mm256_cmp_pd(p, zero, _CMP_NGT_UQ);
+    bad = _mm256_or_pd(bad, _mm256_and_pd(pred_nonpos, data_pos));
+    //for pred <= 0 (and data == 0), the bin is skipped: use log(1.0) = 0.
+    const __m256d logp = log_avx2(_mm256_blendv_pd(p, _mm256_set1_pd(1.0), pred_nonpos));
+    sum_dlog = _mm256_fmadd_pd(d, logp, sum_dlog);
+}
+
+__attribute__((target("avx2,fma")))
+double tnll_avx2(const double * data, const double * pred, unsigned int n){
+    __m256d sum_pred = _mm256_setzero_pd(), sum_dlog = _mm256_setzero_pd(), bad = _mm256_setzero_pd();
+    __m256d sum_pred2 = _mm256_setzero_pd(), sum_dlog2 = _mm256_setzero_pd();
+    unsigned int i = 0;
+    //two independent accumulators to hide the latency of the log:
+    for(; i + 8 <= n; i+=8){
+        tnll_step_avx2(_mm256_loadu_pd(data + i), _mm256_loadu_pd(pred + i), sum_pred, sum_dlog, bad);
+        tnll_step_avx2(_mm256_loadu_pd(data + i + 4), _mm256_loadu_pd(pred + i + 4), sum_pred2, sum_dlog2, bad);
+    }
+    for(; i + 4 <= n; i+=4){
+        tnll_step_avx2(_mm256_loadu_pd(data + i), _mm256_loadu_pd(pred + i), sum_pred, sum_dlog, bad);
+    }
+    if(i < n){
+        //masked lanes are loaded as data = pred = 0 which do not contribute:
+        const __m256i mask = tail_mask_avx2(n - i);
+        tnll_step_avx2(_mm256_maskload_pd(data + i, mask), _mm256_maskload_pd(pred + i, mask), sum_pred2, sum_dlog2, bad);
+    }
+    if(_mm256_movemask_pd(bad)) return std::numeric_limits<double>::infinity();
+    return hsum_avx2(_mm256_add_pd(sum_pred, sum_pred2)) - hsum_avx2(_mm256_add_pd(sum_dlog, sum_dlog2));
+}
+
+__attribute__((target("avx2,fma")))
+double log2_dot_avx2_impl(const double * x, const double * y, unsigned int n){
+    __m256d sum = _mm256_setzero_pd();
+    unsigned int i = 0;
+    for(; i + 4 <= n; i+=4){
+        sum = _mm256_fmadd_pd(_mm256_loadu_pd(y + i), log_avx2_full(_mm256_loadu_pd(x + i)), sum);
+    }
+    if(i < n){
+        // use x = 1 for the masked lanes:
+        const __m256i mask = tail_mask_avx2(n - i);
+        __m256d xv = _mm256_blendv_pd(_mm256_set1_pd(1.0), _mm256_maskload_pd(x + i, mask), _mm256_castsi256_pd(mask));
+        sum = _mm256_fmadd_pd(_mm256_maskload_pd(y + i, mask), log_avx2_full(xv), sum);
+    }
+    return hsum_avx2(sum) * one_over_ln2;
+}
+
+
+/* AVX-512 */
+
+// the horizontal sum. _mm512_reduce_add_pd is not used as it passes an undefined source operand to
+// the extract, which triggers -Wmaybe-uninitialized.
+__attribute__((target("avx512f")))
+inline double hsum_avx512(__m512d v){
+    const __m256d s4 = _mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xf, v, 0), _mm512_maskz_extractf64x4_pd(0xf, v, 1));
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(s4), _mm256_extractf128_pd(s4, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+// log(x) for x > 0 finite. getexp / getmant handle subnormals, so no scaling is required here.
+// The maskz forms are used as the plain ones pass an undefined source operand, which triggers -Wmaybe-uninitialized.
+__attribute__((target("avx512f")))
+inline __m512d log_avx512(__m512d x){
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __mmask8 all = 0xff;
+    __m512d k = _mm512_maskz_getexp_pd(all, x);
+    __m512d m = _mm512_maskz_getmant_pd(all, x, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_zero);
+    const __mmask8 m_large = _mm512_cmp_pd_mask(m, _mm512_set1_pd(sqrt2), _CMP_GE_OQ);
+    m = _mm512_mask_mul_pd(m, m_large, m, _mm512_set1_pd(0.5));
+    k = _mm512_mask_add_pd(k, m_large, k, one);
+    const __m512d f = _mm512_sub_pd(m, one);
+    const __m512d s = _mm512_div_pd(f, _mm512_add_pd(f, _mm512_set1_pd(2.0)));
+    const __m512d z = _mm512_mul_pd(s, s);
+    __m512d R = _mm512_fmadd_pd(z, _mm512_set1_pd(Lg7), _mm512_set1_pd(Lg6));
+    R = _mm512_fmadd_pd(z, R, _mm512_set1_pd(Lg5));
+    R = _mm512_fmadd_pd(z, R, _mm512_set1_pd(Lg4));
+    R = _mm512_fmadd_pd(z, R, _mm512_set1_pd(Lg3));
+    R = _mm512_fmadd_pd(z, R, _mm512_set1_pd(Lg2));
+    R = _mm512_fmadd_pd(z, R, _mm512_set1_pd(Lg1));
+    R = _mm512_mul_pd(z, R);
+    const __m512d hfsq = _mm512_mul_pd(_mm512_set1_pd(0.5), _mm512_mul_pd(f, f));
+    __m512d t = _mm512_fmadd_pd(s, _mm512_add_pd(hfsq, R), _mm512_mul_pd(k, _mm512_set1_pd(ln2_lo)));
+    t = _mm512_sub_pd(_mm512_sub_pd(hfsq, t), f);
+    return _mm512_fmsub_pd(k, _mm512_set1_pd(ln2_hi), t);
+}
+
+__attribute__((target("avx512f")))
+inline __m512d log_avx512_full(__m512d x){
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d inf = _mm512_set1_pd(std::numeric_limits<double>::infinity());
+    const __mmask8 regular = _mm512_cmp_pd_mask(x, zero, _CMP_GT_OQ) & _mm512_cmp_pd_mask(x, inf, _CMP_LT_OQ);
+    __m512d result = log_avx512(_mm512_mask_blend_pd(regular, _mm512_set1_pd(1.0), x));
+    result = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, inf, _CMP_EQ_OQ), result, inf);
+    result = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, zero, _CMP_EQ_OQ), result, _mm512_sub_pd(zero, inf));
+    result = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, zero, _CMP_NGE_UQ), result, _mm512_set1_pd(std::numeric_limits<double>::quiet_NaN()));
+    return result;
+}
+
+__attribute__((target("avx512f")))
+inline void tnll_step_avx512(__m512d d, __m512d p, __m512d & sum_pred, __m512d & sum_dlog, __mmask8 & bad){
+    const __m512d zero = _mm512_setzero_pd();
+    sum_pred = _mm512_add_pd(sum_pred, p);
+    const __mmask8 data_pos = _mm512_cmp_pd_mask(d, zero, _CMP_GT_OQ);
+    d = _mm512_maskz_mov_pd(data_pos, d);
+    const __mmask8 pred_nonpos = _mm512_cmp_pd_mask(p, zero, _CMP_NGT_UQ);
+    bad |= pred_nonpos & data_pos;
+    const __m512d logp = log_avx512(_mm512_mask_blend_pd(pred_nonpos, p, _mm512_set1_pd(1.0)));
+    sum_dlog = _mm512_fmadd_pd(d, logp, sum_dlog);
+}
+
+__attribute__((target("avx512f")))
+double tnll_avx512(const double * data, const double * pred, unsigned int n){
+    __m512d sum_pred = _mm512_setzero_pd(), sum_dlog = _mm512_setzero_pd();
+    __m512d sum_pred2 = _mm512_setzero_pd(), sum_dlog2 = _mm512_setzero_pd();
+    __mmask8 bad = 0;
+    unsigned int i = 0;
+    for(; i + 16 <= n; i+=16){
+        tnll_step_avx512(_mm512_loadu_pd(data + i), _mm512_loadu_pd(pred + i), sum_pred, sum_dlog, bad);
+        tnll_step_avx512(_mm512_loadu_pd(data + i + 8), _mm512_loadu_pd(pred + i + 8), sum_pred2, sum_dlog2, bad);
+    }
+    for(; i + 8 <= n; i+=8){
+        tnll_step_avx512(_mm512_loadu_pd(data + i), _mm512_loadu_pd(pred + i), sum_pred, sum_dlog, bad);
+    }
+    if(i < n){
+        const __mmask8 mask = static_cast<__mmask8>((1u << (n - i)) - 1);
+        tnll_step_avx512(_mm512_maskz_loadu_pd(mask, data + i), _mm512_maskz_loadu_pd(mask, pred + i), sum_pred2, sum_dlog2, bad);
+    }
+    if(bad) return std::numeric_limits<double>::infinity();
+    return hsum_avx512(_mm512_add_pd(sum_pred, sum_pred2)) - hsum_avx512(_mm512_add_pd(sum_dlog, sum_dlog2));
+}
+
+__attribute__((target("avx512f")))
+double log2_dot_avx512_impl(const double * x, const double * y, unsigned int n){
+    __m512d sum = _mm512_setzero_pd();
+    unsigned int i = 0;
+    for(; i + 8 <= n; i+=8){
+        sum = _mm512_fmadd_pd(_mm512_loadu_pd(y + i), log_avx512_full(_mm512_loadu_pd(x + i)), sum);
+    }
+    if(i < n){
+        const __mmask8 mask = static_cast<__mmask8>((1u << (n - i)) - 1);
+        __m512d xv = _mm512_mask_loadu_pd(_mm512_set1_pd(1.0), mask, x + i);
+        sum = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, y + i), log_avx512_full(xv), sum);
+    }
+    return hsum_avx512(sum) * one_over_ln2;
+}
+
+int get_simd_support(){
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) return log2_dot_avx512;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return log2_dot_avx2;
+    return log2_dot_nosimd;
+}
+
+}
+
+#else
+
+namespace{
+int get_simd_support(){
+    return log2_dot_nosimd;
+}
+}
+
+#endif
+
+namespace{
+
+typedef double (*t_kernel)(const double *, const double *, unsigned int);
+
+// the support and the kernels are determined on first use, so they do not depend on the order of static initialization:
+int simd_support(){
+    static const int support = get_simd_support();
+    return support;
+}
+
+t_kernel select_tnll(int level){
+#ifdef THETA_HAVE_SIMD_KERNELS
+    if(level >= log2_dot_avx512) return &tnll_avx512;
+    if(level >= log2_dot_avx2) return &tnll_avx2;
+#endif
+    return &template_nllikelihood_default;
+}
+
+t_kernel select_log2_dot(int level){
+#ifdef THETA_HAVE_SIMD_KERNELS
+    if(level >= log2_dot_avx512) return &log2_dot_avx512_impl;
+    if(level >= log2_dot_avx2) return &log2_dot_avx2_impl;
+#endif
+    return &log2_dot_default;
+}
+
+}
+
+int log2_dot_simd_support(){
+    return simd_support();
+}
+
+double log2_dot(const double * x, const double * y, unsigned int n){
+    static const t_kernel kernel = select_log2_dot(simd_support());
+    return kernel(x, y, n);
+}
+
+double template_nllikelihood(const double * data, const double * pred, unsigned int n){
+    static const t_kernel kernel = select_tnll(simd_support());
+    return kernel(data, pred, n);
+}
+
+double log2_dot_simd(int level, const double * x, const double * y, unsigned int n){
+    return select_log2_dot(std::min(level, simd_support()))(x, y, n);
+}
+
+double template_nllikelihood_simd(int level, const double * data, const double * pred, unsigned int n){
+    return select_tnll(std::min(level, simd_support()))(data, pred, n);
+}
@@ -1,4 +1,5 @@
-// fallback implementation for log2_dot.s which is implemented specifically for 64-bit architectures
+// fallback implementation for log2_dot.s which is implemented specifically for 64-bit architectures.
+// The dispatching functions log2_dot and template_nllikelihood are defined in log2_dot-simd.cpp.
 
 #include "interface/log2_dot.hpp"
 #include <cstddef>
@@ -7,7 +8,7 @@
 
 #include "interface/utils.hpp"
 
-double log2_dot(const double * x, const double * y, unsigned int n){
+double log2_dot_default(const double * x, const double * y, unsigned int n){
     double result = 0.0;
     for(size_t i=0; i<n; ++i){
         result += y[i] * log2(x[i]);
@@ -15,7 +16,7 @@ double log2_dot(const double * x, const double * y, unsigned int n){
     return result;
 }
 
-double template_nllikelihood(const double * data, const double * pred, unsigned int n){
+double template_nllikelihood_default(const double * data, const double * pred, unsigned int n){
    double result = 0.0;
    for(unsigned int i=0; i<n; ++i){
         result += pred[i];
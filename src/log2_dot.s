@@ -1,8 +1,8 @@
 .text
 .align 4
-.globl log2_dot
-.globl template_nllikelihood
-log2_dot:
+.globl log2_dot_default
+.globl template_nllikelihood_default
+log2_dot_default:
     fldz
     testl %edx, %edx
     je .exit
@@ -25,7 +25,7 @@ log2_dot:
 
 /* note: according to the System V AMD64 ABI, we only have to preserve %rbx, %rsp, %rbp, %r12-%r15, so we just do not use these ... */
 .p2align 4
-template_nllikelihood:  /* data = %rdi, pred = %rsi; n = %edx */
+template_nllikelihood_default:  /* data = %rdi, pred = %rsi; n = %edx */
     fldz /* use st(0) to save    sum_i  data[i] * log(pred[i])   */
     xorpd %xmm2, %xmm2 /* use xmm2 to save     sum_i pred[i] */
     testl %edx, %edx
@@ -36,12 +36,16 @@ template_nllikelihood:  /* data = %rdi, pred = %rsi; n = %edx */
     xorpd %xmm1, %xmm1 /* xmm1 is always 0.0 */
 .tl_loopstart:
     movsd (%rsi,%rax), %xmm0  /* xmm0 = pred[i] */
+    movsd (%rdi,%rax), %xmm3  /* xmm3 = data[i] */
+    addsd %xmm0, %xmm2
     ucomisd %xmm0, %xmm1
     jae .tl_predzero
+    /* data <= 0 or NAN does not contribute to the log term: */
+    ucomisd %xmm1, %xmm3
+    jbe .tl_loopinc
     fldl (%rdi,%rax)
     fldl (%rsi,%rax)
     fyl2x
-    addsd %xmm0, %xmm2
     faddp %st, %st(1)
 .tl_loopinc:
     addq $8, %rax
@@ -54,10 +58,9 @@ template_nllikelihood:  /* data = %rdi, pred = %rsi; n = %edx */
     addsd  %xmm2, %xmm0
     ret
 .tl_predzero: /* look at data: */
-    movsd (%rdi,%rax), %xmm0
-    ucomisd %xmm0, %xmm1
-    /* if data is also zero, skip this entry and go to the next: */
-    je .tl_loopinc
+    ucomisd %xmm1, %xmm3
+    /* if data is not positive, skip this entry and go to the next: */
+    jbe .tl_loopinc
     /* otherwise: return infinity; pop fpu stack first: */
     fstpl -8(%rsp)
     movsd .infinity(%rip), %xmm0
@@ -1,5 +1,12 @@
 #include "interface/model.hpp"
 #include "interface/log2_dot.hpp"
+#include "interface/timing.hpp"
+#include "interface/perf_profile.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <new>
 
 using namespace std;
 using namespace theta;
@@ -51,6 +58,7 @@ void default_model::set_prediction(const ObsId & obs_id, boost::ptr_vector<Funct
 }
 
 void default_model::get_prediction(Data & result, const ParValues & parameters) const {
+    ProfileSection profile(profile_histogram_function);
     for(ObsIds::const_iterator obsit=observables.begin(); obsit!=observables.end(); ++obsit){
         histos_type::const_iterator it = histos.find(*obsit);
         assert(it!=histos.end());
@@ -63,8 +71,7 @@ void default_model::get_prediction(Data & result, const ParValues & parameters)
                 result[*obsit].add_with_coeff(h_coeffs[i](parameters), h_producers[i](parameters));
             }
             else{
-                result[*obsit] = h_producers[i](parameters);
-                result[*obsit] *= h_coeffs[i](parameters);
+                result[*obsit].assign_with_coeff(h_coeffs[i](parameters), h_producers[i](parameters));
                 result_init = true;
             }
         }
@@ -77,6 +84,7 @@ void default_model::get_prediction(Data & result, const ParValues & parameters)
 }
 
 void default_model::get_prediction_randomized(Random & rnd, Data & result, const ParValues & parameters) const{
+    ProfileSection profile(profile_histogram_function);
     for(ObsIds::const_iterator obsit=observables.begin(); obsit!=observables.end(); ++obsit){
         histos_type::const_iterator it = histos.find(*obsit);
         assert(it!=histos.end());
@@ -89,8 +97,7 @@ void default_model::get_prediction_randomized(Random & rnd, Data & result, const
                 result[*obsit].add_with_coeff(h_coeffs[i](parameters), h_producers[i].getRandomFluctuation(rnd, parameters));
             }
             else{
-                result[*obsit] = h_producers[i].getRandomFluctuation(rnd, parameters);
-                result[*obsit] *= h_coeffs[i](parameters);
+                result[*obsit].assign_with_coeff(h_coeffs[i](parameters), h_producers[i].getRandomFluctuation(rnd, parameters));
                 result_init = true;
             }
         }
@@ -151,11 +158,35 @@ default_model::default_model(const Configuration & ctx): Model(ctx.vm){
 
 /* default_model_nll */
 default_model_nll::default_model_nll(const default_model & m, const Data & dat, const ObsIds & obs): model(m),
-        data(dat), obs_ids(obs){
+        data(dat), obs_ids(obs), tile(0), components_valid(false){
     Function::par_ids = model.getParameters();
     for(ParIds::const_iterator it=par_ids.begin(); it!=par_ids.end(); ++it){
         ranges[*it] = model.get_parameter_distribution().support(*it);
     }
+    for(ObsIds::const_iterator obsit=obs_ids.begin(); obsit!=obs_ids.end(); ++obsit){
+        default_model::histos_type::const_iterator it = model.histos.find(*obsit);
+        assert(it!=model.histos.end());
+        default_model::histos_type::const_mapped_reference h_producers = *(it->second);
+        default_model::coeffs_type::const_iterator it2 = model.coeffs.find(*obsit);
+        default_model::coeffs_type::const_mapped_reference h_coeffs = *(it2->second);
+        std::vector<component> & comps = components[*obsit];
+        comps.resize(h_producers.size());
+        for(size_t i=0; i<comps.size(); ++i){
+            comps[i].coeff_pars = ParLayout(par_ids, h_coeffs[i].getParameters());
+            comps[i].histo_pars = ParLayout(par_ids, h_producers[i].getParameters());
+        }
+    }
+    par_values.resize(par_ids.size(), NAN);
+    par_changed.resize(par_ids.size(), 1);
+    //aligned for the add_fast routines:
+    int err = posix_memalign(reinterpret_cast<void**>(&tile), 16, sizeof(double) * tile_size);
+    if(err!=0){
+        throw std::bad_alloc();
+    }
+}
+
+default_model_nll::~default_model_nll(){
+    free(tile);
 }
 
 void default_model_nll::set_additional_term(const boost::shared_ptr<Function> & term){
@@ -176,7 +207,184 @@ void default_model_nll::set_override_distribution(const boost::shared_ptr<Distri
 }
 
 
+namespace{
+    //whether any of the parameters in layout has a non-zero flag
+    bool any_flag(const std::vector<char> & flags, const ParLayout & layout){
+        for(size_t i=0; i<layout.size(); ++i){
+            if(flags[layout[i]]) return true;
+        }
+        return false;
+    }
+}
+
+void default_model_nll::update_changed(const ParValues & values) const{
+    size_t i = 0;
+    for(ParIds::const_iterator it=par_ids.begin(); it!=par_ids.end(); ++it, ++i){
+        double value = values.get(*it);
+        //note that the initial NAN compares unequal:
+        par_changed[i] = par_values[i] != value;
+        par_values[i] = value;
+    }
+}
+
+const std::vector<default_model_nll::component> & default_model_nll::update_components(const ObsId & obs_id) const{
+    ProfileSection profile(profile_histogram_function);
+    default_model::histos_type::const_iterator it = model.histos.find(obs_id);
+    assert(it!=model.histos.end());
+    default_model::histos_type::const_mapped_reference h_producers = *(it->second);
+    default_model::coeffs_type::const_iterator it2 = model.coeffs.find(obs_id);
+    default_model::coeffs_type::const_mapped_reference h_coeffs = *(it2->second);
+    std::vector<component> & comps = components[obs_id];
+    const size_t n_components = comps.size();
+    const double * x = par_values.empty() ? 0 : &par_values[0];
+    for(size_t i=0; i<n_components; ++i){
+        if(!components_valid || any_flag(par_changed, comps[i].histo_pars)){
+            comps[i].histo = h_producers[i].eval_dense(x, comps[i].histo_pars.get_offsets());
+        }
+        if(!components_valid || any_flag(par_changed, comps[i].coeff_pars)){
+            comps[i].coeff = h_coeffs[i].eval_dense(x, comps[i].coeff_pars.get_offsets());
+        }
+    }
+    return comps;
+}
+
+double default_model_nll::eval_observable(const ObsId & obs_id) const{
+    const std::vector<component> & comps = update_components(obs_id);
+    const size_t n_components = comps.size();
+    const Histogram & data_histo = data[obs_id];
+    const double * data_data = data_histo.getData();
+    const size_t nbins = data_histo.get_nbins();
+    //Go through the Histogram data in blocks, including underflow and overflow bins, so
+    // the blocks start at 16-byte aligned addresses. Underflow and overflow are not part of the likelihood.
+    const size_t n_total = nbins + 2;
+    double result = 0.0;
+    for(size_t start=0; start < n_total; start += tile_size){
+        const size_t n = min(tile_size, n_total - start);
+        if(n_components == 0){
+            std::fill(tile, tile + n, 0.0);
+        }
+        else{
+            const double * h0 = comps[0].histo.getData() + start;
+            std::copy(h0, h0 + n, tile);
+            mul_fast(tile, comps[0].coeff, n);
+            for(size_t i=1; i<n_components; ++i){
+                add_fast_with_coeff(tile, comps[i].histo.getData() + start, comps[i].coeff, n);
+            }
+        }
+        //the likelihood for bins [first, last) of this block:
+        const size_t first = start == 0 ? 1 : 0;
+        const size_t last = start + n == n_total ? n - 1 : n;
+        result += template_nllikelihood(data_data + start + first, tile + first, last - first);
+        if(std::isinf(result)) break;
+    }
+    return result;
+}
+
+double default_model_nll::eval_observable_withDerivatives(const ObsId & obs_id, const ParValues & values, ParValues & derivatives) const{
+    const std::vector<component> & comps = update_components(obs_id);
+    const size_t n_components = comps.size();
+    const Histogram & data_histo = data[obs_id];
+    const size_t nbins = data_histo.get_nbins();
+    pred.reset(nbins, data_histo.get_xmin(), data_histo.get_xmax());
+    for(size_t i=0; i<n_components; ++i){
+        pred.add_with_coeff(comps[i].coeff, comps[i].histo);
+    }
+    const double result = template_nllikelihood(data_histo.getData() + 1, pred.getData() + 1, nbins);
+    if(std::isinf(result)) return result;
+    //d NLL / d p = sum_bins (1 - data / pred) * d pred / d p. Fill the weights (1 - data / pred) into pred:
+    double * w = pred.getData();
+    const double * d = data_histo.getData();
+    for(size_t k=1; k<=nbins; ++k){
+        w[k] = w[k] > 0.0 ? 1.0 - d[k] / w[k] : 1.0;
+    }
+    w[0] = w[nbins+1] = 0.0;
+    default_model::histos_type::const_iterator it = model.histos.find(obs_id);
+    default_model::histos_type::const_mapped_reference h_producers = *(it->second);
+    default_model::coeffs_type::const_iterator it2 = model.coeffs.find(obs_id);
+    default_model::coeffs_type::const_mapped_reference h_coeffs = *(it2->second);
+    for(size_t i=0; i<n_components; ++i){
+        //derivative of the coefficient:
+        const ParIds & c_pids = h_coeffs[i].getParameters();
+        if(c_pids.size() > 0){
+            double w_dot_h = 0.0;
+            const double * h = comps[i].histo.getData();
+            for(size_t k=1; k<=nbins; ++k){
+                w_dot_h += w[k] * h[k];
+            }
+            h_coeffs[i].eval_withDerivatives(values, coeff_derivatives);
+            for(ParIds::const_iterator p_it=c_pids.begin(); p_it!=c_pids.end(); ++p_it){
+                derivatives.addTo(*p_it, coeff_derivatives.get(*p_it) * w_dot_h);
+            }
+        }
+        //derivative of the template:
+        const ParIds & h_pids = h_producers[i].getParameters();
+        for(ParIds::const_iterator p_it=h_pids.begin(); p_it!=h_pids.end(); ++p_it){
+            const double * g = h_producers[i].gradient(values, *p_it).getData();
+            double w_dot_g = 0.0;
+            for(size_t k=1; k<=nbins; ++k){
+                w_dot_g += w[k] * g[k];
+            }
+            derivatives.addTo(*p_it, comps[i].coeff * w_dot_g);
+        }
+    }
+    return result;
+}
+
+bool default_model_nll::provides_derivatives() const{
+    if(additional_term && !additional_term->provides_derivatives()) return false;
+    if(!get_parameter_distribution().provides_derivatives()) return false;
+    for(default_model::coeffs_type::const_iterator it=model.coeffs.begin(); it!=model.coeffs.end(); ++it){
+        for(boost::ptr_vector<Function>::const_iterator f_it=it->second->begin(); f_it!=it->second->end(); ++f_it){
+            if(f_it->getnpar() > 0 && !f_it->provides_derivatives()) return false;
+        }
+    }
+    for(default_model::histos_type::const_iterator it=model.histos.begin(); it!=model.histos.end(); ++it){
+        for(boost::ptr_vector<HistogramFunction>::const_iterator h_it=it->second->begin(); h_it!=it->second->end(); ++h_it){
+            if(h_it->getParameters().size() > 0 && !h_it->provides_derivatives()) return false;
+        }
+    }
+    return true;
+}
+
+double default_model_nll::eval_withDerivatives(const ParValues & values, ParValues & derivatives) const{
+    ++timing_counters.nll_evals;
+    ProfileSection profile(profile_nll);
+    HistodataPoolGuard pool_guard;
+    //1. the prior. This sets the derivatives for all parameters:
+    double result;
+    if(override_distribution){
+        result = override_distribution->evalNL_withDerivatives(values, derivatives);
+    }
+    else{
+        result = model.get_parameter_distribution().evalNL_withDerivatives(values, derivatives);
+    }
+    //2. the template likelihood:
+    try{
+        update_changed(values);
+        for(ObsIds::const_iterator obsit=obs_ids.begin(); obsit!=obs_ids.end(); obsit++){
+            result += eval_observable_withDerivatives(*obsit, values, derivatives);
+        }
+    }
+    catch(...){
+        components_valid = false;
+        throw;
+    }
+    components_valid = true;
+    //3. the additional term:
+    if(additional_term){
+        result += additional_term->eval_withDerivatives(values, coeff_derivatives);
+        const ParIds & a_pids = additional_term->getParameters();
+        for(ParIds::const_iterator p_it=a_pids.begin(); p_it!=a_pids.end(); ++p_it){
+            derivatives.addTo(*p_it, coeff_derivatives.get(*p_it));
+        }
+    }
+    return result;
+}
+
 double default_model_nll::operator()(const ParValues & values) const{
+    ++timing_counters.nll_evals;
+    ProfileSection profile(profile_nll);
+    HistodataPoolGuard pool_guard;
     double result = 0.0;
     //1. the model prior first, because if we are out of bounds, we should not evaluate
     //   the likelihood of the templates ...
@@ -186,14 +394,19 @@ double default_model_nll::operator()(const ParValues & values) const{
     else{
         result += model.get_parameter_distribution().evalNL(values);
     }
-    //2. get the prediciton of the model:
-    model.get_prediction(predictions, values);
-    //3. the template likelihood
-    for(ObsIds::const_iterator obsit=obs_ids.begin(); obsit!=obs_ids.end(); obsit++){
-        const double * pred_data = predictions[*obsit].getData();
-        const double * data_data = data[*obsit].getData();
-        result += template_nllikelihood(data_data + 1, pred_data + 1, data[*obsit].get_nbins());
+    //2. the template likelihood, with the model prediction built on the fly. If the evaluation
+    //   fails, the cached components might be inconsistent, so invalidate them:
+    try{
+        update_changed(values);
+        for(ObsIds::const_iterator obsit=obs_ids.begin(); obsit!=obs_ids.end(); obsit++){
+            result += eval_observable(*obsit);
+        }
+    }
+    catch(...){
+        components_valid = false;
+        throw;
     }
+    components_valid = true;
     //3. The additional likelihood terms, if set:
     if(additional_term){
        result += (*additional_term)(values);
@@ -201,5 +414,141 @@ double default_model_nll::operator()(const ParValues & values) const{
     return result;
 }
 
+void NLLikelihood::eval_batch(const double * x, size_t n, double * result) const{
+    const size_t npar = getnpar();
+    for(size_t k=0; k<n; ++k){
+        result[k] = operator()(x + k * npar);
+    }
+}
+
+void default_model_nll::eval_batch(const double * x, size_t n, double * result) const{
+    if(n==0) return;
+    timing_counters.nll_evals += n;
+    ProfileSection profile(profile_nll);
+    HistodataPoolGuard pool_guard;
+    const size_t npar = getnpar();
+    //1. find the parameters which vary within the batch and the observables whose templates depend on them. The
+    //   templates of the other ("fixed") observables are the same for all points:
+    std::vector<char> varying(npar, 0);
+    for(size_t ipar=0; ipar<npar; ++ipar){
+        for(size_t k=1; k<n; ++k){
+            if(x[k * npar + ipar] != x[ipar]){
+                varying[ipar] = 1;
+                break;
+            }
+        }
+    }
+    const size_t n_obs = obs_ids.size();
+    vector<bool> obs_fixed(n_obs, true);
+    //the offset of the first component of observable j in batch_coeffs, in units of n:
+    vector<size_t> c_offset(n_obs);
+    size_t n_components_total = 0;
+    size_t j = 0;
+    for(ObsIds::const_iterator obsit=obs_ids.begin(); obsit!=obs_ids.end(); ++obsit, ++j){
+        const std::vector<component> & comps = components[*obsit];
+        for(size_t i=0; i<comps.size(); ++i){
+            if(any_flag(varying, comps[i].histo_pars)) obs_fixed[j] = false;
+        }
+        c_offset[j] = n_components_total;
+        n_components_total += comps.size();
+    }
+    batch_coeffs.resize(n_components_total * n);
+    batch_nll.resize(n_obs * n);
+    batch_prior.resize(n);
+    batch_additional.resize(n);
+    const Distribution & dist = get_parameter_distribution();
+    //2. go through the points. For the fixed observables, only the coefficients are evaluated; the other observables
+    //   are evaluated completely, as in operator():
+    try{
+        for(size_t k=0; k<n; ++k){
+            size_t ipar = 0;
+            for(ParIds::const_iterator it=par_ids.begin(); it!=par_ids.end(); ++it, ++ipar){
+                batch_values.set(*it, x[k * npar + ipar]);
+            }
+            batch_prior[k] = dist.evalNL(batch_values);
+            update_changed(batch_values);
+            j = 0;
+            for(ObsIds::const_iterator obsit=obs_ids.begin(); obsit!=obs_ids.end(); ++obsit, ++j){
+                if(!obs_fixed[j]){
+                    batch_nll[j * n + k] = eval_observable(*obsit);
+                    continue;
+                }
+                double * coeffs = &batch_coeffs[c_offset[j] * n];
+                if(k==0){
+                    const std::vector<component> & comps = update_components(*obsit);
+                    for(size_t i=0; i<comps.size(); ++i){
+                        coeffs[i * n] = comps[i].coeff;
+                    }
+                    continue;
+                }
+                default_model::coeffs_type::const_iterator it2 = model.coeffs.find(*obsit);
+                default_model::coeffs_type::const_mapped_reference h_coeffs = *(it2->second);
+                const std::vector<component> & comps = components[*obsit];
+                for(size_t i=0; i<h_coeffs.size(); ++i){
+                    if(any_flag(par_changed, comps[i].coeff_pars)){
+                        coeffs[i * n + k] = h_coeffs[i].eval_dense(&par_values[0], comps[i].coeff_pars.get_offsets());
+                    }
+                    else coeffs[i * n + k] = coeffs[i * n + k - 1];
+                }
+            }
+            components_valid = true;
+            if(additional_term){
+                batch_additional[k] = (*additional_term)(batch_values);
+            }
+        }
+    }
+    catch(...){
+        components_valid = false;
+        throw;
+    }
+    //3. the template likelihood for the fixed observables, block by block. Each block of the templates is
+    //   used for all points. Within a point, the summation is the same as in eval_observable.
+    j = 0;
+    for(ObsIds::const_iterator obsit=obs_ids.begin(); obsit!=obs_ids.end(); ++obsit, ++j){
+        if(!obs_fixed[j]) continue;
+        std::vector<component> & comps = components[*obsit];
+        const size_t n_components = comps.size();
+        const double * coeffs = &batch_coeffs[c_offset[j] * n];
+        double * nll = &batch_nll[j * n];
+        std::fill(nll, nll + n, 0.0);
+        const Histogram & data_histo = data[*obsit];
+        const double * data_data = data_histo.getData();
+        const size_t n_total = data_histo.get_nbins() + 2;
+        for(size_t start=0; start < n_total; start += tile_size){
+            const size_t nt = min(tile_size, n_total - start);
+            const size_t first = start == 0 ? 1 : 0;
+            const size_t last = start + nt == n_total ? nt - 1 : nt;
+            for(size_t k=0; k<n; ++k){
+                if(std::isinf(nll[k])) continue;
+                if(n_components == 0){
+                    std::fill(tile, tile + nt, 0.0);
+                }
+                else{
+                    const double * h0 = comps[0].histo.getData() + start;
+                    std::copy(h0, h0 + nt, tile);
+                    mul_fast(tile, coeffs[k], nt);
+                    for(size_t i=1; i<n_components; ++i){
+                        add_fast_with_coeff(tile, comps[i].histo.getData() + start, coeffs[i * n + k], nt);
+                    }
+                }
+                nll[k] += template_nllikelihood(data_data + start + first, tile + first, last - first);
+            }
+        }
+        //keep the cached coefficients consistent with the last point:
+        for(size_t i=0; i<n_components; ++i){
+            comps[i].coeff = coeffs[i * n + n - 1];
+        }
+    }
+    //4. sum up, in the same order as operator():
+    for(size_t k=0; k<n; ++k){
+        double res = batch_prior[k];
+        for(j=0; j<n_obs; ++j){
+            res += batch_nll[j * n + k];
+        }
+        if(additional_term) res += batch_additional[k];
+        result[k] = res;
+    }
+}
+
 REGISTER_PLUGIN_DEFAULT(default_model)
 
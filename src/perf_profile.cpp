@@ -0,0 +1,248 @@
+#include "interface/perf_profile.hpp"
+#include "interface/utils.hpp"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/cstdint.hpp>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <iomanip>
+#include <sstream>
+#include <memory>
+#include <set>
+
+using namespace std;
+using namespace theta;
+
+bool theta::profiling_enabled = false;
+
+namespace{
+
+    enum e_event { ev_cycles = 0, ev_instructions, ev_cache_misses, ev_branch_misses, n_events };
+
+    const boost::uint64_t event_configs[n_events] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                     PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    const char * event_names[n_events] = {"cycles", "instructions", "cache misses", "branch misses"};
+    const char * section_names[n_profile_sections] = {"nll", "histogram_function", "minimize"};
+
+    // the counters of one thread. The events are read as one group, so the counts of all events refer to the same time.
+    struct thread_counters{
+        // the file descriptors of the events, -1 if not available; fd[ev_cycles] is the group leader:
+        int fd[n_events];
+        // the index of the event in the values read from the group, or -1:
+        int group_index[n_events];
+        int n_group;
+        // the currently active section, -1 for none:
+        int current;
+        boost::uint64_t last[n_events];
+        boost::uint64_t counts[n_profile_sections][n_events];
+        boost::uint64_t calls[n_profile_sections];
+
+        thread_counters(): n_group(0), current(-1){
+            for(int i=0; i<n_events; ++i){
+                fd[i] = group_index[i] = -1;
+                last[i] = 0;
+                for(int s=0; s<n_profile_sections; ++s) counts[s][i] = 0;
+            }
+            for(int s=0; s<n_profile_sections; ++s) calls[s] = 0;
+        }
+
+        ~thread_counters(){
+            for(int i=0; i<n_events; ++i){
+                if(fd[i] >= 0) close(fd[i]);
+            }
+        }
+
+        // open the counters; returns an empty string on success, the reason of the failure otherwise
+        string open(){
+            for(int i=0; i<n_events; ++i){
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = event_configs[i];
+                attr.disabled = i == 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP;
+                fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fd[0], 0);
+                if(fd[i] < 0){
+                    //without cycles, nothing can be reported. The other events are optional:
+                    if(i == 0) return string("perf_event_open failed for cycles: ") + strerror(errno);
+                    continue;
+                }
+                group_index[i] = n_group++;
+            }
+            if(ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) < 0){
+                return string("enabling the performance counters failed: ") + strerror(errno);
+            }
+            read_counts(last);
+            return "";
+        }
+
+        void read_counts(boost::uint64_t * values){
+            // the format for PERF_FORMAT_GROUP: the number of events, followed by their values
+            boost::uint64_t buf[1 + n_events];
+            if(read(fd[0], buf, sizeof(buf)) < static_cast<ssize_t>((1 + n_group) * sizeof(boost::uint64_t))){
+                for(int i=0; i<n_events; ++i) values[i] = last[i];
+                return;
+            }
+            for(int i=0; i<n_events; ++i){
+                values[i] = group_index[i] >= 0 ? buf[1 + group_index[i]] : 0;
+            }
+        }
+
+        // attribute the events since the last read to the current section
+        void update(){
+            boost::uint64_t values[n_events];
+            read_counts(values);
+            if(current >= 0){
+                for(int i=0; i<n_events; ++i){
+                    counts[current][i] += values[i] - last[i];
+                }
+            }
+            for(int i=0; i<n_events; ++i) last[i] = values[i];
+        }
+    };
+
+    // the counts of the threads which have exited, summed up
+    struct retired_counts{
+        size_t n_threads;
+        boost::uint64_t counts[n_profile_sections][n_events];
+        boost::uint64_t calls[n_profile_sections];
+        bool available[n_events];
+
+        retired_counts(): n_threads(0){
+            for(int i=0; i<n_events; ++i){
+                available[i] = true;
+                for(int s=0; s<n_profile_sections; ++s) counts[s][i] = 0;
+            }
+            for(int s=0; s<n_profile_sections; ++s) calls[s] = 0;
+        }
+
+        void add(const thread_counters & c){
+            ++n_threads;
+            for(int i=0; i<n_events; ++i){
+                if(c.fd[i] < 0) available[i] = false;
+            }
+            for(int s=0; s<n_profile_sections; ++s){
+                calls[s] += c.calls[s];
+                for(int i=0; i<n_events; ++i) counts[s][i] += c.counts[s][i];
+            }
+        }
+    };
+
+    boost::mutex registry_mutex;
+    // the counters of all running threads and the sum of the exited threads, for the report.
+    // Threads without available counters are not registered:
+    set<thread_counters*> registry;
+    retired_counts retired;
+
+    // called at the exit of a thread: add its counts to retired and close its file descriptors
+    void retire_counters(thread_counters * c);
+
+    // owns the counters of the current thread:
+    boost::thread_specific_ptr<thread_counters> counters_owner(&retire_counters);
+    // the counters of the current thread, as counters_owner.get(); 0 if not opened yet:
+    THETA_THREAD_LOCAL thread_counters * counters = 0;
+    // whether opening the counters failed in the current thread:
+    THETA_THREAD_LOCAL bool counters_failed = false;
+
+    void retire_counters(thread_counters * c){
+        {
+            boost::mutex::scoped_lock lock(registry_mutex);
+            retired.add(*c);
+            registry.erase(c);
+        }
+        counters = 0;
+        delete c;
+    }
+
+    // the counters of the current thread, opening them if necessary; 0 if not available
+    thread_counters * get_counters(string & reason){
+        if(counters || counters_failed) return counters;
+        std::auto_ptr<thread_counters> c(new thread_counters());
+        reason = c->open();
+        if(!reason.empty()){
+            counters_failed = true;
+            return 0;
+        }
+        boost::mutex::scoped_lock lock(registry_mutex);
+        registry.insert(c.get());
+        counters = c.get();
+        counters_owner.reset(c.release());
+        return counters;
+    }
+
+    // the ratio a / b scaled by factor as string, or "n/a" if not available
+    string ratio(boost::uint64_t a, boost::uint64_t b, double factor, bool available){
+        if(!available || b == 0) return "n/a";
+        stringstream ss;
+        ss << fixed << setprecision(2) << factor * a / b;
+        return ss.str();
+    }
+}
+
+bool theta::enable_profiling(string & reason){
+    reason = "";
+    if(get_counters(reason) == 0) return false;
+    profiling_enabled = true;
+    return true;
+}
+
+int ProfileSection::enter(e_profile_section section){
+    string reason;
+    thread_counters * c = get_counters(reason);
+    if(c == 0) return -1;
+    c->update();
+    int previous = c->current;
+    c->current = section;
+    ++c->calls[section];
+    return previous;
+}
+
+void ProfileSection::leave(int previous){
+    thread_counters * c = counters;
+    if(c == 0) return;
+    c->update();
+    c->current = previous;
+}
+
+void theta::write_profile_report(ostream & out){
+    retired_counts total;
+    {
+        boost::mutex::scoped_lock lock(registry_mutex);
+        total = retired;
+        for(set<thread_counters*>::const_iterator it=registry.begin(); it!=registry.end(); ++it){
+            total.add(**it);
+        }
+    }
+    const size_t n_threads = total.n_threads;
+    const boost::uint64_t (&counts)[n_profile_sections][n_events] = total.counts;
+    const boost::uint64_t * calls = total.calls;
+    const bool * available = total.available;
+    if(n_threads == 0) return;
+    ios_base::fmtflags flags = out.flags();
+    out << endl << "Profile (hardware performance counters in user space, " << n_threads << " thread(s); nested sections are not included):" << endl;
+    out << "  " << left << setw(20) << "section" << right << setw(12) << "calls" << setw(16) << "cycles" << setw(16) << "instructions"
+        << setw(8) << "IPC" << setw(14) << "cache MPKI" << setw(14) << "branch MPKI" << endl;
+    for(int s=0; s<n_profile_sections; ++s){
+        const boost::uint64_t * c = counts[s];
+        out << "  " << left << setw(20) << section_names[s] << right << setw(12) << calls[s] << setw(16) << c[ev_cycles]
+            << setw(16) << (available[ev_instructions] ? c[ev_instructions] : 0)
+            << setw(8) << ratio(c[ev_instructions], c[ev_cycles], 1.0, available[ev_instructions])
+            << setw(14) << ratio(c[ev_cache_misses], c[ev_instructions], 1000.0, available[ev_cache_misses] && available[ev_instructions])
+            << setw(14) << ratio(c[ev_branch_misses], c[ev_instructions], 1000.0, available[ev_branch_misses] && available[ev_instructions]) << endl;
+    }
+    for(int i=0; i<n_events; ++i){
+        if(!available[i]) out << "  (" << event_names[i] << " not available on this machine)" << endl;
+    }
+    out << "  MPKI: misses per 1000 instructions" << endl;
+    out.flags(flags);
+}
@@ -5,6 +5,11 @@ using namespace theta;
 REGISTER_PLUGIN_BASETYPE(Function);
 REGISTER_PLUGIN_BASETYPE(DataSource);
 
+/* FUNCTION */
+double Function::eval_withDerivatives(const ParValues & v, ParValues & derivatives) const{
+    throw FatalException("Function::eval_withDerivatives: derivatives not implemented for this Function");
+}
+
 /* DATA */
 ObsIds Data::getObservables() const{
     ObsIds result;
@@ -19,3 +24,11 @@ ObsIds Data::getObservables() const{
 void Data::fail_get(const ObsId & oid) const{
     throw NotFoundException("Data::operator[]() const: no data found for given ObsId");
 }
+
+void Data::grow(size_t n){
+    std::vector<Histogram> new_data(n);
+    for(size_t i=0; i<data.size(); ++i){
+        new_data[i].swap(data[i]);
+    }
+    data.swap(new_data);
+}
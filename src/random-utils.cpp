@@ -4,12 +4,68 @@
 
 #include <boost/date_time/local_time/local_time.hpp>
 #include <unistd.h>
+#include <sstream>
+#include <algorithm>
 
 using namespace theta;
 
+void RandomStreams::add(Random * rnd){
+    randoms.push_back(rnd);
+}
+
+void RandomStreams::remove(Random * rnd){
+    randoms.erase(std::remove(randoms.begin(), randoms.end(), rnd), randoms.end());
+}
+
+void RandomStreams::set_event(int runid, int eventid){
+    for(size_t i=0; i<randoms.size(); ++i){
+        randoms[i]->set_stream(runid, eventid);
+    }
+}
+
+int theta::time_seed(){
+    using namespace boost::posix_time;
+    using namespace boost::gregorian;
+    ptime t(microsec_clock::universal_time());
+    time_duration td = t - ptime(date(1970, 1, 1));
+    int seed = td.total_microseconds();
+    // to avoid clashes in case of batch system usage with jobs starting in the same clock resolution
+    // interval with the same configuration, also use the hostname for the seed:
+    char hname[HOST_NAME_MAX + 1];
+    gethostname(hname, HOST_NAME_MAX + 1);
+    // In case the hostname does not fit into hname, the name is truncated but no error is returned.
+    // This should not happen, as we use HOST_NAME_MAX. On the other hand, we do not check for
+    // any errors potentially returned by gethostname ...
+    hname[HOST_NAME_MAX] = '\0';
+    int c;
+    size_t i=0;
+    while((c = hname[i++])){
+        seed = seed * 33 + (int)hname[i];
+    }
+    return seed;
+}
+
+std::auto_ptr<RandomSource> theta::make_random_source(const std::string & source_type, const std::string & name){
+   std::auto_ptr<RandomSource> result;
+   if(source_type=="taus"){
+      result.reset(new RandomSourceTaus());
+   }
+   else if(source_type == "mt"){
+      result.reset(new RandomSourceMersenneTwister());
+   }
+   else if(source_type == "philox"){
+      result.reset(new RandomSourcePhilox(RandomSourcePhilox::name_key(name)));
+   }
+   else{
+      throw ConfigurationException("unknown source_type given for rnd_gen (valid values are 'taus', 'mt' and 'philox')");
+   }
+   return result;
+}
+
 RandomConsumer::RandomConsumer(const theta::plugin::Configuration & cfg, const std::string & name): seed(-1){
    std::auto_ptr<RandomSource> rnd_source;
    std::string source_type = "taus";
+   std::string poisson_algo = "root";
    if(cfg.setting.exists("rnd_gen")){
        SettingWrapper s = cfg.setting["rnd_gen"];
        if(s.exists("source_type")){
@@ -18,54 +74,70 @@ RandomConsumer::RandomConsumer(const theta::plugin::Configuration & cfg, const s
        if(s.exists("seed")){
           seed = s["seed"];
        }
+       if(s.exists("poisson")){
+          poisson_algo = static_cast<std::string>(s["poisson"]);
+       }
    }
-   if(source_type=="taus"){
-      rnd_source.reset(new RandomSourceTaus());
-   }
-   else if(source_type == "mt"){
-      rnd_source.reset(new RandomSourceMersenneTwister());
-   }
-   else{
-      throw ConfigurationException("unknown source_type given for rnd_gen (valid values are 'taus' and 'mt')");
-   }
+   rnd_source = make_random_source(source_type, name);
+   const bool counter_based = source_type == "philox";
    if(seed == -1){
-       using namespace boost::posix_time;
-       using namespace boost::gregorian;
-       ptime t(microsec_clock::universal_time());
-       time_duration td = t - ptime(date(1970, 1, 1));
-       seed = td.total_microseconds();
+       // within a Run, all instances (also those of the worker threads) start from the same time-based seed:
+       if(cfg.pm->exists<int>("time_seed")){
+           seed = *(cfg.pm->get<int>("time_seed"));
+       }
+       else{
+           seed = time_seed();
+       }
        // to avoid clashes with other RandomConsumers initialized in the same microsecond / clock resolution
        // interval: use also the RandomConsumer's name which should be unique within one theta configuration.
        for(size_t i=0; i<name.size(); ++i){
            seed = seed * 33 + (int)name[i];
        }
-       // to avoid clashes in case of batch system usage with jobs starting in the same clock resolution
-       // interval with the same configuration (=same name), also use the hostname for the seed:
-       char hname[HOST_NAME_MAX + 1];
-       gethostname(hname, HOST_NAME_MAX + 1);
-       // In case the hostname does not fit into hname, the name is truncated but no error is returned.
-       // This should not happen, as we use HOST_NAME_MAX. On the other hand, we do not check for
-       // any errors potentially returned by gethostname ...
-       hname[HOST_NAME_MAX] = '\0';
-       int c;
-       size_t i=0;
-       while((c = hname[i++])){
-           seed = seed * 33 + (int)hname[i];
+   }
+   // in a Run with several worker threads, each worker has its own instance, saved under a different name.
+   // For a sequential source, the workers must use different seeds. For a counter-based source, the random
+   // stream is determined by the eventid instead, so all workers use the same seed:
+   std::string rndinfo_name = name;
+   if(cfg.pm->exists<int>("threadid")){
+       int threadid = *(cfg.pm->get<int>("threadid"));
+       if(threadid > 0){
+           if(!counter_based){
+               seed = seed * 33 + threadid;
+           }
+           std::stringstream ss;
+           ss << name << "__thread" << threadid;
+           rndinfo_name = ss.str();
        }
-       
    }
    rnd_gen.reset(new Random(rnd_source.release()));
+   if(poisson_algo == "ptrs"){
+       rnd_gen->set_poisson_algorithm(Random::poisson_algo_ptrs);
+   }
+   else if(poisson_algo != "root"){
+       throw ConfigurationException("unknown poisson algorithm given for rnd_gen (valid values are 'root' and 'ptrs')");
+   }
    rnd_gen->set_seed(seed);
    int runid = *(cfg.pm->get<int>("runid"));
-   cfg.pm->get<RndInfoTable>()->append(runid, name, seed);
+   std::string key;
+   if(counter_based){
+       std::stringstream ss;
+       ss << "philox:" << static_cast<unsigned int>(seed) << ":" << RandomSourcePhilox::name_key(name);
+       key = ss.str();
+       if(cfg.pm->exists<RandomStreams>("default")){
+           streams = cfg.pm->get<RandomStreams>("default");
+           streams->add(rnd_gen.get());
+       }
+   }
+   cfg.pm->get<RndInfoTable>()->append(runid, rndinfo_name, seed, key);
 }
 
-void theta::randomize_poisson(Histogram & h, Random & rnd){
-    const size_t nbins = h.get_nbins();
-    for(size_t bin=0; bin<=nbins+1; ++bin){
-        double mu = h.get(bin);
-        if(mu > 0.){
-            h.set(bin, rnd.poisson(mu));
-        }
+RandomConsumer::~RandomConsumer(){
+    if(streams){
+        streams->remove(rnd_gen.get());
     }
 }
+
+void theta::randomize_poisson(Histogram & h, Random & rnd){
+    //including underflow and overflow bin:
+    rnd.poisson(h.getData(), h.get_nbins() + 2);
+}
@@ -185,6 +185,91 @@ unsigned int Random::poisson_root(double mean) {
     }
 }
 
+namespace{
+
+// log(k!), tabulated for small k and using the Stirling series otherwise. This is much faster
+// than utils::lngamma, which matters for poisson_ptrs.
+class LogFactorial{
+    static const int n_table = 256;
+    double table[n_table];
+public:
+    LogFactorial(){
+        table[0] = 0.0;
+        for(int k=1; k<n_table; ++k){
+            table[k] = table[k-1] + log(static_cast<double>(k));
+        }
+    }
+
+    double operator()(double k) const{
+        if(k < n_table) return table[static_cast<int>(k)];
+        const double x = k + 1;
+        const double x2 = 1.0 / (x * x);
+        return (x - 0.5) * log(x) - x + 0.91893853320467274178 + (1.0 / 12 - (1.0 / 360 - x2 / 1260) * x2) / x;
+    }
+};
+
+const LogFactorial log_factorial;
+
+}
+
+unsigned int Random::poisson_inversion(double mean) {
+    // sequential search in the cumulative distribution, using the recursion p(k) = p(k-1) * mean / k.
+    // The search is cut off at k = 100 where the remaining tail probability is below 1e-60 for mean < 10.
+    double u = uniform();
+    double p = exp(-mean);
+    double cdf = p;
+    unsigned int k = 0;
+    while(u > cdf && k < 100){
+        ++k;
+        p *= mean / k;
+        cdf += p;
+    }
+    return k;
+}
+
+unsigned int Random::poisson_ptrs(double mean) {
+    if (mean <= 0) return 0;
+    if (mean < 10) return poisson_inversion(mean);
+    if (mean >= 1E9) {
+        // use Gaussian approximation vor very large values, as in poisson_root
+        return static_cast<unsigned int> (gauss(sqrt(mean)) + mean + 0.5);
+    }
+    const double slam = sqrt(mean);
+    const double loglam = log(mean);
+    const double b = 0.931 + 2.53 * slam;
+    const double a = -0.059 + 0.02483 * b;
+    const double log_invalpha = log(1.1239 + 1.1328 / (b - 3.4));
+    const double vr = 0.9277 - 3.6224 / (b - 2);
+    while (1) {
+        double U = uniform() - 0.5;
+        double V = 1.0 - uniform();
+        double us = 0.5 - fabs(U);
+        double k = floor((2 * a / us + b) * U + mean + 0.43);
+        if (us >= 0.07 && V <= vr) {
+            return static_cast<unsigned int> (k);
+        }
+        if (k < 0 || (us < 0.013 && V > us)) {
+            continue;
+        }
+        if (log(V) + log_invalpha - log(a / (us * us) + b) <= -mean + k * loglam - log_factorial(k)) {
+            return static_cast<unsigned int> (k);
+        }
+    }
+}
+
+void Random::poisson(double * x, size_t n) {
+    if(poisson_algo == poisson_algo_ptrs){
+        for(size_t i=0; i<n; ++i){
+            if(x[i] > 0.) x[i] = poisson_ptrs(x[i]);
+        }
+    }
+    else{
+        for(size_t i=0; i<n; ++i){
+            if(x[i] > 0.) x[i] = poisson_root(x[i]);
+        }
+    }
+}
+
 unsigned int Random::get_uniform_int(unsigned int n) {
     unsigned int k;
     unsigned int scale = 0xFFFFFFFF / n;
@@ -261,3 +346,71 @@ void RandomSourceMersenneTwister::fill(vector<unsigned int> & buffer) {
     }
 }
 
+
+RandomSourcePhilox::RandomSourcePhilox(unsigned int name_key_){
+    key[1] = name_key_;
+    set_seed(0);
+}
+
+unsigned int RandomSourcePhilox::name_key(const std::string & name){
+    unsigned int result = 2166136261u;
+    for(size_t i=0; i<name.size(); ++i){
+        result ^= static_cast<unsigned char>(name[i]);
+        result *= 16777619u;
+    }
+    return result & 0xffffffffu;
+}
+
+void RandomSourcePhilox::set_seed(unsigned int s){
+    key[0] = s & 0xffffffffu;
+    set_stream(0, 0);
+}
+
+bool RandomSourcePhilox::set_stream(unsigned int runid, unsigned int eventid){
+    counter[0] = counter[1] = 0;
+    counter[2] = eventid & 0xffffffffu;
+    counter[3] = runid & 0xffffffffu;
+    return true;
+}
+
+void RandomSourcePhilox::fill(vector<unsigned int> & buffer){
+    const size_t n = buffer.size();
+    const size_t n_blocks = (n + 3) / 4;
+    const unsigned int k0 = key[0], k1 = key[1], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    const unsigned int block0 = counter[0];
+    unsigned int * out = &buffer[0];
+    unsigned int last[4];
+    for(size_t b=0; b<n_blocks; ++b){
+        unsigned int x0 = block0 + b, x1 = c1, x2 = c2, x3 = c3;
+        unsigned int key0 = k0, key1 = k1;
+        for(int round=0; round<10; ++round){
+            const unsigned long long p0 = 0xD2511F53ull * x0;
+            const unsigned long long p1 = 0xCD9E8D57ull * x2;
+            const unsigned int hi0 = static_cast<unsigned int>(p0 >> 32), lo0 = static_cast<unsigned int>(p0);
+            const unsigned int hi1 = static_cast<unsigned int>(p1 >> 32), lo1 = static_cast<unsigned int>(p1);
+            x0 = (hi1 ^ x1 ^ key0) & 0xffffffffu;
+            x1 = lo1 & 0xffffffffu;
+            x2 = (hi0 ^ x3 ^ key1) & 0xffffffffu;
+            x3 = lo0 & 0xffffffffu;
+            key0 = (key0 + 0x9E3779B9u) & 0xffffffffu;
+            key1 = (key1 + 0xBB67AE85u) & 0xffffffffu;
+        }
+        if(4 * b + 4 <= n){
+            out[4*b] = x0;
+            out[4*b+1] = x1;
+            out[4*b+2] = x2;
+            out[4*b+3] = x3;
+        }
+        else{
+            //the last, incomplete block: the remaining numbers of the block are discarded
+            last[0] = x0; last[1] = x1; last[2] = x2; last[3] = x3;
+            for(size_t i=4*b; i<n; ++i){
+                out[i] = last[i - 4*b];
+            }
+        }
+    }
+    //the block counter is 64 bit wide:
+    const unsigned int new_block0 = (block0 + n_blocks) & 0xffffffffu;
+    if(new_block0 < block0) counter[1] = (counter[1] + 1) & 0xffffffffu;
+    counter[0] = new_block0;
+}
@@ -3,24 +3,333 @@
 #include "interface/phys.hpp"
 #include "interface/model.hpp"
 #include "interface/redirect_stdio.hpp"
+#include "interface/random-utils.hpp"
+#include "interface/utils.hpp"
 
 #include <iomanip>
+#include <deque>
+#include <map>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/variant.hpp>
 
 
 using namespace theta;
 using namespace std;
 
+namespace{
+
+typedef boost::variant<double, int, std::string, Histogram> product_value;
+
+// the result of one pseudo experiment, as calculated by a worker thread and passed to the writer
+struct event_result{
+    enum e_status{
+        ok, producer_error, data_unavailable, failure, fatal_failure, finished
+    };
+    int eventid;
+    e_status status;
+    //the error message in case of status producer_error, failure and fatal_failure:
+    std::string message;
+    //the products as pairs (column index, value):
+    std::vector<std::pair<size_t, product_value> > products;
+    //the time it took to produce the data and run the producers, in nanoseconds:
+    boost::uint64_t time_ns;
+    
+    event_result(int eventid_, e_status status_ = ok): eventid(eventid_), status(status_), time_ns(0){}
+};
+
+class buffered_column: public Column{
+public:
+    size_t index;
+    explicit buffered_column(size_t index_): index(index_){}
+};
+
+class set_product_visitor: public boost::static_visitor<>{
+private:
+    ProductsTable & table;
+    const Column & c;
+public:
+    set_product_visitor(ProductsTable & table_, const Column & c_): table(table_), c(c_){}
+    
+    template <typename T>
+    void operator()(const T & t) const{
+        table.set_product(c, t);
+    }
+};
+
+}
+
+// The columns of the products table, shared among all workers. Columns are declared
+// by name in the underlying ProductsTable only once, even if the same product is declared
+// by the producer instances of all workers. Products can be declared from the worker threads,
+// so all access is synchronized.
+class Run::products_columns{
+public:
+    explicit products_columns(const boost::shared_ptr<ProductsTable> & table_): table(table_){}
+    
+    size_t declare_product(const ProductsSource & source, const std::string & product_name, const data_type & type){
+        std::string full_name = source.getName() + "__" + product_name;
+        boost::mutex::scoped_lock lock(mutex);
+        std::map<std::string, size_t>::const_iterator it = name_to_index.find(full_name);
+        if(it != name_to_index.end()) return it->second;
+        size_t index = columns.size();
+        columns.push_back(table->declare_product(source, product_name, type));
+        name_to_index[full_name] = index;
+        return index;
+    }
+    
+    void write_row(int runid, const event_result & r){
+        boost::mutex::scoped_lock lock(mutex);
+        for(size_t i=0; i<r.products.size(); ++i){
+            boost::apply_visitor(set_product_visitor(*table, columns[r.products[i].first]), r.products[i].second);
+        }
+        table->add_row(runid, r.eventid);
+    }
+    
+private:
+    boost::shared_ptr<ProductsTable> table;
+    boost::ptr_vector<Column> columns;
+    std::map<std::string, size_t> name_to_index;
+    boost::mutex mutex;
+};
+
+// ProductsSink for the producers and the data source of one worker: saves the products
+// of the current event in memory
+class Run::products_sink: public ProductsSink{
+public:
+    explicit products_sink(const boost::shared_ptr<products_columns> & columns_): columns(columns_){}
+
+    virtual std::auto_ptr<Column> declare_product(const ProductsSource & source, const std::string & product_name, const data_type & type){
+        return std::auto_ptr<Column>(new buffered_column(columns->declare_product(source, product_name, type)));
+    }
+    virtual void set_product(const Column & c, double d){
+        set(c, d);
+    }
+    virtual void set_product(const Column & c, int i){
+        set(c, i);
+    }
+    virtual void set_product(const Column & c, const std::string & s){
+        set(c, s);
+    }
+    virtual void set_product(const Column & c, const Histogram & h){
+        set(c, h);
+    }
+    
+    // move the current products to result, and clear the current products:
+    void take_products(std::vector<std::pair<size_t, product_value> > & result){
+        result.clear();
+        current.swap(result);
+    }
+    
+private:
+    template<typename T>
+    void set(const Column & c, const T & value){
+        current.push_back(std::make_pair(static_cast<const buffered_column &>(c).index, product_value(value)));
+    }
+    
+    boost::shared_ptr<products_columns> columns;
+    std::vector<std::pair<size_t, product_value> > current;
+};
+
+// A worker holds its own instance of the model, data_source and producers and
+// runs the pseudo experiments of its share of eventids in a separate thread.
+class Run::worker{
+public:
+    worker(const plugin::Configuration & cfg, int threadid, int n_threads, int n_event, const boost::shared_ptr<products_columns> & columns,
+           bool timing);
+    
+    //the thread main: process the events threadid + 1, threadid + 1 + n_threads, ...
+    void operator()();
+    
+    // get the next result (called by the writer). Blocks until a result is available.
+    std::auto_ptr<event_result> pop();
+    
+    // make the thread stop as soon as possible; the thread must still be joined.
+    void stop();
+
+    // the timing statistics of the data source and the producers; only valid after the thread has been joined.
+    const std::vector<TimingStats> & get_timing_stats() const{
+        return timing_stats;
+    }
+    
+private:
+    void push(std::auto_ptr<event_result> r);
+    void run_event(event_result & r, Data & data);
+
+    //maximum number of finished events not yet written:
+    static const size_t max_queue_size = 16;
+
+    int threadid, n_threads, n_event, runid;
+    boost::shared_ptr<products_sink> sink;
+    std::auto_ptr<Model> model;
+    std::auto_ptr<DataSource> data_source;
+    boost::ptr_vector<Producer> producers;
+    boost::shared_ptr<RandomStreams> random_streams;
+
+    bool timing;
+    std::vector<TimingStats> timing_stats;
+    TimingSampler sampler;
+    
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<event_result*> queue;
+    bool stopped;
+};
+
+Run::worker::worker(const plugin::Configuration & cfg, int threadid_, int n_threads_, int n_event_,
+                    const boost::shared_ptr<products_columns> & columns, bool timing_): threadid(threadid_), n_threads(n_threads_),
+                    n_event(n_event_), runid(*cfg.pm->get<int>("runid")), sink(new products_sink(columns)), timing(timing_), stopped(false){
+    //each worker uses a copy of the property map, with its own ProductsSink:
+    plugin::Configuration wcfg(cfg, cfg.setting);
+    wcfg.pm.reset(new PropertyMap(*cfg.pm));
+    wcfg.pm->set<ProductsSink>("default", sink);
+    wcfg.pm->set("threadid", boost::shared_ptr<int>(new int(threadid)));
+    random_streams.reset(new RandomStreams());
+    wcfg.pm->set("default", random_streams);
+    SettingWrapper s = cfg.setting;
+    model = plugin::PluginManager<Model>::instance().build(plugin::Configuration(wcfg, s["model"]));
+    data_source = plugin::PluginManager<DataSource>::instance().build(plugin::Configuration(wcfg, s["data_source"]));
+    size_t n_p = s["producers"].size();
+    for (size_t i = 0; i < n_p; i++) {
+         producers.push_back(plugin::PluginManager<Producer>::instance().build(plugin::Configuration(wcfg, s["producers"][i])));
+    }
+    if(timing){
+        timing_stats.push_back(TimingStats("data_source"));
+        for(size_t i=0; i<producers.size(); ++i){
+            timing_stats.push_back(TimingStats(producers[i].getName()));
+        }
+    }
+}
+
+void Run::worker::run_event(event_result & r, Data & data){
+    random_streams->set_event(runid, r.eventid);
+    const boost::uint64_t sampled = timing_counters.sampling_weight;
+    try{
+        TimedCall call(timing ? &timing_stats[0] : 0, sampled);
+        data_source->fill(data);
+    }
+    catch(DataSource::DataUnavailable &){
+        r.status = event_result::data_unavailable;
+        return;
+    }
+    catch(theta::Exception & ex){
+        r.status = event_result::failure;
+        r.message = ex.message + " (in Run::run while throwing toy data)";
+        return;
+    }
+    for (size_t j = 0; j < producers.size(); j++) {
+        try {
+            TimedCall call(timing ? &timing_stats[j + 1] : 0, sampled);
+            producers[j].produce(data, *model);
+        } catch (Exception & ex) {
+            r.status = event_result::producer_error;
+            std::stringstream ss;
+            ss << "Producer '" << producers[j].getName() << "' failed: " << ex.message << ".";
+            r.message = ss.str();
+            break;
+        }
+        catch(FatalException & f){
+            r.status = event_result::fatal_failure;
+            stringstream ss;
+            ss << "Producer '" << producers[j].getName() << "': " << f.message;
+            r.message = ss.str();
+            break;
+        }
+    }
+    sink->take_products(r.products);
+}
+
+void Run::worker::operator()(){
+    HistodataPoolGuard pool_guard;
+    Data data;
+    for(int eventid = threadid + 1; eventid <= n_event; eventid += n_threads){
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if(stopped) return;
+        }
+        if(stop_execution) break;
+        std::auto_ptr<event_result> r(new event_result(eventid));
+        const boost::uint64_t t0 = utils::now_ns();
+        const boost::uint64_t sampled = timing ? sampler.sample() : 0;
+        timing_counters.sampling_weight = sampled;
+        const boost::uint64_t minimize_sampled0 = timing_counters.minimize_sampled;
+        try{
+            run_event(*r, data);
+        }
+        catch(std::exception & ex){
+            r->status = event_result::fatal_failure;
+            r->message = ex.what();
+        }
+        catch(...){
+            r->status = event_result::fatal_failure;
+            r->message = "unknown exception in worker thread";
+        }
+        r->time_ns = utils::now_ns() - t0;
+        if(sampled) sampler.add_sampled(r->time_ns, producers.size() + 1 + timing_counters.minimize_sampled - minimize_sampled0);
+        bool last = r->status == event_result::data_unavailable || r->status == event_result::failure
+                  || r->status == event_result::fatal_failure;
+        push(r);
+        if(last) return;
+    }
+    push(std::auto_ptr<event_result>(new event_result(0, event_result::finished)));
+}
+
+void Run::worker::push(std::auto_ptr<event_result> r){
+    boost::mutex::scoped_lock lock(mutex);
+    while(queue.size() >= max_queue_size && !stopped){
+        cond.wait(lock);
+    }
+    if(stopped) return;
+    queue.push_back(r.release());
+    cond.notify_all();
+}
+
+std::auto_ptr<event_result> Run::worker::pop(){
+    boost::mutex::scoped_lock lock(mutex);
+    while(queue.empty()){
+        cond.wait(lock);
+    }
+    std::auto_ptr<event_result> result(queue.front());
+    queue.pop_front();
+    cond.notify_all();
+    return result;
+}
+
+void Run::worker::stop(){
+    boost::mutex::scoped_lock lock(mutex);
+    stopped = true;
+    for(size_t i=0; i<queue.size(); ++i){
+        delete queue[i];
+    }
+    queue.clear();
+    cond.notify_all();
+}
+
 
 void Run::run(){
+    if(n_threads > 1){
+        run_parallel();
+        return;
+    }
     //log the start of the run:
     //use eventid = 0 to indicate a "run-scoped" entry
-    logtable->append(runid, 0, LogTable::info, "run start");
+    logtable->append(runid, 0, LogTable::info, LogTable::run_start);
    
+    HistodataPoolGuard pool_guard;
     Data data;
+    TimingSampler sampler;
     //main event loop:
     for (int eventid = 1; eventid <= n_event; eventid++) {
         if(stop_execution)break;
+        const boost::uint64_t t0 = utils::now_ns();
+        const boost::uint64_t sampled = timing ? sampler.sample() : 0;
+        timing_counters.sampling_weight = sampled;
+        const boost::uint64_t minimize_sampled0 = timing_counters.minimize_sampled;
+        random_streams->set_event(runid, eventid);
         try{
+            TimedCall call(timing_stat(0), sampled);
             data_source->fill(data);
         }
         catch(DataSource::DataUnavailable &){
@@ -30,10 +339,11 @@ void Run::run(){
            ex.message += " (in Run::run while throwing toy data)";
            throw;
         }
-        logtable->append(runid, eventid, LogTable::info, "start");
+        logtable->append(runid, eventid, LogTable::info, LogTable::event_start);
         bool error = false;
         for (size_t j = 0; j < producers.size(); j++) {
             try {
+                TimedCall call(timing_stat(j + 1), sampled);
                 producers[j].produce(data, *model);
             } catch (Exception & ex) {
                 error = true;
@@ -49,15 +359,88 @@ void Run::run(){
                 throw;
             }
         }
-        //only add a row if no error ocurred to prevent NULL values and similar things ...
-        if(!error){
-            products_table->add_row(runid, eventid);
+        {
+            TimedCall call(timing_stat(producers.size() + 1), sampled);
+            //only add a row if no error ocurred to prevent NULL values and similar things ...
+            if(!error){
+                products_table->add_row(runid, eventid);
+            }
+            logtable->append(runid, eventid, LogTable::info, LogTable::event_end);
         }
-        logtable->append(runid, eventid, LogTable::info, "end");
+        const boost::uint64_t event_ns = utils::now_ns() - t0;
+        logtable->add_event_time(event_ns);
+        if(sampled) sampler.add_sampled(event_ns, producers.size() + 2 + timing_counters.minimize_sampled - minimize_sampled0);
         if(progress_listener) progress_listener->progress(eventid, n_event);
     }
     
-    logtable->append(runid, 0, LogTable::info, "run end");
+    logtable->append(runid, 0, LogTable::info, LogTable::run_end);
+    write_timing();
+    report();
+}
+
+void Run::run_parallel(){
+    logtable->append(runid, 0, LogTable::info, LogTable::run_start);
+    boost::thread_group threads;
+    for(size_t i=0; i<workers.size(); ++i){
+        threads.create_thread(boost::ref(workers[i]));
+    }
+    //the writer: collect the results from the workers in eventid order
+    TimingStats database_timing("database");
+    TimingSampler sampler;
+    try{
+        for (int eventid = 1; eventid <= n_event; eventid++) {
+            if(stop_execution)break;
+            std::auto_ptr<event_result> r = workers[(eventid - 1) % n_threads].pop();
+            if(r->status == event_result::finished || r->status == event_result::data_unavailable) break;
+            if(r->status == event_result::failure) throw Exception(r->message);
+            if(r->status == event_result::fatal_failure) throw FatalException(r->message);
+            assert(r->eventid == eventid);
+            logtable->append(runid, eventid, LogTable::info, LogTable::event_start);
+            const boost::uint64_t sampled = timing ? sampler.sample() : 0;
+            const boost::uint64_t t0 = sampled ? utils::now_ns() : 0;
+            {
+                TimedCall call(timing ? &database_timing : 0, sampled);
+                if(r->status == event_result::producer_error){
+                    logtable->append(runid, eventid, LogTable::error, r->message);
+                }
+                else{
+                    columns->write_row(runid, *r);
+                }
+                logtable->append(runid, eventid, LogTable::info, LogTable::event_end);
+            }
+            if(sampled) sampler.add_sampled(utils::now_ns() - t0, 1);
+            logtable->add_event_time(r->time_ns);
+            if(progress_listener) progress_listener->progress(eventid, n_event);
+        }
+    }
+    catch(...){
+        stop_workers(threads);
+        throw;
+    }
+    stop_workers(threads);
+    logtable->append(runid, 0, LogTable::info, LogTable::run_end);
+    if(timing){
+        timing_stats = workers[0].get_timing_stats();
+        for(size_t i=1; i<workers.size(); ++i){
+            const std::vector<TimingStats> & stats = workers[i].get_timing_stats();
+            for(size_t j=0; j<stats.size(); ++j){
+                timing_stats[j].add(stats[j]);
+            }
+        }
+        timing_stats.push_back(database_timing);
+    }
+    write_timing();
+    report();
+}
+
+void Run::stop_workers(boost::thread_group & threads){
+    for(size_t i=0; i<workers.size(); ++i){
+        workers[i].stop();
+    }
+    threads.join_all();
+}
+
+void Run::report(){
     if(log_report){
         const int* n_messages = logtable->get_n_messages();
         LogTable::e_severity s = logtable->get_loglevel();
@@ -69,6 +452,50 @@ void Run::run(){
             theta::cout << "  infos:    " << setw(6) << n_messages[2] << endl;
         if(s > 2)
             theta::cout << "  debug:    " << setw(6) << n_messages[3] << endl;
+        if(timing){
+            std::ios_base::fmtflags flags = theta::cout.flags();
+            std::streamsize precision = theta::cout.precision();
+            theta::cout << endl << "Timing (times in seconds, extrapolated from the sampled calls):" << endl;
+            theta::cout << "  " << left << setw(20) << "component" << right << setw(10) << "calls" << setw(10) << "sampled" << setw(10) << "wall"
+                        << setw(10) << "cpu" << setw(12) << "nll evals" << setw(10) << "minimize" << setw(10) << "wall" << setw(10) << "cpu" << endl;
+            for(size_t i=0; i<timing_stats.size(); ++i){
+                const TimingStats & t = timing_stats[i];
+                theta::cout << "  " << left << setw(20) << t.name << right << setw(10) << t.calls << setw(10) << t.sampled
+                            << fixed << setprecision(3) << setw(10) << t.wall_time() << setw(10) << t.cpu_time()
+                            << setw(12) << t.nll_evals << setw(10) << t.minimize_calls << setw(10) << t.minimize_wall_time()
+                            << setw(10) << t.minimize_cpu_time() << endl;
+            }
+            theta::cout.flags(flags);
+            theta::cout.precision(precision);
+        }
+    }
+}
+
+void Run::write_timing(){
+    if(!timing) return;
+    std::auto_ptr<Column> c_runid = timing_table->add_column("runid", typeInt);
+    std::auto_ptr<Column> c_name = timing_table->add_column("name", typeString);
+    std::auto_ptr<Column> c_calls = timing_table->add_column("calls", typeInt);
+    std::auto_ptr<Column> c_sampled = timing_table->add_column("sampled", typeInt);
+    std::auto_ptr<Column> c_wall_time = timing_table->add_column("wall_time", typeDouble);
+    std::auto_ptr<Column> c_cpu_time = timing_table->add_column("cpu_time", typeDouble);
+    std::auto_ptr<Column> c_nll_evals = timing_table->add_column("nll_evals", typeDouble);
+    std::auto_ptr<Column> c_minimize_calls = timing_table->add_column("minimize_calls", typeInt);
+    std::auto_ptr<Column> c_minimize_wall_time = timing_table->add_column("minimize_wall_time", typeDouble);
+    std::auto_ptr<Column> c_minimize_cpu_time = timing_table->add_column("minimize_cpu_time", typeDouble);
+    for(size_t i=0; i<timing_stats.size(); ++i){
+        const TimingStats & t = timing_stats[i];
+        timing_table->set_column(*c_runid, runid);
+        timing_table->set_column(*c_name, t.name);
+        timing_table->set_column(*c_calls, static_cast<int>(t.calls));
+        timing_table->set_column(*c_sampled, static_cast<int>(t.sampled));
+        timing_table->set_column(*c_wall_time, t.wall_time());
+        timing_table->set_column(*c_cpu_time, t.cpu_time());
+        timing_table->set_column(*c_nll_evals, static_cast<double>(t.nll_evals));
+        timing_table->set_column(*c_minimize_calls, static_cast<int>(t.minimize_calls));
+        timing_table->set_column(*c_minimize_wall_time, t.minimize_wall_time());
+        timing_table->set_column(*c_minimize_cpu_time, t.minimize_cpu_time());
+        timing_table->add_row();
     }
 }
 
@@ -78,6 +505,7 @@ Run::Run(const plugin::Configuration & cfg){
     //0. set default values for members:
     vm = cfg.vm;
     log_report = true;
+    timing = false;
     runid = 1;
     n_event = s["n-events"];
     
@@ -97,10 +525,27 @@ Run::Run(const plugin::Configuration & cfg){
     
     boost::shared_ptr<int> ptr_runid(new int(runid));
     cfg.pm->set("runid", ptr_runid);
+
+    random_streams.reset(new RandomStreams());
+    cfg.pm->set("default", random_streams);
+
+    //the RandomConsumers without a configured seed (also those of the worker threads) all derive their seed from this one:
+    cfg.pm->set("time_seed", boost::shared_ptr<int>(new int(time_seed())));
+    
+    //producers which need additional instances of the model (e.g., for parallel Markov chains) build them from this setting:
+    cfg.pm->set("model", boost::shared_ptr<SettingWrapper>(new SettingWrapper(s["model"])));
         
+    n_threads = 1;
+    if(s.exists("n-threads")){
+        n_threads = s["n-threads"];
+        if(n_threads < 1) throw ConfigurationException("n-threads must be >= 1");
+    }
+    
     //2. model and data_source
-    model = plugin::PluginManager<Model>::instance().build(plugin::Configuration(cfg, s["model"]));
-    data_source = plugin::PluginManager<DataSource>::instance().build(plugin::Configuration(cfg, s["data_source"]));
+    if(n_threads == 1){
+        model = plugin::PluginManager<Model>::instance().build(plugin::Configuration(cfg, s["model"]));
+        data_source = plugin::PluginManager<DataSource>::instance().build(plugin::Configuration(cfg, s["data_source"]));
+    }
     
     //3. logging stuff
     LogTable::e_severity level = LogTable::warning;
@@ -121,15 +566,42 @@ Run::Run(const plugin::Configuration & cfg){
     if(s.exists("log-report")){
         log_report = s["log-report"];
     }
+    if(s.exists("log-compact") && static_cast<bool>(s["log-compact"])){
+        std::auto_ptr<Table> summary_table_underlying = db->create_table("log_summary");
+        logtable->set_compact(summary_table_underlying);
+    }
+    timing = s.exists("timing") && static_cast<bool>(s["timing"]);
+    if(timing){
+        calibrate_timing();
+        timing_table = db->create_table("timing");
+    }
     
     //4. producers:
     size_t n_p = s["producers"].size();
     if (n_p == 0)
         throw ConfigurationException("no producers specified!");
-    for (size_t i = 0; i < n_p; i++) {
-         producers.push_back(plugin::PluginManager<Producer>::instance().build(plugin::Configuration(cfg, s["producers"][i])));
+    if(n_threads == 1){
+        for (size_t i = 0; i < n_p; i++) {
+             producers.push_back(plugin::PluginManager<Producer>::instance().build(plugin::Configuration(cfg, s["producers"][i])));
+        }
+        if(timing){
+            timing_stats.push_back(TimingStats("data_source"));
+            for(size_t i=0; i<producers.size(); ++i){
+                timing_stats.push_back(TimingStats(producers[i].getName()));
+            }
+            timing_stats.push_back(TimingStats("database"));
+        }
+    }
+    else{
+        //5. the workers, each with their own model, data_source and producers:
+        columns.reset(new products_columns(products_table));
+        for(int i=0; i<n_threads; ++i){
+            workers.push_back(new worker(cfg, i, n_threads, n_event, columns, timing));
+        }
     }
 }
 
+Run::~Run(){}
+
 REGISTER_PLUGIN_DEFAULT(Run)
 
@@ -0,0 +1,86 @@
+#include "interface/timing.hpp"
+
+#include <time.h>
+#include <cmath>
+
+using namespace theta;
+
+THETA_THREAD_LOCAL TimingCounters theta::timing_counters = {0, 0, 0, 0, 0, 0};
+TimingOverhead theta::timing_overhead = {0, 0, 0, 0};
+
+namespace{
+    // the maximum fraction of the event time used for reading the clocks:
+    const double max_overhead = 0.01;
+
+    // the number of events always timed at the beginning:
+    const boost::uint64_t n_initial = 10;
+}
+
+boost::uint64_t theta::thread_cpu_ns(){
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<boost::uint64_t>(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+}
+
+void theta::calibrate_timing(){
+    const int n = 1000;
+    //the time measured for an empty call, reading the clocks in the same order as TimedCall:
+    boost::uint64_t wall = 0, cpu = 0;
+    for(int i=0; i<n; ++i){
+        boost::uint64_t wall0 = utils::now_ns();
+        boost::uint64_t cpu0 = thread_cpu_ns();
+        cpu += thread_cpu_ns() - cpu0;
+        wall += utils::now_ns() - wall0;
+    }
+    //the time of complete measurements, as seen from an enclosing one:
+    boost::uint64_t sum = 0;
+    boost::uint64_t wall0 = utils::now_ns();
+    boost::uint64_t cpu0 = thread_cpu_ns();
+    for(int i=0; i<n; ++i){
+        sum += utils::now_ns();
+        sum += thread_cpu_ns();
+        sum += thread_cpu_ns();
+        sum += utils::now_ns();
+    }
+    boost::uint64_t nested_cpu = thread_cpu_ns() - cpu0;
+    boost::uint64_t nested_wall = utils::now_ns() - wall0;
+    //prevent the compiler from optimizing the loop away:
+    if(sum == 0) ++nested_wall;
+    timing_overhead.wall_ns = wall / n;
+    timing_overhead.cpu_ns = cpu / n;
+    timing_overhead.nested_wall_ns = nested_wall / n;
+    timing_overhead.nested_cpu_ns = nested_cpu / n;
+}
+
+void TimingStats::add(const TimingStats & other){
+    calls += other.calls;
+    sampled += other.sampled;
+    wall_ns += other.wall_ns;
+    cpu_ns += other.cpu_ns;
+    nll_evals += other.nll_evals;
+    minimize_calls += other.minimize_calls;
+    minimize_sampled += other.minimize_sampled;
+    minimize_wall_ns += other.minimize_wall_ns;
+    minimize_cpu_ns += other.minimize_cpu_ns;
+}
+
+TimingSampler::TimingSampler(): event_ns(0.0), n_sampled(0), interval(1), countdown(0){
+}
+
+boost::uint64_t TimingSampler::sample(){
+    if(countdown == 0){
+        countdown = interval - 1;
+        return interval;
+    }
+    --countdown;
+    return 0;
+}
+
+void TimingSampler::add_sampled(boost::uint64_t wall_ns, size_t n_timed){
+    ++n_sampled;
+    event_ns += (wall_ns - event_ns) / std::min<boost::uint64_t>(n_sampled, 100);
+    if(n_sampled < n_initial || event_ns <= 0.0) return;
+    double cost = static_cast<double>(n_timed * timing_overhead.nested_wall_ns);
+    //the new interval applies after the current countdown, which is the weight of the current event:
+    interval = std::max<boost::uint64_t>(1, static_cast<boost::uint64_t>(ceil(cost / (max_overhead * event_ns))));
+}
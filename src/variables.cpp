@@ -11,6 +11,30 @@ using namespace theta::utils;
 using namespace std;
 using namespace libconfig;
 
+namespace{
+    size_t index_of(const ParIds & all, const ParId & pid){
+        size_t i = 0;
+        for(ParIds::const_iterator it=all.begin(); it!=all.end(); ++it, ++i){
+            if(*it == pid) return i;
+        }
+        throw InvalidArgumentException("ParLayout: parameter not found in layout parameters");
+    }
+}
+
+ParLayout::ParLayout(const ParIds & all, const ParIds & sub){
+    offsets.reserve(sub.size());
+    for(ParIds::const_iterator it=sub.begin(); it!=sub.end(); ++it){
+        offsets.push_back(index_of(all, *it));
+    }
+}
+
+ParLayout::ParLayout(const ParIds & all, const std::vector<ParId> & sub){
+    offsets.reserve(sub.size());
+    for(std::vector<ParId>::const_iterator it=sub.begin(); it!=sub.end(); ++it){
+        offsets.push_back(index_of(all, *it));
+    }
+}
+
 ParId VarIdManager::createParId(const std::string & name) {
     if (parNameExists(name)) {
         stringstream ss;
@@ -0,0 +1,48 @@
+#include "plugins/hmc.hpp"
+#include "plugins/mcmc.hpp"
+#include "interface/model.hpp"
+#include "interface/random.hpp"
+
+#include "test/utils.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace theta;
+using namespace theta::plugin;
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(hmc_tests)
+
+// the No-U-Turn sampler recovers mean and width of an about gaussian posterior: the normalization beta of a
+// flat template with 10000 events on its asimov data has mean 1 and width 0.01.
+BOOST_AUTO_TEST_CASE(nuts_gauss){
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    ParId beta = vm->createParId("beta");
+    vm->createObsId("obs0", 10, -1, 1);
+    ConfigCreator cc("flat-histo = {type = \"fixed_poly\"; observable=\"obs0\"; coefficients = [1.0]; normalize_to = 10000.0;};\n"
+            "c = {type = \"mult\"; parameters=(\"beta\");};\n"
+            "dist = {type = \"flat_distribution\"; beta = { range = (0.0, \"inf\"); fix-sample-value = 1.0; }; };\n"
+            "m = {\n"
+            "  obs0 = { background = { coefficient-function = \"@c\"; histogram = \"@flat-histo\"; }; };\n"
+            "  parameter-distribution = \"@dist\";\n"
+            "};\n", vm);
+    const Configuration & cfg = cc.get();
+    std::auto_ptr<Model> model = PluginManager<Model>::instance().build(Configuration(cfg, cfg.setting["m"]));
+    Data data;
+    model->get_prediction(data, ParValues().set(beta, 1.0));
+    std::auto_ptr<NLLikelihood> nll = model->getNLLikelihood(data);
+    BOOST_CHECK(nll->provides_derivatives());
+    Random rnd(new RandomSourceTaus());
+    HMCOptions options;
+    // start away from the mode, with a too large width:
+    vector<double> start(1, 1.02);
+    Matrix sqrt_cov(1, 1);
+    sqrt_cov(0,0) = 0.05;
+    MCMCChainRecord record(1, false);
+    hamiltonianMC(*nll, record, rnd, start, sqrt_cov, 5000, 500, options);
+    BOOST_CHECK_EQUAL(record.get_count(), 5000u);
+    BOOST_CHECK(fabs(record.get_mean(0) - 1.0) < 0.001);
+    BOOST_CHECK(fabs(sqrt(record.get_variance(0)) - 0.01) < 0.001);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,14 +1,44 @@
 #include "interface/utils.hpp"
 #include "interface/random.hpp"
 #include "plugins/mcmc-result.hpp"
+#include "plugins/mcmc.hpp"
+#include "interface/model.hpp"
+#include "interface/producer.hpp"
+#include "interface/database.hpp"
+#include "test/utils.hpp"
 
 #include <boost/test/unit_test.hpp>
-
-BOOST_AUTO_TEST_SUITE(mcmc_tests)
+#include <boost/thread/thread.hpp>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
 
 using namespace theta;
+using namespace theta::plugin;
 using namespace std;
 
+// a likelihood term which is zero for the first max-calls evaluations and throws a MinimizationException afterwards
+class failing_term: public Function{
+public:
+    failing_term(const Configuration & cfg): n_calls(0){
+        max_calls = cfg.setting["max-calls"];
+    }
+
+    virtual double operator()(const ParValues & v) const{
+        if(++n_calls > max_calls) throw MinimizationException("failing_term: too many calls");
+        return 0.0;
+    }
+
+private:
+    int max_calls;
+    mutable int n_calls;
+};
+
+REGISTER_PLUGIN(failing_term)
+
+BOOST_AUTO_TEST_SUITE(mcmc_tests)
+
 
 //test the numerical stability of the covariance calculation of the
 // mcmcResult class.
@@ -19,7 +49,6 @@ BOOST_AUTO_TEST_CASE(mcmc_result0){
     double vec[2] = {0,1};
     res.fill(vec, 0, 1);
     res.fill(vec, 0, 1);
-    res.end();
     BOOST_CHECK(res.getCount()==2);
     BOOST_CHECK(res.getnpar()==2);
     vector<double> means = res.getMeans();
@@ -46,7 +75,6 @@ BOOST_AUTO_TEST_CASE(mcmc_result1){
         vec[0] = i%2?(10-2.1):(10+2.1);
         res.fill(vec, 0.0, 1);
     }
-    res.end();
     vector<double> means = res.getMeans();
     BOOST_CHECK(utils::close_to_relative(means[0], 10.0));
     BOOST_CHECK(utils::close_to_relative(means[1], 1.1));
@@ -126,6 +154,428 @@ BOOST_AUTO_TEST_CASE(mcmc_result3){
     cout << setprecision(18);
 }
 
+namespace{
+
+// negative log of a one-dimensional gaussian with the given mean and width
+class GaussNLL{
+public:
+    GaussNLL(double mean_, double width_): mean(mean_), width(width_){}
+
+    size_t getnpar() const{
+        return 1;
+    }
+
+    double operator()(const double * x) const{
+        const double d = (x[0] - mean) / width;
+        return 0.5 * d * d;
+    }
+
+private:
+    double mean, width;
+};
+
+// a model with one parameter beta for the normalization of a flat template with 10000 events. With its asimov data,
+// the posterior of beta is about gaussian with mean 1 and width 0.01.
+const char * poisson_model_cfg = "flat-histo = {type = \"fixed_poly\"; observable=\"obs0\"; coefficients = [1.0]; normalize_to = 10000.0;};\n"
+            "c = {type = \"mult\"; parameters=(\"beta\");};\n"
+            "dist = {type = \"flat_distribution\"; beta = { range = (0.0, \"inf\"); fix-sample-value = 1.0; }; };\n"
+            "m = {\n"
+            "  obs0 = { background = { coefficient-function = \"@c\"; histogram = \"@flat-histo\"; }; };\n"
+            "  parameter-distribution = \"@dist\";\n"
+            "};\n";
+
+// saves the double and string products in memory
+class SaveProducts: public ProductsSink{
+private:
+    class MemColumn: public theta::Column{
+        public:
+            MemColumn(const string & name_): name(name_){}
+            string name;
+    };
+public:
+    map<string, double> doubles;
+    map<string, string> strings;
+
+    virtual std::auto_ptr<Column> declare_product(const ProductsSource & source, const std::string & product_name, const data_type & type){
+        return std::auto_ptr<Column>(new MemColumn(source.getName() + "__" + product_name));
+    }
+    virtual void set_product(const Column & c, double d){
+        doubles[static_cast<const MemColumn &>(c).name] = d;
+    }
+    virtual void set_product(const Column & c, int i){
+    }
+    virtual void set_product(const Column & c, const std::string & s){
+        strings[static_cast<const MemColumn &>(c).name] = s;
+    }
+    virtual void set_product(const Column & c, const Histogram & h){
+    }
+};
+
+// calls get_sqrt_cov_start for its own model, as a worker thread of a Run would
+class proposal_task{
+public:
+    proposal_task(const MCMCOptions & options_, const Model & model_, const boost::shared_ptr<VarIdManager> & vm_):
+        options(options_), model(model_), vm(vm_){}
+
+    void operator()(){
+        Random rnd(new RandomSourceTaus());
+        sqrt_cov = get_sqrt_cov_start(&options, rnd, model, startvalues, boost::shared_ptr<Distribution>(), vm);
+    }
+
+    vector<double> startvalues;
+    Matrix sqrt_cov;
+
+private:
+    const MCMCOptions & options;
+    const Model & model;
+    boost::shared_ptr<VarIdManager> vm;
+};
+
+vector<string> read_lines(const string & filename){
+    vector<string> result;
+    ifstream in(filename.c_str());
+    string line;
+    while(getline(in, line)) result.push_back(line);
+    return result;
+}
+
+}
+
+// the adaptive engine recovers mean and width of a gaussian posterior, starting with a much too small proposal
+BOOST_AUTO_TEST_CASE(adaptive_gauss){
+    Random rnd(new RandomSourceTaus());
+    GaussNLL nll(3.0, 2.0);
+    MCMCOptions options;
+    vector<double> start(1, 0.0);
+    Matrix sqrt_cov(1, 1);
+    sqrt_cov(0,0) = 0.05;
+    MCMCChainRecord record(1, false);
+    MCMCChainInfo info = adaptiveMetropolis(nll, record, rnd, start, sqrt_cov, 50000, 5000, options);
+    BOOST_CHECK_EQUAL(info.iterations, 50000u);
+    BOOST_CHECK_EQUAL(record.get_count(), 50000u);
+    BOOST_CHECK(fabs(record.get_mean(0) - 3.0) < 0.15);
+    BOOST_CHECK(fabs(sqrt(record.get_variance(0)) - 2.0) < 0.15);
+    // the adapted proposal has about the optimal acceptance rate of 0.44 in one dimension:
+    BOOST_CHECK(info.acceptance_rate > 0.3 && info.acceptance_rate < 0.6);
+    BOOST_CHECK(info.swap_rate == 0.0);
+    BOOST_CHECK(info.ess > 1000.0 && info.ess <= 50000.0);
+}
+
+BOOST_AUTO_TEST_CASE(tempering_gauss){
+    Random rnd(new RandomSourceTaus());
+    GaussNLL nll(-1.0, 0.5);
+    MCMCOptions options;
+    options.n_temperatures = 4;
+    vector<double> start(1, 0.0);
+    Matrix sqrt_cov(1, 1);
+    sqrt_cov(0,0) = 0.5;
+    MCMCChainRecord record(1, false);
+    MCMCChainInfo info = adaptiveMetropolis(nll, record, rnd, start, sqrt_cov, 50000, 5000, options);
+    BOOST_CHECK(fabs(record.get_mean(0) + 1.0) < 0.05);
+    BOOST_CHECK(fabs(sqrt(record.get_variance(0)) - 0.5) < 0.05);
+    BOOST_CHECK(info.swap_rate > 0.0 && info.swap_rate < 1.0);
+    BOOST_CHECK(info.ess > 1000.0);
+}
+
+// ESS-based stopping with a configured check interval
+BOOST_AUTO_TEST_CASE(target_ess){
+    Random rnd(new RandomSourceTaus());
+    GaussNLL nll(0.0, 1.0);
+    MCMCOptions options;
+    options.target_ess = 2000.0;
+    options.check_interval = 500;
+    vector<double> start(1, 0.0);
+    Matrix sqrt_cov(1, 1);
+    sqrt_cov(0,0) = 1.0;
+    MCMCChainRecord record(1, false);
+    MCMCChainInfo info = adaptiveMetropolis(nll, record, rnd, start, sqrt_cov, 1000000, 1000, options);
+    BOOST_CHECK(info.ess >= 2000.0);
+    BOOST_CHECK(info.iterations < 1000000u);
+    BOOST_CHECK_EQUAL(info.iterations % 500, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(options){
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    ConfigCreator cc("temperatures = 3; target-ess = 100.0; check-interval = 200;", vm);
+    MCMCOptions options(cc.get());
+    BOOST_CHECK_EQUAL(options.n_temperatures, 3u);
+    BOOST_CHECK_EQUAL(options.check_interval, 200u);
+    BOOST_CHECK(options.proposal_cache.empty());
+    ConfigCreator cc_invalid("check-interval = 0;", vm);
+    bool exception = false;
+    try{
+        MCMCOptions invalid(cc_invalid.get());
+    }
+    catch(ConfigurationException &){
+        exception = true;
+    }
+    BOOST_CHECK(exception);
+}
+
+// several chains on a model with a gaussian posterior: the chains agree, i.e., R-hat is about 1
+BOOST_AUTO_TEST_CASE(chains_rhat){
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    ParId beta = vm->createParId("beta");
+    vm->createObsId("obs0", 10, -1, 1);
+    ConfigCreator cc(string(poisson_model_cfg) + "mcmc = { chains = 4; };\n", vm);
+    const Configuration & cfg = cc.get();
+    cfg.pm->set("model", boost::shared_ptr<SettingWrapper>(new SettingWrapper(cfg.setting["m"])));
+    std::auto_ptr<Model> model = PluginManager<Model>::instance().build(Configuration(cfg, cfg.setting["m"]));
+    Data data;
+    model->get_prediction(data, ParValues().set(beta, 1.0));
+    std::auto_ptr<NLLikelihood> nll = model->getNLLikelihood(data);
+    MCMCOptions options(Configuration(cfg, cfg.setting["mcmc"]));
+    MCMCChains chains(cfg, options);
+    Random rnd(new RandomSourceTaus());
+    vector<double> start(1, 1.0);
+    Matrix sqrt_cov(1, 1);
+    sqrt_cov(0,0) = 0.01;
+    MCMCChainRecord record(1, false);
+    MCMCDiagnostics diag = chains.run(*nll, data, record, rnd, start, sqrt_cov, 40000, 2000);
+    BOOST_CHECK_EQUAL(record.get_count(), 40000u);
+    // the posterior of beta has mean 1 and width 0.01:
+    BOOST_CHECK(fabs(record.get_mean(0) - 1.0) < 0.002);
+    BOOST_CHECK(fabs(sqrt(record.get_variance(0)) - 0.01) < 0.001);
+    BOOST_CHECK(diag.ess > 0.0);
+    BOOST_CHECK(diag.rhat >= 1.0 && diag.rhat < 1.02);
+
+    // a single chain has no R-hat:
+    MCMCOptions options1;
+    MCMCChains single(cfg, options1);
+    MCMCChainRecord record1(1, false);
+    diag = single.run(*nll, data, record1, rnd, start, sqrt_cov, 10000, 1000);
+    BOOST_CHECK(diag.ess > 0.0);
+    BOOST_CHECK(std::isnan(diag.rhat));
+}
+
+// the exception of a failed chain is passed on with its type, and the chains use the configured random source
+BOOST_AUTO_TEST_CASE(chains_errors){
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    ParId beta = vm->createParId("beta");
+    vm->createObsId("obs0", 10, -1, 1);
+    ConfigCreator cc(string(poisson_model_cfg) + "mcmc = { chains = 3; };\n"
+            "failing = { name = \"failing\"; additional-nll-term = { type = \"failing_term\"; max-calls = 100; }; };\n"
+            "philox = { name = \"philox\"; rnd_gen = { source_type = \"philox\"; }; };\n"
+            "invalid = { name = \"invalid\"; rnd_gen = { source_type = \"unknown\"; }; };\n", vm);
+    const Configuration & cfg = cc.get();
+    cfg.pm->set("model", boost::shared_ptr<SettingWrapper>(new SettingWrapper(cfg.setting["m"])));
+    std::auto_ptr<Model> model = PluginManager<Model>::instance().build(Configuration(cfg, cfg.setting["m"]));
+    Data data;
+    model->get_prediction(data, ParValues().set(beta, 1.0));
+    std::auto_ptr<NLLikelihood> nll = model->getNLLikelihood(data);
+    MCMCOptions options(Configuration(cfg, cfg.setting["mcmc"]));
+    vector<double> start(1, 1.0);
+    Matrix sqrt_cov(1, 1);
+    sqrt_cov(0,0) = 0.01;
+    MCMCChains failing(Configuration(cfg, cfg.setting["failing"]), options);
+    Random rnd(new RandomSourceTaus());
+    MCMCChainRecord record(1, false);
+    bool exception = false;
+    try{
+        failing.run(*nll, data, record, rnd, start, sqrt_cov, 3000, 100);
+    }
+    catch(MinimizationException & ex){
+        exception = true;
+        BOOST_CHECK_EQUAL(ex.message, "failing_term: too many calls");
+    }
+    BOOST_CHECK(exception);
+
+    // with the philox source, the result is determined by the seed:
+    MCMCChains philox(Configuration(cfg, cfg.setting["philox"]), options);
+    double means[2];
+    for(int i=0; i<2; ++i){
+        Random rnd_i(new RandomSourceTaus());
+        rnd_i.set_seed(17);
+        MCMCChainRecord record_i(1, false);
+        philox.run(*nll, data, record_i, rnd_i, start, sqrt_cov, 3000, 100);
+        means[i] = record_i.get_mean(0);
+    }
+    BOOST_CHECK_EQUAL(means[0], means[1]);
+    BOOST_CHECK(fabs(means[0] - 1.0) < 0.01);
+    exception = false;
+    try{
+        MCMCChains invalid(Configuration(cfg, cfg.setting["invalid"]), options);
+    }
+    catch(ConfigurationException &){
+        exception = true;
+    }
+    BOOST_CHECK(exception);
+}
+
+// the proposal cache is only used if configured; cached results are independent of the random number generator
+// passed and are read back from the file
+BOOST_AUTO_TEST_CASE(proposal_cache){
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    vm->createParId("beta");
+    vm->createObsId("obs0", 10, -1, 1);
+    ConfigCreator cc(poisson_model_cfg, vm);
+    const Configuration & cfg = cc.get();
+    std::auto_ptr<Model> model = PluginManager<Model>::instance().build(Configuration(cfg, cfg.setting["m"]));
+    const boost::shared_ptr<Distribution> no_override;
+    const string filename = "proposal_cache_test.txt", filename2 = "proposal_cache_test2.txt";
+    remove(filename.c_str());
+    remove(filename2.c_str());
+    Random rnd(new RandomSourceTaus());
+    MCMCOptions options;
+    options.adaptive = false;
+
+    // without cache:
+    vector<double> start0, start1, start2;
+    rnd.set_seed(1);
+    Matrix sqrt_cov0 = get_sqrt_cov_start(&options, rnd, *model, start0, no_override, vm);
+    BOOST_CHECK(read_lines(filename).empty());
+
+    // with cache, the second call does not depend on rnd:
+    options.proposal_cache = filename;
+    rnd.set_seed(1);
+    Matrix sqrt_cov1 = get_sqrt_cov_start(&options, rnd, *model, start1, no_override, vm);
+    rnd.set_seed(2);
+    Matrix sqrt_cov2 = get_sqrt_cov_start(&options, rnd, *model, start2, no_override, vm);
+    BOOST_REQUIRE(start1.size() == 1 && start2.size() == 1 && start0.size() == 1);
+    BOOST_CHECK_EQUAL(start1[0], start2[0]);
+    BOOST_CHECK_EQUAL(sqrt_cov1(0,0), sqrt_cov2(0,0));
+    BOOST_CHECK_EQUAL(read_lines(filename).size(), 1u);
+    // ... and agrees with the calculation without cache within the statistical precision:
+    BOOST_CHECK(fabs(start1[0] - start0[0]) < 0.01);
+    BOOST_CHECK(fabs(sqrt_cov1(0,0) / sqrt_cov0(0,0) - 1) < 0.3);
+
+    // for the adaptive engine, the cached diagonal matrix is exactly the one calculated without cache:
+    options.adaptive = true;
+    vector<double> start_diag, start_diag_cached;
+    Matrix sqrt_cov_diag = get_sqrt_cov_diagonal(*model, start_diag, no_override);
+    Matrix sqrt_cov_diag_cached = get_sqrt_cov_start(&options, rnd, *model, start_diag_cached, no_override, vm);
+    BOOST_CHECK_EQUAL(start_diag[0], start_diag_cached[0]);
+    BOOST_CHECK_EQUAL(sqrt_cov_diag(0,0), sqrt_cov_diag_cached(0,0));
+    vector<string> lines = read_lines(filename);
+    BOOST_REQUIRE_EQUAL(lines.size(), 2u);
+
+    // entries are read from the file; use a modified copy to check that the values come from the file:
+    {
+        ofstream out(filename2.c_str());
+        for(size_t i=0; i<lines.size(); ++i){
+            istringstream ss(lines[i]);
+            string key;
+            size_t n;
+            double start, sqrt_cov;
+            ss >> key >> n >> start >> sqrt_cov;
+            out << setprecision(17) << key << " " << n << " " << (start + 1) << " " << 2 * sqrt_cov << endl;
+        }
+    }
+    options.proposal_cache = filename2;
+    vector<double> start3;
+    Matrix sqrt_cov3 = get_sqrt_cov_start(&options, rnd, *model, start3, no_override, vm);
+    BOOST_CHECK(utils::close_to_relative(start3[0], start_diag[0] + 1));
+    BOOST_CHECK(utils::close_to_relative(sqrt_cov3(0,0), 2 * sqrt_cov_diag(0,0)));
+    BOOST_CHECK_EQUAL(read_lines(filename2).size(), 2u);
+    remove(filename.c_str());
+    remove(filename2.c_str());
+}
+
+// the batch means estimate of the ESS, and therefore the error estimate of the mean, is finite
+BOOST_AUTO_TEST_CASE(batch_means){
+    Random rnd(new RandomSourceTaus());
+    Matrix sqrt_cov(2, 2);
+    sqrt_cov(0,0) = 1.0;
+    // second parameter is fixed
+    MCMCProposal proposal(sqrt_cov);
+    MCMCBatchMeans bm(2);
+    double x[2];
+    x[1] = 5.0;
+    // not enough batches yet:
+    BOOST_CHECK_EQUAL(bm.ess(proposal), 0.0);
+    // for independent points, the ESS is about the number of points:
+    const size_t n = 100000;
+    double sum = 0.0, sum2 = 0.0;
+    for(size_t i=0; i<n; ++i){
+        x[0] = rnd.gauss();
+        sum += x[0];
+        sum2 += x[0] * x[0];
+        bm.add(x, 1);
+    }
+    BOOST_CHECK_EQUAL(bm.get_count(), n);
+    double ess = bm.ess(proposal);
+    BOOST_CHECK(std::isfinite(ess));
+    BOOST_CHECK(ess > 0.5 * n && ess < 2.0 * n);
+    const double sd = sqrt((sum2 - sum * sum / n) / (n - 1));
+    const double error = sd / sqrt(ess);
+    BOOST_CHECK(std::isfinite(error) && error > 0.0);
+    // weighted points, i.e., a highly correlated chain, have a smaller ESS:
+    MCMCBatchMeans bm_weighted(2);
+    for(size_t i=0; i<n / 10; ++i){
+        x[0] = rnd.gauss();
+        bm_weighted.add(x, 10);
+    }
+    BOOST_CHECK_EQUAL(bm_weighted.get_count(), n);
+    double ess_weighted = bm_weighted.ess(proposal);
+    BOOST_CHECK(std::isfinite(ess_weighted));
+    BOOST_CHECK(ess_weighted > 0.05 * n && ess_weighted < 0.2 * n);
+}
+
+// several threads requesting the same entry calculate it only once and get the same result
+BOOST_AUTO_TEST_CASE(proposal_cache_threads){
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    vm->createParId("beta");
+    vm->createObsId("obs0", 10, -1, 1);
+    ConfigCreator cc(poisson_model_cfg, vm);
+    const Configuration & cfg = cc.get();
+    const string filename = "proposal_cache_threads.txt";
+    remove(filename.c_str());
+    MCMCOptions options;
+    options.adaptive = false;
+    options.proposal_cache = filename;
+    const size_t n = 4;
+    boost::ptr_vector<Model> models;
+    boost::ptr_vector<proposal_task> tasks;
+    for(size_t k=0; k<n; ++k){
+        models.push_back(PluginManager<Model>::instance().build(Configuration(cfg, cfg.setting["m"])));
+        tasks.push_back(new proposal_task(options, models[k], vm));
+    }
+    boost::thread_group threads;
+    for(size_t k=0; k<n; ++k){
+        threads.create_thread(boost::ref(tasks[k]));
+    }
+    threads.join_all();
+    BOOST_CHECK_EQUAL(read_lines(filename).size(), 1u);
+    for(size_t k=1; k<n; ++k){
+        BOOST_REQUIRE_EQUAL(tasks[k].startvalues.size(), 1u);
+        BOOST_CHECK_EQUAL(tasks[k].startvalues[0], tasks[0].startvalues[0]);
+        BOOST_CHECK_EQUAL(tasks[k].sqrt_cov(0,0), tasks[0].sqrt_cov(0,0));
+    }
+    remove(filename.c_str());
+}
+
+// the "method" product records how the quantiles were calculated; both methods agree with the posterior of beta
+BOOST_AUTO_TEST_CASE(quantiles_method){
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    ParId beta = vm->createParId("beta");
+    vm->createObsId("obs0", 10, -1, 1);
+    ConfigCreator cc(string(poisson_model_cfg) +
+            "exact = { type = \"mcmc_quantiles\"; name = \"exact\"; parameter = \"beta\"; quantiles = [0.16, 0.5, 0.84]; iterations = 20000; };\n"
+            "digest = { type = \"mcmc_quantiles\"; name = \"digest\"; parameter = \"beta\"; quantiles = [0.16, 0.5, 0.84]; iterations = 20000;\n"
+            "   method = \"tdigest\"; compression = 50.0; };\n"
+            "db = { type = \"blackhole_database\"; };\n", vm);
+    const Configuration & cfg = cc.get();
+    boost::shared_ptr<Database> db;
+    db = PluginManager<Database>::instance().build(Configuration(cfg, cfg.setting["db"]));
+    std::auto_ptr<Table> rndinfo_table_underlying = db->create_table("rndinfo");
+    cfg.pm->set("default", boost::shared_ptr<RndInfoTable>(new RndInfoTable(rndinfo_table_underlying)));
+    boost::shared_ptr<SaveProducts> products(new SaveProducts());
+    cfg.pm->set<ProductsSink>("default", products);
+    cfg.pm->set("runid", boost::shared_ptr<int>(new int(1)));
+    std::auto_ptr<Model> model = PluginManager<Model>::instance().build(Configuration(cfg, cfg.setting["m"]));
+    Data data;
+    model->get_prediction(data, ParValues().set(beta, 1.0));
+    std::auto_ptr<Producer> exact = PluginManager<Producer>::instance().build(Configuration(cfg, cfg.setting["exact"]));
+    std::auto_ptr<Producer> digest = PluginManager<Producer>::instance().build(Configuration(cfg, cfg.setting["digest"]));
+    exact->produce(data, *model);
+    digest->produce(data, *model);
+    BOOST_CHECK_EQUAL(products->strings["exact__method"], "exact");
+    BOOST_CHECK_EQUAL(products->strings["digest__method"], "tdigest:50");
+    BOOST_CHECK(fabs(products->doubles["exact__quant05000"] - 1.0) < 0.003);
+    BOOST_CHECK(fabs(products->doubles["digest__quant05000"] - 1.0) < 0.003);
+    BOOST_CHECK(fabs(products->doubles["digest__quant08400"] - products->doubles["digest__quant01600"] - 0.02) < 0.004);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 
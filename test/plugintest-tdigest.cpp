@@ -0,0 +1,108 @@
+#include "plugins/tdigest.hpp"
+#include "interface/random.hpp"
+#include "interface/exception.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <vector>
+
+using namespace theta;
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(tdigest_tests)
+
+namespace{
+
+// the empirical cumulative distribution of the sorted values at x
+double ecdf(const vector<double> & sorted, double x){
+    return static_cast<double>(upper_bound(sorted.begin(), sorted.end(), x) - sorted.begin()) / sorted.size();
+}
+
+}
+
+// compare the quantiles of a gaussian sample with the exact quantiles of the sample, in terms of the quantile level
+BOOST_AUTO_TEST_CASE(gauss){
+    Random rnd(new RandomSourceTaus());
+    TDigest digest(100.0);
+    const size_t n = 200000;
+    vector<double> values(n);
+    for(size_t i=0; i<n; ++i){
+        values[i] = rnd.gauss();
+        digest.add(values[i]);
+    }
+    BOOST_CHECK_EQUAL(digest.get_weight(), static_cast<double>(n));
+    sort(values.begin(), values.end());
+    const double qs[] = {0.001, 0.01, 0.05, 0.16, 0.5, 0.84, 0.95, 0.99, 0.999};
+    for(size_t i=0; i<sizeof(qs) / sizeof(double); ++i){
+        const double q = qs[i];
+        const double level = ecdf(values, digest.quantile(q));
+        // the error is below 1 / compression around the median and much smaller in the tails:
+        const double tolerance = q * (1 - q) < 0.01 ? 0.001 : 0.005;
+        BOOST_CHECK_MESSAGE(fabs(level - q) < tolerance, "quantile " << q << " has level " << level);
+    }
+    BOOST_CHECK_EQUAL(digest.quantile(0.0), values[0]);
+    BOOST_CHECK_EQUAL(digest.quantile(1.0), values[n-1]);
+}
+
+// uniform values 0, 1, ..., n-1 in random order: the quantile q is q * (n-1)
+BOOST_AUTO_TEST_CASE(uniform){
+    Random rnd(new RandomSourceTaus());
+    const size_t n = 100000;
+    vector<double> values(n);
+    for(size_t i=0; i<n; ++i){
+        values[i] = i;
+    }
+    for(size_t i=n-1; i>0; --i){
+        swap(values[i], values[static_cast<size_t>(rnd.uniform() * i)]);
+    }
+    TDigest digest(200.0);
+    for(size_t i=0; i<n; ++i){
+        digest.add(values[i]);
+    }
+    for(double q = 0.05; q < 1.0; q += 0.05){
+        BOOST_CHECK_MESSAGE(fabs(digest.quantile(q) / (n - 1) - q) < 0.005, "quantile " << q << " is " << digest.quantile(q));
+    }
+}
+
+// adding a value with weight w is the same as adding it w times
+BOOST_AUTO_TEST_CASE(weights){
+    Random rnd(new RandomSourceTaus());
+    TDigest digest(100.0);
+    vector<double> values;
+    for(size_t i=0; i<20000; ++i){
+        const double x = rnd.uniform();
+        const size_t w = 1 + i % 5;
+        digest.add(x, w);
+        values.insert(values.end(), w, x);
+    }
+    BOOST_CHECK_EQUAL(digest.get_weight(), static_cast<double>(values.size()));
+    sort(values.begin(), values.end());
+    for(double q = 0.1; q < 1.0; q += 0.1){
+        BOOST_CHECK(fabs(ecdf(values, digest.quantile(q)) - q) < 0.005);
+    }
+    digest.reset();
+    BOOST_CHECK_EQUAL(digest.get_weight(), 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(invalid){
+    bool exception = false;
+    try{
+        TDigest digest(0.0);
+    }
+    catch(InvalidArgumentException &){
+        exception = true;
+    }
+    BOOST_CHECK(exception);
+    exception = false;
+    TDigest digest;
+    try{
+        digest.quantile(0.5);
+    }
+    catch(InvalidArgumentException &){
+        exception = true;
+    }
+    BOOST_CHECK(exception);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,152 @@
+#include "plugins/warm_start.hpp"
+#include "interface/plugin.hpp"
+#include "interface/phys.hpp"
+#include "interface/minimizer.hpp"
+#include "interface/exception.hpp"
+
+#include "test/utils.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace theta;
+using namespace theta::plugin;
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(warm_start_tests)
+
+namespace{
+
+// nll of a gaussian in p0 with mean mu and width 1, and in p1 with mean 2 and width 0.5
+class ShiftedGauss: public Function{
+public:
+    ShiftedGauss(const ParId & p0_, const ParId & p1_): mu(0.0), p0(p0_), p1(p1_){
+        par_ids.insert(p0);
+        par_ids.insert(p1);
+    }
+
+    virtual double operator()(const ParValues & v) const{
+        double x = v.get(p0), y = v.get(p1);
+        return 0.5 * (x - mu) * (x - mu) + 2 * (y - 2) * (y - 2);
+    }
+
+    double mu;
+private:
+    ParId p0, p1;
+};
+
+// delegates to another minimizer, but fails if the start values differ from the cold start
+class ColdOnlyMinimizer: public Minimizer{
+public:
+    ColdOnlyMinimizer(const Configuration & cfg, Minimizer & m_, const ParValues & cold_start_): Minimizer(cfg), m(m_), cold_start(cold_start_){}
+
+    virtual MinimizationResult minimize(const Function & f, const ParValues & start,
+                const ParValues & step, const map<ParId, pair<double, double> > & ranges){
+        const ParIds & pars = f.getParameters();
+        for(ParIds::const_iterator it=pars.begin(); it!=pars.end(); ++it){
+            if(start.get(*it) != cold_start.get(*it)) throw MinimizationException("not the cold start");
+        }
+        return m.minimize(f, start, step, ranges);
+    }
+
+private:
+    Minimizer & m;
+    ParValues cold_start;
+};
+
+}
+
+// the minimum found from a warm start must agree with the one from the cold start
+BOOST_AUTO_TEST_CASE(warm_vs_cold){
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    ParId p0 = vm->createParId("p0");
+    ParId p1 = vm->createParId("p1");
+    ConfigCreator cc("type = \"lbfgs_minimizer\"; tolerance = 1e-8;", vm);
+    std::auto_ptr<Minimizer> min = PluginManager<Minimizer>::instance().build(cc.get());
+    BOOST_REQUIRE(min.get());
+    const double inf = numeric_limits<double>::infinity();
+    ParValues start, step;
+    map<ParId, pair<double, double> > ranges;
+    start.set(p0, 0.0).set(p1, 0.0);
+    step.set(p0, 1.0).set(p1, 1.0);
+    ranges[p0] = make_pair(-inf, inf);
+    ranges[p1] = make_pair(-inf, inf);
+    const char * policies[] = {"mean", "last", "covariance-step"};
+    const int expected_start[] = {WarmStart::mean, WarmStart::last, WarmStart::covariance_step};
+    for(int k=0; k<3; ++k){
+        ConfigCreator cc_ws(string("warm-start = \"") + policies[k] + "\";", vm);
+        WarmStart ws(cc_ws.get().setting);
+        BOOST_CHECK(ws.enabled());
+        ShiftedGauss f(p0, p1);
+        for(int i=0; i<5; ++i){
+            f.mu = 0.3 * i;
+            MinimizationResult res_warm = ws.minimize(*min, f, start, step, ranges);
+            BOOST_CHECK_EQUAL(ws.get_used_start(), i == 0 ? static_cast<int>(WarmStart::cold) : expected_start[k]);
+            MinimizationResult res_cold = min->minimize(f, start, step, ranges);
+            BOOST_CHECK(fabs(res_warm.values.get(p0) - res_cold.values.get(p0)) < 1e-4);
+            BOOST_CHECK(fabs(res_warm.values.get(p1) - res_cold.values.get(p1)) < 1e-4);
+            BOOST_CHECK(fabs(res_warm.fval - res_cold.fval) < 1e-6);
+        }
+    }
+    // "none" (the default) always uses the cold start:
+    ConfigCreator cc_none("", vm);
+    WarmStart ws(cc_none.get().setting);
+    BOOST_CHECK(!ws.enabled());
+    ShiftedGauss f(p0, p1);
+    ws.minimize(*min, f, start, step, ranges);
+    ws.minimize(*min, f, start, step, ranges);
+    BOOST_CHECK_EQUAL(ws.get_used_start(), static_cast<int>(WarmStart::cold));
+}
+
+// if the minimization from the warm start fails, the cold start is used
+BOOST_AUTO_TEST_CASE(fallback){
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    ParId p0 = vm->createParId("p0");
+    ParId p1 = vm->createParId("p1");
+    ConfigCreator cc("type = \"lbfgs_minimizer\"; tolerance = 1e-8;", vm);
+    std::auto_ptr<Minimizer> min = PluginManager<Minimizer>::instance().build(cc.get());
+    BOOST_REQUIRE(min.get());
+    const double inf = numeric_limits<double>::infinity();
+    ParValues start, step;
+    map<ParId, pair<double, double> > ranges;
+    start.set(p0, 0.0).set(p1, 0.0);
+    step.set(p0, 1.0).set(p1, 1.0);
+    ranges[p0] = make_pair(-inf, inf);
+    ranges[p1] = make_pair(-inf, inf);
+    ColdOnlyMinimizer cold_only(cc.get(), *min, start);
+    ConfigCreator cc_ws("warm-start = \"last\";", vm);
+    WarmStart ws(cc_ws.get().setting);
+    ShiftedGauss f(p0, p1);
+    f.mu = 1.0;
+    ws.minimize(cold_only, f, start, step, ranges);
+    BOOST_CHECK_EQUAL(ws.get_used_start(), static_cast<int>(WarmStart::cold));
+    MinimizationResult res = ws.minimize(cold_only, f, start, step, ranges);
+    BOOST_CHECK_EQUAL(ws.get_used_start(), -static_cast<int>(WarmStart::last));
+    BOOST_CHECK(fabs(res.values.get(p0) - 1.0) < 1e-4);
+    BOOST_CHECK(fabs(res.values.get(p1) - 2.0) < 1e-4);
+
+    // a failure from the cold start is not caught:
+    ColdOnlyMinimizer never(cc.get(), *min, ParValues().set(p0, 1.0).set(p1, 1.0));
+    bool exception = false;
+    try{
+        ws.minimize(never, f, start, step, ranges);
+    }
+    catch(MinimizationException &){
+        exception = true;
+    }
+    BOOST_CHECK(exception);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_policy){
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    ConfigCreator cc("warm-start = \"first\";", vm);
+    bool exception = false;
+    try{
+        WarmStart ws(cc.get().setting);
+    }
+    catch(ConfigurationException &){
+        exception = true;
+    }
+    BOOST_CHECK(exception);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
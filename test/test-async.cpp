@@ -0,0 +1,144 @@
+#include "interface/plugin.hpp"
+#include "interface/database.hpp"
+#include "interface/histogram.hpp"
+#include "interface/variables.hpp"
+
+#include "test/utils.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <sqlite3.h>
+#include <stdexcept>
+
+using namespace std;
+using namespace theta;
+using namespace theta::plugin;
+
+//a database whose tables cannot be created, to test the error handling of the writer thread:
+class throwing_database: public Database{
+public:
+    throwing_database(const Configuration & cfg){}
+    virtual std::auto_ptr<Table> create_table(const string & table_name){
+        throw std::runtime_error("create_table failed");
+    }
+};
+
+REGISTER_PLUGIN(throwing_database)
+
+BOOST_AUTO_TEST_SUITE(async)
+
+namespace{
+    //returns the result of the sql query on filename, which must return one integer or double
+    double query(const string & filename, const string & sql){
+        sqlite3 * db = 0;
+        BOOST_REQUIRE(sqlite3_open(filename.c_str(), &db) == SQLITE_OK);
+        sqlite3_stmt * st = 0;
+        BOOST_REQUIRE(sqlite3_prepare_v2(db, sql.c_str(), -1, &st, 0) == SQLITE_OK);
+        BOOST_REQUIRE(sqlite3_step(st) == SQLITE_ROW);
+        double result = sqlite3_column_double(st, 0);
+        sqlite3_finalize(st);
+        sqlite3_close(db);
+        return result;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sqlite){
+   load_core_plugins();
+   boost::shared_ptr<VarIdManager> vm(new VarIdManager());
+   //the small queue forces add_row to wait for the writer thread:
+   ConfigCreator cc("type = \"async_database\"; queue_size = 3; statistics_table = \"stats\"; "
+                    "database = { type = \"sqlite_database\"; filename = \"test_async.db\"; batch_size = 5; };", vm);
+   boost::shared_ptr<Database> db;
+   db = PluginManager<Database>::instance().build(cc.get());
+   std::auto_ptr<Table> table = db->create_table("t");
+   table->set_autoinc_column("id");
+   std::auto_ptr<Column> c_d = table->add_column("d", theta::typeDouble);
+   std::auto_ptr<Column> c_i = table->add_column("i", theta::typeInt);
+   std::auto_ptr<Column> c_s = table->add_column("s", theta::typeString);
+   std::auto_ptr<Column> c_h = table->add_column("h", theta::typeHisto);
+   std::auto_ptr<Table> log = db->create_table("log");
+   std::auto_ptr<Column> c_message = log->add_column("message", theta::typeString);
+   const int n = 1000;
+   for(int k=0; k<n; ++k){
+       table->set_column(*c_d, 0.5 * k);
+       //rows of the other table in between must not affect the current row of t:
+       if(k % 10 == 0){
+           log->set_column(*c_message, "message");
+           log->add_row();
+       }
+       table->set_column(*c_i, k);
+       //leave s unset for odd rows; it must be NULL:
+       if(k % 2 == 0) table->set_column(*c_s, "row");
+       Histogram h(k % 3 + 1, 0.0, 1.0);
+       h.set(1, k);
+       table->set_column(*c_h, h);
+       int id = table->add_row();
+       BOOST_CHECK_EQUAL(id, k + 1);
+   }
+   BOOST_CHECK_THROW(table->add_column("late", theta::typeDouble), FatalException);
+   std::auto_ptr<Table> empty_table = db->create_table("empty");
+   std::auto_ptr<Column> c_e = empty_table->add_column("e", theta::typeDouble);
+   empty_table.reset();
+   log.reset();
+   table.reset();
+   db.reset();
+   BOOST_CHECK_EQUAL(query("test_async.db", "select count(*) from t;"), n);
+   BOOST_CHECK_EQUAL(query("test_async.db", "select sum(id) from t;"), n * (n + 1) / 2);
+   BOOST_CHECK_EQUAL(query("test_async.db", "select sum(i) from t where d = 0.5 * i;"), n * (n - 1) / 2);
+   BOOST_CHECK_EQUAL(query("test_async.db", "select count(*) from t where s is null;"), n / 2);
+   BOOST_CHECK_EQUAL(query("test_async.db", "select count(*) from t where length(h) = (i % 3 + 5) * 8;"), n);
+   BOOST_CHECK_EQUAL(query("test_async.db", "select count(*) from log;"), n / 10);
+   BOOST_CHECK_EQUAL(query("test_async.db", "select count(*) from empty;"), 0);
+   BOOST_CHECK_EQUAL(query("test_async.db", "select rows from stats;"), n + n / 10);
+   BOOST_CHECK_EQUAL(query("test_async.db", "select max_queued from stats;"), 4);
+   BOOST_CHECK(query("test_async.db", "select latency_max >= latency_mean and latency_mean > 0 from stats;") == 1);
+   boost::filesystem::remove("test_async.db");
+}
+
+BOOST_AUTO_TEST_CASE(writer_error){
+   load_core_plugins();
+   boost::shared_ptr<VarIdManager> vm(new VarIdManager());
+   ConfigCreator cc("type = \"async_database\"; database = { type = \"sqlite_database\"; filename = \"test_async_error.db\"; };", vm);
+   boost::shared_ptr<Database> db;
+   db = PluginManager<Database>::instance().build(cc.get());
+   std::auto_ptr<Table> table = db->create_table("t");
+   //the duplicate column name is detected by sqlite in the writer thread, so it is reported by a later add_row:
+   std::auto_ptr<Column> c1 = table->add_column("a", theta::typeDouble);
+   std::auto_ptr<Column> c2 = table->add_column("a", theta::typeDouble);
+   bool thrown = false;
+   for(int k=0; k<10000 && !thrown; ++k){
+       try{
+           table->add_row();
+       }
+       catch(DatabaseException &){
+           thrown = true;
+       }
+   }
+   BOOST_CHECK(thrown);
+   table.reset();
+   db.reset();
+   boost::filesystem::remove("test_async_error.db");
+   //exceptions not derived from theta::Exception are reported as well:
+   ConfigCreator cc_throw("type = \"async_database\"; database = { type = \"throwing_database\"; };", vm);
+   db = PluginManager<Database>::instance().build(cc_throw.get());
+   table = db->create_table("t");
+   c1 = table->add_column("a", theta::typeDouble);
+   thrown = false;
+   for(int k=0; k<10000 && !thrown; ++k){
+       try{
+           table->add_row();
+       }
+       catch(DatabaseException & ex){
+           thrown = true;
+           BOOST_CHECK(ex.message.find("create_table failed") != string::npos);
+       }
+   }
+   BOOST_CHECK(thrown);
+   table.reset();
+   db.reset();
+   ConfigCreator cc2("type = \"async_database\"; queue_size = 0; database = { type = \"blackhole_database\"; };", vm);
+   BOOST_CHECK_THROW(PluginManager<Database>::instance().build(cc2.get()), ConfigurationException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
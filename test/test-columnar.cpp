@@ -0,0 +1,111 @@
+#include "interface/plugin.hpp"
+#include "interface/database.hpp"
+#include "interface/histogram.hpp"
+#include "interface/variables.hpp"
+
+#include "test/utils.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <cmath>
+
+using namespace std;
+using namespace theta;
+using namespace theta::plugin;
+
+BOOST_AUTO_TEST_SUITE(columnar)
+
+namespace{
+    // write n rows into table "products" of filename, starting at row first. The chunk size
+    // is not a divisor of n, to test the last, partial chunk.
+    void write_file(const string & filename, int first, int n){
+        boost::shared_ptr<VarIdManager> vm(new VarIdManager());
+        ConfigCreator cc("type = \"columnar_database\"; filename = \"" + filename + "\"; chunk_size = 7; products_data = (\"d\", \"i\", \"s\", \"h\");", vm);
+        boost::shared_ptr<Database> db;
+        db = PluginManager<Database>::instance().build(cc.get());
+        std::auto_ptr<Table> table = db->create_table("products");
+        std::auto_ptr<Column> c_d = table->add_column("d", theta::typeDouble);
+        std::auto_ptr<Column> c_i = table->add_column("i", theta::typeInt);
+        std::auto_ptr<Column> c_s = table->add_column("s", theta::typeString);
+        std::auto_ptr<Column> c_h = table->add_column("h", theta::typeHisto);
+        std::auto_ptr<Column> c_x = table->add_column("x", theta::typeDouble); // not saved because of products_data
+        std::auto_ptr<Table> log_table = db->create_table("log");
+        log_table->set_autoinc_column("id");
+        std::auto_ptr<Column> c_m = log_table->add_column("message", theta::typeString);
+        Histogram h(3, 0.0, 3.0);
+        for(int k=first; k<first + n; ++k){
+            table->set_column(*c_d, 0.5 * k);
+            table->set_column(*c_i, k);
+            //leave s unset for odd rows and h for the first 10 rows, i.e., for the whole first chunk:
+            if(k % 2 == 0) table->set_column(*c_s, string(k, 'a'));
+            h.set(2, k);
+            if(k >= 10) table->set_column(*c_h, h);
+            table->set_column(*c_x, 1.0);
+            table->add_row();
+            log_table->set_column(*c_m, "message");
+            BOOST_CHECK_EQUAL(log_table->add_row(), k - first + 1);
+        }
+        std::auto_ptr<Table> empty_table = db->create_table("empty");
+        std::auto_ptr<Column> c_e = empty_table->add_column("e", theta::typeDouble);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(roundtrip){
+    load_core_plugins();
+    write_file("test_columnar1.thc", 0, 30);
+    write_file("test_columnar2.thc", 30, 5);
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager());
+    ConfigCreator cc("type = \"columnar_database_in\"; filenames = (\"test_columnar1.thc\", \"test_columnar2.thc\");", vm);
+    std::auto_ptr<DatabaseInput> db = PluginManager<DatabaseInput>::instance().build(cc.get());
+    vector<string> columns;
+    columns.push_back("h");
+    columns.push_back("s");
+    columns.push_back("i");
+    columns.push_back("d");
+    std::auto_ptr<DatabaseInput::ResultIterator> it = db->query("products", columns);
+    int k = 0;
+    for(; it->has_data(); ++(*it), ++k){
+        BOOST_CHECK_EQUAL(it->get_double(3), 0.5 * k);
+        BOOST_CHECK_EQUAL(it->get_int(2), k);
+        if(k % 2 == 0){
+            BOOST_CHECK_EQUAL(it->get_string(1), string(k, 'a'));
+        }
+        else{
+            BOOST_CHECK_THROW(it->get_string(1), DatabaseException);
+        }
+        if(k >= 10){
+            Histogram h = it->get_histogram(0);
+            BOOST_CHECK_EQUAL(h.get_nbins(), 3);
+            BOOST_CHECK_EQUAL(h.get_xmax(), 3.0);
+            BOOST_CHECK_EQUAL(h.get(2), k);
+            BOOST_CHECK_EQUAL(h.get_sum_of_bincontents(), k);
+        }
+        else{
+            BOOST_CHECK_THROW(it->get_histogram(0), DatabaseException);
+        }
+        BOOST_CHECK_THROW(it->get_int(3), DatabaseException);
+    }
+    BOOST_CHECK_EQUAL(k, 35);
+    columns.clear();
+    columns.push_back("id");
+    it = db->query("log", columns);
+    k = 0;
+    for(; it->has_data(); ++(*it), ++k){
+        BOOST_CHECK_EQUAL(it->get_int(0), k < 30 ? k + 1 : k - 29);
+    }
+    BOOST_CHECK_EQUAL(k, 35);
+    columns.clear();
+    columns.push_back("e");
+    it = db->query("empty", columns);
+    BOOST_CHECK(!it->has_data());
+    columns.push_back("x");
+    BOOST_CHECK_THROW(db->query("products", columns), DatabaseException);
+    BOOST_CHECK_THROW(db->query("none", columns), DatabaseException);
+    it.reset();
+    db.reset();
+    boost::filesystem::remove("test_columnar1.thc");
+    boost::filesystem::remove("test_columnar2.thc");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
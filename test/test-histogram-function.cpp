@@ -188,4 +188,61 @@ BOOST_AUTO_TEST_CASE(cubiclinear_histomorph){
     BOOST_ASSERT(fabs(der - (0.12 + 0.17)/2) < 1e-8);
 }
 
+//compare HistogramFunction::gradient to finite differences for the morphing plugins:
+BOOST_AUTO_TEST_CASE(histomorph_gradients){
+    load_core_plugins();
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    const size_t nbins = 10;
+    ParId delta1 = vm->createParId("delta1");
+    ParId delta2 = vm->createParId("delta2");
+    vm->createObsId("obs", nbins, -1, 1);
+    ConfigCreator cc("h0 = {type = \"fixed_gauss\"; observable=\"obs\"; width = 0.5; mean = 0.0; normalize_to = 1.0;};\n"
+            "h1p = {type = \"fixed_gauss\"; observable=\"obs\"; width = 0.6; mean = 0.1; normalize_to = 1.1;};\n"
+            "h1m = {type = \"fixed_gauss\"; observable=\"obs\"; width = 0.45; mean = -0.1; normalize_to = 0.93;};\n"
+            "h2p = {type = \"fixed_poly\"; observable=\"obs\"; coefficients = [1.0, 0.3]; normalize_to = 1.2;};\n"
+            "h2m = {type = \"fixed_poly\"; observable=\"obs\"; coefficients = [1.0, -0.2]; normalize_to = 0.9;};\n"
+            "interpolating = { type = \"interpolating_histo\"; parameters = (\"delta1\", \"delta2\"); nominal-histogram = \"@h0\";\n"
+            "      delta1-plus-histogram = \"@h1p\"; delta1-minus-histogram = \"@h1m\";\n"
+            "      delta2-plus-histogram = \"@h2p\"; delta2-minus-histogram = \"@h2m\";\n"
+            "};\n"
+            "cubiclinear = { type = \"cubiclinear_histomorph\"; parameters = (\"delta1\", \"delta2\"); nominal-histogram = \"@h0\";\n"
+            "      delta1-plus-histogram = \"@h1p\"; delta1-minus-histogram = \"@h1m\";\n"
+            "      delta2-plus-histogram = \"@h2p\"; delta2-minus-histogram = \"@h2m\";\n"
+            "};\n"
+            "linear = { type = \"linear_histo_morph\"; parameters = (\"delta1\", \"delta2\"); nominal-histogram = \"@h0\";\n"
+            "      nominal-expectation = 100.0;\n"
+            "      delta1-kappa-plus-histogram = \"@h2p\"; delta1-kappa-minus-histogram = \"@h2m\";\n"
+            "      delta1-plus-relexp = 0.1; delta1-minus-relexp = -0.05;\n"
+            "      delta2-plus-relexp = 0.2; delta2-minus-relexp = -0.15;\n"
+            "};\n"
+            , vm);
+    const theta::plugin::Configuration & cfg = cc.get();
+    const char * names[] = {"interpolating", "cubiclinear", "linear"};
+    const double points[][2] = {{0.3, -0.4}, {-0.8, 0.6}, {1.7, -1.3}, {-2.1, 0.05}};
+    const double eps = 1e-6;
+    for(size_t ih=0; ih<3; ++ih){
+        std::auto_ptr<HistogramFunction> hf = PluginManager<HistogramFunction>::instance().build(Configuration(cfg, cfg.setting[names[ih]]));
+        BOOST_REQUIRE(hf->provides_derivatives());
+        for(size_t ip=0; ip<4; ++ip){
+            ParValues values;
+            values.set(delta1, points[ip][0]).set(delta2, points[ip][1]);
+            for(int ipar=0; ipar<2; ++ipar){
+                ParId pid = ipar==0 ? delta1 : delta2;
+                Histogram grad = hf->gradient(values, pid);
+                ParValues v2;
+                v2.set(values);
+                v2.set(pid, values.get(pid) + eps);
+                Histogram h_plus = (*hf)(v2);
+                v2.set(pid, values.get(pid) - eps);
+                Histogram h_minus = (*hf)(v2);
+                double scale = h_plus.get_sum_of_bincontents();
+                for(size_t i=1; i<=nbins; ++i){
+                    double num_der = (h_plus.get(i) - h_minus.get(i)) / (2 * eps);
+                    BOOST_CHECK(fabs(num_der - grad.get(i)) < 1e-6 * scale);
+                }
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,9 @@
 #include "interface/utils.hpp"
 #include "interface/random.hpp"
 #include "interface/exception.hpp"
+#include "interface/plugin.hpp"
+#include "interface/model.hpp"
+#include "test/utils.hpp"
 
 
 #include <boost/test/unit_test.hpp>
@@ -219,4 +222,149 @@ BOOST_AUTO_TEST_CASE(test_reset){
    BOOST_CHECK(exception);
 }
 
+BOOST_AUTO_TEST_CASE(test_swap_view){
+   const size_t nbins = 11;
+   Histogram a(nbins, 0.0, 1.0), b(3, -1.0, 2.0);
+   for(size_t i=0; i<=nbins+1; i++){
+       a.set(i, 0.5*i + 1);
+   }
+   b.set(2, 3.0);
+   Histogram a0 = a, b0 = b;
+   const double * a_data = a.getData();
+   a.swap(b);
+   check_histos_equal(a, b0);
+   check_histos_equal(b, a0);
+   BOOST_CHECK(b.getData() == a_data);
+   std::swap(a, b);
+   check_histos_equal(a, a0);
+
+   //assign_with_coeff with the same and with a different binning:
+   b.assign_with_coeff(2.0, a);
+   Histogram expected = a;
+   expected *= 2.0;
+   check_histos_equal(b, expected);
+   Histogram c(nbins, 0.0, 1.0);
+   const double * c_data = c.getData();
+   c.assign_with_coeff(-3.0, HistogramView(a.getData(), nbins, 0.0, 1.0));
+   BOOST_CHECK(c.getData() == c_data);
+   for(size_t i=0; i<=nbins+1; i++){
+       BOOST_CHECK(c.get(i) == -3.0 * a.get(i));
+   }
+   Histogram d((HistogramView(a)));
+   check_histos_equal(d, a);
+#if __cplusplus >= 201103L
+   const double * d_data = d.getData();
+   Histogram e(std::move(d));
+   BOOST_CHECK(e.getData() == d_data);
+   check_histos_equal(e, a);
+   d = b0;
+   check_histos_equal(d, b0);
+   d = std::move(e);
+   BOOST_CHECK(d.getData() == d_data);
+#endif
+
+   //Data growth keeps the histogram contents:
+   VarIdManager vm;
+   ObsId o0 = vm.createObsId("o0", nbins, 0.0, 1.0);
+   ObsId o1 = vm.createObsId("o1", nbins, 0.0, 1.0);
+   Data data;
+   data[o0] = a;
+   data[o1] = b0;
+   check_histos_equal(data[o0], a);
+   Data data2;
+   data2.swap(data);
+   check_histos_equal(data2[o0], a);
+   BOOST_CHECK(data.getObservables().size()==0);
+}
+
+// with a HistodataPoolGuard, histogram data is cached per thread: after a warm-up, creating, copying and destroying
+// Histograms and Data of the same sizes does not allocate memory
+BOOST_AUTO_TEST_CASE(test_alloc_pool){
+    VarIdManager vm;
+    ObsId obs = vm.createObsId("obs", 1, 0, 1);
+    int n_allocs0, n_frees0, n_allocs1, n_frees1;
+    //without a guard, the cache is not used:
+    get_allocs_frees(n_allocs0, n_frees0);
+    for(int k=0; k<2; ++k){
+        Histogram h(10, 0, 1);
+    }
+    get_allocs_frees(n_allocs1, n_frees1);
+    BOOST_CHECK_EQUAL(n_allocs1 - n_allocs0, 2);
+    BOOST_CHECK_EQUAL(n_frees1 - n_frees0, 2);
+    HistodataPoolGuard pool_guard;
+    for(int k=0; k<3; ++k){
+        if(k==2) get_allocs_frees(n_allocs0, n_frees0);
+        for(size_t nbins=1; nbins < 300; nbins += 7){
+            Histogram h(nbins, 0, 1);
+            h.set(1, 2.0);
+            Histogram h2(h);
+            BOOST_CHECK(h2.get(1) == 2.0);
+            Histogram h3;
+            h3 = h2;
+            h3.reset(nbins + 1, 0, 1);
+            Data d;
+            d[obs] = h;
+        }
+    }
+    get_allocs_frees(n_allocs1, n_frees1);
+    BOOST_CHECK_EQUAL(n_allocs1 - n_allocs0, 0);
+    BOOST_CHECK_EQUAL(n_frees1 - n_frees0, 0);
+}
+
+// report the number of memory allocations for histogram data per likelihood evaluation
+BOOST_AUTO_TEST_CASE(test_alloc_nll){
+    load_core_plugins();
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    const size_t nbins = 101;
+    ParId beta1 = vm->createParId("beta1");
+    ParId delta = vm->createParId("delta");
+    vm->createObsId("obs0", nbins, -1, 1);
+    ConfigCreator cc("flat-histo = {type = \"fixed_poly\"; observable=\"obs0\"; coefficients = [1.0]; normalize_to = 1000.0;};\n"
+            "gauss-histo = {type = \"fixed_gauss\"; observable=\"obs0\"; width = 0.5; mean = 0.5; normalize_to = 100.0;};\n"
+            "gauss-histo-plus = {type = \"fixed_gauss\"; observable=\"obs0\"; width = 0.5; mean = 0.6; normalize_to = 100.0;};\n"
+            "gauss-histo-minus = {type = \"fixed_gauss\"; observable=\"obs0\"; width = 0.5; mean = 0.4; normalize_to = 100.0;};\n"
+            "morph = { type = \"cubiclinear_histomorph\"; parameters = (\"delta\"); nominal-histogram = \"@gauss-histo\";\n"
+            "      delta-plus-histogram = \"@gauss-histo-plus\"; delta-minus-histogram = \"@gauss-histo-minus\";\n"
+            "};\n"
+            "c1 = {type = \"mult\"; parameters=(\"beta1\");};\n"
+            "dist = {\n"
+            "       type = \"flat_distribution\";\n"
+            "       beta1 = { range = (\"-inf\", \"inf\"); fix-sample-value = 1.0; }; \n"
+            "       delta = { range = (\"-inf\", \"inf\"); fix-sample-value = 0.0; };\n"
+            " };\n"
+            "m = {\n"
+            "  obs0 = {\n"
+            "       signal = { coefficient-function = \"@c1\"; histogram = \"@morph\"; };\n"
+            "       background = { coefficient-function = \"@c1\"; histogram = \"@flat-histo\"; };\n"
+            "   };\n"
+            "  parameter-distribution = \"@dist\";\n"
+            "};\n"
+            , vm);
+    const theta::plugin::Configuration & cfg = cc.get();
+    std::auto_ptr<Model> m = plugin::PluginManager<Model>::instance().build(plugin::Configuration(cfg, cfg.setting["m"]));
+    ParValues values;
+    values.set(beta1, 1.0);
+    values.set(delta, 0.0);
+    Data data;
+    m->get_prediction(data, values);
+    std::auto_ptr<NLLikelihood> nll = m->getNLLikelihood(data);
+    //as in the event loop of a Run:
+    HistodataPoolGuard pool_guard;
+    const int n_eval = 1000;
+    int n_allocs0, n_frees0, n_allocs1, n_frees1;
+    for(int k=0; k<2; ++k){
+        if(k==1) get_allocs_frees(n_allocs0, n_frees0);
+        for(int i=0; i<n_eval; ++i){
+            values.set(beta1, 1.0 + 0.001 * i);
+            values.set(delta, -1.0 + 0.002 * i);
+            (*nll)(values);
+        }
+    }
+    get_allocs_frees(n_allocs1, n_frees1);
+    double allocs_per_eval = static_cast<double>(n_allocs1 - n_allocs0) / n_eval;
+    std::cout << "histogram allocations per likelihood evaluation: " << allocs_per_eval << std::endl;
+    BOOST_CHECK_EQUAL(n_allocs1 - n_allocs0, 0);
+    BOOST_CHECK_EQUAL(n_frees1 - n_frees0, 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
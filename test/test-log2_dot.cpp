@@ -1,11 +1,14 @@
 #include <boost/test/unit_test.hpp>
+#include <boost/timer.hpp>
 #include <iostream>
+#include <vector>
 
 #include <stdint.h>
 #include <math.h>
 
 #include "interface/log2_dot.hpp"
 #include "interface/utils.hpp"
+#include "interface/random.hpp"
 
 using namespace std;
 using namespace theta;
@@ -56,5 +59,97 @@ BOOST_AUTO_TEST_CASE(tl){
     BOOST_CHECK(utils::close_to_relative(ref, res));
 }
 
+//compare all simd implementations to the reference, for all sizes up to 40 (to cover all the tail handling)
+// and for random data including zero predictions and zero data:
+BOOST_AUTO_TEST_CASE(tl_simd){
+    Random rnd(new RandomSourceTaus());
+    const unsigned int nmax = 40;
+    std::vector<double> data(nmax), pred(nmax);
+    for(int level=log2_dot_nosimd; level <= log2_dot_simd_support(); ++level){
+        for(unsigned int n=0; n<=nmax; ++n){
+            for(unsigned int i=0; i<n; ++i){
+                pred[i] = rnd.uniform() * 100;
+                data[i] = rnd.poisson(pred[i]);
+                //some special cases:
+                if(i % 7 == 3) pred[i] = data[i] = 0.0;
+                if(i % 11 == 5) data[i] = 0.0;
+                if(i % 13 == 7) pred[i] = 1e-310; //subnormal
+            }
+            double ref = template_nllikelihood_reference(&data[0], &pred[0], n);
+            double res = template_nllikelihood_simd(level, &data[0], &pred[0], n);
+            BOOST_CHECK(fabs(ref - res) <= 1e-12 * std::max(1.0, fabs(ref)));
+            //log2_dot, for pred > 0:
+            for(unsigned int i=0; i<n; ++i){
+                if(pred[i] <= 0.0) pred[i] = 0.5;
+            }
+            double ref2 = 0.0;
+            for(unsigned int i=0; i<n; ++i){
+                ref2 += data[i] * log2(pred[i]);
+            }
+            double res2 = log2_dot_simd(level, &pred[0], &data[0], n);
+            BOOST_CHECK(fabs(ref2 - res2) <= 1e-12 * std::max(1.0, fabs(ref2)));
+            //+inf for data > 0 and pred <= 0, at any position:
+            if(n > 0){
+                pred[n-1] = 0.0;
+                data[n-1] = 1.0;
+                res = template_nllikelihood_simd(level, &data[0], &pred[0], n);
+                BOOST_CHECK(isinf(res) && res > 0);
+                pred[n-1] = -1.0;
+                res = template_nllikelihood_simd(level, &data[0], &pred[0], n);
+                BOOST_CHECK(isinf(res) && res > 0);
+                //data = pred = 0 is skipped:
+                pred[n-1] = data[n-1] = 0.0;
+                ref = template_nllikelihood_reference(&data[0], &pred[0], n);
+                res = template_nllikelihood_simd(level, &data[0], &pred[0], n);
+                BOOST_CHECK(fabs(ref - res) <= 1e-12 * std::max(1.0, fabs(ref)));
+                //negative and NAN data do not contribute to the log term:
+                pred[n-1] = 2.0;
+                data[n-1] = -1.0;
+                ref = template_nllikelihood_reference(&data[0], &pred[0], n);
+                res = template_nllikelihood_simd(level, &data[0], &pred[0], n);
+                BOOST_CHECK(fabs(ref - res) <= 1e-12 * std::max(1.0, fabs(ref)));
+                data[n-1] = std::numeric_limits<double>::quiet_NaN();
+                res = template_nllikelihood_simd(level, &data[0], &pred[0], n);
+                BOOST_CHECK(fabs(ref - res) <= 1e-12 * std::max(1.0, fabs(ref)));
+            }
+        }
+    }
+}
+
+//microbenchmark of the different implementations. It just prints the time per bin
+// and does not check anything. Run with --log2_dot_benchmark
+BOOST_AUTO_TEST_CASE(tl_benchmark){
+    int argc = boost::unit_test::framework::master_test_suite().argc;
+    char ** argv = boost::unit_test::framework::master_test_suite().argv;
+    bool run = false;
+    for(int i=1; i<argc; ++i){
+        if(argv[i] == string("--log2_dot_benchmark")) run = true;
+    }
+    if(!run) return;
+    Random rnd(new RandomSourceTaus());
+    const unsigned int nbins[] = {10, 100, 1000, 10000};
+    const char * names[] = {"default", "avx2", "avx512"};
+    //number of bins to evaluate in total per measurement:
+    const size_t n_total = 5000000;
+    std::vector<double> data(10000), pred(10000);
+    for(size_t i=0; i<data.size(); ++i){
+        pred[i] = rnd.uniform() * 10;
+        data[i] = rnd.poisson(pred[i]);
+    }
+    cout << "template_nllikelihood benchmark [ns per bin]:" << endl;
+    for(size_t j=0; j<sizeof(nbins) / sizeof(unsigned int); ++j){
+        const unsigned int n = nbins[j];
+        cout << "  n = " << n << ":";
+        for(int level=log2_dot_nosimd; level <= log2_dot_simd_support(); ++level){
+            volatile double result = 0.0;
+            boost::timer t;
+            for(size_t k=0; k < n_total / n; ++k){
+                result += template_nllikelihood_simd(level, &data[0], &pred[0], n);
+            }
+            cout << " " << names[level] << "=" << t.elapsed() * 1e9 / n_total;
+        }
+        cout << endl;
+    }
+}
 
 BOOST_AUTO_TEST_SUITE_END()
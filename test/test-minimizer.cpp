@@ -33,7 +33,8 @@ public:
 BOOST_AUTO_TEST_CASE(minuit){
     boost::shared_ptr<VarIdManager> vm(new VarIdManager);
     if(!load_root_plugins()){
-      cout << "In test minuit: root plugin could not be loaded, not executing root tests";
+      cout << "In test minuit: root plugin could not be loaded, not executing root tests" << endl;
+      return;
     }
     
     ParId p0 = vm->createParId("p0");
@@ -68,5 +69,162 @@ BOOST_AUTO_TEST_CASE(minuit){
     BOOST_REQUIRE(exception);
 }
 
+// nll of a two-dimensional gaussian with mean (1, -2) and standard deviations (0.5, 1)
+class GaussFunction: public Function{
+public:
+    GaussFunction(const ParId & p0_, const ParId & p1_, bool derivatives_): p0(p0_), p1(p1_), derivatives(derivatives_){
+        par_ids.insert(p0);
+        par_ids.insert(p1);
+    }
+
+    virtual double operator()(const ParValues & v) const{
+        double x = v.get(p0), y = v.get(p1);
+        return 2 * (x - 1) * (x - 1) + 0.5 * (y + 2) * (y + 2);
+    }
+
+    virtual double eval_withDerivatives(const ParValues & v, ParValues & der) const{
+        double x = v.get(p0), y = v.get(p1);
+        der.set(p0, 4 * (x - 1));
+        der.set(p1, y + 2);
+        return operator()(v);
+    }
+
+    virtual bool provides_derivatives() const{
+        return derivatives;
+    }
+
+private:
+    ParId p0, p1;
+    bool derivatives;
+};
+
+// GaussFunction which throws an Exception once it has been evaluated more than max_calls times
+class ThrowingGaussFunction: public GaussFunction{
+public:
+    ThrowingGaussFunction(const ParId & p0_, const ParId & p1_, int max_calls_): GaussFunction(p0_, p1_, true), max_calls(max_calls_), n_calls(0){}
+
+    virtual double operator()(const ParValues & v) const{
+        count();
+        return GaussFunction::operator()(v);
+    }
+
+    virtual double eval_withDerivatives(const ParValues & v, ParValues & der) const{
+        count();
+        return GaussFunction::eval_withDerivatives(v, der);
+    }
+
+    int max_calls;
+    mutable int n_calls;
+
+private:
+    void count() const{
+        if(++n_calls > max_calls) throw Exception("too many calls");
+    }
+};
+
+BOOST_AUTO_TEST_CASE(lbfgs){
+    load_core_plugins();
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    ParId p0 = vm->createParId("p0");
+    ParId p1 = vm->createParId("p1");
+    ConfigCreator cc("type = \"lbfgs_minimizer\"; tolerance = 1e-8; covariance = true;", vm);
+    std::auto_ptr<Minimizer> min = PluginManager<Minimizer>::instance().build(cc.get());
+    BOOST_REQUIRE(min.get());
+    const double inf = numeric_limits<double>::infinity();
+    for(int analytic=0; analytic < 2; ++analytic){
+        GaussFunction f(p0, p1, analytic);
+        ParValues start, step;
+        std::map<ParId, pair<double, double> > ranges;
+        start.set(p0, 0.0).set(p1, 0.0);
+        step.set(p0, 1.0).set(p1, 1.0);
+        ranges[p0] = make_pair(0.0, inf);
+        ranges[p1] = make_pair(-inf, inf);
+        MinimizationResult res = min->minimize(f, start, step, ranges);
+        BOOST_CHECK(fabs(res.values.get(p0) - 1.0) < 1e-4);
+        BOOST_CHECK(fabs(res.values.get(p1) + 2.0) < 1e-4);
+        BOOST_CHECK(fabs(res.fval) < 1e-8);
+        BOOST_CHECK(fabs(res.errors_plus.get(p0) - 0.5) < 1e-3);
+        BOOST_CHECK(fabs(res.errors_minus.get(p1) - 1.0) < 1e-3);
+        BOOST_CHECK(fabs(res.covariance(0,0) - 0.25) < 1e-3);
+        BOOST_CHECK(fabs(res.covariance(0,1)) < 1e-4);
+        BOOST_CHECK(fabs(res.covariance(1,1) - 1.0) < 1e-3);
+
+        // minimum at the boundary and fixed p1:
+        ranges[p0] = make_pair(1.5, 3.0);
+        step.set(p1, 0.0);
+        res = min->minimize(f, start, step, ranges);
+        BOOST_CHECK(fabs(res.values.get(p0) - 1.5) < 1e-3);
+        BOOST_CHECK(res.values.get(p1) == 0.0);
+        BOOST_CHECK(res.errors_plus.get(p1) == 0.0);
+    }
+    // infinite at start:
+    GaussFunction f(p0, p1, false);
+    ParValues start, step;
+    std::map<ParId, pair<double, double> > ranges;
+    start.set(p0, inf).set(p1, 0.0);
+    step.set(p0, 1.0).set(p1, 1.0);
+    ranges[p0] = make_pair(-inf, inf);
+    ranges[p1] = make_pair(-inf, inf);
+    bool exception = false;
+    try{
+        min->minimize(f, start, step, ranges);
+    }
+    catch(MinimizationException & ex){
+        exception = true;
+    }
+    BOOST_CHECK(exception);
+
+    // a failure while calculating the Hessian is reported as MinimizationException. Count the calls
+    // needed for the minimization without the covariance first:
+    ConfigCreator cc_nocov("type = \"lbfgs_minimizer\"; tolerance = 1e-8;", vm);
+    std::auto_ptr<Minimizer> min_nocov = PluginManager<Minimizer>::instance().build(cc_nocov.get());
+    ThrowingGaussFunction tf(p0, p1, numeric_limits<int>::max());
+    start.set(p0, 0.0);
+    min_nocov->minimize(tf, start, step, ranges);
+    tf.max_calls = tf.n_calls;
+    tf.n_calls = 0;
+    exception = false;
+    try{
+        min->minimize(tf, start, step, ranges);
+    }
+    catch(MinimizationException & ex){
+        exception = true;
+    }
+    BOOST_CHECK(exception);
+    BOOST_CHECK(tf.n_calls > tf.max_calls);
+}
+
+// a re-used minuit instance must give the same result as a newly allocated one:
+BOOST_AUTO_TEST_CASE(minuit_reuse){
+    if(!load_root_plugins()){
+      cout << "In test minuit_reuse: root plugin could not be loaded, not executing root tests" << endl;
+      return;
+    }
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    ParId p0 = vm->createParId("p0");
+    ParId p1 = vm->createParId("p1");
+    ConfigCreator cc_reuse("type = \"root_minuit\"; reuse = true;", vm);
+    ConfigCreator cc_new("type = \"root_minuit\";", vm);
+    std::auto_ptr<Minimizer> min_reuse = PluginManager<Minimizer>::instance().build(cc_reuse.get());
+    std::auto_ptr<Minimizer> min_new = PluginManager<Minimizer>::instance().build(cc_new.get());
+    const double inf = numeric_limits<double>::infinity();
+    GaussFunction f(p0, p1, false);
+    ParValues step;
+    std::map<ParId, pair<double, double> > ranges;
+    step.set(p0, 1.0).set(p1, 1.0);
+    ranges[p0] = make_pair(-inf, inf);
+    ranges[p1] = make_pair(-inf, inf);
+    for(int i=0; i<3; ++i){
+        ParValues start;
+        start.set(p0, 2.0 * i).set(p1, -i);
+        MinimizationResult res_reuse = min_reuse->minimize(f, start, step, ranges);
+        MinimizationResult res_new = min_new->minimize(f, start, step, ranges);
+        BOOST_CHECK(fabs(res_reuse.values.get(p0) - res_new.values.get(p0)) < 1e-3);
+        BOOST_CHECK(fabs(res_reuse.values.get(p1) - res_new.values.get(p1)) < 1e-3);
+        BOOST_CHECK(fabs(res_reuse.errors_plus.get(p0) - res_new.errors_plus.get(p0)) < 1e-3);
+        BOOST_CHECK(fabs(res_reuse.errors_plus.get(p1) - res_new.errors_plus.get(p1)) < 1e-3);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
@@ -4,6 +4,9 @@
 #include "interface/plugin.hpp"
 #include "interface/histogram-function.hpp"
 #include "interface/model.hpp"
+#include "interface/distribution.hpp"
+#include "interface/exception.hpp"
+#include "interface/log2_dot.hpp"
 
 #include "test/utils.hpp"
 
@@ -18,6 +21,38 @@ using namespace std;
 
 BOOST_AUTO_TEST_SUITE(model_tests)
 
+namespace{
+
+// forwards to another distribution, but without derivatives
+class NoDerivativesDistribution: public Distribution{
+public:
+    explicit NoDerivativesDistribution(const Distribution & d_): d(d_){
+        par_ids = d.getParameters();
+    }
+    virtual void sample(ParValues & result, Random & rnd) const{
+        d.sample(result, rnd);
+    }
+    virtual void mode(ParValues & result) const{
+        d.mode(result);
+    }
+    virtual double evalNL(const ParValues & values) const{
+        return d.evalNL(values);
+    }
+    virtual double evalNL_withDerivatives(const ParValues & values, ParValues & derivatives) const{
+        throw FatalException("NoDerivativesDistribution::evalNL_withDerivatives not implemented");
+    }
+    virtual bool provides_derivatives() const{
+        return false;
+    }
+    virtual const std::pair<double, double> & support(const ParId & p) const{
+        return d.support(p);
+    }
+private:
+    const Distribution & d;
+};
+
+}
+
 BOOST_AUTO_TEST_CASE(model0){
     BOOST_CHECKPOINT("model0 entry");
     load_core_plugins();
@@ -142,6 +177,202 @@ BOOST_AUTO_TEST_CASE(model0){
     BOOST_CHECK(nll10 < nll09);
 }
 
+//the likelihood is evaluated in blocks of bins; check the result with an odd number of bins
+// spanning several blocks against the likelihood of the prediction:
+BOOST_AUTO_TEST_CASE(model_nll_blocks){
+    load_core_plugins();
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    const size_t nbins = 1301;
+    ParId beta1 = vm->createParId("beta1");
+    ParId beta2 = vm->createParId("beta2");
+    ObsId obs0 = vm->createObsId("obs0", nbins, -1, 1);
+    ConfigCreator cc("flat-histo = {type = \"fixed_poly\"; observable=\"obs0\"; coefficients = [1.0]; normalize_to = 1000.0;};\n"
+            "gauss-histo = {type = \"fixed_gauss\"; observable=\"obs0\"; width = 0.5; mean = 0.5; normalize_to = 1000.0;};\n"
+            "c1 = {type = \"mult\"; parameters=(\"beta1\");};\n"
+            "c2 = {type = \"mult\"; parameters=(\"beta2\");};\n"
+            "dist-flat = {\n"
+            "       type = \"flat_distribution\";\n"
+            "       beta1 = { range = (\"-inf\", \"inf\"); fix-sample-value = 1.0; }; \n"
+            "       beta2 = { range = (\"-inf\", \"inf\"); fix-sample-value = 1.0; };\n"
+            " };\n"
+            "m = {\n"
+            "  obs0 = {\n"
+            "       signal = { coefficient-function = \"@c1\"; histogram = \"@gauss-histo\"; };\n"
+            "       background = { coefficient-function = \"@c2\"; histogram = \"@flat-histo\"; };\n"
+            "   };\n"
+            "  parameter-distribution = \"@dist-flat\";\n"
+            "};\n"
+            , vm);
+    const theta::plugin::Configuration & cfg = cc.get();
+    std::auto_ptr<Model> m = PluginManager<Model>::instance().build(Configuration(cfg, cfg.setting["m"]));
+    ParValues values;
+    values.set(beta1, 1.2);
+    values.set(beta2, 0.7);
+    Data data;
+    m->get_prediction(data, values);
+    Random rnd(new RandomSourceTaus());
+    for(size_t i=1; i<=nbins; ++i){
+        data[obs0].set(i, rnd.poisson(data[obs0].get(i)));
+    }
+    std::auto_ptr<NLLikelihood> nll = m->getNLLikelihood(data);
+    Data pred;
+    for(int k=0; k<3; ++k){
+        values.set(beta1, 0.5 + k);
+        values.set(beta2, 1.5 - 0.5 * k);
+        m->get_prediction(pred, values);
+        double expected = template_nllikelihood(data[obs0].getData() + 1, pred[obs0].getData() + 1, nbins);
+        double res = (*nll)(values);
+        BOOST_CHECK(utils::close_to(expected, res, 1000.0));
+    }
+    //only some components are re-evaluated if only one parameter changes:
+    for(int k=0; k<6; ++k){
+        if(k % 2) values.set(beta1, 0.8 + 0.1 * k);
+        else values.set(beta2, 1.3 - 0.1 * k);
+        m->get_prediction(pred, values);
+        double expected = template_nllikelihood(data[obs0].getData() + 1, pred[obs0].getData() + 1, nbins);
+        double res = (*nll)(values);
+        BOOST_CHECK(utils::close_to(expected, res, 1000.0));
+    }
+    //zero prediction with non-zero data is +inf:
+    values.set(beta1, 0.0);
+    values.set(beta2, 0.0);
+    double res = (*nll)(values);
+    BOOST_CHECK(std::isinf(res) && res > 0);
+}
 
+//compare the analytical derivatives of the likelihood to finite differences:
+BOOST_AUTO_TEST_CASE(model_nll_derivatives){
+    load_core_plugins();
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    const size_t nbins = 20;
+    ParId beta1 = vm->createParId("beta1");
+    ParId beta2 = vm->createParId("beta2");
+    ParId delta = vm->createParId("delta");
+    vm->createObsId("obs0", nbins, -1, 1);
+    ConfigCreator cc("flat-histo = {type = \"fixed_poly\"; observable=\"obs0\"; coefficients = [1.0]; normalize_to = 100.0;};\n"
+            "gauss-histo = {type = \"fixed_gauss\"; observable=\"obs0\"; width = 0.5; mean = 0.5; normalize_to = 100.0;};\n"
+            "gauss-histo-plus = {type = \"fixed_gauss\"; observable=\"obs0\"; width = 0.5; mean = 0.6; normalize_to = 110.0;};\n"
+            "gauss-histo-minus = {type = \"fixed_gauss\"; observable=\"obs0\"; width = 0.5; mean = 0.4; normalize_to = 95.0;};\n"
+            "signal-histo = { type = \"cubiclinear_histomorph\"; parameters = (\"delta\"); nominal-histogram = \"@gauss-histo\";\n"
+            "      delta-plus-histogram = \"@gauss-histo-plus\"; delta-minus-histogram = \"@gauss-histo-minus\";};\n"
+            "c1 = {type = \"mult\"; parameters=(\"beta1\");};\n"
+            "c2 = {type = \"sys_rate_function\"; factors = (\"beta2\"); sys_rates = ((\"delta\", -0.1, 0.2));};\n"
+            "m = {\n"
+            "  obs0 = {\n"
+            "       signal = { coefficient-function = \"@c1\"; histogram = \"@signal-histo\"; };\n"
+            "       background = { coefficient-function = \"@c2\"; histogram = \"@flat-histo\"; };\n"
+            "   };\n"
+            "  parameter-distribution = {\n"
+            "     type = \"product_distribution\";\n"
+            "     distributions = (\"@dist-flat\", \"@dist-delta\");\n"
+            "  };\n"
+            "};\n"
+            "dist-flat = {\n"
+            "       type = \"flat_distribution\";\n"
+            "       beta1 = { range = (\"-inf\", \"inf\"); fix-sample-value = 1.0; }; \n"
+            "       beta2 = { range = (\"-inf\", \"inf\"); fix-sample-value = 1.0; };\n"
+            " };\n"
+            "dist-delta = {type = \"gauss\"; parameter = \"delta\"; mean = 0.0; width = 1.0; range = (\"-inf\", \"inf\");};\n"
+            , vm);
+    const theta::plugin::Configuration & cfg = cc.get();
+    std::auto_ptr<Model> m = PluginManager<Model>::instance().build(Configuration(cfg, cfg.setting["m"]));
+    ParValues values;
+    values.set(beta1, 1.0).set(beta2, 1.0).set(delta, 0.0);
+    Data data;
+    m->get_prediction(data, values);
+    std::auto_ptr<NLLikelihood> nll = m->getNLLikelihood(data);
+    BOOST_REQUIRE(nll->provides_derivatives());
+    const double points[][3] = {{1.2, 0.9, 0.3}, {0.8, 1.1, -0.6}, {1.0, 1.0, 1.4}};
+    const ParIds & pids = nll->getParameters();
+    const double eps = 1e-6;
+    for(size_t ip=0; ip<3; ++ip){
+        values.set(beta1, points[ip][0]).set(beta2, points[ip][1]).set(delta, points[ip][2]);
+        ParValues der;
+        double value = nll->eval_withDerivatives(values, der);
+        BOOST_CHECK(utils::close_to(value, (*nll)(values), 100.0));
+        for(ParIds::const_iterator it=pids.begin(); it!=pids.end(); ++it){
+            ParValues v2;
+            v2.set(values);
+            v2.set(*it, values.get(*it) + eps);
+            double f_plus = (*nll)(v2);
+            v2.set(*it, values.get(*it) - eps);
+            double f_minus = (*nll)(v2);
+            double num_der = (f_plus - f_minus) / (2 * eps);
+            BOOST_CHECK(fabs(num_der - der.get(*it)) < 1e-4 * max(1.0, fabs(num_der)));
+        }
+    }
+    // the parameter distribution must provide derivatives as well:
+    nll->set_override_distribution(boost::shared_ptr<Distribution>(new NoDerivativesDistribution(m->get_parameter_distribution())));
+    BOOST_CHECK(!nll->provides_derivatives());
+    nll->set_override_distribution(boost::shared_ptr<Distribution>());
+    BOOST_CHECK(nll->provides_derivatives());
+}
+
+//eval_batch must give the same result as evaluating the points one by one, both if only coefficients
+// vary within the batch and if the templates vary:
+BOOST_AUTO_TEST_CASE(model_nll_batch){
+    load_core_plugins();
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    const size_t nbins = 701;
+    ParId beta1 = vm->createParId("beta1");
+    ParId beta2 = vm->createParId("beta2");
+    ParId delta = vm->createParId("delta");
+    vm->createObsId("obs0", nbins, -1, 1);
+    ConfigCreator cc("flat-histo = {type = \"fixed_poly\"; observable=\"obs0\"; coefficients = [1.0]; normalize_to = 1000.0;};\n"
+            "gauss-histo = {type = \"fixed_gauss\"; observable=\"obs0\"; width = 0.5; mean = 0.5; normalize_to = 1000.0;};\n"
+            "gauss-histo-plus = {type = \"fixed_gauss\"; observable=\"obs0\"; width = 0.5; mean = 0.6; normalize_to = 1100.0;};\n"
+            "gauss-histo-minus = {type = \"fixed_gauss\"; observable=\"obs0\"; width = 0.5; mean = 0.4; normalize_to = 950.0;};\n"
+            "signal-histo = { type = \"cubiclinear_histomorph\"; parameters = (\"delta\"); nominal-histogram = \"@gauss-histo\";\n"
+            "      delta-plus-histogram = \"@gauss-histo-plus\"; delta-minus-histogram = \"@gauss-histo-minus\";};\n"
+            "c1 = {type = \"mult\"; parameters=(\"beta1\");};\n"
+            "c2 = {type = \"mult\"; parameters=(\"beta2\");};\n"
+            "m = {\n"
+            "  obs0 = {\n"
+            "       signal = { coefficient-function = \"@c1\"; histogram = \"@signal-histo\"; };\n"
+            "       background = { coefficient-function = \"@c2\"; histogram = \"@flat-histo\"; };\n"
+            "   };\n"
+            "  parameter-distribution = {\n"
+            "     type = \"product_distribution\";\n"
+            "     distributions = (\"@dist-flat\", \"@dist-delta\");\n"
+            "  };\n"
+            "};\n"
+            "dist-flat = {\n"
+            "       type = \"flat_distribution\";\n"
+            "       beta1 = { range = (\"-inf\", \"inf\"); fix-sample-value = 1.0; }; \n"
+            "       beta2 = { range = (0.0, \"inf\"); fix-sample-value = 1.0; };\n"
+            " };\n"
+            "dist-delta = {type = \"gauss\"; parameter = \"delta\"; mean = 0.0; width = 1.0; range = (\"-inf\", \"inf\");};\n"
+            , vm);
+    const theta::plugin::Configuration & cfg = cc.get();
+    std::auto_ptr<Model> m = PluginManager<Model>::instance().build(Configuration(cfg, cfg.setting["m"]));
+    ParValues values;
+    values.set(beta1, 1.0).set(beta2, 1.0).set(delta, 0.0);
+    Data data;
+    m->get_prediction(data, values);
+    std::auto_ptr<NLLikelihood> nll = m->getNLLikelihood(data);
+    //the parameter order is beta1, beta2, delta:
+    const size_t n = 5;
+    //only beta1 varies; the last point has a zero prediction:
+    double x_coeff[n][3] = {{0.5, 1.0, 0.3}, {0.9, 1.0, 0.3}, {1.3, 1.0, 0.3}, {0.9, 1.0, 0.3}, {0.0, 1.0, 0.3}};
+    x_coeff[4][1] = 0.0;
+    //all parameters vary; the last point is outside the support of beta2:
+    const double x_all[n][3] = {{0.5, 1.2, 0.3}, {0.9, 0.9, -0.5}, {1.3, 1.0, 1.2}, {1.1, 0.8, 1.2}, {1.0, -1.0, 0.0}};
+    const double * xs[2] = {&x_coeff[0][0], &x_all[0][0]};
+    for(int ix=0; ix<2; ++ix){
+        double result[n];
+        nll->eval_batch(xs[ix], n, result);
+        for(size_t k=0; k<n; ++k){
+            double expected = (*nll)(xs[ix] + 3 * k);
+            if(std::isinf(expected)) BOOST_CHECK(result[k] == expected);
+            else BOOST_CHECK(utils::close_to(expected, result[k], 1000.0));
+        }
+        //the cached state is consistent after eval_batch:
+        double expected = (*nll)(xs[ix] + 3 * 2);
+        nll->eval_batch(xs[ix] + 3 * 2, 1, result);
+        BOOST_CHECK(utils::close_to(expected, result[0], 1000.0));
+        nll->eval_batch(xs[ix], n, result);
+        BOOST_CHECK(utils::close_to(expected, (*nll)(xs[ix] + 3 * 2), 1000.0));
+    }
+}
 
 BOOST_AUTO_TEST_SUITE_END()
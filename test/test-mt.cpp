@@ -1,7 +1,16 @@
 #include "interface/random.hpp"
+#include "interface/random-utils.hpp"
+#include "interface/database.hpp"
+#include "interface/variables.hpp"
+
+#include "test/utils.hpp"
 
 #include <boost/test/unit_test.hpp>
 #include <boost/timer.hpp>
+#include <boost/filesystem.hpp>
+#include <sqlite3.h>
+#include <cmath>
+#include <iostream>
 
 using namespace theta;
 
@@ -164,6 +173,201 @@ BOOST_AUTO_TEST_CASE(random2_taus){
 }
 
 
+// known answer test from the Random123 distribution (kat_vectors), and stream addressing
+BOOST_AUTO_TEST_CASE(random2_philox){
+    Random rnd(new RandomSourcePhilox(0));
+    rnd.set_seed(0);
+    BOOST_REQUIRE_EQUAL(rnd.get(), 0x6627e8d5u);
+    BOOST_REQUIRE_EQUAL(rnd.get(), 0xe169c58du);
+    BOOST_REQUIRE_EQUAL(rnd.get(), 0xbc57ac4cu);
+    BOOST_REQUIRE_EQUAL(rnd.get(), 0x9b00dbd8u);
+    // the stream of an event does not depend on what has been generated before:
+    Random rnd2(new RandomSourcePhilox(RandomSourcePhilox::name_key("source")));
+    Random rnd3(new RandomSourcePhilox(RandomSourcePhilox::name_key("source")));
+    rnd2.set_seed(123);
+    rnd3.set_seed(123);
+    std::vector<unsigned int> event5;
+    for(int eventid=1; eventid<=5; ++eventid){
+        rnd2.set_stream(1, eventid);
+        for(int i=0; i<1000 * eventid; ++i){
+            unsigned int r = rnd2.get();
+            if(eventid==5) event5.push_back(r);
+        }
+    }
+    rnd3.set_stream(1, 5);
+    for(size_t i=0; i<event5.size(); ++i){
+        BOOST_REQUIRE_EQUAL(event5[i], rnd3.get());
+    }
+    // different events, runs and keys give different streams:
+    rnd3.set_stream(1, 4);
+    BOOST_CHECK(rnd3.get() != event5[0]);
+    rnd3.set_stream(2, 5);
+    BOOST_CHECK(rnd3.get() != event5[0]);
+    Random rnd4(new RandomSourcePhilox(RandomSourcePhilox::name_key("other")));
+    rnd4.set_seed(123);
+    rnd4.set_stream(1, 5);
+    BOOST_CHECK(rnd4.get() != event5[0]);
+    // set_stream has no effect on sequential generators:
+    Random taus(new RandomSourceTaus()), taus2(new RandomSourceTaus());
+    taus.get();
+    taus2.get();
+    taus.set_stream(1, 5);
+    for(int i=0; i<200; ++i){
+        BOOST_REQUIRE_EQUAL(taus.get(), taus2.get());
+    }
+}
+
+namespace{
+
+class SeedConsumer: public RandomConsumer{
+public:
+    SeedConsumer(const plugin::Configuration & cfg): RandomConsumer(cfg, "source"){}
+    int get_seed() const{
+        return seed;
+    }
+};
+
+//returns the result of the sql query on filename, which must return one integer
+int query(const std::string & filename, const std::string & sql){
+    sqlite3 * db = 0;
+    BOOST_REQUIRE(sqlite3_open(filename.c_str(), &db) == SQLITE_OK);
+    sqlite3_stmt * st = 0;
+    BOOST_REQUIRE(sqlite3_prepare_v2(db, sql.c_str(), -1, &st, 0) == SQLITE_OK);
+    BOOST_REQUIRE(sqlite3_step(st) == SQLITE_ROW);
+    int result = sqlite3_column_int(st, 0);
+    sqlite3_finalize(st);
+    sqlite3_close(db);
+    return result;
+}
+
+}
+
+// without a configured seed, the workers of a Run derive their seeds from the same time-based seed of the Run: with philox,
+// they all use the same seed; with taus, different ones. All of them are saved in the rndinfo table.
+BOOST_AUTO_TEST_CASE(random2_consumer_seed){
+    load_core_plugins();
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    ConfigCreator cc_db("type = \"sqlite_database\"; filename = \"test_rndinfo.db\";", vm);
+    boost::shared_ptr<Database> db;
+    db = plugin::PluginManager<Database>::instance().build(cc_db.get());
+    std::auto_ptr<Table> rndinfo_table_underlying = db->create_table("rndinfo");
+    boost::shared_ptr<RndInfoTable> rndinfo_table(new RndInfoTable(rndinfo_table_underlying));
+    const char * source_types[] = {"philox", "taus"};
+    for(int k=0; k<2; ++k){
+        ConfigCreator cc(std::string("rnd_gen = { source_type = \"") + source_types[k] + "\"; };", vm);
+        plugin::Configuration cfg(cc.get());
+        cfg.pm->set("default", rndinfo_table);
+        cfg.pm->set("runid", boost::shared_ptr<int>(new int(1)));
+        cfg.pm->set("time_seed", boost::shared_ptr<int>(new int(12345)));
+        std::vector<int> seeds;
+        for(int threadid=0; threadid<3; ++threadid){
+            plugin::Configuration wcfg(cfg);
+            wcfg.pm.reset(new PropertyMap(*cfg.pm));
+            wcfg.pm->set("threadid", boost::shared_ptr<int>(new int(threadid)));
+            SeedConsumer consumer(wcfg);
+            seeds.push_back(consumer.get_seed());
+        }
+        // a second Run with the same time-based seed uses the same seeds:
+        plugin::Configuration wcfg(cfg);
+        wcfg.pm.reset(new PropertyMap(*cfg.pm));
+        wcfg.pm->set("threadid", boost::shared_ptr<int>(new int(0)));
+        BOOST_CHECK_EQUAL(SeedConsumer(wcfg).get_seed(), seeds[0]);
+        if(k==0){
+            BOOST_CHECK(seeds[0] == seeds[1] && seeds[1] == seeds[2]);
+        }
+        else{
+            BOOST_CHECK(seeds[0] != seeds[1] && seeds[1] != seeds[2] && seeds[0] != seeds[2]);
+        }
+    }
+    rndinfo_table.reset();
+    db.reset();
+    BOOST_CHECK_EQUAL(query("test_rndinfo.db", "select count(*) from rndinfo;"), 8);
+    BOOST_CHECK_EQUAL(query("test_rndinfo.db", "select count(*) from rndinfo where name = 'source__thread2';"), 2);
+    BOOST_CHECK_EQUAL(query("test_rndinfo.db", "select count(distinct seed) from rndinfo where key <> '';"), 1);
+    boost::filesystem::remove("test_rndinfo.db");
+}
+
+// check mean, variance and the frequencies of small values for both poisson algorithms
+BOOST_AUTO_TEST_CASE(random2_poisson){
+    const double means[] = {0.3, 3.0, 9.9, 10.0, 25.0, 300.0, 1e5};
+    const int n_draws = 200000;
+    for(int algo = Random::poisson_algo_root; algo <= Random::poisson_algo_ptrs; ++algo){
+        Random rnd(new RandomSourceTaus());
+        rnd.set_poisson_algorithm(algo);
+        for(size_t i=0; i<sizeof(means) / sizeof(double); ++i){
+            const double mu = means[i];
+            double sum = 0, sum2 = 0;
+            int n0 = 0;
+            for(int j=0; j<n_draws; ++j){
+                double k = rnd.poisson(mu);
+                sum += k;
+                sum2 += k*k;
+                if(k==0) ++n0;
+            }
+            double mean = sum / n_draws;
+            double var = sum2 / n_draws - mean * mean;
+            // the mean has a standard deviation of sqrt(mu / n_draws), the variance of about mu * sqrt(2 / n_draws):
+            BOOST_CHECK(fabs(mean - mu) < 5 * sqrt(mu / n_draws));
+            BOOST_CHECK(fabs(var - mu) < 5 * mu * sqrt(2.0 / n_draws) + 5 * sqrt(mu / n_draws));
+            double p0 = exp(-mu);
+            BOOST_CHECK(fabs(n0 - n_draws * p0) < 5 * sqrt(n_draws * p0) + 1);
+        }
+    }
+}
+
+// the array version of poisson must give the same result as the per-element one, and
+// results are reproducible for a fixed seed
+BOOST_AUTO_TEST_CASE(random2_poisson_array){
+    std::vector<double> x(1000), x2(1000);
+    for(size_t i=0; i<x.size(); ++i){
+        x[i] = 0.05 * i;
+    }
+    x[10] = -1.0;
+    for(int algo = Random::poisson_algo_root; algo <= Random::poisson_algo_ptrs; ++algo){
+        Random rnd(new RandomSourceTaus());
+        Random rnd2(new RandomSourceTaus());
+        rnd.set_poisson_algorithm(algo);
+        rnd2.set_poisson_algorithm(algo);
+        rnd.set_seed(17);
+        rnd2.set_seed(17);
+        x2 = x;
+        rnd2.poisson(&x2[0], x2.size());
+        for(size_t i=0; i<x.size(); ++i){
+            double expected = x[i] > 0 ? rnd.poisson(x[i]) : x[i];
+            BOOST_REQUIRE(expected == x2[i]);
+        }
+    }
+}
+
+//microbenchmark of the poisson algorithms. It just prints the time per random number
+// and does not check anything. Run with --poisson_benchmark
+BOOST_AUTO_TEST_CASE(random2_poisson_benchmark){
+    int argc = boost::unit_test::framework::master_test_suite().argc;
+    char ** argv = boost::unit_test::framework::master_test_suite().argv;
+    bool run = false;
+    for(int i=1; i<argc; ++i){
+        if(argv[i] == std::string("--poisson_benchmark")) run = true;
+    }
+    if(!run) return;
+    const double means[] = {2.0, 20.0, 200.0};
+    const int n_draws = 1000000;
+    for(size_t i=0; i<sizeof(means) / sizeof(double); ++i){
+        double t[2];
+        for(int algo = Random::poisson_algo_root; algo <= Random::poisson_algo_ptrs; ++algo){
+            Random rnd(new RandomSourceTaus());
+            rnd.set_poisson_algorithm(algo);
+            std::vector<double> x(1000);
+            boost::timer timer;
+            for(int j=0; j<n_draws / 1000; ++j){
+                std::fill(x.begin(), x.end(), means[i]);
+                rnd.poisson(&x[0], x.size());
+            }
+            t[algo] = timer.elapsed() * 1e9 / n_draws;
+        }
+        std::cout << "poisson(" << means[i] << "): ns per random number: root=" << t[0] << " ptrs=" << t[1] << std::endl;
+    }
+}
+
 //conclusions: new model takes about 50% longer compared to old one;
 // MT is another 50% slower compared to Taus.
 /*BOOST_AUTO_TEST_CASE(speed_compare){
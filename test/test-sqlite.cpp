@@ -6,6 +6,11 @@
 #include "test/utils.hpp"
 
 #include <boost/test/unit_test.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+
+#include <sqlite3.h>
+#include <iostream>
 
 using namespace std;
 using namespace theta;
@@ -52,4 +57,186 @@ BOOST_AUTO_TEST_CASE(largefile){
    BOOST_REQUIRE(true);
 }
 
+namespace{
+    //returns the result of the sql query on filename, which must return one integer or double
+    double query(const string & filename, const string & sql){
+        sqlite3 * db = 0;
+        BOOST_REQUIRE(sqlite3_open(filename.c_str(), &db) == SQLITE_OK);
+        sqlite3_stmt * st = 0;
+        BOOST_REQUIRE(sqlite3_prepare_v2(db, sql.c_str(), -1, &st, 0) == SQLITE_OK);
+        BOOST_REQUIRE(sqlite3_step(st) == SQLITE_ROW);
+        double result = sqlite3_column_double(st, 0);
+        sqlite3_finalize(st);
+        sqlite3_close(db);
+        return result;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(buffered){
+   load_core_plugins();
+   boost::shared_ptr<VarIdManager> vm(new VarIdManager());
+   //the batch size is not a divisor of the number of rows, to test the last, partial batch:
+   ConfigCreator cc("type = \"sqlite_database\"; filename = \"test_buffered.db\"; batch_size = 7; journal_mode = \"wal\"; "
+                    "synchronous = \"off\"; page_size = 8192;", vm);
+   boost::shared_ptr<Database> db;
+   db = PluginManager<Database>::instance().build(cc.get());
+   std::auto_ptr<Table> table = db->create_table("t");
+   table->set_autoinc_column("id");
+   std::auto_ptr<Column> c_d = table->add_column("d", theta::typeDouble);
+   std::auto_ptr<Column> c_i = table->add_column("i", theta::typeInt);
+   std::auto_ptr<Column> c_s = table->add_column("s", theta::typeString);
+   std::auto_ptr<Column> c_h = table->add_column("h", theta::typeHisto);
+   Histogram h(3, 0.0, 3.0);
+   h.set(2, 5.0);
+   const int n = 100;
+   for(int k=0; k<n; ++k){
+       table->set_column(*c_d, 0.5 * k);
+       table->set_column(*c_i, k);
+       //leave s unset for odd rows; it must be NULL:
+       if(k % 2 == 0) table->set_column(*c_s, "row");
+       table->set_column(*c_h, h);
+       int id = table->add_row();
+       BOOST_CHECK_EQUAL(id, k + 1);
+   }
+   std::auto_ptr<Table> empty_table = db->create_table("empty");
+   std::auto_ptr<Column> c_e = empty_table->add_column("e", theta::typeDouble);
+   empty_table.reset();
+   table.reset();
+   db.reset();
+   BOOST_CHECK_EQUAL(query("test_buffered.db", "select count(*) from t;"), n);
+   BOOST_CHECK_EQUAL(query("test_buffered.db", "select sum(id) from t;"), n * (n + 1) / 2);
+   BOOST_CHECK_EQUAL(query("test_buffered.db", "select sum(i) from t where d = 0.5 * i;"), n * (n - 1) / 2);
+   BOOST_CHECK_EQUAL(query("test_buffered.db", "select count(*) from t where s is null;"), n / 2);
+   BOOST_CHECK_EQUAL(query("test_buffered.db", "select count(*) from t where s = 'row';"), n / 2);
+   BOOST_CHECK_EQUAL(query("test_buffered.db", "select count(*) from t where length(h) = 7 * 8;"), n);
+   BOOST_CHECK_EQUAL(query("test_buffered.db", "select count(*) from empty;"), 0);
+   BOOST_CHECK_EQUAL(query("test_buffered.db", "pragma page_size;"), 8192);
+   boost::filesystem::remove("test_buffered.db");
+}
+
+BOOST_AUTO_TEST_CASE(logtable_compact){
+   load_core_plugins();
+   boost::shared_ptr<VarIdManager> vm(new VarIdManager());
+   ConfigCreator cc("type = \"sqlite_database\"; filename = \"test_logtable.db\";", vm);
+   const int n = 10;
+   {
+       boost::shared_ptr<Database> db;
+       db = PluginManager<Database>::instance().build(cc.get());
+       std::auto_ptr<Table> t = db->create_table("log");
+       LogTable log(t);
+       std::auto_ptr<Table> t2 = db->create_table("log_default");
+       LogTable log_default(t2);
+       std::auto_ptr<Table> summary = db->create_table("log_summary");
+       log.set_compact(summary);
+       log.set_loglevel(LogTable::info);
+       log_default.set_loglevel(LogTable::info);
+       //the summary is also written if the info messages are not logged:
+       std::auto_ptr<Table> t3 = db->create_table("log_quiet");
+       LogTable log_quiet(t3);
+       std::auto_ptr<Table> summary_quiet = db->create_table("log_quiet_summary");
+       log_quiet.set_compact(summary_quiet);
+       log_quiet.set_loglevel(LogTable::warning);
+       for(int runid = 1; runid <= 2; ++runid){
+           log.append(runid, 0, LogTable::info, LogTable::run_start);
+           log_default.append(runid, 0, LogTable::info, LogTable::run_start);
+           log_quiet.append(runid, 0, LogTable::info, LogTable::run_start);
+           for(int eventid=1; eventid<=n; ++eventid){
+               log.append(runid, eventid, LogTable::info, LogTable::event_start);
+               log_default.append(runid, eventid, LogTable::info, LogTable::event_start);
+               if(eventid == 3) log.append(runid, eventid, LogTable::error, "producer failed");
+               if(eventid == 5) log.append(runid, eventid, LogTable::warning, "slow convergence");
+               log.append(runid, eventid, LogTable::debug, "suppressed");
+               log.append(runid, eventid, LogTable::info, LogTable::event_end);
+               log_default.append(runid, eventid, LogTable::info, LogTable::event_end);
+               log_quiet.append(runid, eventid, LogTable::info, LogTable::event_end);
+               log.add_event_time(1000 * eventid);
+           }
+           log.append(runid, 0, LogTable::info, LogTable::run_end);
+           log_default.append(runid, 0, LogTable::info, LogTable::run_end);
+           log_quiet.append(runid, 0, LogTable::info, LogTable::run_end);
+       }
+       BOOST_CHECK_EQUAL(log.get_n_messages()[LogTable::error], 2);
+       BOOST_CHECK_EQUAL(log.get_n_messages()[LogTable::warning], 2);
+       BOOST_CHECK_EQUAL(log.get_n_messages()[LogTable::info], 2 * (2 * n + 2));
+       BOOST_CHECK_EQUAL(log.get_n_messages()[LogTable::debug], 0);
+       BOOST_CHECK_EQUAL(log_quiet.get_n_messages()[LogTable::info], 0);
+   }
+   //in compact mode, only the errors are written to the log table:
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select count(*) from log;"), 2);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select count(*) from log where severity = 1;"), 0);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select count(*) from log where eventid = 3 and severity = 0;"), 2);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select count(*) from log_default;"), 2 * (2 * n + 2));
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select count(*) from log_default where message = 'end';"), 2 * n);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select count(*) from log_default where message = 'run start';"), 2);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select count(*) from log_summary;"), 2);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select n_events from log_summary where runid = 2;"), n);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select n_errors from log_summary where runid = 2;"), 1);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select n_warnings from log_summary where runid = 2;"), 1);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select n_infos from log_summary where runid = 2;"), 2 * n + 2);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select n_debugs from log_summary where runid = 2;"), 0);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select event_time_total from log_summary where runid = 2;"), 1000 * n * (n + 1) / 2);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select event_time_min from log_summary where runid = 2;"), 1000);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select event_time_max from log_summary where runid = 2;"), 1000 * n);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select count(*) from log_quiet;"), 0);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select count(*) from log_quiet_summary;"), 2);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select n_events from log_quiet_summary where runid = 2;"), n);
+   BOOST_CHECK_EQUAL(query("test_logtable.db", "select n_infos from log_quiet_summary where runid = 2;"), 0);
+   boost::filesystem::remove("test_logtable.db");
+}
+
+BOOST_AUTO_TEST_CASE(invalid_settings){
+   load_core_plugins();
+   boost::shared_ptr<VarIdManager> vm(new VarIdManager());
+   ConfigCreator cc("type = \"sqlite_database\"; filename = \"test_invalid.db\"; journal_mode = \"fast\";", vm);
+   BOOST_CHECK_THROW(PluginManager<Database>::instance().build(cc.get()), ConfigurationException);
+   ConfigCreator cc2("type = \"sqlite_database\"; filename = \"test_invalid.db\"; page_size = 1000;", vm);
+   BOOST_CHECK_THROW(PluginManager<Database>::instance().build(cc2.get()), ConfigurationException);
+}
+
+//measures the rows per second written for tables with 10, 100 and 1000 double columns. Run with --sqlite_benchmark
+BOOST_AUTO_TEST_CASE(benchmark){
+   int argc = boost::unit_test::framework::master_test_suite().argc;
+   char ** argv = boost::unit_test::framework::master_test_suite().argv;
+   bool test = false;
+   for(int i=1; i<argc; ++i){
+       if(argv[i] == string("--sqlite_benchmark")) test = true;
+   }
+   if(!test) return;
+   load_core_plugins();
+   boost::shared_ptr<VarIdManager> vm(new VarIdManager());
+   const size_t ncols[] = {10, 100, 1000};
+   const char * settings[] = {"", "page_size = 65536; journal_mode = \"off\"; synchronous = \"off\";"};
+   for(size_t is=0; is<2; ++is){
+     for(size_t ic=0; ic<3; ++ic){
+       //about 10^7 values per table:
+       const size_t nrows = 10 * 1000 * 1000 / ncols[ic];
+       ConfigCreator cc(string("type = \"sqlite_database\"; filename = \"test_benchmark.db\"; ") + settings[is], vm);
+       boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+       boost::shared_ptr<Database> db;
+       db = PluginManager<Database>::instance().build(cc.get());
+       std::auto_ptr<Table> table = db->create_table("products");
+       boost::ptr_vector<Column> columns;
+       for(size_t i=0; i<ncols[ic]; ++i){
+           stringstream ss;
+           ss << "c" << i;
+           columns.push_back(table->add_column(ss.str(), theta::typeDouble));
+       }
+       for(size_t k=0; k<nrows; ++k){
+           for(size_t i=0; i<ncols[ic]; ++i){
+               table->set_column(columns[i], 1.0 * k + i);
+           }
+           table->add_row();
+       }
+       //the time spent in the event loop, excluding the rows still being written by the writer thread:
+       double seconds_add = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() * 1e-6;
+       table.reset();
+       db.reset();
+       double seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() * 1e-6;
+       cout << "sqlite_database {" << settings[is] << "}: " << ncols[ic] << " columns: " << nrows / seconds << " rows/s ("
+            << nrows / seconds_add << " rows/s in add_row)" << endl;
+     }
+   }
+   boost::filesystem::remove("test_benchmark.db");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
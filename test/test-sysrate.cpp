@@ -83,4 +83,102 @@ BOOST_AUTO_TEST_CASE(sysrate0){
     BOOST_REQUIRE(utils::close_to((*f)(values), 0.0, 1.0));
 }
 
+//compare the analytical derivatives of sys_rate_function and mult to finite differences:
+BOOST_AUTO_TEST_CASE(sysrate_derivatives){
+    load_core_plugins();
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    ParId delta1 = vm->createParId("delta1");
+    ParId delta2 = vm->createParId("delta2");
+    ParId beta1 = vm->createParId("beta1");
+    ParId beta2 = vm->createParId("beta2");
+    ConfigCreator cc("f = {type = \"sys_rate_function\";"
+         "factors = (\"beta1\", \"beta2\");\n"
+         "sys_rates = ((\"delta1\", -0.2, 0.17), (\"delta2\", -0.9, 0.0));\n"
+         "};\n"
+         "g = {type = \"mult\"; parameters = (\"beta1\", \"beta2\", \"beta1\");};", vm);
+    const theta::plugin::Configuration & cfg = cc.get();
+    std::auto_ptr<Function> f = PluginManager<Function>::instance().build(Configuration(cfg, cfg.setting["f"]));
+    std::auto_ptr<Function> g = PluginManager<Function>::instance().build(Configuration(cfg, cfg.setting["g"]));
+    BOOST_REQUIRE(f->provides_derivatives());
+    BOOST_REQUIRE(g->provides_derivatives());
+    const double points[][4] = {{1.3, 0.88, 0.5, -0.3}, {0.7, 1.2, -0.7, 0.4}, {2.0, 0.1, 1.5, 0.2}};
+    ParId pids[] = {beta1, beta2, delta1, delta2};
+    const double eps = 1e-6;
+    for(size_t ip=0; ip<3; ++ip){
+        ParValues values;
+        for(size_t j=0; j<4; ++j) values.set(pids[j], points[ip][j]);
+        for(int ifunc=0; ifunc<2; ++ifunc){
+            const Function & func = ifunc == 0 ? *f : *g;
+            ParValues der;
+            double value = func.eval_withDerivatives(values, der);
+            BOOST_CHECK(utils::close_to_relative(value, func(values)));
+            const ParIds & f_pids = func.getParameters();
+            for(ParIds::const_iterator it=f_pids.begin(); it!=f_pids.end(); ++it){
+                ParValues v2;
+                v2.set(values);
+                v2.set(*it, values.get(*it) + eps);
+                double f_plus = func(v2);
+                v2.set(*it, values.get(*it) - eps);
+                double f_minus = func(v2);
+                double num_der = (f_plus - f_minus) / (2 * eps);
+                BOOST_CHECK(fabs(num_der - der.get(*it)) < 1e-6 * max(1.0, fabs(num_der)));
+            }
+        }
+    }
+    //cut off at zero:
+    ParValues values;
+    values.set(beta1, 1.0).set(beta2, 1.0).set(delta1, 0.0).set(delta2, -2.0);
+    ParValues der;
+    BOOST_CHECK(f->eval_withDerivatives(values, der) == 0.0);
+    BOOST_CHECK(der.get(delta2) == 0.0);
+    BOOST_CHECK(der.get(beta1) == 0.0);
+}
+
+//eval_dense with a ParLayout into a larger parameter array gives the same as operator():
+BOOST_AUTO_TEST_CASE(sysrate_dense){
+    load_core_plugins();
+    boost::shared_ptr<VarIdManager> vm(new VarIdManager);
+    ParId delta1 = vm->createParId("delta1");
+    ParId other = vm->createParId("other");
+    ParId delta2 = vm->createParId("delta2");
+    ParId beta1 = vm->createParId("beta1");
+    ParId beta2 = vm->createParId("beta2");
+    ConfigCreator cc("f = {type = \"sys_rate_function\";"
+         "factors = (\"beta2\", \"beta1\");\n"
+         "sys_rates = ((\"delta2\", -0.2, 0.17), (\"delta1\", -0.9, 0.3));\n"
+         "};\n"
+         "g = {type = \"mult\"; parameters = (\"beta2\", \"beta1\", \"beta2\");};"
+         "e = {type = \"exp_function\"; parameter = \"delta2\"; lambda_minus = 0.1; lambda_plus = 0.2;};", vm);
+    const theta::plugin::Configuration & cfg = cc.get();
+    std::auto_ptr<Function> f = PluginManager<Function>::instance().build(Configuration(cfg, cfg.setting["f"]));
+    std::auto_ptr<Function> g = PluginManager<Function>::instance().build(Configuration(cfg, cfg.setting["g"]));
+    std::auto_ptr<Function> e = PluginManager<Function>::instance().build(Configuration(cfg, cfg.setting["e"]));
+    const Function * funcs[] = {f.get(), g.get(), e.get()};
+    ParIds all;
+    all.insert(delta1);
+    all.insert(other);
+    all.insert(delta2);
+    all.insert(beta1);
+    all.insert(beta2);
+    //in the order of all: delta1, other, delta2, beta1, beta2
+    const double points[][5] = {{1.3, 17.0, -0.3, 0.88, 0.5}, {-0.7, 17.0, 0.4, 1.2, 2.1}, {-2.0, 17.0, -1.5, 0.1, 0.2}};
+    for(size_t ip=0; ip<3; ++ip){
+        ParValues values(points[ip], all);
+        for(size_t i=0; i<3; ++i){
+            ParLayout layout(all, funcs[i]->getParameters());
+            BOOST_CHECK(funcs[i]->eval_dense(points[ip], layout.get_offsets()) == (*funcs[i])(values));
+        }
+    }
+    bool exception = false;
+    try{
+        ParIds sub;
+        sub.insert(other);
+        ParLayout layout(f->getParameters(), sub);
+    }
+    catch(InvalidArgumentException & ex){
+        exception = true;
+    }
+    BOOST_CHECK(exception);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
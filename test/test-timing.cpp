@@ -0,0 +1,134 @@
+#include "interface/timing.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/filesystem.hpp>
+
+#include <sstream>
+
+using namespace theta;
+
+BOOST_AUTO_TEST_SUITE(timing)
+
+BOOST_AUTO_TEST_CASE(timed_call){
+    calibrate_timing();
+    BOOST_CHECK(timing_overhead.nested_wall_ns > 0);
+    BOOST_CHECK(timing_overhead.nested_wall_ns >= timing_overhead.wall_ns);
+    TimingStats stats("test");
+    const int n = 10;
+    for(int i=0; i<n; ++i){
+        //every other call is timed, and represents two calls:
+        const boost::uint64_t weight = i % 2 == 0 ? 2 : 0;
+        TimedCall call(&stats, weight);
+        timing_counters.nll_evals += 3;
+        timing_counters.sampling_weight = weight;
+        MinimizeCall minimize;
+        //spend some cpu time:
+        volatile double x = 0.0;
+        for(int k=0; k<100000; ++k) x += k;
+    }
+    timing_counters.sampling_weight = 0;
+    BOOST_CHECK_EQUAL(stats.calls, n);
+    BOOST_CHECK_EQUAL(stats.sampled, n / 2);
+    BOOST_CHECK_EQUAL(stats.nll_evals, 3 * n);
+    BOOST_CHECK_EQUAL(stats.minimize_calls, n);
+    BOOST_CHECK_EQUAL(stats.minimize_sampled, n / 2);
+    BOOST_CHECK(stats.wall_ns > 0 && stats.cpu_ns > 0);
+    BOOST_CHECK(stats.minimize_wall_ns <= stats.wall_ns);
+    BOOST_CHECK_CLOSE(stats.wall_time(), 1e-9 * stats.wall_ns, 1e-10);
+    BOOST_CHECK_CLOSE(stats.minimize_cpu_time(), 1e-9 * stats.minimize_cpu_ns, 1e-10);
+    //a disabled TimedCall records nothing:
+    {
+        TimedCall call(0, 1);
+    }
+    TimingStats sum("test");
+    sum.add(stats);
+    sum.add(stats);
+    BOOST_CHECK_EQUAL(sum.calls, 2 * n);
+    BOOST_CHECK_CLOSE(sum.wall_time(), 2 * stats.wall_time(), 1e-10);
+}
+
+BOOST_AUTO_TEST_CASE(sampler){
+    calibrate_timing();
+    //for events taking 1 second, every event is timed:
+    TimingSampler slow;
+    for(int i=0; i<100; ++i){
+        BOOST_CHECK_EQUAL(slow.sample(), 1);
+        slow.add_sampled(1000000000, 5);
+    }
+    BOOST_CHECK_EQUAL(slow.get_interval(), 1);
+    //for events taking 100ns, the sampling interval is chosen such that reading the clocks of 5 calls per sampled event
+    // costs less than 1%:
+    TimingSampler fast;
+    size_t n_sampled = 0;
+    boost::uint64_t weight_sum = 0;
+    const size_t n = 100000;
+    for(size_t i=0; i<n; ++i){
+        boost::uint64_t weight = fast.sample();
+        if(weight){
+            ++n_sampled;
+            weight_sum += weight;
+            fast.add_sampled(100, 5);
+        }
+    }
+    BOOST_CHECK(fast.get_interval() > 100);
+    BOOST_CHECK(n_sampled < n / 100);
+    BOOST_CHECK(n_sampled >= 10);
+    //the weights of the sampled events add up to the number of events, up to the events after the last sampled one:
+    BOOST_CHECK(weight_sum >= n && weight_sum < n + fast.get_interval());
+}
+
+namespace{
+
+void profiled_work(){
+    ProfileSection nll(profile_nll);
+    volatile double x = 0.0;
+    for(int k=0; k<10000; ++k) x += k;
+}
+
+size_t n_open_files(){
+    size_t result = 0;
+    for(boost::filesystem::directory_iterator it("/proc/self/fd"); it!=boost::filesystem::directory_iterator(); ++it) ++result;
+    return result;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(profile){
+    std::string reason;
+    bool enabled = enable_profiling(reason);
+    //the hardware counters are not available everywhere, e.g. not in most virtual machines:
+    BOOST_CHECK_EQUAL(enabled, reason.empty());
+    BOOST_CHECK_EQUAL(enabled, profiling_enabled);
+    {
+        ProfileSection nll(profile_nll);
+        volatile double x = 0.0;
+        for(int k=0; k<100000; ++k) x += k;
+        ProfileSection hf(profile_histogram_function);
+        for(int k=0; k<100000; ++k) x += k;
+    }
+    std::stringstream out;
+    write_profile_report(out);
+    if(enabled){
+        BOOST_CHECK(out.str().find("histogram_function") != std::string::npos);
+        BOOST_CHECK(out.str().find(" 1 thread(s)") != std::string::npos);
+    }
+    else{
+        BOOST_CHECK(out.str().empty());
+    }
+    //the counters of exited threads are kept in the report, but their file descriptors are closed:
+    const size_t n_files = n_open_files();
+    const int n_threads = 20;
+    for(int i=0; i<n_threads; ++i){
+        boost::thread t(&profiled_work);
+        t.join();
+    }
+    BOOST_CHECK_EQUAL(n_open_files(), n_files);
+    if(enabled){
+        std::stringstream out2;
+        write_profile_report(out2);
+        BOOST_CHECK(out2.str().find(" 21 thread(s)") != std::string::npos);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 
 [ -x root/create_testhistos ] && root/create_testhistos
 execute_checked bin/test
+execute_checked bin/plugintest
 rm -f testhistos.root
 
 fail=0
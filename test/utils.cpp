@@ -52,6 +52,10 @@ bool load_root_plugins(){
     catch(Exception & ex){
         return false;
     }
+    catch(FatalException & ex){
+        //e.g. lib/root.so not built
+        return false;
+    }
     BOOST_TEST_CHECKPOINT("loaded root plugin");
     loaded = true;
     return true;